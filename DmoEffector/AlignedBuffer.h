@@ -0,0 +1,53 @@
+#pragma once
+
+#include "RealTimeArena.h"
+
+/*
+	Array of T aligned to cache line for SIMD instructions.
+
+	Memory is allocated by allocate() method that should be called out of the real-time thread.
+	Allocated memory is cleared by 0.
+	Memory is taken from CRealTimeArena selected by CRealTimeArena::Scope on the calling thread, if any.
+*/
+template<class T, size_t Alignment = 64>
+class CAlignedBuffer
+{
+	DISALLOW_COPY_AND_ASSIGN(CAlignedBuffer);
+
+public:
+	CAlignedBuffer() : m_data(NULL), m_size(0), m_arena(NULL) {}
+	~CAlignedBuffer() { free(); }
+
+	HRESULT allocate(size_t size)
+	{
+		free();
+		if (size) {
+			m_data = (T*)CRealTimeArena::allocateAligned(sizeof(T) * size, Alignment, &m_arena);
+			HR_ASSERT(m_data, E_OUTOFMEMORY);
+			ZeroMemory(m_data, sizeof(T) * size);
+			m_size = size;
+		}
+		return S_OK;
+	}
+
+	void free()
+	{
+		if (m_data) {
+			CRealTimeArena::freeAligned(m_arena, m_data);
+			m_data = NULL;
+			m_arena = NULL;
+		}
+		m_size = 0;
+	}
+
+	void clear() { if (m_data) ZeroMemory(m_data, sizeof(T) * m_size); }
+
+	T* get() const { return m_data; }
+	operator T*() const { return m_data; }
+	size_t size() const { return m_size; }
+
+protected:
+	T* m_data;
+	size_t m_size;
+	CRealTimeArena* m_arena;		// Arena m_data has been allocated from, or NULL for the heap.
+};
@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "AsioCallbackPool.h"
+#include "AsioHandler.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("AsioCallbackPool"));
+
+/*
+	Static callbacks of the slot that call methods of the handler assigned to the slot.
+*/
+template<long Slot>
+struct CAsioCallbackPool::Trampoline
+{
+	static void bufferSwitch(long doubleBufferIndex, ASIOBool directProcess)
+	{
+		CAsioHandler* handler = m_handlers[Slot].load(std::memory_order_acquire);
+		if (handler) handler->bufferSwitch(doubleBufferIndex, directProcess);
+		else LOG4CPLUS_WARN(logger, "No handler in slot " << Slot << ": " __FUNCTION__ "(" << doubleBufferIndex << "," << directProcess << ")");
+	}
+
+	static ASIOTime* bufferSwitchTimeInfo(ASIOTime* params, long doubleBufferIndex, ASIOBool directProcess)
+	{
+		CAsioHandler* handler = m_handlers[Slot].load(std::memory_order_acquire);
+		if (handler) return handler->bufferSwitchTimeInfo(params, doubleBufferIndex, directProcess);
+		LOG4CPLUS_WARN(logger, "No handler in slot " << Slot << ": " __FUNCTION__ "(" << doubleBufferIndex << "," << directProcess << ")");
+		return params;
+	}
+
+	static void sampleRateDidChange(ASIOSampleRate sRate)
+	{
+		CAsioHandler* handler = m_handlers[Slot].load(std::memory_order_acquire);
+		if (handler) handler->sampleRateDidChange(sRate);
+		else LOG4CPLUS_WARN(logger, "No handler in slot " << Slot << ": " __FUNCTION__ "(" << sRate << ")");
+	}
+
+	static long asioMessage(long selector, long value, void* message, double* opt)
+	{
+		CAsioHandler* handler = m_handlers[Slot].load(std::memory_order_acquire);
+		if (handler) return handler->asioMessage(selector, value, message, opt);
+		LOG4CPLUS_WARN(logger, "No handler in slot " << Slot << ": " __FUNCTION__ "(" << selector << "," << value << ",...)");
+		return 0;
+	}
+};
+
+#define TRAMPOLINE(slot) { Trampoline<slot>::bufferSwitch, Trampoline<slot>::sampleRateDidChange, Trampoline<slot>::asioMessage, Trampoline<slot>::bufferSwitchTimeInfo }
+
+/*static*/ ASIOCallbacks CAsioCallbackPool::m_callbacks[MaxHandlers] = {
+	TRAMPOLINE(0), TRAMPOLINE(1), TRAMPOLINE(2), TRAMPOLINE(3),
+	TRAMPOLINE(4), TRAMPOLINE(5), TRAMPOLINE(6), TRAMPOLINE(7),
+};
+
+/*static*/ std::atomic<CAsioHandler*> CAsioCallbackPool::m_handlers[MaxHandlers];
+
+/*static*/ ASIOCallbacks* CAsioCallbackPool::acquire(CAsioHandler* handler)
+{
+	HR_EXPECT(handler, E_POINTER);
+
+	for (long slot = 0; handler && (slot < MaxHandlers); slot++) {
+		CAsioHandler* free = NULL;
+		if (m_handlers[slot].compare_exchange_strong(free, handler)) {
+			LOG4CPLUS_DEBUG(logger, "Acquired slot " << slot);
+			return &m_callbacks[slot];
+		}
+	}
+	LOG4CPLUS_ERROR(logger, "All of " << MaxHandlers << " slots are in use.");
+	return NULL;
+}
+
+/*static*/ void CAsioCallbackPool::release(ASIOCallbacks* callbacks)
+{
+	const ptrdiff_t slot = callbacks - m_callbacks;
+	if (FAILED(HR_EXPECT((0 <= slot) && (slot < MaxHandlers), E_INVALIDARG))) return;
+
+	m_handlers[slot].store(NULL, std::memory_order_release);
+	LOG4CPLUS_DEBUG(logger, "Released slot " << slot);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+class CAsioHandler;
+
+/*
+	Fixed pool of ASIO callbacks, each routed to its own CAsioHandler object.
+
+	ASIO callbacks don't have a parameter to pass the object, so that each slot of the pool has
+	its own set of static functions generated by template, which calls methods of the handler assigned to the slot.
+	So that as many handlers as MaxHandlers can run in one process.
+*/
+class CAsioCallbackPool
+{
+public:
+	static const long MaxHandlers = 8;
+
+	// Assigns free slot to the handler and returns callbacks of the slot.
+	// Returns NULL if all slots are in use.
+	static ASIOCallbacks* acquire(CAsioHandler* handler);
+
+	// Frees the slot. Should be called after the driver has disposed buffers.
+	static void release(ASIOCallbacks* callbacks);
+
+protected:
+	template<long Slot> struct Trampoline;
+
+	static std::atomic<CAsioHandler*> m_handlers[MaxHandlers];
+	static ASIOCallbacks m_callbacks[MaxHandlers];
+};
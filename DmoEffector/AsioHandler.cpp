@@ -1,57 +1,62 @@
 #include "stdafx.h"
 #include "AsioHandler.h"
 #include "AsioDriver.h"
+#include "AsioCallbackPool.h"
 
 static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("AsioHandler"));
 
-CAsioHandler* CAsioHandler::m_instance = NULL;
-
 /*
-	Protected constructor.
-
-	Call getInstance() static method to create or get CAsioHandler object.
+	numChannels: Count of channels to be used. 0 means all channels of the driver.
 */
-CAsioHandler::CAsioHandler(int numChannels)
-	: CAsioHandlerContext(numChannels), m_workQueueId(0)
+CAsioHandler::CAsioHandler(int numChannels /*= 0*/)
+	: CAsioHandlerContext(numChannels), m_workQueueId(0), m_dataLaneOverflows(0), m_dataEvent(new DataEvent())
 {
-	// Allocate buffer infos for channel * 2(in and out).
-	asioBufferInfos.reset(new ASIOBufferInfo[numChannels * 2]);
-
 	ZeroMemory(&statistics, sizeof(statistics));
 	ZeroMemory(&driverInfo, sizeof(driverInfo));
-
-	m_instance = this;
+	HR_EXPECT_OK(m_dataLane.initialize(MaxDataSlots));
 }
 
 
 CAsioHandler::~CAsioHandler()
 {
 	HR_EXPECT_OK(this->shutdown());
-
-	m_instance = NULL;
 }
 
 /*
-	Returns singleton CAioHandler object.
-*/
-CAsioHandler * CAsioHandler::getInstance(int numChannels /*= 0*/)
-{
-	return (m_instance) ? m_instance : new CAsioHandler(numChannels);
-}
+	Setup the ASIO driver.
 
-HRESULT CAsioHandler::setup(IASIO* asio, HWND hwnd)
+	lookaheadBuffers: Count of buffers processed ahead to absorb jitter of the work queue thread.
+	                  Each buffer adds bufferSize samples to output latency. 0 disables lookahead mode.
+	effectChain: Effects applied to all channels. This object takes ownership.
+	             If NULL, samples are passed through without effect.
+*/
+HRESULT CAsioHandler::setup(IASIO* asio, HWND hwnd, long lookaheadBuffers /*= 0*/, CEffectChain* effectChain /*= NULL*/)
 {
 	HR_ASSERT(asio, E_POINTER);
+	HR_ASSERT((0 <= lookaheadBuffers) && (lookaheadBuffers <= MaxLookaheadBuffers), E_INVALIDARG);
+
+	// Callbacks are held until shutdown() so that the driver never calls back to other object.
+	if (!asioCallbacks) asioCallbacks = CAsioCallbackPool::acquire(this);
+	HR_ASSERT(asioCallbacks, E_OUTOFMEMORY);
 	HR_ASSERT_OK(MFStartup(MF_VERSION));
 
+	// The engine runs without the trace if the file can not be created.
+	HR_EXPECT_OK(traceRecorder.open());
+	TraceRecord record;
+	ZeroMemory(&record, sizeof(record));
+	record.setup.lookaheadBuffers = lookaheadBuffers;
+	record.setup.numChannels = numChannels;
+	traceRecorder.record(TraceSetup, &record);
+
 	this->asio = asio;
+	HR_ASSERT_OK(effectChains.initialize(effectChain ? effectChain : new CEffectChain()));
 
 	// Create work queue and initial state object.
 	HR_ASSERT_OK(MFAllocateWorkQueue(&m_workQueueId));
-	m_currentState.reset(CAsioHandlerState::createInitialState(this));
+	currentState.reset(CAsioHandlerState::createInitialState(this));
 
 	// Trigger setup event.
-	CComPtr<CAsioHandlerEvent> event(new SetupEvent(asio, hwnd, numChannels));
+	CComPtr<CAsioHandlerEvent> event(new SetupEvent(asio, hwnd, numChannels, lookaheadBuffers));
 	return triggerEvent(event);
 }
 /*
@@ -68,6 +73,7 @@ HRESULT CAsioHandler::shutdown()
 
 	// Returning S_FALSE means that this method has done nothing.
 	HRESULT hr = S_FALSE;
+	traceRecorder.record(TraceShutdown);
 
 	if (m_workQueueId) {
 		// Shutdown and wait for state to shutdown.
@@ -85,41 +91,255 @@ HRESULT CAsioHandler::shutdown()
 		asio.Release();
 	}
 
+	if (asioCallbacks) {
+		CAsioCallbackPool::release(asioCallbacks);
+		asioCallbacks = NULL;
+	}
+
+	HR_EXPECT_OK(traceRecorder.close());
 	m_state = State::NotLoaded;
 	return hr;
 }
 
 HRESULT CAsioHandler::start()
 {
+	traceRecorder.record(TraceStart);
 	CComPtr<CAsioHandlerEvent> event(new StartEvent());
 	return triggerEvent(event);
 }
 
 HRESULT CAsioHandler::stop()
 {
+	traceRecorder.record(TraceStop);
 	CComPtr<CAsioHandlerEvent> event(new StopEvent());
 	return triggerEvent(event);
 }
 
+/*
+	Selects device channels to be created and processed.
+
+	inputs, outputs: Device channel indexes. Channel n of the effect chain reads inputs[n] and writes outputs[n].
+	                 Counts may differ. Missing inputs are silent and missing outputs are discarded.
+	                 Both empty arms channels from 0 to numChannels of the constructor - 1, as setup does.
+	Called before setup, the channels are created by setup.
+	Called after setup, the driver is stopped, buffers are re-created and the driver is restarted if it was running.
+*/
+HRESULT CAsioHandler::armChannels(const std::vector<long>& inputs, const std::vector<long>& outputs)
+{
+	if (!m_workQueueId) {
+		armedInputs = inputs;
+		armedOutputs = outputs;
+		return S_OK;
+	}
+
+	// Trace recorder holds input buffers of the format recorded.
+	HR_ASSERT(!traceRecorder.isOpen(), E_ILLEGAL_METHOD_CALL);
+	CComPtr<CAsioHandlerEvent> event(new ArmChannelsEvent(inputs, outputs));
+	return triggerEvent(event);
+}
+
+/*
+	Replaces effect chain without stopping the driver.
+
+	Should be called by the UI thread after setup has completed.
+	The chain is prepared and warmed up in the calling thread and
+	is taken by the work queue thread at the next buffer. This object takes ownership.
+*/
+HRESULT CAsioHandler::replaceEffectChain(CEffectChain* effectChain)
+{
+	std::unique_ptr<CEffectChain> chain(effectChain);
+	HR_ASSERT(chain, E_POINTER);
+	HR_ASSERT(0 < bufferSize, E_ILLEGAL_METHOD_CALL);
+
+	traceRecorder.record(TraceReplaceEffectChain);
+	{
+		// Fails here if the arena doesn't have room for the chain, instead of the real-time thread.
+		CRealTimeArena::Scope scope(&arena);
+		HR_ASSERT_OK(chain->prepare(numChannels, bufferSize, sampleRate, sampleType));
+	}
+	HR_ASSERT_OK(chain->warmUp());
+	long previousLatency = getAddedLatency();
+	HR_ASSERT_OK(effectChains.publish(chain.release()));
+
+	if (getAddedLatency() != previousLatency) {
+		CComPtr<CAsioHandlerEvent> latenciesChanged(new AsioLatenciesChangedEvent());
+		HR_EXPECT_OK(triggerEvent(latenciesChanged));
+	}
+	return S_OK;
+}
+
+/*
+	Posts change of the effect parameter to the chain published last.
+
+	Should be called by the UI thread.
+	See CEffectChain::postParameterChange().
+*/
+HRESULT CAsioHandler::postParameterChange(long effect, DWORD parameter, const MP_ENVELOPE_SEGMENT& segment)
+{
+	CEffectChain* effectChain = effectChains.getLatest();
+	HR_ASSERT(effectChain, E_ILLEGAL_METHOD_CALL);
+
+	TraceRecord record;
+	ZeroMemory(&record, sizeof(record));
+	record.parameterChange.effect = effect;
+	record.parameterChange.parameter = parameter;
+	record.parameterChange.start = segment.rtStart;
+	record.parameterChange.end = segment.rtEnd;
+	record.parameterChange.startValue = segment.valStart;
+	record.parameterChange.endValue = segment.valEnd;
+	record.parameterChange.curve = segment.iCurve;
+	record.parameterChange.flags = segment.flags;
+	traceRecorder.record(TraceParameterChange, &record);
+	return effectChain->postParameterChange(effect, parameter, segment);
+}
+
+REFERENCE_TIME CAsioHandler::getStreamTime() const
+{
+	CEffectChainSwapper::Latest effectChain(effectChains);
+	return effectChain.get() ? effectChain->getStreamTime() : 0;
+}
+
+/*
+	Starts measurement of round trip latency from the output channel to the input channel.
+
+	Should be called by the UI thread while running.
+	The output channel is replaced by the test signal until the measurement completes.
+*/
+HRESULT CAsioHandler::startLatencyMeasurement(long inputChannel, long outputChannel, long runs /*= CLatencyMeter::DefaultRuns*/)
+{
+	HR_ASSERT(0 < bufferSize, E_ILLEGAL_METHOD_CALL);
+
+	TraceRecord record;
+	ZeroMemory(&record, sizeof(record));
+	record.latencyMeasurement.inputChannel = inputChannel;
+	record.latencyMeasurement.outputChannel = outputChannel;
+	record.latencyMeasurement.runs = runs;
+	traceRecorder.record(TraceLatencyMeasurement, &record);
+	return latencyMeter.start(inputChannel, outputChannel, runs);
+}
+
+/*
+	Returns result of the measurement and stores it as calibration of the driver.
+
+	Should be called by the UI thread. Returns S_FALSE while measuring.
+*/
+HRESULT CAsioHandler::getLatencyMeasurement(CLatencyMeter::Result* result)
+{
+	HRESULT hr = latencyMeter.analyze(result);
+	if (hr != S_OK) return hr;
+
+	HR_ASSERT_OK(calibrateLatency(*result));
+	CComPtr<CAsioHandlerEvent> latenciesChanged(new AsioLatenciesChangedEvent());
+	HR_EXPECT_OK(triggerEvent(latenciesChanged));
+	return S_OK;
+}
+
+/*
+	Puts the event into the lane and requests the work queue to handle an event.
+
+	Each work item handles one event taken by popEvent() method, not always the event put here.
+*/
 HRESULT CAsioHandler::triggerEvent(CAsioHandlerEvent * event)
 {
-	HR_ASSERT_OK(MFPutWorkItem(m_workQueueId, this, event));
+	HR_ASSERT(event, E_POINTER);
+
+	if (event->getLane() == EventLanes::Data) {
+		const DataEvent* ev;
+		HR_ASSERT_OK(event->cast(&ev));
+		return triggerData(ev->params, ev->doubleBufferIndex, ev->clock);
+	}
+
+	{
+		CComCritSecLock<CComAutoCriticalSection> lock(m_controlLaneLock);
+		m_controlLane.push_back(event);
+		long depth = (long)m_controlLane.size();
+		statistics.queueDepth[EventLanes::Control] = depth;
+		if (statistics.maxQueueDepth[EventLanes::Control] < depth) statistics.maxQueueDepth[EventLanes::Control] = depth;
+	}
+
+	HR_ASSERT_OK(MFPutWorkItem(m_workQueueId, this, NULL));
 	return S_OK;
 }
 
-// Set result of exp to hr1 unless hr1 is error.
-#define HR_PRESERVE_ERROR(hr1, exp) do { HRESULT hr2 = HR_EXPECT_OK(exp); if(SUCCEEDED(hr1)) hr1 = hr2; } while(false)
+/*
+	Puts the buffer switch into the data lane and requests the work queue to handle an event.
 
-HRESULT CAsioHandler::handleEvent(const CAsioHandlerEvent* event)
+	Called by the driver thread. The data lane takes neither lock nor memory allocation.
+	Depth of the data lane in Statistics is updated by this method and popEvent().
+*/
+HRESULT CAsioHandler::triggerData(const ASIOTime& params, long doubleBufferIndex, const CSampleClock::Estimate& clock)
 {
-	CAsioHandlerState* nextState = NULL;
-	HRESULT hr = HR_EXPECT_OK(m_currentState->handleEvent(event, &nextState));
-	if (nextState) {
-		// State transition
-		HR_PRESERVE_ERROR(hr, m_currentState->exit(event, nextState));
-		HR_PRESERVE_ERROR(hr, nextState->entry(event, m_currentState.get()));
-		m_currentState.reset(nextState);
+	DataSlot slot = { params, doubleBufferIndex, clock };
+	if (!m_dataLane.push(slot)) {
+		// Work items of the slots in the lane are still pending, so no item is put for this buffer.
+		m_dataLaneOverflows.fetch_add(1, std::memory_order_relaxed);
+		return S_FALSE;
+	}
+	long depth = (long)m_dataLane.getCount();
+	statistics.queueDepth[EventLanes::Data] = depth;
+	if (statistics.maxQueueDepth[EventLanes::Data] < depth) statistics.maxQueueDepth[EventLanes::Data] = depth;
+
+	HR_ASSERT_OK(MFPutWorkItem(m_workQueueId, this, NULL));
+	return S_OK;
+}
+
+/*
+	Takes an event to be handled next.
+
+	Data lane is always drained first, so that control events are handled
+	only in the slack after all pending buffers are completed.
+	Order of triggering between the lanes is not kept: A buffer switch waiting in the data lane
+	is handled before any control event waiting, even if it was triggered after the control event.
+	A control event is taken only when the data lane is empty.
+
+	If more than one buffer switch is waiting, the driver has already switched buffers
+	after the older ones were triggered. The older ones are dropped as stale
+	and the newest one is returned, so that processing resynchronizes on the freshest buffer.
+
+	Returns S_FALSE if no event is waiting.
+*/
+HRESULT CAsioHandler::popEvent(CAsioHandlerEvent** ppEvent)
+{
+	HR_ASSERT(ppEvent, E_POINTER);
+
+	long waiting = 0;
+	DataSlot slot;
+	while (m_dataLane.pop(slot)) waiting++;
+	statistics.queueDepth[EventLanes::Data] = (long)m_dataLane.getCount();
+	const long overflows = m_dataLaneOverflows.exchange(0, std::memory_order_relaxed);
+
+	long dropped = 0;
+	if (waiting) {
+		// In lookahead mode, input buffers wait in the FIFO and no buffer is lost.
+		if (!lookaheadBuffers && ((1 < waiting) || overflows)) {
+			dropped = waiting - 1 + overflows;
+			statistics.xrun++;
+			statistics.droppedBuffers += dropped;
+		}
+		m_dataEvent->params = slot.params;
+		m_dataEvent->doubleBufferIndex = slot.doubleBufferIndex;
+		m_dataEvent->clock = slot.clock;
+		*ppEvent = m_dataEvent;
+		(*ppEvent)->AddRef();
+	}
+
+	if (dropped) {
+		// Only one record for each xrun however many buffers were dropped.
+		LOG4CPLUS_WARN(logger, "Xrun #" << statistics.xrun << ": Dropped " << dropped << " stale buffer(s). Total " << statistics.droppedBuffers);
 	}
+	if (waiting) return S_OK;
+
+	CComCritSecLock<CComAutoCriticalSection> lock(m_controlLaneLock);
+	if (m_controlLane.empty()) return S_FALSE;
+	*ppEvent = m_controlLane.front().Detach();
+	m_controlLane.pop_front();
+	statistics.queueDepth[EventLanes::Control] = (long)m_controlLane.size();
+	return S_OK;
+}
+
+HRESULT CAsioHandler::handleEvent(const CAsioHandlerEvent* event)
+{
+	HRESULT hr = handleStateEvent(event);
 
 	if (FAILED(hr) && event->isUserEvent) {
 		// Failed to handle user event.
@@ -146,15 +366,13 @@ HRESULT STDMETHODCALLTYPE CAsioHandler::GetParameters(DWORD *pdwFlags, DWORD *pd
 	Implementation of IMFAsyncCallback::Invoke().
 
 	Calls handleEvent() method with CAsioEvent object.
-	CAsioEvent object is obtained from state of IMFAsyncResult.
+	CAsioEvent object is taken from the lanes by popEvent() method.
 */
 HRESULT STDMETHODCALLTYPE CAsioHandler::Invoke(IMFAsyncResult *pAsyncResult)
 {
-	CComPtr<IUnknown> unkState;
-	HR_ASSERT_OK(pAsyncResult->GetState(&unkState));
 	CComPtr<CAsioHandlerEvent> event;
-	HR_ASSERT_OK(unkState->QueryInterface(&event));
-	return handleEvent(event);
+	HR_ASSERT_OK(popEvent(&event));
+	return event ? handleEvent(event) : S_OK;
 }
 
 void CAsioHandler::bufferSwitch(long doubleBufferIndex, ASIOBool directProcess)
@@ -174,9 +392,20 @@ void CAsioHandler::bufferSwitch(long doubleBufferIndex, ASIOBool directProcess)
 ASIOTime * CAsioHandler::bufferSwitchTimeInfo(ASIOTime * params, long doubleBufferIndex, ASIOBool directProcess)
 {
 	statistics.bufferSwitch[doubleBufferIndex]++;
+	traceRecorder.recordBufferSwitch(*params, doubleBufferIndex);
 
-	CComPtr<CAsioHandlerEvent> event(new DataEvent(params, doubleBufferIndex));
-	HR_EXPECT_OK(triggerEvent(event));
+	if (lookaheadBuffers) {
+		transferLookahead(doubleBufferIndex);
+	}
+
+	// Raw pair of position and time is filtered by the loop, and is passed through as is.
+	const AsioTimeInfo& timeInfo = params->timeInfo;
+	const DWORD validFlags = kSystemTimeValid | kSamplePositionValid;
+	if ((timeInfo.flags & validFlags) == validFlags) {
+		sampleClock.update(CSampleClock::toLongLong(timeInfo.samplePosition), CSampleClock::toLongLong(timeInfo.systemTime));
+	}
+
+	HR_EXPECT_OK(triggerData(*params, doubleBufferIndex, sampleClock.getEstimate()));
 	return nullptr;
 }
 
@@ -194,6 +423,8 @@ long CAsioHandler::asioMessage(long selector, long value, void * message, double
 	CComPtr<CAsioHandlerEvent> event;
 	LPCSTR strSelector = "UNKNOWN";
 
+	traceRecorder.recordMessage(selector, value);
+
 #define CASE(x) case x: strSelector=#x;
 
 	switch (selector) {
@@ -244,35 +475,3 @@ long CAsioHandler::asioMessage(long selector, long value, void * message, double
 	LOG4CPLUS_INFO(logger, __FUNCTION__ "(" << strSelector << ":" << selector << ",value=" << value << ") returned " << ret);
 	return ret;
 }
-
-void CAsioHandler::s_bufferSwitch(long doubleBufferIndex, ASIOBool directProcess)
-{
-	if (m_instance) m_instance->bufferSwitch(doubleBufferIndex, directProcess);
-	else LOG4CPLUS_WARN(logger, "No instance: " __FUNCTION__ "(" << doubleBufferIndex << "," << directProcess << ")");
-}
-
-ASIOTime * CAsioHandler::s_bufferSwitchTimeInfo(ASIOTime * params, long doubleBufferIndex, ASIOBool directProcess)
-{
-	ASIOTime* ret = params;
-	if(m_instance) ret = m_instance->bufferSwitchTimeInfo(params, doubleBufferIndex, directProcess);
-	else LOG4CPLUS_WARN(logger, "No instance: " __FUNCTION__ "(" << doubleBufferIndex << "," << directProcess << ")");
-	return ret;
-}
-
-void CAsioHandler::s_sampleRateDidChange(ASIOSampleRate sRate)
-{
-	if (m_instance) m_instance->sampleRateDidChange(sRate);
-	else LOG4CPLUS_WARN(logger, "No instance: " __FUNCTION__ "(" << sRate << ")");
-}
-
-long CAsioHandler::s_asioMessage(long selector, long value, void * message, double * opt)
-{
-	long ret = 0;
-	if(m_instance) ret = m_instance->asioMessage(selector, value, message, opt);
-	else LOG4CPLUS_WARN(logger, "No instance: " __FUNCTION__ "(" << selector << "," << value << ",...)");
-	return ret;
-}
-
-ASIOCallbacks CAsioHandler::m_callbacks = {
-	s_bufferSwitch, s_sampleRateDidChange, s_asioMessage, s_bufferSwitchTimeInfo
-};
@@ -3,29 +3,40 @@
 #include "AsioHandlerEvent.h"
 #include "AsioHandlerState.h"
 #include "AsioHandlerContext.h"
+#include "WaitFreeQueue.h"
+
+#include <deque>
 
 class CAsioDriver;
 
+/*
+	Engine driven by the ASIO driver.
+
+	Each object has its own driver, work queue and callbacks acquired from CAsioCallbackPool,
+	so that objects as many as CAsioCallbackPool::MaxHandlers can run at the same time.
+*/
 class CAsioHandler : public CAsioHandlerContext, public IMFAsyncCallback, public CUnknownImpl
 {
-protected:
-	static CAsioHandler* m_instance;
-	CAsioHandler(int numChannels);
-
 public:
+	CAsioHandler(int numChannels = 0);
 	~CAsioHandler();
 
-	static CAsioHandler* getInstance(int numChannels = 0);
-
-	HRESULT setup(IASIO* asio, HWND hwnd);
+	HRESULT setup(IASIO* asio, HWND hwnd, long lookaheadBuffers = 0, CEffectChain* effectChain = NULL);
 	HRESULT shutdown();
 	HRESULT start();
 
 	HRESULT stop();
 
+	HRESULT armChannels(const std::vector<long>& inputs, const std::vector<long>& outputs);
+	HRESULT replaceEffectChain(CEffectChain* effectChain);
+	HRESULT postParameterChange(long effect, DWORD parameter, const MP_ENVELOPE_SEGMENT& segment);
+	REFERENCE_TIME getStreamTime() const;
+
+	HRESULT startLatencyMeasurement(long inputChannel, long outputChannel, long runs = CLatencyMeter::DefaultRuns);
+	HRESULT getLatencyMeasurement(CLatencyMeter::Result* result);
+
 #pragma region CAsioHandlerContext
 	virtual HRESULT triggerEvent(CAsioHandlerEvent* event);
-	virtual ASIOCallbacks* getAsioCallbacks() const { return &m_callbacks; };
 #pragma endregion
 
 #pragma region IMFAsyncCallback
@@ -47,16 +58,31 @@ public:
 	void sampleRateDidChange(ASIOSampleRate sRate);
 	long asioMessage(long selector, long value, void* message, double* opt);
 
-	static void s_bufferSwitch(long doubleBufferIndex, ASIOBool directProcess);
-	static ASIOTime* s_bufferSwitchTimeInfo(ASIOTime* params, long doubleBufferIndex, ASIOBool directProcess);
-	static void s_sampleRateDidChange(ASIOSampleRate sRate);
-	static long s_asioMessage(long selector, long value, void* message, double* opt);
-
-	static ASIOCallbacks m_callbacks;
-
-	std::unique_ptr<CAsioHandlerState> m_currentState;
 	DWORD m_workQueueId;
 
+	// Buffer switch passed from the driver thread to the work queue thread.
+	struct DataSlot {
+		ASIOTime params;
+		long doubleBufferIndex;
+		CSampleClock::Estimate clock;
+	};
+
+	// Capacity of the data lane. The driver is far behind when the lane is full.
+	static const size_t MaxDataSlots = 16;
+
+	// Data lane written by the driver thread without lock and allocation.
+	CWaitFreeQueue<DataSlot> m_dataLane;
+	// Count of buffer switches discarded because the data lane was full. Added to Statistics by popEvent().
+	std::atomic<long> m_dataLaneOverflows;
+	// Event handed out for the data lane. Reused because the work queue handles one event at a time.
+	CComPtr<DataEvent> m_dataEvent;
+
+	// Control events waiting to be handled by the work queue thread.
+	std::deque<CComPtr<CAsioHandlerEvent>> m_controlLane;
+	CComAutoCriticalSection m_controlLaneLock;
+
+	HRESULT triggerData(const ASIOTime& params, long doubleBufferIndex, const CSampleClock::Estimate& clock);
+	HRESULT popEvent(CAsioHandlerEvent** ppEvent);
 	HRESULT handleEvent(const CAsioHandlerEvent* event);
 
 #pragma warning(push)
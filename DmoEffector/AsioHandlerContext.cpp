@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "AsioHandlerContext.h"
+#include "AsioHandlerState.h"
 
 static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("AsioHandler.Context"));
 
@@ -7,7 +8,8 @@ static long getSampleSize(ASIOSampleType type);
 static void logChannelInfo(const ASIOChannelInfo& info);
 
 CAsioHandlerContext::CAsioHandlerContext(int numChannels)
-	: m_state(State::NotLoaded), numChannels(numChannels)
+	: m_state(State::NotLoaded), asioCallbacks(NULL), calibratedLatency(0), numChannels(numChannels), setupChannels(numChannels)
+	, bufferSize(0), sampleSize(0), sampleType(ASIOSTLastEntry), passThrough(false), sampleRate(0), lookaheadBuffers(0)
 	, shutDownEvent(CreateEvent(NULL, FALSE, FALSE, NULL))
 {
 	WIN32_EXPECT(NULL != (HANDLE)shutDownEvent);
@@ -25,33 +27,241 @@ HRESULT CAsioHandlerContext::getProperty(Property * pProperty)
 	pProperty->state = m_state;
 	pProperty->numChannels = numChannels;
 	pProperty->bufferSize = bufferSize;
+	pProperty->addedLatency = getAddedLatency();
+	pProperty->inputLatency = driverInfo.inputLatency;
+	pProperty->calibratedLatency = calibratedLatency.load(std::memory_order_relaxed);
+	pProperty->outputLatency = driverInfo.outputLatency + pProperty->addedLatency + pProperty->calibratedLatency;
 	return S_OK;
 }
 
-HRESULT CAsioHandlerContext::initializeChannelInfo(long channel)
+/*
+	Resolves device channels to be created from armed channels, and sets numChannels.
+
+	requestedChannels: Count of channels used if no channel is armed. 0 means all channels of the smaller side.
+*/
+HRESULT CAsioHandlerContext::resolveArmedChannels(int requestedChannels, long numInputChannels, long numOutputChannels)
 {
-	ASIOChannelInfo input, output;
-	ZeroMemory(&input, sizeof(input));
-	ZeroMemory(&output, sizeof(output));
-	input.channel = output.channel = channel;
-	input.isInput = ASIOTrue;
-	output.isInput = ASIOFalse;
-	ASIO_ASSERT_OK(asio->getChannelInfo(&input));
-	logChannelInfo(input);
-	ASIO_ASSERT_OK(asio->getChannelInfo(&output));
-	logChannelInfo(output);
+	if (armedInputs.empty() && armedOutputs.empty()) {
+		if (0 < requestedChannels) {
+			HR_ASSERT((requestedChannels <= numInputChannels) && (requestedChannels <= numOutputChannels), E_INVALIDARG);
+		} else {
+			requestedChannels = min(numInputChannels, numOutputChannels);
+		}
+		inputChannels.resize(requestedChannels);
+		outputChannels.resize(requestedChannels);
+		for (long channel = 0; channel < requestedChannels; channel++) {
+			inputChannels[channel] = outputChannels[channel] = channel;
+		}
+	} else {
+		// Each device channel should be armed at most once.
+		std::vector<bool> isArmed(numInputChannels + numOutputChannels, false);
+		for (size_t i = 0; i < armedInputs.size(); i++) {
+			const long channel = armedInputs[i];
+			HR_ASSERT((0 <= channel) && (channel < numInputChannels) && !isArmed[channel], E_INVALIDARG);
+			isArmed[channel] = true;
+		}
+		for (size_t i = 0; i < armedOutputs.size(); i++) {
+			const long channel = armedOutputs[i];
+			HR_ASSERT((0 <= channel) && (channel < numOutputChannels) && !isArmed[numInputChannels + channel], E_INVALIDARG);
+			isArmed[numInputChannels + channel] = true;
+		}
+		inputChannels = armedInputs;
+		outputChannels = armedOutputs;
+	}
+
+	numChannels = (int)max(inputChannels.size(), outputChannels.size());
+	HR_ASSERT(0 < numChannels, E_INVALIDARG);
+	LOG4CPLUS_INFO(logger, "Armed " << inputChannels.size() << " input(s) and " << outputChannels.size() << " output(s) of "
+		<< numInputChannels << " inputs and " << numOutputChannels << " outputs");
+	return S_OK;
+}
 
-	// Input and output type should equal.
-	ASIO_ASSERT(input.type == output.type, E_ABORT);
+/*
+	Retrieves sample type of the device channel of the buffer info.
+*/
+HRESULT CAsioHandlerContext::initializeChannelInfo(const ASIOBufferInfo& bufferInfo)
+{
+	ASIOChannelInfo info;
+	ZeroMemory(&info, sizeof(info));
+	info.channel = bufferInfo.channelNum;
+	info.isInput = bufferInfo.isInput;
+	ASIO_ASSERT_OK(asio->getChannelInfo(&info));
+	logChannelInfo(info);
 
-	long sampleSize = getSampleSize(input.type);
+	long sampleSize = getSampleSize(info.type);
 	ASIO_ASSERT(0 < sampleSize, E_INVALIDARG);
 
+	// All channels, input and output, should have same sample type.
+	ASIO_ASSERT((this->sampleSize == 0) || (this->sampleType == info.type), E_ABORT);
+	this->sampleSize = sampleSize;
+	this->sampleType = info.type;
+	this->passThrough = !CSampleConverter::canConvert(info.type);
+
+	return S_OK;
+}
+
+// Set result of exp to hr1 unless hr1 is error.
+#define HR_PRESERVE_ERROR(hr1, exp) do { HRESULT hr2 = HR_EXPECT_OK(exp); if(SUCCEEDED(hr1)) hr1 = hr2; } while(false)
+
+/*
+	Passes the event to the current state and makes transition to the next state if any.
+
+	Returns error of the state even if the transition has been made.
+*/
+HRESULT CAsioHandlerContext::handleStateEvent(const CAsioHandlerEvent* event)
+{
+	HR_ASSERT(currentState, E_ILLEGAL_METHOD_CALL);
+
+	CAsioHandlerState* nextState = NULL;
+	HRESULT hr = HR_EXPECT_OK(currentState->handleEvent(event, &nextState));
+	if (nextState) {
+		// State transition
+		HR_PRESERVE_ERROR(hr, currentState->exit(event, nextState));
+		HR_PRESERVE_ERROR(hr, nextState->entry(event, currentState.get()));
+		currentState.reset(nextState);
+	}
+	return hr;
+}
+
+/*
+	Retrieves latencies from the driver.
+
+	Called when buffers are created and when the driver notifies kAsioLatenciesChanged.
+*/
+HRESULT CAsioHandlerContext::updateLatencies()
+{
+	ASIO_ASSERT_OK(asio->getLatencies(&driverInfo.inputLatency, &driverInfo.outputLatency));
+	LOG4CPLUS_INFO(logger, "Latencies: Input " << driverInfo.inputLatency << ", Output " << driverInfo.outputLatency
+		<< " + " << getAddedLatency() << " + " << calibratedLatency.load(std::memory_order_relaxed) << " samples");
+	return S_OK;
+}
+
+/*
+	Returns latency added by lookahead mode and effects of the chain published last.
+*/
+long CAsioHandlerContext::getAddedLatency() const
+{
+	// Called by the work queue thread and the UI thread.
+	CEffectChainSwapper::Latest effectChain(effectChains);
+	return (lookaheadBuffers * bufferSize) + ((effectChain.get() && effectChain->isPrepared()) ? effectChain->getLatency() : 0);
+}
+
+/*
+	Stores round trip latency measured by latencyMeter less latencies reported by the driver and added by this engine.
+
+	The result is used as calibration of the driver, sample rate and buffer size from the next setup.
+*/
+HRESULT CAsioHandlerContext::calibrateLatency(const CLatencyMeter::Result& result)
+{
+	const long reported = driverInfo.inputLatency + driverInfo.outputLatency + getAddedLatency();
+	const long calibrated = (long)floor(result.latency + 0.5) - reported;
+	LOG4CPLUS_INFO(logger, "Measured round trip latency " << result.latency << " samples (jitter " << result.jitter
+		<< "), Reported " << reported << ", Calibration " << calibrated << " samples");
+
+	calibratedLatency.store(calibrated, std::memory_order_relaxed);
+	HR_EXPECT_OK(CLatencyMeter::saveCalibration(driverInfo.name, sampleRate, bufferSize, calibrated));
+	return S_OK;
+}
+
+/*
+	Allocates buffers of this object used while running, other than the effect chain.
+
+	Called twice when buffers are created: to size the arena, and to allocate from the arena.
+*/
+HRESULT CAsioHandlerContext::allocateBuffers()
+{
+	HR_ASSERT_OK(spectrumAnalyzer.initialize(numChannels, bufferSize, sampleType, sampleSize, sampleRate));
+	HR_ASSERT_OK(latencyMeter.initialize(numChannels, bufferSize, sampleType));
+	HR_ASSERT_OK(effectChains.prepare(bufferSize));
+	if (lookaheadBuffers) {
+		HR_ASSERT_OK(initializeLookahead());
+	}
+
+	// Channels not armed on one side share the silent input or the discarded output.
+	const long bufferBytes = getBufferBytes();
+	HR_ASSERT_OK(unarmedBuffers.allocate(bufferBytes * 2));
+	for (long channel = (long)inputChannels.size(); channel < numChannels; channel++) {
+		ASIOBufferInfo& in = getInputBufferInfo(channel);
+		in.buffers[0] = in.buffers[1] = &unarmedBuffers[0];
+	}
+	for (long channel = (long)outputChannels.size(); channel < numChannels; channel++) {
+		ASIOBufferInfo& out = getOutputBufferInfo(channel);
+		out.buffers[0] = out.buffers[1] = &unarmedBuffers[bufferBytes];
+	}
 	return S_OK;
 }
 
+/*
+	Allocates FIFOs used by lookahead mode.
+
+	Each block of FIFO contains buffers of all channels.
+	FIFO can hold one more block than lookaheadBuffers for the block being processed.
+*/
+HRESULT CAsioHandlerContext::initializeLookahead()
+{
+	HR_ASSERT((0 < lookaheadBuffers) && (lookaheadBuffers <= MaxLookaheadBuffers), E_INVALIDARG);
+
+	size_t blockSize = getBufferBytes() * numChannels;
+	HR_ASSERT_OK(lookaheadInput.initialize(blockSize, lookaheadBuffers + 1));
+	HR_ASSERT_OK(lookaheadOutput.initialize(blockSize, lookaheadBuffers + 1));
+	return S_OK;
+}
+
+/*
+	Fills output FIFO with silent buffers as many as lookaheadBuffers before starting the driver.
+*/
+HRESULT CAsioHandlerContext::primeLookahead()
+{
+	if (!lookaheadBuffers) return S_FALSE;
+
+	lookaheadInput.reset();
+	lookaheadOutput.reset();
+	for (long i = 0; i < lookaheadBuffers; i++) {
+		HR_ASSERT(lookaheadOutput.getWritableBlock(), E_UNEXPECTED);
+		lookaheadOutput.push();
+	}
+	return S_OK;
+}
+
+/*
+	Exchanges ASIO buffers with lookahead FIFOs.
+
+	Called in the driver thread by bufferSwitchTimeInfo() callback.
+	Copies input buffers to input FIFO and copies processed buffers in output FIFO to output buffers.
+	If processed buffers are not ready, silence is output.
+*/
+void CAsioHandlerContext::transferLookahead(long doubleBufferIndex)
+{
+	long bufferBytes = getBufferBytes();
+
+	BYTE* input = lookaheadInput.getWritableBlock();
+	if (input) {
+		for (long channel = 0; channel < numChannels; channel++) {
+			CopyMemory(&input[channel * bufferBytes], getInputBufferInfo(channel).buffers[doubleBufferIndex], bufferBytes);
+		}
+		lookaheadInput.push();
+	} else {
+		statistics.inputOverrun++;
+	}
+
+	const BYTE* output = lookaheadOutput.getReadableBlock();
+	for (long channel = 0; channel < numChannels; channel++) {
+		void* buffer = getOutputBufferInfo(channel).buffers[doubleBufferIndex];
+		if (output) CopyMemory(buffer, &output[channel * bufferBytes], bufferBytes);
+		else ZeroMemory(buffer, bufferBytes);
+	}
+	if (output) lookaheadOutput.pop();
+	else statistics.outputUnderrun++;
+
+	// Notify the driver that output data is available if supported.
+	if (driverInfo.isOutputReadySupported) {
+		asio->outputReady();
+	}
+}
+
 /*
 Call function for each channels(from 0 to m_numChannels - 1).
+Only armed channels are created, so that channel n is armedInputs[n] and armedOutputs[n] of the device.
 */
 HRESULT CAsioHandlerContext::forInChannels(std::function<HRESULT(long channel, ASIOBufferInfo&in, ASIOBufferInfo&out)> func)
 {
@@ -2,7 +2,18 @@
 
 #include <functional>
 
+#include "RealTimeArena.h"
+#include "BlockFifo.h"
+#include "EffectChainSwapper.h"
+#include "SpectrumAnalyzer.h"
+#include "SharedTap.h"
+#include "SampleClock.h"
+#include "WaveOutRenderer.h"
+#include "LatencyMeter.h"
+#include "TraceRecorder.h"
+
 struct CAsioHandlerEvent;
+class CAsioHandlerState;
 
 class CAsioHandlerContext
 {
@@ -14,6 +25,13 @@ public:
 
 	struct Statistics {
 		long bufferSwitch[2];	// Count of bufferSwitchTimeInfo() called for each doubleBufferIndex.
+		long queueDepth[2];		// Count of events waiting in each lane. Index is EventLanes value.
+								// Data lane is counted when a buffer switch is triggered.
+		long maxQueueDepth[2];	// Maximum value of queueDepth for each lane.
+		long xrun;				// Count of times the work queue thread fell behind the driver.
+		long droppedBuffers;	// Count of stale Data events dropped without being handled.
+		long inputOverrun;		// Count of input buffers discarded in lookahead mode because the input FIFO was full.
+		long outputUnderrun;	// Count of buffers output as silence in lookahead mode because processed buffer was not ready.
 	};
 
 	// State of this class.
@@ -31,32 +49,129 @@ public:
 		State state;
 		int numChannels;
 		long bufferSize;
+		long inputLatency;		// Input latency in samples reported by the driver.
+		long outputLatency;		// Output latency in samples including addedLatency and calibratedLatency.
+		long addedLatency;		// Latency in samples added by this engine.
+		long calibratedLatency;	// Round trip latency in samples not reported by the driver. See CLatencyMeter.
 	};
 
 	virtual HRESULT triggerEvent(CAsioHandlerEvent* event) = 0;
-	virtual ASIOCallbacks* getAsioCallbacks() const = 0;
+	ASIOCallbacks* getAsioCallbacks() const { return asioCallbacks; }
+	HRESULT handleStateEvent(const CAsioHandlerEvent* event);
 
 	HRESULT getProperty(Property* pProperty);
 	ASIOBufferInfo& getInputBufferInfo(int channel) { return asioBufferInfos.get()[channel]; }
 	ASIOBufferInfo& getOutputBufferInfo(int channel) { return asioBufferInfos.get()[channel + numChannels]; }
-	HRESULT initializeChannelInfo(long channel);
+	HRESULT resolveArmedChannels(int requestedChannels, long numInputChannels, long numOutputChannels);
+	HRESULT initializeChannelInfo(const ASIOBufferInfo& bufferInfo);
+	HRESULT updateLatencies();
+	long getAddedLatency() const;
+	HRESULT calibrateLatency(const CLatencyMeter::Result& result);
+	long getBufferBytes() const { return bufferSize * sampleSize; }
 
 	HRESULT forInChannels(std::function<HRESULT(long channel, ASIOBufferInfo& in, ASIOBufferInfo& out)> func);
 
 	// ASIO4All
 	CComPtr<IASIO> asio;
 
+	// Callbacks passed to the driver. Each object running at the same time has its own callbacks.
+	ASIOCallbacks* asioCallbacks;
+	std::unique_ptr<CAsioHandlerState> currentState;
+
 	struct DriverInfo {
+		char name[100];
 		bool isOutputReadySupported;
+		long inputLatency;
+		long outputLatency;
 	};
 
 	DriverInfo driverInfo;
+	// Round trip latency in samples not reported by the driver.
+	// Loaded by the work queue thread when buffers are created, and updated by calibrateLatency() of the UI thread.
+	std::atomic<long> calibratedLatency;
 
+	// Count of channels processed by the effect chain. Larger one of counts of armed inputs and outputs.
 	int numChannels;
+	// Buffer infos of channels processed, inputs followed by outputs. Each has numChannels entries.
+	// Channels not armed have buffers of this object: inputs are silent and outputs are discarded.
 	std::unique_ptr<ASIOBufferInfo[]> asioBufferInfos;
+
+	// Channels armed by the user. Empty means that channels from 0 to setupChannels - 1 are armed on both sides.
+	// Channel n of the effect chain reads input armedInputs[n] and writes output armedOutputs[n].
+	// Set before setup or by ArmChannels event.
+	std::vector<long> armedInputs;
+	std::vector<long> armedOutputs;
+	// Count of channels requested by setup, used if no channel is armed. 0 means all channels of the smaller side.
+	int setupChannels;
+	// Device channel indexes of inputs and outputs created, resolved from armed channels when buffers are created.
+	std::vector<long> inputChannels;
+	std::vector<long> outputChannels;
+	// Buffer infos of armed channels passed to IASIO::createBuffers(), inputs followed by outputs.
+	std::unique_ptr<ASIOBufferInfo[]> deviceBufferInfos;
+
 	long bufferSize;
+	long sampleSize;		// Size of one sample in bytes.
+	ASIOSampleType sampleType;
+	bool passThrough;		// Samples can't be converted to float. Input is copied to output without effects.
+	ASIOSampleRate sampleRate;
 	Statistics statistics;
 
+	// Memory of all buffers used by the work queue thread and the driver thread, except ASIO buffers.
+	// Reserved when buffers are created, by the size of buffers of the effect chain and this object.
+	// Declared before the objects allocating from it, so that it is destroyed after them.
+	CRealTimeArena arena;
+	// Count of chains that the arena can hold at the same time:
+	// The chain running, the chain replacing it and the chain waiting to be reclaimed.
+	static const long ArenaChains = 3;
+
+	// Silent input buffer and discarded output buffer of channels not armed.
+	CAlignedBuffer<BYTE> unarmedBuffers;
+
+	// Effects applied to all channels.
+	// The chain can be replaced while running. See CAsioHandler::replaceEffectChain().
+	CEffectChainSwapper effectChains;
+
+	// Buffer of each channel passed to effectChains.
+	std::vector<const void*> processInputs;
+	std::vector<void*> processOutputs;
+
+	// Lookahead processing mode.
+	// The driver thread exchanges ASIO buffers with FIFOs and the work queue thread
+	// processes buffers ahead, so that jitter of the work queue thread is absorbed.
+	long lookaheadBuffers;			// Count of buffers processed ahead. 0 means lookahead mode is disabled.
+	CBlockFifo lookaheadInput;		// Input buffers captured by the driver thread.
+	CBlockFifo lookaheadOutput;		// Processed buffers to be output by the driver thread.
+	static const long MaxLookaheadBuffers = 2;
+
+	HRESULT allocateBuffers();
+	HRESULT initializeLookahead();
+	HRESULT primeLookahead();
+	void transferLookahead(long doubleBufferIndex);
+
+	// Analyzes processed buffers on its own thread.
+	// Buffers are tapped by the work queue thread after effectChains.process().
+	CSpectrumAnalyzer spectrumAnalyzer;
+
+	// Filters sample position and system time of each buffer switch.
+	// Updated by the driver thread and the estimate is passed to the work queue thread by DataEvent.
+	CSampleClock sampleClock;
+
+	// Publishes input and processed buffers to shared memory read by external processes.
+	// Configured before setup and written by the work queue thread after effectChains.process().
+	CSharedTap sharedTap;
+
+	// Renders processed buffers to the waveOut device through the adaptive resampling bridge.
+	// Configured before start and written by the work queue thread after effectChains.process().
+	CWaveOutRenderer outputRenderer;
+
+	// Measures round trip latency by test signal from an output channel looped back to an input channel.
+	// Started by the UI thread and processed by the work queue thread after effectChains.process().
+	CLatencyMeter latencyMeter;
+
+	// Records callbacks of the driver and methods called by the user to the trace file. See CTraceReplayer.
+	// Configured before setup, and written by the driver thread and the threads calling CAsioHandler methods.
+	CTraceRecorder traceRecorder;
+
 	// Event handle to notify work queue thread to shutodown. 
 	CHandle shutDownEvent;
 };
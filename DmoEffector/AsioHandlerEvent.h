@@ -2,6 +2,8 @@
 
 #include <guiddef.h>
 
+#include "SampleClock.h"
+
 class CAsioDriver;
 
 ENUM(EventTypes,
@@ -10,12 +12,23 @@ ENUM(EventTypes,
 	Start,						/// CAsioHandler::start() method has been called by user.
 	Stop,						/// CAsioHandler::stop() method has been called by user.
 	Data,						/// CAsioHandler::bufferSwitchTimeInfo() callback has been called by ASIO driver.
+	ArmChannels,				/// CAsioHandler::armChannels() method has been called by user after setup.
 	AsioResetRequest,			/// ASIO driver requests a reset.
 	//AsioBufferSizeChange,		/// ASIO buffer sizes will change, issued by the user. - Done by AsioRestRequest
 	AsioResyncRequest,			/// ASIO driver detected underruns and requires a resynchronization.
 	AsioLatenciesChanged		/// ASIO driver detected a latancy change.
 );
 
+/**
+	Lanes in which events wait to be handled.
+
+	Events in Data lane are always handled prior to events in Control lane.
+ */
+ENUM(EventLanes,
+	Data,						/// Real-time lane for Data event.
+	Control						/// Lane for events other than Data.
+);
+
 MIDL_INTERFACE("2A8782E9-2869-442B-9EEC-DDE68415B6D2")
 CAsioHandlerEvent : public IUnknown, public CUnknownImpl
 {
@@ -43,6 +56,9 @@ public:
 
 	virtual LPCTSTR toString() const { return type.toString(); }
 
+	// Returns lane in which this event should wait.
+	EventLanes getLane() const { return (type == EventTypes::Data) ? EventLanes::Data : EventLanes::Control; }
+
 	const EventTypes type;
 
 	// Indicates where the event is caused by user.
@@ -86,22 +102,46 @@ typedef EventBase<EventTypes::AsioLatenciesChanged, false> AsioLatenciesChangedE
 class SetupEvent : public EventBase<EventTypes::Setup, true>
 {
 public:
-	SetupEvent(IASIO* asio, HWND hwnd, int numChannels)
+	SetupEvent(IASIO* asio, HWND hwnd, int numChannels, long lookaheadBuffers)
 		: EventBase()
-		, asio(asio), hwnd(hwnd), numChannels(numChannels) {}
+		, asio(asio), hwnd(hwnd), numChannels(numChannels), lookaheadBuffers(lookaheadBuffers) {}
 
 	CComPtr<IASIO> asio;
 	const HWND hwnd;
 	const int numChannels;
+	const long lookaheadBuffers;	// Count of buffers processed ahead. 0 means lookahead mode is disabled.
 };
 
+class ArmChannelsEvent : public EventBase<EventTypes::ArmChannels, true>
+{
+public:
+	ArmChannelsEvent(const std::vector<long>& inputs, const std::vector<long>& outputs)
+		: EventBase()
+		, inputs(inputs), outputs(outputs) {}
+
+	const std::vector<long> inputs;		// Device channel indexes. See CAsioHandlerContext::armedInputs.
+	const std::vector<long> outputs;
+};
+
+/**
+	Event of the buffer switch.
+
+	Members are not const, so that CAsioHandler reuses one object for all buffers
+	instead of allocating an event in the driver thread.
+ */
 class DataEvent : public EventBase<EventTypes::Data, false>
 {
 public:
-	DataEvent(const ASIOTime * params, long doubleBufferIndex)
+	DataEvent() : EventBase(), doubleBufferIndex(0)
+	{
+		ZeroMemory(&params, sizeof(params));
+		ZeroMemory(&clock, sizeof(clock));
+	}
+	DataEvent(const ASIOTime * params, long doubleBufferIndex, const CSampleClock::Estimate& clock)
 		: EventBase()
-		, params(*params), doubleBufferIndex(doubleBufferIndex) {}
+		, params(*params), doubleBufferIndex(doubleBufferIndex), clock(clock) {}
 
-	const ASIOTime params;
-	const long doubleBufferIndex;
+	ASIOTime params;
+	long doubleBufferIndex;
+	CSampleClock::Estimate clock;		// Filtered time of the buffer. See CAsioHandlerContext::sampleClock.
 };
@@ -33,6 +33,7 @@ HRESULT CAsioHandlerState::handleEvent(const CAsioHandlerEvent * event, CAsioHan
 	case EventTypes::AsioResyncRequest:
 		break;
 	case EventTypes::AsioLatenciesChanged:
+		HR_ASSERT_OK(context->updateLatencies());
 		break;
 	default:
 		return handleUnexpectedEvent(event, nextState);
@@ -79,51 +80,178 @@ HRESULT NotInitializedState::setup(const SetupEvent * event)
 	ASIO_ASSERT(asio->init(event->hwnd), E_ABORT);
 
 	// Show name and version of ASIO driver created.
-	char driverName[100];
+	char* driverName = context->driverInfo.name;
 	asio->getDriverName(driverName);
 	LOG4CPLUS_INFO(logger, "Loaded '" << driverName << "' version=" << asio->getDriverVersion());
 
-	// Get number of channels and assert that we have enough channels.
-	int numChannels = event->numChannels;
+	context->driverInfo.isOutputReadySupported = (asio->outputReady() == ASE_OK);
+	context->lookaheadBuffers = event->lookaheadBuffers;
+	context->setupChannels = event->numChannels;
+	return createBuffers(event->numChannels);
+}
+
+/*
+	Creates buffers of armed channels and prepares all objects for the buffers.
+
+	requestedChannels: Count of channels used if no channel is armed. 0 means all channels of the smaller side.
+*/
+HRESULT CAsioHandlerState::createBuffers(int requestedChannels)
+{
+	IASIO* asio = context->asio;
+
+	// Get number of channels and resolve channels to be created.
 	long numInputChannels, numOutputChannels;
 	ASIO_ASSERT_OK(asio->getChannels(&numInputChannels, &numOutputChannels));
 	LOG4CPLUS_INFO(logger, "Input " << numInputChannels << " channels, Output " << numOutputChannels << " channels");
-	if (0 < numChannels) {
-		HR_ASSERT((numChannels <= numInputChannels) && (numChannels <= numOutputChannels), E_INVALIDARG);
-	} else {
-		numChannels = min(numInputChannels, numOutputChannels);
-	}
-	context->numChannels = numChannels;
-
-	// Initialize all ASIOBufferInfo prior to calling IASIO::createBuffers().
-	// Buffers are prepared for each in/out, channel and double buffer index 0/1
-	context->forInChannels([this](long channel, ASIOBufferInfo&in, ASIOBufferInfo&out) {
-		in.isInput = ASIOTrue;
-		out.isInput = ASIOFalse;
-		in.channelNum = out.channelNum = channel;
-		in.buffers[0] = in.buffers[1] = out.buffers[0] = out.buffers[1] = NULL;
-		return S_OK;
-	});
+	HR_ASSERT_OK(context->resolveArmedChannels(requestedChannels, numInputChannels, numOutputChannels));
+	const int numChannels = context->numChannels;
+	const long numInputs = (long)context->inputChannels.size();
+	const long numOutputs = (long)context->outputChannels.size();
 
-	context->driverInfo.isOutputReadySupported = (asio->outputReady() == ASE_OK);
+	// Initialize ASIOBufferInfo of armed channels prior to calling IASIO::createBuffers().
+	// Buffers are prepared for each armed input and output, and double buffer index 0/1
+	context->deviceBufferInfos.reset(new ASIOBufferInfo[numInputs + numOutputs]);
+	ASIOBufferInfo* deviceBufferInfos = context->deviceBufferInfos.get();
+	ZeroMemory(deviceBufferInfos, sizeof(ASIOBufferInfo) * (numInputs + numOutputs));
+	context->sampleSize = 0;
+	for (long i = 0; i < numInputs + numOutputs; i++) {
+		ASIOBufferInfo& info = deviceBufferInfos[i];
+		info.isInput = (i < numInputs) ? ASIOTrue : ASIOFalse;
+		info.channelNum = info.isInput ? context->inputChannels[i] : context->outputChannels[i - numInputs];
+		HR_ASSERT_OK(context->initializeChannelInfo(info));
+	}
 
 	// Create buffers for input and output.
 	long minSize, maxSize, preferredSize, granularity;
 	ASIO_ASSERT_OK(asio->getBufferSize(&minSize, &maxSize, &preferredSize, &granularity));
 	context->bufferSize = preferredSize;
-	ASIO_ASSERT_OK(asio->createBuffers(context->asioBufferInfos.get(), numChannels * 2, context->bufferSize, context->getAsioCallbacks()));
-	LOG4CPLUS_INFO(logger, "Created buffers: " << numChannels << "channels, Prepared buffer size=" << context->bufferSize);
+	ASIO_ASSERT_OK(asio->createBuffers(deviceBufferInfos, numInputs + numOutputs, context->bufferSize, context->getAsioCallbacks()));
+	LOG4CPLUS_INFO(logger, "Created buffers: " << numInputs << " input(s), " << numOutputs << " output(s), Prepared buffer size=" << context->bufferSize);
+
+	// Allocate buffer infos for channel * 2(in and out).
+	// Buffers of channels not armed are set by allocateBuffers().
+	context->asioBufferInfos.reset(new ASIOBufferInfo[numChannels * 2]);
+	ZeroMemory(context->asioBufferInfos.get(), sizeof(ASIOBufferInfo) * numChannels * 2);
+	for (long channel = 0; channel < numInputs; channel++) context->getInputBufferInfo(channel) = deviceBufferInfos[channel];
+	for (long channel = 0; channel < numOutputs; channel++) context->getOutputBufferInfo(channel) = deviceBufferInfos[numInputs + channel];
+
+	// Prepare effects for the buffers.
+	ASIO_ASSERT_OK(asio->getSampleRate(&context->sampleRate));
+	// Chains other than the latest are prepared for the previous buffers and hold blocks of the arena.
+	HR_ASSERT_OK(context->effectChains.flush());
+	{
+		// The UI thread may publish another chain meanwhile.
+		CEffectChainSwapper::Latest effectChain(context->effectChains);
+		HR_ASSERT_OK(allocateBuffers(effectChain.get()));
+		LOG4CPLUS_INFO(logger, "Sample rate=" << context->sampleRate << ", " << effectChain->getEffectCount() << " effect(s)");
+	}
+	context->processInputs.resize(numChannels);
+	context->processOutputs.resize(numChannels);
+	// The engine runs without the shared tap if shared memory is not available.
+	HR_EXPECT_OK(context->sharedTap.open(numChannels, context->bufferSize, context->sampleType, context->sampleSize, context->sampleRate));
+	HR_EXPECT_OK(context->traceRecorder.setFormat(numChannels, context->bufferSize, context->sampleType, context->sampleSize, context->sampleRate, &context->getInputBufferInfo(0)));
+	long calibratedLatency = 0;
+	HR_EXPECT_OK(CLatencyMeter::loadCalibration(context->driverInfo.name, context->sampleRate, context->bufferSize, &calibratedLatency));
+	context->calibratedLatency.store(calibratedLatency, std::memory_order_relaxed);
 
 	// Set 0 to all buffers.
-	context->forInChannels([this](long channel, ASIOBufferInfo&in, ASIOBufferInfo&out) {
-		ZeroMemory(in.buffers[0], context->bufferSize);
-		ZeroMemory(in.buffers[1], context->bufferSize);
-		ZeroMemory(out.buffers[0], context->bufferSize);
-		ZeroMemory(out.buffers[1], context->bufferSize);
+	long bufferBytes = context->getBufferBytes();
+	context->forInChannels([bufferBytes](long channel, ASIOBufferInfo&in, ASIOBufferInfo&out) {
+		ZeroMemory(in.buffers[0], bufferBytes);
+		ZeroMemory(in.buffers[1], bufferBytes);
+		ZeroMemory(out.buffers[0], bufferBytes);
+		ZeroMemory(out.buffers[1], bufferBytes);
 
 		return S_OK;
 	});
 
+	if (context->lookaheadBuffers) {
+		LOG4CPLUS_INFO(logger, "Lookahead mode: " << context->lookaheadBuffers << " buffer(s), Added latency=" << context->getAddedLatency());
+	}
+
+	HR_ASSERT_OK(context->updateLatencies());
+	if (context->getAddedLatency() || calibratedLatency) {
+		// Notify that latency has been changed by lookahead mode, effects or calibration.
+		CComPtr<CAsioHandlerEvent> latenciesChanged(new AsioLatenciesChangedEvent());
+		HR_EXPECT_OK(context->triggerEvent(latenciesChanged));
+	}
+
+	return S_OK;
+}
+
+/*
+	Allocates buffers of the effect chain and the engine from the arena.
+
+	Buffers are allocated from the heap first to measure the size of the arena, so that
+	exhaustion of the arena fails setup instead of the real-time thread.
+	When buffers are re-created, this frees the blocks allocated from the arena for the previous buffers,
+	so that the arena can be replaced by the size of the new buffers.
+*/
+HRESULT CAsioHandlerState::allocateBuffers(CEffectChain* effectChain)
+{
+	size_t chainSize = 0, engineSize = 0;
+	{
+		CRealTimeArena::Meter meter(&chainSize);
+		HR_ASSERT_OK(effectChain->prepare(context->numChannels, context->bufferSize, context->sampleRate, context->sampleType));
+	}
+	{
+		CRealTimeArena::Meter meter(&engineSize);
+		HR_ASSERT_OK(context->allocateBuffers());
+	}
+	// Other chains that hold blocks have been deleted by CEffectChainSwapper::flush().
+	HR_ASSERT(!context->arena.getUsed(), E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT_OK(context->arena.reserve(engineSize + chainSize * CAsioHandlerContext::ArenaChains));
+
+	CRealTimeArena::Scope scope(&context->arena);
+	HR_ASSERT_OK(effectChain->prepare(context->numChannels, context->bufferSize, context->sampleRate, context->sampleType));
+	HR_ASSERT_OK(context->allocateBuffers());
+	LOG4CPLUS_INFO(logger, "Arena: Chain=" << chainSize << " bytes, Engine=" << engineSize << " bytes, Used=" << context->arena.getUsed() << " of " << context->arena.getCapacity() << " bytes");
+	return S_OK;
+}
+
+/*
+	Disposes buffers and creates buffers of the channels armed by the event.
+
+	The driver should have been stopped.
+	Empty channels arm the count of channels requested by setup.
+	If buffers can not be created, no buffers are left until channels are armed again.
+*/
+HRESULT CAsioHandlerState::rearm(const ArmChannelsEvent* event)
+{
+	ASIO_ASSERT_OK(context->asio->disposeBuffers());
+	context->deviceBufferInfos.reset();
+	context->armedInputs = event->inputs;
+	context->armedOutputs = event->outputs;
+	HRESULT hr = createBuffers(context->setupChannels);
+	if (FAILED(hr)) {
+		// Buffers may have been created by the driver before the failure.
+		context->asio->disposeBuffers();
+		context->deviceBufferInfos.reset();
+	}
+	return hr;
+}
+
+HRESULT CAsioHandlerState::startDriver()
+{
+	// Buffers have been disposed if re-arming failed.
+	HR_ASSERT(context->deviceBufferInfos, E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT_OK(context->primeLookahead());
+	HR_ASSERT_OK(context->spectrumAnalyzer.start());
+	context->sampleClock.reset(context->sampleRate);
+	HR_EXPECT_OK(context->outputRenderer.start(context->numChannels, context->bufferSize, context->sampleType, context->sampleRate));
+	ASIO_ASSERT_OK(context->asio->start());
+	return S_OK;
+}
+
+HRESULT CAsioHandlerState::stopDriver()
+{
+	ASIO_ASSERT_OK(context->asio->stop());
+	context->spectrumAnalyzer.stop();
+	context->outputRenderer.stop();
+	LOG4CPLUS_INFO(logger, "Sample clock: Estimated sample rate=" << context->sampleClock.getEstimate().sampleRate
+		<< ", Drift=" << context->sampleClock.getDriftPpm() << " ppm, Resets=" << context->sampleClock.getResetCount());
+
+	// TODO: Notify CAsioHandlerContext::Statistics to user.
 	return S_OK;
 }
 
@@ -131,9 +259,16 @@ HRESULT StandbyState::handleEvent(const CAsioHandlerEvent * event, CAsioHandlerS
 {
 	switch (event->type) {
 	case EventTypes::Start:
-		ASIO_ASSERT_OK(context->asio->start());
+		HR_ASSERT_OK(startDriver());
 		*nextState = new RunningState(this);
 		break;
+	case EventTypes::ArmChannels:
+		{
+			const ArmChannelsEvent* ev;
+			HR_ASSERT_OK(event->cast(&ev));
+			HR_ASSERT_OK(rearm(ev));
+		}
+		break;
 	default:
 		return CAsioHandlerState::handleEvent(event, nextState);
 	}
@@ -144,12 +279,20 @@ HRESULT RunningState::handleEvent(const CAsioHandlerEvent * event, CAsioHandlerS
 {
 	switch (event->type) {
 	case EventTypes::Stop:
-		ASIO_ASSERT_OK(context->asio->stop());
-
-		// TODO: Notify CAsioHandlerContext::Statistics to user.
-
+		HR_ASSERT_OK(stopDriver());
 		*nextState = new StandbyState(this);
 		break;
+	case EventTypes::ArmChannels:
+		{
+			const ArmChannelsEvent* ev;
+			HR_ASSERT_OK(event->cast(&ev));
+			HR_ASSERT_OK(stopDriver());
+			// Goes to standby state if the driver can not be restarted with the channels.
+			HRESULT hr = rearm(ev);
+			if (SUCCEEDED(hr)) hr = startDriver();
+			if (FAILED(hr)) *nextState = new StandbyState(this);
+			return hr;
+		}
 	case EventTypes::Data:
 		{
 			const DataEvent* ev;
@@ -165,10 +308,20 @@ HRESULT RunningState::handleEvent(const CAsioHandlerEvent * event, CAsioHandlerS
 
 HRESULT RunningState::handleData(const ASIOTime & params, long doubleBufferIndex)
 {
-	context->forInChannels([this, doubleBufferIndex](long /*channel*/, ASIOBufferInfo&in, ASIOBufferInfo&out) {
-		CopyMemory(out.buffers[doubleBufferIndex], in.buffers[doubleBufferIndex], context->bufferSize);
+	if (context->lookaheadBuffers) {
+		return handleLookahead();
+	}
+
+	context->forInChannels([this, doubleBufferIndex](long channel, ASIOBufferInfo&in, ASIOBufferInfo&out) {
+		context->processInputs[channel] = in.buffers[doubleBufferIndex];
+		context->processOutputs[channel] = out.buffers[doubleBufferIndex];
 		return S_OK;
 	});
+	process();
+	context->latencyMeter.process(&context->processInputs[0], &context->processOutputs[0]);
+	context->spectrumAnalyzer.tap(&context->processOutputs[0]);
+	context->sharedTap.write(&context->processInputs[0], &context->processOutputs[0]);
+	context->outputRenderer.write(&context->processOutputs[0]);
 
 	// Notify the driver that output data is available if supported.
 	if (context->driverInfo.isOutputReadySupported) {
@@ -177,3 +330,54 @@ HRESULT RunningState::handleData(const ASIOTime & params, long doubleBufferIndex
 
 	return S_OK;
 }
+
+/*
+	Processes processInputs into processOutputs by the effect chain.
+
+	Samples that can't be converted to float are copied without effects, as the driver would pass them through.
+*/
+void RunningState::process()
+{
+	if (context->passThrough) {
+		for (long channel = 0; channel < context->numChannels; channel++) {
+			CopyMemory(context->processOutputs[channel], context->processInputs[channel], context->getBufferBytes());
+		}
+		return;
+	}
+	context->effectChains.process(&context->processInputs[0], &context->processOutputs[0], context->bufferSize);
+}
+
+/*
+	Processes all input buffers captured in lookahead mode.
+
+	Processed buffers are output by the driver thread.
+	See CAsioHandlerContext::transferLookahead().
+*/
+HRESULT RunningState::handleLookahead()
+{
+	CBlockFifo& input = context->lookaheadInput;
+	CBlockFifo& output = context->lookaheadOutput;
+	long bufferBytes = context->getBufferBytes();
+
+	const BYTE* inputBlock;
+	while ((inputBlock = input.getReadableBlock()) != NULL) {
+		BYTE* outputBlock = output.getWritableBlock();
+		if (!outputBlock) break;
+
+		// Each block contains buffers of all channels.
+		for (long channel = 0; channel < context->numChannels; channel++) {
+			context->processInputs[channel] = &inputBlock[channel * bufferBytes];
+			context->processOutputs[channel] = &outputBlock[channel * bufferBytes];
+		}
+		process();
+		context->latencyMeter.process(&context->processInputs[0], &context->processOutputs[0]);
+		context->spectrumAnalyzer.tap(&context->processOutputs[0]);
+		context->sharedTap.write(&context->processInputs[0], &context->processOutputs[0]);
+		context->outputRenderer.write(&context->processOutputs[0]);
+
+		output.push();
+		input.pop();
+	}
+
+	return S_OK;
+}
@@ -29,6 +29,12 @@ public:
 protected:
 	CAsioHandlerState(Types type, CAsioHandlerState* previousState);
 
+	HRESULT createBuffers(int requestedChannels);
+	HRESULT allocateBuffers(CEffectChain* effectChain);
+	HRESULT rearm(const ArmChannelsEvent* event);
+	HRESULT startDriver();
+	HRESULT stopDriver();
+
 	// CAsioHandler object that holds context values.
 	CAsioHandlerContext* context;
 };
@@ -60,4 +66,6 @@ public:
 
 protected:
 	HRESULT handleData(const ASIOTime& params, long doubleBufferIndex);
+	HRESULT handleLookahead();
+	void process();
 };
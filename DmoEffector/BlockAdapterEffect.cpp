@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "BlockAdapterEffect.h"
+#include "VectorOps.h"
+
+CBlockAdapterEffect::CBlockAdapterEffect(CEffect* effect, long blockSize /*= 0*/)
+	: m_effect(effect), m_process(NULL), m_context(NULL), m_blockSize(blockSize ? blockSize : effect->getPreferredBlockSize())
+	, m_isFastPath(false), m_position(0), m_fill(0)
+{
+}
+
+HRESULT CBlockAdapterEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT(0 < m_blockSize, E_INVALIDARG);
+	HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+	HR_ASSERT_OK(m_effect->prepare(numChannels, m_blockSize, sampleRate));
+	m_process = m_effect->getProcessFunction(&m_context);
+	HR_ASSERT(m_process, E_UNEXPECTED);
+
+	m_isFastPath = (m_blockSize == maxFrames) && !m_effect->requiresFullBlock();
+	m_position = 0;
+	m_fill = 0;
+	if (!m_isFastPath) {
+		m_inputs.reset(new float*[numChannels]);
+		m_outputs.reset(new float*[numChannels]);
+		for (int i = 0; i < 2; i++) {
+			m_blocks[i].reset(new CAlignedBuffer<float>[numChannels]);
+			for (long channel = 0; channel < numChannels; channel++) {
+				HR_ASSERT_OK(m_blocks[i][channel].allocate(m_blockSize));
+			}
+		}
+		for (long channel = 0; channel < numChannels; channel++) {
+			m_inputs[channel] = m_blocks[0][channel];
+			m_outputs[channel] = m_blocks[1][channel];
+		}
+	}
+	return S_OK;
+}
+
+long CBlockAdapterEffect::getLatency() const
+{
+	return m_effect->getLatency() + (m_isFastPath ? 0 : m_blockSize - 1);
+}
+
+/*
+	Renders parameters of the effect in the fast path.
+	Otherwise parameters are rendered by processBlock() for the block and position is saved here.
+*/
+void CBlockAdapterEffect::renderParameters(LONGLONG position, long frames)
+{
+	if (m_isFastPath) {
+		m_effect->renderParameters(position, frames);
+	} else {
+		m_position = position;
+	}
+}
+
+/*
+	Output sample is the input sample blockSize - 1 samples before.
+
+	When input is written at position m_fill of the block, output is taken from position m_fill + 1 of the block processed before.
+	When the block is filled, it is processed and its first sample is output.
+*/
+void CBlockAdapterEffect::process(float* const* channels, long numChannels, long frames)
+{
+	if (m_isFastPath) {
+		m_process(m_context, channels, channels, (uint32_t)frames);
+		return;
+	}
+
+	for (long done = 0; done < frames; ) {
+		long count = min(frames - done, m_blockSize - m_fill);
+		bool isFilled = (m_fill + count == m_blockSize);
+		long fromPrevious = isFilled ? count - 1 : count;
+		for (long channel = 0; channel < numChannels; channel++) {
+			float* samples = &channels[channel][done];
+			vecCopy(&m_inputs[channel][m_fill], samples, count);
+			vecCopy(samples, &m_outputs[channel][m_fill + 1], fromPrevious);
+		}
+
+		if (isFilled) {
+			processBlock(m_position + done + count - m_blockSize);
+			for (long channel = 0; channel < numChannels; channel++) {
+				channels[channel][done + count - 1] = m_outputs[channel][0];
+			}
+			m_fill = 0;
+		} else {
+			m_fill += count;
+		}
+		done += count;
+	}
+}
+
+/*
+	Processes the filled block.
+
+	position: Position of the first sample of the block.
+*/
+void CBlockAdapterEffect::processBlock(LONGLONG position)
+{
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		std::swap(m_inputs[channel], m_outputs[channel]);
+	}
+	m_effect->renderParameters(position, m_blockSize);
+	m_process(m_context, m_outputs.get(), m_outputs.get(), (uint32_t)m_blockSize);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Effect.h"
+
+/*
+	Effect that runs another effect in fixed block size regardless of the size of ASIO buffer.
+
+	Input samples are accumulated until a block is filled. Output is taken from the block processed before.
+	Added latency is blockSize - 1 samples, which is the minimum to process samples in fixed block.
+	If the block size equals maxFrames passed to prepare(), samples are passed to the effect directly without latency
+	unless the effect requires full block.
+
+	Parameters of the effect are rendered at the position of the block processed by the effect.
+*/
+class CBlockAdapterEffect : public CEffect
+{
+public:
+	// Takes ownership of the effect.
+	// If blockSize is 0, CEffect::getPreferredBlockSize() of the effect is used.
+	CBlockAdapterEffect(CEffect* effect, long blockSize = 0);
+
+	virtual LPCTSTR getName() const { return m_effect->getName(); }
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual ProcessFunction getProcessFunction(void** context) { *context = this; return processEffectOf<CBlockAdapterEffect>; }
+	virtual long getLatency() const;
+
+	virtual DWORD getParameterCount() const { return m_effect->getParameterCount(); }
+	virtual CEffectParameter* getParameter(DWORD index) const { return m_effect->getParameter(index); }
+	virtual void renderParameters(LONGLONG position, long frames);
+
+	long getBlockSize() const { return m_blockSize; }
+	bool isFastPath() const { return m_isFastPath; }
+
+protected:
+	void processBlock(LONGLONG position);
+
+	std::unique_ptr<CEffect> m_effect;
+	// Process function of the effect returned after it is prepared.
+	ProcessFunction m_process;
+	void* m_context;
+	const long m_blockSize;
+	bool m_isFastPath;
+
+	// Position of the first sample passed to process() saved by renderParameters().
+	LONGLONG m_position;
+
+	// Block being filled by input and block processed before, for each channel.
+	// They are swapped when the block is processed.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_blocks[2];
+	std::unique_ptr<float*[]> m_inputs;
+	std::unique_ptr<float*[]> m_outputs;
+	long m_fill;
+};
@@ -0,0 +1,55 @@
+#include "stdafx.h"
+#include "BlockFifo.h"
+
+CBlockFifo::CBlockFifo()
+	: m_blockSize(0), m_numBlocks(0), m_writeCount(0), m_readCount(0)
+{
+}
+
+HRESULT CBlockFifo::initialize(size_t blockSize, long numBlocks)
+{
+	HR_ASSERT(0 < blockSize, E_INVALIDARG);
+	HR_ASSERT(0 < numBlocks, E_INVALIDARG);
+
+	HR_ASSERT_OK(m_buffer.allocate(blockSize * numBlocks));
+	m_blockSize = blockSize;
+	m_numBlocks = numBlocks;
+	reset();
+	return S_OK;
+}
+
+/*
+	Discards all blocks.
+
+	Should not be called while producer or consumer is running.
+*/
+void CBlockFifo::reset()
+{
+	m_writeCount.store(0, std::memory_order_relaxed);
+	m_readCount.store(0, std::memory_order_relaxed);
+	m_buffer.clear();
+}
+
+BYTE * CBlockFifo::getWritableBlock()
+{
+	unsigned long write = m_writeCount.load(std::memory_order_relaxed);
+	unsigned long read = m_readCount.load(std::memory_order_acquire);
+	return ((long)(write - read) < m_numBlocks) ? getBlock(write) : NULL;
+}
+
+void CBlockFifo::push()
+{
+	m_writeCount.fetch_add(1, std::memory_order_release);
+}
+
+const BYTE * CBlockFifo::getReadableBlock() const
+{
+	unsigned long read = m_readCount.load(std::memory_order_relaxed);
+	unsigned long write = m_writeCount.load(std::memory_order_acquire);
+	return (read != write) ? getBlock(read) : NULL;
+}
+
+void CBlockFifo::pop()
+{
+	m_readCount.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+#include "AlignedBuffer.h"
+
+/*
+	FIFO of fixed size blocks for one producer thread and one consumer thread.
+
+	Neither producer nor consumer blocks.
+	Memory is allocated by initialize() method and is never allocated while running.
+*/
+class CBlockFifo
+{
+	DISALLOW_COPY_AND_ASSIGN(CBlockFifo);
+
+public:
+	CBlockFifo();
+
+	HRESULT initialize(size_t blockSize, long numBlocks);
+	void reset();
+
+	// Producer side.
+	// Returns NULL if the FIFO is full.
+	BYTE* getWritableBlock();
+	void push();
+
+	// Consumer side.
+	// Returns NULL if the FIFO is empty.
+	const BYTE* getReadableBlock() const;
+	void pop();
+
+	long getCount() const { return (long)(m_writeCount.load(std::memory_order_acquire) - m_readCount.load(std::memory_order_acquire)); }
+	long getNumBlocks() const { return m_numBlocks; }
+	size_t getBlockSize() const { return m_blockSize; }
+
+protected:
+	BYTE* getBlock(unsigned long count) const { return &m_buffer[(count % m_numBlocks) * m_blockSize]; }
+
+	CAlignedBuffer<BYTE> m_buffer;
+	size_t m_blockSize;
+	long m_numBlocks;
+
+	// Total count of blocks pushed and popped.
+	std::atomic<unsigned long> m_writeCount;
+	std::atomic<unsigned long> m_readCount;
+};
@@ -0,0 +1,234 @@
+#include "stdafx.h"
+#include "ClockBridge.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("ClockBridge"));
+
+static const double Pi = 3.14159265358979323846;
+
+/*static*/ const double CClockBridge::MaxCorrection = 0.002;
+/*static*/ const double CClockBridge::FillTimeConstant = 1.0;
+/*static*/ const double CClockBridge::LoopFrequency = 0.02;
+/*static*/ const double CClockBridge::LoopDamping = 0.8;
+
+static double besselI0(double x);
+// Returns dot product of Taps input frames and coefficients interpolated between 2 phases.
+static float interpolate(const float* input, const float* phase0, const float* phase1, float fraction);
+
+CClockBridge::CClockBridge()
+	: m_numChannels(0), m_inputRate(0), m_outputRate(0), m_nominalStep(0), m_targetFill(0), m_size(0)
+	, m_written(0), m_released(0)
+	, m_isPrimed(false), m_index(0), m_fraction(0), m_filteredError(0), m_smoothedError(0), m_integral(0), m_correction(0)
+	, m_overflows(0), m_underruns(0), m_correctionPpm(0), m_fill(0)
+{
+}
+
+HRESULT CClockBridge::initialize(long numChannels, double inputRate, double outputRate, long maxInputFrames, long maxOutputFrames)
+{
+	HR_ASSERT(0 < numChannels, E_INVALIDARG);
+	HR_ASSERT((0 < inputRate) && (0 < outputRate), E_INVALIDARG);
+	HR_ASSERT((0 < maxInputFrames) && (0 < maxOutputFrames), E_INVALIDARG);
+
+	m_numChannels = numChannels;
+	m_inputRate = inputRate;
+	m_outputRate = outputRate;
+	m_nominalStep = inputRate / outputRate;
+
+	// Target should absorb a burst of the producer, a read of the consumer, frames of the filter
+	// and the transient of the controller. 20 milliseconds is added for the transient and jitter of threads.
+	const long readFrames = (long)ceil(maxOutputFrames * m_nominalStep * (1 + MaxCorrection));
+	m_targetFill = maxInputFrames + readFrames + Taps + (long)(inputRate * 0.02);
+
+	long size = 1;
+	while (size < (m_targetFill + maxInputFrames) * 2) size <<= 1;
+	m_size = size;
+	m_fifo.reset(new CAlignedBuffer<float>[numChannels]);
+	for (long channel = 0; channel < numChannels; channel++) {
+		HR_ASSERT_OK(m_fifo[channel].allocate(size + Taps));
+	}
+
+	// Kaiser windowed sinc. Cutoff is lowered to 90% of the lower Nyquist frequency.
+	// Sum of each phase is normalized to 1 so that DC gain doesn't depend on the phase.
+	HR_ASSERT_OK(m_coefficients.allocate((Phases + 1) * Taps));
+	const double cutoff = 0.9 * min(1.0, outputRate / inputRate);
+	const double beta = 8.0;
+	for (long phase = 0; phase <= Phases; phase++) {
+		float* h = &m_coefficients[phase * Taps];
+		double sum = 0;
+		for (long k = 0; k < Taps; k++) {
+			double t = k - (Taps / 2 - 1) - (double)phase / Phases;
+			double x = cutoff * t;
+			double sinc = (x == 0) ? 1 : sin(Pi * x) / (Pi * x);
+			double r = t / (Taps / 2);
+			double window = (fabs(r) < 1) ? besselI0(beta * sqrt(1 - r * r)) / besselI0(beta) : 0;
+			h[k] = (float)(sinc * window);
+			sum += h[k];
+		}
+		for (long k = 0; k < Taps; k++) h[k] = (float)(h[k] / sum);
+	}
+
+	reset();
+	LOG4CPLUS_INFO(logger, "Ratio=" << m_nominalStep << ", Target fill=" << m_targetFill << " frames, FIFO=" << size << " frames");
+	return S_OK;
+}
+
+/*
+	Discards all frames.
+*/
+void CClockBridge::reset()
+{
+	m_written.store(0, std::memory_order_relaxed);
+	m_released.store(0, std::memory_order_relaxed);
+	m_isPrimed = false;
+	m_index = 0;
+	m_fraction = 0;
+	m_filteredError = 0;
+	m_smoothedError = 0;
+	m_integral = 0;
+	m_correction = 0;
+	m_overflows = 0;
+	m_underruns = 0;
+	m_correctionPpm = 0;
+	m_fill = 0;
+}
+
+void CClockBridge::write(const float* const* channels, long frames)
+{
+	const LONGLONG written = m_written.load(std::memory_order_relaxed);
+	if (m_size < written + frames - m_released.load(std::memory_order_acquire)) {
+		m_overflows.store(getOverflows() + 1, std::memory_order_relaxed);
+		return;
+	}
+
+	const long mask = m_size - 1;
+	const long offset = (long)(written & mask);
+	const long first = min(frames, m_size - offset);
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		float* fifo = m_fifo[channel];
+		vecCopy(&fifo[offset], channels[channel], first);
+		vecCopy(fifo, &channels[channel][first], frames - first);
+		// Frames at the start of the FIFO are copied after the end.
+		if (offset < Taps) {
+			vecCopy(&fifo[m_size + offset], &fifo[offset], min(first, Taps - offset));
+		}
+		if (first < frames) {
+			vecCopy(&fifo[m_size], fifo, min(frames - first, (long)Taps));
+		}
+	}
+	m_written.store(written + frames, std::memory_order_release);
+}
+
+void CClockBridge::read(float* const* channels, long frames)
+{
+	const LONGLONG written = m_written.load(std::memory_order_acquire);
+	long done = 0;
+
+	if (!m_isPrimed) {
+		// Starts at the position where fill level is the target.
+		if (m_targetFill <= written - m_released.load(std::memory_order_relaxed) - (Taps / 2)) {
+			m_index = written - m_targetFill;
+			m_fraction = 0;
+			m_isPrimed = true;
+		}
+	}
+
+	if (m_isPrimed) {
+		updateController(frames);
+		const double step = m_nominalStep * (1 + m_correction);
+		const long integerStep = (long)floor(step);
+		const double fractionStep = step - integerStep;
+		const long mask = m_size - 1;
+
+		for (; (done < frames) && isReadable(written); done++) {
+			const double phase = m_fraction * Phases;
+			const long phaseIndex = (long)phase;
+			const float* h0 = &m_coefficients[phaseIndex * Taps];
+			const float* h1 = h0 + Taps;
+			const float fraction = (float)(phase - phaseIndex);
+			const long start = (long)((m_index - (Taps / 2 - 1)) & mask);
+			for (long channel = 0; channel < m_numChannels; channel++) {
+				channels[channel][done] = interpolate(&m_fifo[channel][start], h0, h1, fraction);
+			}
+
+			m_fraction += fractionStep;
+			const long carry = (long)m_fraction;
+			m_fraction -= carry;
+			m_index += integerStep + carry;
+		}
+
+		if (done < frames) {
+			// Restarts when the FIFO is filled again.
+			m_underruns.store(getUnderruns() + 1, std::memory_order_relaxed);
+			m_isPrimed = false;
+		}
+		m_released.store(m_index - (Taps / 2 - 1), std::memory_order_release);
+	} else {
+		// Frames not used while priming are released to make space.
+		const LONGLONG keep = min(written, (LONGLONG)m_targetFill + Taps / 2);
+		m_released.store(written - keep, std::memory_order_release);
+	}
+
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		vecClear(&channels[channel][done], frames - done);
+	}
+}
+
+/*
+	Updates correction of the step by PI controller of fill level.
+
+	Fill level is measured in seconds of the input at the position of the next output frame,
+	and is smoothed to remove the sawtooth caused by bursts of writes and reads.
+	Smoothing is much faster than the loop so that the loop stays stable.
+	Parameters of the loop are for the plant d(fill)/dt = drift - correction.
+*/
+void CClockBridge::updateController(long frames)
+{
+	const double dt = frames / m_outputRate;
+	const double fill = m_written.load(std::memory_order_relaxed) - (m_index + m_fraction);
+	m_fill.store(fill, std::memory_order_relaxed);
+	const double error = (fill - m_targetFill) / m_inputRate;
+	// Two stages of smoothing attenuate beat of the sawtooth that would modulate the step.
+	const double alpha = dt / (FillTimeConstant + dt);
+	m_filteredError += (error - m_filteredError) * alpha;
+	m_smoothedError += (m_filteredError - m_smoothedError) * alpha;
+
+	const double omega = 2 * Pi * LoopFrequency;
+	const double kp = 2 * LoopDamping * omega;
+	const double ki = omega * omega;
+	const double integral = m_integral + m_smoothedError * dt;
+	double correction = kp * m_smoothedError + ki * integral;
+	if (fabs(correction) < MaxCorrection) {
+		m_integral = integral;
+	} else {
+		// Integral is not updated while the correction is limited.
+		correction = (0 < correction) ? MaxCorrection : -MaxCorrection;
+	}
+	m_correction = correction;
+	m_correctionPpm.store(correction * 1e6, std::memory_order_relaxed);
+}
+
+static double besselI0(double x)
+{
+	double sum = 1, term = 1;
+	for (int k = 1; k < 50; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12) break;
+	}
+	return sum;
+}
+
+// Coefficients should be aligned and Taps should be multiple of 4.
+static float interpolate(const float* input, const float* phase0, const float* phase1, float fraction)
+{
+	const __m128 f = _mm_set1_ps(fraction);
+	__m128 sum = _mm_setzero_ps();
+	for (long k = 0; k < CClockBridge::Taps; k += 4) {
+		__m128 h0 = _mm_load_ps(&phase0[k]);
+		__m128 h = _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&phase1[k]), h0), f));
+		sum = _mm_add_ps(sum, _mm_mul_ps(h, _mm_loadu_ps(&input[k])));
+	}
+	float s[4];
+	_mm_storeu_ps(s, sum);
+	return (s[0] + s[1]) + (s[2] + s[3]);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+
+#include "AlignedBuffer.h"
+
+/*
+	Bridge of samples between two threads driven by independent clocks.
+
+	The producer writes frames of its clock domain, for example the ASIO buffers, to FIFO of each channel.
+	The consumer reads frames of the other clock domain, resampling the FIFO by polyphase filter
+	whose step is controlled by fill level of the FIFO.
+
+	Step of the resampler is inputRate / outputRate * (1 + correction).
+	correction is computed by PI controller from error of the smoothed fill level to the target,
+	so that the FIFO never underflows or overflows however long the clocks drift apart.
+
+	Filter of the resampler reads input frames directly from the FIFO.
+	FIFO of each channel has copy of the first Taps frames after its end, so that the filter never wraps.
+*/
+class CClockBridge
+{
+	DISALLOW_COPY_AND_ASSIGN(CClockBridge);
+
+public:
+	CClockBridge();
+
+	/*
+		Called while neither producer nor consumer is running.
+
+		maxInputFrames: Maximum count of frames written at a time.
+		maxOutputFrames: Maximum count of frames read at a time.
+	*/
+	HRESULT initialize(long numChannels, double inputRate, double outputRate, long maxInputFrames, long maxOutputFrames);
+	void reset();
+
+	// Called by the producer thread.
+	// Frames are dropped if the FIFO doesn't have enough space.
+	void write(const float* const* channels, long frames);
+
+	// Called by the consumer thread.
+	// Silence is output until the FIFO is filled up to the target fill level, and after underrun.
+	void read(float* const* channels, long frames);
+
+	// Called by any thread.
+	long getOverflows() const { return m_overflows.load(std::memory_order_relaxed); }
+	long getUnderruns() const { return m_underruns.load(std::memory_order_relaxed); }
+	// Returns ratio correction of the resampler in ppm.
+	double getCorrectionPpm() const { return m_correctionPpm.load(std::memory_order_relaxed); }
+	// Returns fill level of the FIFO in input frames before the last read.
+	double getFill() const { return m_fill.load(std::memory_order_relaxed); }
+
+	long getNumChannels() const { return m_numChannels; }
+	// Returns fill level that the controller keeps in input frames. This is the latency added by the bridge.
+	long getTargetFill() const { return m_targetFill; }
+
+	static const long Taps = 32;
+	static const long Phases = 256;
+	// Limit of the correction of the ratio.
+	static const double MaxCorrection;
+	// Time constant of smoothing fill level in seconds.
+	static const double FillTimeConstant;
+	// Natural frequency and damping ratio of the control loop.
+	static const double LoopFrequency;
+	static const double LoopDamping;
+
+protected:
+	void updateController(long frames);
+	// Returns true if input frames necessary to output a frame have been written.
+	bool isReadable(LONGLONG written) const { return m_index + Taps / 2 < written; }
+
+	long m_numChannels;
+	double m_inputRate;
+	double m_outputRate;
+	double m_nominalStep;			// inputRate / outputRate
+	long m_targetFill;
+
+	// FIFO of each channel. Size is m_size + Taps.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_fifo;
+	long m_size;					// Power of 2.
+	std::atomic<LONGLONG> m_written;	// Count of frames written.
+	std::atomic<LONGLONG> m_released;	// Count of frames no longer used by the consumer.
+
+	// Coefficients of (Phases + 1) phases, each of Taps.
+	// Phase p is the filter for the fraction p / Phases of the input position.
+	CAlignedBuffer<float> m_coefficients;
+
+	// State of the consumer.
+	bool m_isPrimed;				// False while waiting for the target fill level.
+	LONGLONG m_index;				// Integer part of the input position of the next output frame.
+	double m_fraction;				// Fraction part of the input position.
+	double m_filteredError;			// Error of fill level in seconds smoothed by the first stage.
+	double m_smoothedError;			// Error smoothed by the second stage.
+	double m_integral;
+	double m_correction;
+
+	std::atomic<long> m_overflows;
+	std::atomic<long> m_underruns;
+	std::atomic<double> m_correctionPpm;
+	std::atomic<double> m_fill;
+};
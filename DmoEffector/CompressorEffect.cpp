@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "CompressorEffect.h"
+#include "VectorOps.h"
+
+// log2(10) / 20: Converts dB to log2 of linear value.
+static const float DbToLog2 = 0.16609640f;
+
+static const double Pi = 3.14159265358979323846;
+
+CCompressorEffect::CCompressorEffect(Mode mode /*= Mode::Compressor*/, double lookaheadTime /*= 0.005*/, long sidechainChannels /*= 0*/)
+	: m_mode(mode), m_lookaheadTime(lookaheadTime), m_sidechainChannels(sidechainChannels)
+	, m_mainChannels(0), m_lookahead(0), m_detectorDelay(0)
+	, m_dequeHead(0), m_dequeCount(0), m_samplePosition(0)
+	, m_averageIndex(0), m_averageSum(0), m_releasedGain(1.0f)
+{
+	addParameter(new CEffectParameter(_T("Threshold"), -60.0f, 0.0f, 0.0f));
+	addParameter(new CEffectParameter(_T("Ratio"), 1.0f, 20.0f, 1.0f));
+	addParameter(new CEffectParameter(_T("Release"), 1.0f, 1000.0f, 100.0f, CEffectParameter::Smoothing::None));
+	addParameter(new CEffectParameter(_T("Makeup"), 0.0f, 24.0f, 0.0f));
+}
+
+HRESULT CCompressorEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT((0 <= m_sidechainChannels) && (m_sidechainChannels < numChannels), E_INVALIDARG);
+	HR_ASSERT(0 <= m_lookaheadTime, E_INVALIDARG);
+	HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+
+	m_mainChannels = numChannels - m_sidechainChannels;
+	m_lookahead = (long)floor(m_lookaheadTime * sampleRate + 0.5);
+	m_detectorDelay = (m_mode == Mode::Limiter) ? TruePeakTaps / 2 - 1 : 0;
+
+	HR_ASSERT_OK(m_level.allocate(maxFrames));
+	HR_ASSERT_OK(m_gain.allocate(maxFrames));
+	HR_ASSERT_OK(m_scratch.allocate(maxFrames));
+	m_delayLines.reset(new CDelayLine[m_mainChannels]);
+	for (long channel = 0; channel < m_mainChannels; channel++) {
+		HR_ASSERT_OK(m_delayLines[channel].initialize(m_lookahead + m_detectorDelay, maxFrames));
+	}
+
+	if (m_mode == Mode::Limiter) {
+		// Hann windowed sinc that interpolates at phase / TruePeakPhases between samples.
+		for (long phase = 1; phase < TruePeakPhases; phase++) {
+			float* h = m_truePeakFilter[phase - 1];
+			double sum = 0;
+			for (long k = 0; k < TruePeakTaps; k++) {
+				double t = k - (TruePeakTaps / 2 - 1) - (double)phase / TruePeakPhases;
+				double sinc = (t == 0) ? 1 : sin(Pi * t) / (Pi * t);
+				double window = 0.5 * (1 + cos(Pi * t / (TruePeakTaps / 2)));
+				h[k] = (float)(sinc * window);
+				sum += h[k];
+			}
+			for (long k = 0; k < TruePeakTaps; k++) h[k] = (float)(h[k] / sum);
+		}
+		long detectedChannels = m_sidechainChannels ? m_sidechainChannels : m_mainChannels;
+		m_history.reset(new CAlignedBuffer<float>[detectedChannels]);
+		for (long channel = 0; channel < detectedChannels; channel++) {
+			HR_ASSERT_OK(m_history[channel].allocate(TruePeakTaps - 1 + maxFrames));
+		}
+	}
+
+	long window = m_lookahead + 1;
+	HR_ASSERT_OK(m_dequeValues.allocate(window));
+	HR_ASSERT_OK(m_dequePositions.allocate(window));
+	m_dequeHead = m_dequeCount = 0;
+	m_samplePosition = 0;
+	HR_ASSERT_OK(m_average.allocate(window));
+	for (long i = 0; i < window; i++) m_average[i] = 1.0f;
+	m_averageIndex = 0;
+	m_averageSum = window;
+	m_releasedGain = 1.0f;
+	return S_OK;
+}
+
+void CCompressorEffect::process(float* const* channels, long /*numChannels*/, long frames)
+{
+	const float* const* detected = m_sidechainChannels ? &channels[m_mainChannels] : channels;
+	if (m_mode == Mode::Limiter) {
+		detectTruePeak(detected, frames);
+	} else {
+		detectLevel(detected, frames);
+	}
+	holdPeak(frames);
+	computeGain(frames);
+	smoothGain(frames);
+	applyMakeup(frames);
+
+	for (long channel = 0; channel < m_mainChannels; channel++) {
+		m_delayLines[channel].process(channels[channel], channels[channel], frames);
+		vecMultiply(channels[channel], m_gain, frames);
+	}
+}
+
+void CCompressorEffect::detectLevel(const float* const* channels, long frames)
+{
+	long detectedChannels = m_sidechainChannels ? m_sidechainChannels : m_mainChannels;
+	vecClear(m_level, frames);
+	for (long channel = 0; channel < detectedChannels; channel++) {
+		vecMaxAbsAccumulate(m_level, channels[channel], frames);
+	}
+}
+
+/*
+	Detects level as maximum of absolute value of samples and values interpolated between them.
+
+	Level at index i is the peak around the sample i - m_detectorDelay.
+*/
+void CCompressorEffect::detectTruePeak(const float* const* channels, long frames)
+{
+	long detectedChannels = m_sidechainChannels ? m_sidechainChannels : m_mainChannels;
+	vecClear(m_level, frames);
+	for (long channel = 0; channel < detectedChannels; channel++) {
+		float* history = m_history[channel];
+		vecCopy(&history[TruePeakTaps - 1], channels[channel], frames);
+
+		vecMaxAbsAccumulate(m_level, &history[TruePeakTaps / 2], frames);
+		for (long phase = 0; phase < TruePeakPhases - 1; phase++) {
+			vecClear(m_scratch, frames);
+			for (long k = 0; k < TruePeakTaps; k++) {
+				vecMultiplyAdd(m_scratch, &history[k], m_truePeakFilter[phase][k], frames);
+			}
+			vecMaxAbsAccumulate(m_level, m_scratch, frames);
+		}
+
+		memmove(history, &history[frames], sizeof(float) * (TruePeakTaps - 1));
+	}
+}
+
+/*
+	Replaces level with maximum of the level in the window of lookahead + 1 samples
+	using monotonic deque. Each sample is pushed and popped at most once.
+*/
+void CCompressorEffect::holdPeak(long frames)
+{
+	const long window = m_lookahead + 1;
+	for (long i = 0; i < frames; i++, m_samplePosition++) {
+		float level = m_level[i];
+		while (m_dequeCount && (m_dequeValues[(m_dequeHead + m_dequeCount - 1) % window] <= level)) {
+			m_dequeCount--;
+		}
+		if ((m_dequeCount == window) || (m_dequeCount && (m_dequePositions[m_dequeHead] <= m_samplePosition - window))) {
+			m_dequeHead = (m_dequeHead + 1) % window;
+			m_dequeCount--;
+		}
+		long tail = (m_dequeHead + m_dequeCount) % window;
+		m_dequeValues[tail] = level;
+		m_dequePositions[tail] = m_samplePosition;
+		m_dequeCount++;
+		m_level[i] = m_dequeValues[m_dequeHead];
+	}
+}
+
+/*
+	Computes target gain from the held level.
+	log2(gain) = (1 / ratio - 1) * max(0, log2(level) - log2(threshold))
+*/
+void CCompressorEffect::computeGain(long frames)
+{
+	const CEffectParameter* threshold = getParameter(Threshold);
+	const CEffectParameter* ratio = getParameter(Ratio);
+	const bool isLimiter = (m_mode == Mode::Limiter);
+
+	__m128 minLevel = _mm_set1_ps(1e-9f);
+	__m128 dbToLog2 = _mm_set1_ps(DbToLog2);
+	__m128 one = _mm_set1_ps(1.0f);
+	long i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 t = threshold->isConstant() ? _mm_set1_ps(threshold->getValue()) : _mm_loadu_ps(&threshold->getValues()[i]);
+		__m128 slope = _mm_set1_ps(-1.0f);
+		if (!isLimiter) {
+			__m128 r = ratio->isConstant() ? _mm_set1_ps(ratio->getValue()) : _mm_loadu_ps(&ratio->getValues()[i]);
+			slope = _mm_sub_ps(_mm_div_ps(one, r), one);
+		}
+		__m128 over = _mm_sub_ps(log2Ps(_mm_max_ps(_mm_loadu_ps(&m_level[i]), minLevel)), _mm_mul_ps(t, dbToLog2));
+		over = _mm_max_ps(over, _mm_setzero_ps());
+		_mm_storeu_ps(&m_gain[i], exp2Ps(_mm_mul_ps(slope, over)));
+	}
+	for (; i < frames; i++) {
+		float t = threshold->isConstant() ? threshold->getValue() : threshold->getValues()[i];
+		float slope = isLimiter ? -1.0f : 1.0f / (ratio->isConstant() ? ratio->getValue() : ratio->getValues()[i]) - 1.0f;
+		float over = max(0.0f, log2f(max(m_level[i], 1e-9f)) - t * DbToLog2);
+		m_gain[i] = exp2f(slope * over);
+	}
+}
+
+/*
+	Releases gain by one-pole filter and attacks immediately.
+	Then averages gain over the window so that gain reaches the target smoothly before the peak.
+*/
+void CCompressorEffect::smoothGain(long frames)
+{
+	const long window = m_lookahead + 1;
+	float coefficient = (float)exp(-1000.0 / (getParameter(Release)->getValue() * m_sampleRate));
+	float released = m_releasedGain;
+	for (long i = 0; i < frames; i++) {
+		float target = m_gain[i];
+		released = (target < released) ? target : target + coefficient * (released - target);
+
+		m_averageSum += released - m_average[m_averageIndex];
+		m_average[m_averageIndex] = released;
+		if (++m_averageIndex == window) m_averageIndex = 0;
+		m_gain[i] = (float)(m_averageSum / window);
+	}
+	m_releasedGain = released;
+}
+
+void CCompressorEffect::applyMakeup(long frames)
+{
+	const CEffectParameter* makeup = getParameter(Makeup);
+	if (makeup->isConstant()) {
+		if (makeup->getValue() != 0.0f) vecScale(m_gain, exp2f(makeup->getValue() * DbToLog2), frames);
+		return;
+	}
+
+	const float* values = makeup->getValues();
+	__m128 dbToLog2 = _mm_set1_ps(DbToLog2);
+	long i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 scale = exp2Ps(_mm_mul_ps(_mm_loadu_ps(&values[i]), dbToLog2));
+		_mm_storeu_ps(&m_gain[i], _mm_mul_ps(_mm_loadu_ps(&m_gain[i]), scale));
+	}
+	for (; i < frames; i++) m_gain[i] *= exp2f(values[i] * DbToLog2);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "DelayLine.h"
+#include "Effect.h"
+
+/*
+	Compressor and true peak limiter with lookahead.
+
+	Level is detected from main channels or sidechain channels and held by sliding window maximum
+	over lookahead time. Gain computed from the held level is released by one-pole filter and averaged over
+	lookahead time, while main channels are delayed by lookahead time. So gain reduction reaches
+	its target before the peak arrives.
+
+	In Limiter mode, ratio is infinite and level is detected from true peak estimated by
+	4x oversampling, so that output never exceeds the threshold (before makeup gain).
+
+	Last sidechainChannels channels of the node are used only to detect level and are not modified.
+	Connect other ASIO input channels to them by CEffectChain::connect().
+*/
+class CCompressorEffect : public CEffect
+{
+public:
+	ENUM(Mode,
+		Compressor,
+		Limiter
+	);
+
+	enum Parameters {
+		Threshold,		// Threshold in dB. -60.0 to 0.0, neutral value is 0.0.
+		Ratio,			// Compression ratio. 1.0 to 20.0, neutral value is 1.0. Not used in Limiter mode.
+		Release,		// Release time in milliseconds. 1.0 to 1000.0, neutral value is 100.0.
+		Makeup,			// Makeup gain in dB. 0.0 to 24.0, neutral value is 0.0.
+	};
+
+	CCompressorEffect(Mode mode = Mode::Compressor, double lookaheadTime = 0.005, long sidechainChannels = 0);
+
+	virtual LPCTSTR getName() const { return (m_mode == Mode::Limiter) ? _T("Limiter") : _T("Compressor"); }
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual ProcessFunction getProcessFunction(void** context) { *context = this; return processEffectOf<CCompressorEffect>; }
+	virtual long getLatency() const { return m_lookahead + m_detectorDelay; }
+
+	// Count of taps of each phase of the filter to estimate true peak.
+	static const long TruePeakTaps = 8;
+	static const long TruePeakPhases = 4;
+
+protected:
+	void detectLevel(const float* const* channels, long frames);
+	void detectTruePeak(const float* const* channels, long frames);
+	void holdPeak(long frames);
+	void computeGain(long frames);
+	void smoothGain(long frames);
+	void applyMakeup(long frames);
+
+	const Mode m_mode;
+	const double m_lookaheadTime;
+	const long m_sidechainChannels;
+	long m_mainChannels;
+	long m_lookahead;				// Lookahead in samples.
+	long m_detectorDelay;			// Delay of true peak filter in samples.
+
+	CAlignedBuffer<float> m_level;
+	CAlignedBuffer<float> m_gain;
+	CAlignedBuffer<float> m_scratch;
+	std::unique_ptr<CDelayLine[]> m_delayLines;
+
+	// Filter coefficients of each phase except phase 0 and history of samples of each detected channel.
+	float m_truePeakFilter[TruePeakPhases - 1][TruePeakTaps];
+	std::unique_ptr<CAlignedBuffer<float>[]> m_history;
+
+	// Monotonic deque for sliding window maximum of level.
+	// Values are decreasing from head to tail. Ring buffer whose capacity is the window size.
+	CAlignedBuffer<float> m_dequeValues;
+	CAlignedBuffer<LONGLONG> m_dequePositions;
+	long m_dequeHead;
+	long m_dequeCount;
+	LONGLONG m_samplePosition;
+
+	// Moving average of gain over the window.
+	CAlignedBuffer<float> m_average;
+	long m_averageIndex;
+	double m_averageSum;
+
+	float m_releasedGain;
+};
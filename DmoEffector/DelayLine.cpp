@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "DelayLine.h"
+#include "VectorOps.h"
+
+CDelayLine::CDelayLine()
+	: m_size(0), m_delay(0), m_writePosition(0)
+{
+}
+
+/*
+	Allocates ring buffer.
+
+	Samples written by process() are read before they are overwritten
+	if the size is greater than or equal to delay + frames.
+*/
+HRESULT CDelayLine::initialize(long delay, long maxFrames)
+{
+	HR_ASSERT((0 <= delay) && (0 < maxFrames), E_INVALIDARG);
+
+	m_delay = delay;
+	m_size = delay + maxFrames;
+	HR_ASSERT_OK(m_buffer.allocate(m_size));
+	m_writePosition = 0;
+	return S_OK;
+}
+
+void CDelayLine::reset()
+{
+	m_buffer.clear();
+	m_writePosition = 0;
+}
+
+void CDelayLine::process(const float * src, float * dst, long frames)
+{
+	long read = getReadPosition();
+	write(src, frames);
+
+	long count = min(frames, m_size - read);
+	vecCopy(dst, &m_buffer[read], count);
+	vecCopy(&dst[count], m_buffer, frames - count);
+}
+
+void CDelayLine::processAdd(const float * src, float * dst, long frames)
+{
+	long read = getReadPosition();
+	write(src, frames);
+
+	long count = min(frames, m_size - read);
+	vecAdd(dst, &m_buffer[read], count);
+	vecAdd(&dst[count], m_buffer, frames - count);
+}
+
+void CDelayLine::write(const float * src, long frames)
+{
+	long count = min(frames, m_size - m_writePosition);
+	vecCopy(&m_buffer[m_writePosition], src, count);
+	vecCopy(m_buffer, &src[count], frames - count);
+	m_writePosition = (m_writePosition + frames) % m_size;
+}
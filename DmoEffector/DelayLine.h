@@ -0,0 +1,34 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+
+/*
+	Delay line of float samples that delays input by fixed count of samples.
+
+	Ring buffer is allocated by initialize() method for the delay and the maximum frames processed at once.
+*/
+class CDelayLine
+{
+	DISALLOW_COPY_AND_ASSIGN(CDelayLine);
+
+public:
+	CDelayLine();
+
+	HRESULT initialize(long delay, long maxFrames);
+	void reset();
+	long getDelay() const { return m_delay; }
+
+	// Writes src and outputs samples delayed by getDelay() to dst. dst may be the same as src.
+	void process(const float* src, float* dst, long frames);
+	// Same as process() except that delayed samples are added to dst.
+	void processAdd(const float* src, float* dst, long frames);
+
+protected:
+	void write(const float* src, long frames);
+	long getReadPosition() const { return (m_writePosition + m_size - m_delay) % m_size; }
+
+	CAlignedBuffer<float> m_buffer;
+	long m_size;
+	long m_delay;
+	long m_writePosition;
+};
@@ -11,6 +11,7 @@ public:
 	~CSafeVariant() { VariantClear(&m_variant); }
 	VARIANT* operator &() { return &m_variant; }
 	operator LPCWSTR() { return m_variant.bstrVal; }
+	const VARIANT& get() const { return m_variant; }
 
 protected:
 	VARIANT m_variant;
@@ -80,6 +81,24 @@ LPCTSTR CDevice::getDevicePath()
 	return m_devicePath.c_str();
 }
 
+/*
+	Returns device ID of waveOut for the audio renderer.
+
+	Returns S_FALSE if the device is not a waveOut device, for example DirectSound renderer.
+*/
+HRESULT CDevice::getWaveOutId(UINT* pId)
+{
+	HR_ASSERT(pId, E_POINTER);
+	HR_ASSERT(m_moniker, E_ILLEGAL_METHOD_CALL);
+
+	CComPtr<IPropertyBag> prop;
+	HR_ASSERT_OK(m_moniker->BindToStorage(getBindCtx(), NULL, IID_PPV_ARGS(&prop)));
+	CSafeVariant id;
+	if (FAILED(prop->Read(L"WaveOutId", &id, 0)) || (id.get().vt != VT_I4)) return S_FALSE;
+	*pId = (UINT)id.get().lVal;
+	return S_OK;
+}
+
 IBindCtx* CDevice::getBindCtx()
 {
 	if (!m_bindCtx) {
@@ -12,6 +12,7 @@ public:
 	HRESULT getBaseFilter(IBaseFilter** ppBaseFilter);
 	LPCTSTR getName();
 	LPCTSTR getDevicePath();
+	HRESULT getWaveOutId(UINT* pId);
 
 protected:
 	IBindCtx* getBindCtx();
@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include "DmoEffector.h"
 #include "DmoEffectorDlg.h"
+#include "MainController.h"
 
 #include <log4cplus/configurator.h>
 
@@ -59,6 +60,39 @@ BOOL CDmoEffectorApp::InitInstance()
 	// Prepare using COM for DirectShow.
 	CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
 
+	// Loads effect plugins appended to the default effect chain, or the effect chain from the properties file, before other arguments.
+	// The application exits if the chain file has errors, which are logged.
+	// Usage: DmoEffector [/plugin:<library file>]... [/chain:<properties file>] [other arguments]
+	int first = 1;
+	for (; (first < __argc) && !_tcsnicmp(__targv[first], _T("/plugin:"), 8); first++) {
+		HR_EXPECT_OK(CMainController::loadEffectPlugin(&__targv[first][8]));
+	}
+	if ((first < __argc) && !_tcsnicmp(__targv[first], _T("/chain:"), 7)) {
+		if (FAILED(HR_EXPECT_OK(CMainController::loadEffectChainConfig(&__targv[first][7])))) return FALSE;
+		first++;
+	}
+
+	// Renders WAV files without showing the dialog.
+	// Usage: DmoEffector /render <output directory> [/buffer:<frames>] <input file>...
+	if ((first + 2 < __argc) && !_tcsicmp(__targv[first], _T("/render"))) {
+		int arg = first + 2;
+		long bufferSize = COfflineRenderer::DefaultBufferSize;
+		if (!_tcsnicmp(__targv[arg], _T("/buffer:"), 8)) {
+			bufferSize = _ttol(&__targv[arg++][8]);
+		}
+		std::vector<tstring> inputPaths(&__targv[arg], &__targv[__argc]);
+		HR_EXPECT_OK(CMainController::renderFiles(inputPaths, __targv[first + 1], bufferSize));
+		return FALSE;
+	}
+
+	// Replays the trace at the recorded timing, or as fast as possible with /fast.
+	// Usage: DmoEffector /replay <trace file> [/fast]
+	if ((first + 1 < __argc) && !_tcsicmp(__targv[first], _T("/replay"))) {
+		bool isRealTime = !((first + 2 < __argc) && !_tcsicmp(__targv[first + 2], _T("/fast")));
+		HR_EXPECT_OK(CMainController::replayTrace(__targv[first + 1], isRealTime));
+		return FALSE;
+	}
+
 	AfxEnableControlContainer();
 
 	// Create the shell manager, in case the dialog contains
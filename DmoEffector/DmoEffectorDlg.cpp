@@ -51,8 +51,12 @@ END_MESSAGE_MAP()
 
 
 
+/*static*/ const float CDmoEffectorDlg::MinSpectrumLevel = -90.0f;
+/*static*/ const LPCTSTR CDmoEffectorDlg::SharedTapName = _T("DmoEffectorTap");
+
 CDmoEffectorDlg::CDmoEffectorDlg(CWnd* pParent /*=NULL*/)
 	: CDialogEx(IDD_DMOEFFECTOR_DIALOG, pParent)
+	, m_spectrumChannel(-1)
 {
 	m_hIcon = AfxGetApp()->LoadIcon(IDR_MAINFRAME);
 }
@@ -63,6 +67,9 @@ void CDmoEffectorDlg::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_COMBO_INPUT_DEVIES, m_inputDeviceSel);
 	DDX_Control(pDX, IDC_COMBO_OUTPUT_DEVIES, m_outputDeviceSel);
 	DDX_Control(pDX, IDC_COMBO_ASIO_DRIVER, m_asioDriverSel);
+	DDX_Control(pDX, IDC_SLIDER_GAIN, m_gainSlider);
+	DDX_Control(pDX, IDC_COMBO_SPECTRUM, m_spectrumChannelSel);
+	DDX_Control(pDX, IDC_STATIC_SPECTRUM, m_spectrumArea);
 }
 
 BEGIN_MESSAGE_MAP(CDmoEffectorDlg, CDialogEx)
@@ -71,6 +78,9 @@ BEGIN_MESSAGE_MAP(CDmoEffectorDlg, CDialogEx)
 	ON_WM_QUERYDRAGICON()
 	ON_BN_CLICKED(ID_BUTTON_START, &CDmoEffectorDlg::OnBnClickedButtonStart)
 	ON_BN_CLICKED(ID_BUTTON_STOP, &CDmoEffectorDlg::OnBnClickedButtonStop)
+	ON_WM_HSCROLL()
+	ON_CBN_SELCHANGE(IDC_COMBO_SPECTRUM, &CDmoEffectorDlg::OnCbnSelchangeComboSpectrum)
+	ON_WM_TIMER()
 END_MESSAGE_MAP()
 
 template<class T>
@@ -138,6 +148,22 @@ BOOL CDmoEffectorDlg::OnInitDialog()
 	HR_EXPECT_OK(CDevice::createDeviceList(CLSID_AudioRendererCategory, m_outputDeviceList));
 	setupComboBox(m_outputDeviceList, noDeiceMessage, m_outputDeviceSel);
 
+	// Gain slider shows percentage. 100% is neutral value of CGainEffect.
+	m_gainSlider.SetRange(0, 200);
+	m_gainSlider.SetPos(100);
+
+	// Spectrum analyzer shows one channel selected by the combo box.
+	m_spectrumChannelSel.AddString(_T("Off"));
+	for (long channel = 0; channel < CSpectrumAnalyzer::MaxChannels; channel++) {
+		CString name;
+		name.Format(_T("Channel %d"), channel + 1);
+		m_spectrumChannelSel.AddString(name);
+	}
+	m_spectrumChannelSel.SetCurSel(0);
+	for (float& level : m_spectrumLevels) level = MinSpectrumLevel;
+	m_spectrogram.assign(SpectrogramWidth * CSpectrumAnalyzer::MaxBands, 0);
+	WIN32_EXPECT(SetTimer(SpectrumTimer, SpectrumInterval, NULL));
+
 	return TRUE;  // return TRUE  unless you set the focus to a control
 }
 
@@ -179,7 +205,8 @@ void CDmoEffectorDlg::OnPaint()
 	}
 	else
 	{
-		CDialogEx::OnPaint();
+		CPaintDC dc(this);
+		drawSpectrum(dc);
 	}
 }
 
@@ -204,6 +231,8 @@ void CDmoEffectorDlg::OnBnClickedButtonStart()
 	HRESULT hr = HR_EXPECT_OK(pAsioDriver->create(&asio));
 
 	if (SUCCEEDED(hr)) {
+		// All input and output channels are published for external analysis processes. See SharedTapRing.h.
+		m_mainController.setSharedTap(SharedTapName, ~0UL, ~0UL);
 		m_mainController.setup(asio, m_hWnd);
 
 		CDevice* inputDevice = (CDevice*)m_inputDeviceSel.GetItemDataPtr(m_inputDeviceSel.GetCurSel());
@@ -222,3 +251,121 @@ void CDmoEffectorDlg::OnBnClickedButtonStop()
 
 	m_mainController.shutdown();
 }
+
+
+void CDmoEffectorDlg::OnHScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar)
+{
+	if (pScrollBar == (CScrollBar*)&m_gainSlider) {
+		// Gain is changed while the slider is moving.
+		// CGainEffect smooths the change so that zipper noise is not produced.
+		m_mainController.setGain(m_gainSlider.GetPos() / 100.0f);
+	}
+
+	CDialogEx::OnHScroll(nSBCode, nPos, pScrollBar);
+}
+
+
+void CDmoEffectorDlg::OnCbnSelchangeComboSpectrum()
+{
+	m_spectrumChannel = m_spectrumChannelSel.GetCurSel() - 1;
+	m_mainController.setSpectrumChannels((0 <= m_spectrumChannel) ? (1 << m_spectrumChannel) : 0);
+
+	for (float& level : m_spectrumLevels) level = MinSpectrumLevel;
+	std::fill(m_spectrogram.begin(), m_spectrogram.end(), 0);
+	CRect rect;
+	m_spectrumArea.GetWindowRect(&rect);
+	ScreenToClient(&rect);
+	InvalidateRect(&rect, FALSE);
+}
+
+
+void CDmoEffectorDlg::OnTimer(UINT_PTR nIDEvent)
+{
+	if (nIDEvent == SpectrumTimer) {
+		updateSpectrum();
+	}
+
+	CDialogEx::OnTimer(nIDEvent);
+}
+
+// Converts level in dB to color of the spectrogram: black, blue, magenta, yellow and white.
+static DWORD levelToColor(float level, float minLevel)
+{
+	float x = max(0.0f, min(1.0f, 1 - level / minLevel)) * 4;
+	int r = (int)(255 * max(0.0f, min(1.0f, x - 1)));
+	int g = (int)(255 * max(0.0f, min(1.0f, x - 2)));
+	int b = (int)(255 * max(0.0f, min(1.0f, (x < 2) ? x : ((x < 3) ? 3 - x : x - 3))));
+	return (DWORD)((r << 16) | (g << 8) | b);
+}
+
+/*
+	Takes the latest frame from the spectrum analyzer if available.
+
+	The analyzer publishes frames by its own rate. Frames published between timer ticks are not shown.
+*/
+void CDmoEffectorDlg::updateSpectrum()
+{
+	if (m_spectrumChannel < 0) return;
+
+	CSpectrumAnalyzer& analyzer = m_mainController.getSpectrumAnalyzer();
+	if (!analyzer.update()) return;
+	const CSpectrumAnalyzer::Frame& frame = analyzer.getFrame();
+	if (!(frame.channelMask & (1 << m_spectrumChannel))) return;
+
+	const long bands = analyzer.getBandCount();
+	for (long band = 0; band < bands; band++) {
+		m_spectrumLevels[band] = frame.levels[m_spectrumChannel][band];
+
+		DWORD* row = &m_spectrogram[(bands - 1 - band) * SpectrogramWidth];
+		memmove(row, &row[1], sizeof(DWORD) * (SpectrogramWidth - 1));
+		row[SpectrogramWidth - 1] = levelToColor(m_spectrumLevels[band], MinSpectrumLevel);
+	}
+
+	CRect rect;
+	m_spectrumArea.GetWindowRect(&rect);
+	ScreenToClient(&rect);
+	InvalidateRect(&rect, FALSE);
+}
+
+/*
+	Draws bars of band levels and the spectrogram to the spectrum area through memory DC to avoid flicker.
+*/
+void CDmoEffectorDlg::drawSpectrum(CDC& dc)
+{
+	CRect area;
+	m_spectrumArea.GetWindowRect(&area);
+	ScreenToClient(&area);
+	const int width = area.Width();
+	const int barsHeight = area.Height() * 2 / 5;
+	const int spectrogramHeight = area.Height() - barsHeight;
+
+	CDC memDC;
+	memDC.CreateCompatibleDC(&dc);
+	CBitmap bitmap;
+	bitmap.CreateCompatibleBitmap(&dc, width, area.Height());
+	CBitmap* oldBitmap = memDC.SelectObject(&bitmap);
+	memDC.FillSolidRect(0, 0, width, area.Height(), RGB(0, 0, 0));
+
+	const long bands = m_mainController.getSpectrumAnalyzer().getBandCount();
+	for (long band = 0; band < bands; band++) {
+		float ratio = max(0.0f, min(1.0f, 1 - m_spectrumLevels[band] / MinSpectrumLevel));
+		int left = band * width / bands;
+		int right = (band + 1) * width / bands - 1;
+		int height = (int)(ratio * barsHeight);
+		memDC.FillSolidRect(left, barsHeight - height, max(1, right - left), height, RGB(0, 192, 64));
+	}
+
+	BITMAPINFO info;
+	ZeroMemory(&info, sizeof(info));
+	info.bmiHeader.biSize = sizeof(info.bmiHeader);
+	info.bmiHeader.biWidth = SpectrogramWidth;
+	info.bmiHeader.biHeight = -bands;		// Top-down.
+	info.bmiHeader.biPlanes = 1;
+	info.bmiHeader.biBitCount = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+	StretchDIBits(memDC, 0, barsHeight, width, spectrogramHeight, 0, 0, SpectrogramWidth, bands,
+		&m_spectrogram[0], &info, DIB_RGB_COLORS, SRCCOPY);
+
+	dc.BitBlt(area.left, area.top, width, area.Height(), &memDC, 0, 0, SRCCOPY);
+	memDC.SelectObject(oldBitmap);
+}
@@ -48,4 +48,30 @@ public:
 	CComboBox m_outputDeviceSel;
 	afx_msg void OnBnClickedButtonStop();
 	CComboBox m_asioDriverSel;
+	CSliderCtrl m_gainSlider;
+	afx_msg void OnHScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar);
+	CComboBox m_spectrumChannelSel;
+	CStatic m_spectrumArea;
+	afx_msg void OnCbnSelchangeComboSpectrum();
+	afx_msg void OnTimer(UINT_PTR nIDEvent);
+
+protected:
+	// Spectrum of the channel selected by m_spectrumChannelSel is drawn in the rectangle of m_spectrumArea.
+	// m_spectrumArea is invisible and only gives the rectangle.
+	// Upper part shows level of each band and lower part shows spectrogram scrolling to the left.
+	static const UINT_PTR SpectrumTimer = 1;
+	static const UINT SpectrumInterval = 33;	// Interval of updating the spectrum in milliseconds.
+	static const int SpectrogramWidth = 256;	// Count of frames shown by the spectrogram.
+	static const float MinSpectrumLevel;		// Level in dB shown at the bottom of bars.
+
+	// Name of shared memory to which the engine publishes channels.
+	static const LPCTSTR SharedTapName;
+
+	void updateSpectrum();
+	void drawSpectrum(CDC& dc);
+
+	long m_spectrumChannel;						// Channel shown. -1 if the spectrum is off.
+	float m_spectrumLevels[CSpectrumAnalyzer::MaxBands];
+	// Pixels of the spectrogram. Each row is a band from the highest and each column is a frame from the oldest.
+	std::vector<DWORD> m_spectrogram;
 };
@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "EchoCancellerEffect.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("EchoCancellerEffect"));
+
+// y += a * b
+static void complexMultiplyAdd(float* yr, float* yi, const float* ar, const float* ai, const float* br, const float* bi, long count);
+// y += a * conj(b)
+static void complexConjugateMultiplyAdd(float* yr, float* yi, const float* ar, const float* ai, const float* br, const float* bi, long count);
+
+CEchoCancellerEffect::CEchoCancellerEffect(double tailTime /*= 0.2*/, long blockSize /*= 256*/)
+	: m_tailTime(tailTime), m_blockSize(blockSize)
+	, m_partitions(0), m_bins(0), m_stride(0), m_head(0), m_powerCoefficient(0), m_constrainedPartition(0)
+{
+	addParameter(new CEffectParameter(_T("StepSize"), 0.0f, 1.0f, 0.5f));
+}
+
+/*
+	numChannels: Count of microphone channels + 1 (reference).
+	maxFrames: Should be blockSize. CBlockAdapterEffect calls this method so.
+*/
+HRESULT CEchoCancellerEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT(2 <= numChannels, E_INVALIDARG);
+	HR_ASSERT(maxFrames == m_blockSize, E_INVALIDARG);
+	HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+
+	const long size = m_blockSize * 2;
+	HR_ASSERT_OK(m_fft.initialize(size));
+	m_partitions = max(1L, (long)ceil(m_tailTime * sampleRate / m_blockSize));
+	m_bins = m_fft.getBinCount();
+	m_stride = (m_bins + 3) & ~3;
+
+	HR_ASSERT_OK(m_referenceRe.allocate(m_partitions * m_stride));
+	HR_ASSERT_OK(m_referenceIm.allocate(m_partitions * m_stride));
+	m_head = 0;
+	HR_ASSERT_OK(m_referenceTime.allocate(size));
+	HR_ASSERT_OK(m_power.allocate(m_stride));
+	// Time constant of power is about 50 milliseconds.
+	m_powerCoefficient = (float)exp(-m_blockSize / (sampleRate * 0.05));
+
+	const long microphones = numChannels - 1;
+	m_weightsRe.reset(new CAlignedBuffer<float>[microphones]);
+	m_weightsIm.reset(new CAlignedBuffer<float>[microphones]);
+	for (long channel = 0; channel < microphones; channel++) {
+		HR_ASSERT_OK(m_weightsRe[channel].allocate(m_partitions * m_stride));
+		HR_ASSERT_OK(m_weightsIm[channel].allocate(m_partitions * m_stride));
+	}
+	m_constrainedPartition = 0;
+
+	HR_ASSERT_OK(m_time.allocate(size));
+	HR_ASSERT_OK(m_spectrumRe.allocate(m_stride));
+	HR_ASSERT_OK(m_spectrumIm.allocate(m_stride));
+	HR_ASSERT_OK(m_normalizer.allocate(m_stride));
+
+	LOG4CPLUS_INFO(logger, "Partitions=" << m_partitions << ", Block size=" << m_blockSize << ", Microphones=" << microphones);
+	return S_OK;
+}
+
+void CEchoCancellerEffect::process(float* const* channels, long numChannels, long /*frames*/)
+{
+	const long B = m_blockSize;
+	const long microphones = numChannels - 1;
+
+	// Spectrum of the previous and current block of the reference.
+	vecCopy(m_referenceTime, &m_referenceTime[B], B);
+	vecCopy(&m_referenceTime[B], channels[microphones], B);
+	m_head = (m_head + 1) % m_partitions;
+	float* xr = getSpectrum(m_referenceRe, m_head);
+	float* xi = getSpectrum(m_referenceIm, m_head);
+	m_fft.forwardReal(m_referenceTime, xr, xi);
+
+	// Update power and compute step size normalized by power of all partitions.
+	// Regularization is power of white noise of -50 dB.
+	const float mu = getParameter(StepSize)->getValue();
+	const __m128 a = _mm_set1_ps(m_powerCoefficient);
+	const __m128 b = _mm_set1_ps(1.0f - m_powerCoefficient);
+	const __m128 partitions = _mm_set1_ps((float)m_partitions);
+	const __m128 delta = _mm_set1_ps(B * 2 * 1e-5f);
+	const __m128 vmu = _mm_set1_ps(mu);
+	for (long k = 0; k < m_stride; k += 4) {
+		__m128 re = _mm_load_ps(&xr[k]), im = _mm_load_ps(&xi[k]);
+		__m128 power = _mm_add_ps(_mm_mul_ps(a, _mm_load_ps(&m_power[k])), _mm_mul_ps(b, _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+		_mm_store_ps(&m_power[k], power);
+		_mm_store_ps(&m_normalizer[k], _mm_div_ps(vmu, _mm_add_ps(_mm_mul_ps(partitions, power), delta)));
+	}
+
+	for (long channel = 0; channel < microphones; channel++) {
+		CAlignedBuffer<float>& wr = m_weightsRe[channel];
+		CAlignedBuffer<float>& wi = m_weightsIm[channel];
+
+		// Estimate echo: Y = sum(W[p] * X[head - p]), y = last half of IFFT(Y).
+		vecClear(m_spectrumRe, m_stride);
+		vecClear(m_spectrumIm, m_stride);
+		for (long p = 0; p < m_partitions; p++) {
+			long x = (m_head + m_partitions - p) % m_partitions;
+			complexMultiplyAdd(m_spectrumRe, m_spectrumIm, getSpectrum(wr, p), getSpectrum(wi, p),
+				getSpectrum(m_referenceRe, x), getSpectrum(m_referenceIm, x), m_stride);
+		}
+		m_fft.inverseReal(m_spectrumRe, m_spectrumIm, m_time);
+
+		// Error = microphone - echo, which is output of the channel.
+		float* samples = channels[channel];
+		const float* echo = &m_time[B];
+		long i = 0;
+		for (; i + 4 <= B; i += 4) _mm_storeu_ps(&samples[i], _mm_sub_ps(_mm_loadu_ps(&samples[i]), _mm_loadu_ps(&echo[i])));
+		for (; i < B; i++) samples[i] -= echo[i];
+		if (mu == 0.0f) continue;
+
+		// E = FFT([0, error]) normalized, W[p] += E * conj(X[head - p])
+		vecClear(m_time, B);
+		vecCopy(&m_time[B], samples, B);
+		m_fft.forwardReal(m_time, m_spectrumRe, m_spectrumIm);
+		vecMultiply(m_spectrumRe, m_normalizer, m_stride);
+		vecMultiply(m_spectrumIm, m_normalizer, m_stride);
+		for (long p = 0; p < m_partitions; p++) {
+			long x = (m_head + m_partitions - p) % m_partitions;
+			complexConjugateMultiplyAdd(getSpectrum(wr, p), getSpectrum(wi, p), m_spectrumRe, m_spectrumIm,
+				getSpectrum(m_referenceRe, x), getSpectrum(m_referenceIm, x), m_stride);
+		}
+
+		// Constrain weights of one partition to be causal impulse response of blockSize samples.
+		float* cr = getSpectrum(wr, m_constrainedPartition);
+		float* ci = getSpectrum(wi, m_constrainedPartition);
+		m_fft.inverseReal(cr, ci, m_time);
+		vecClear(&m_time[B], B);
+		m_fft.forwardReal(m_time, cr, ci);
+	}
+	m_constrainedPartition = (m_constrainedPartition + 1) % m_partitions;
+}
+
+// Arrays should be aligned and count should be multiple of 4.
+static void complexMultiplyAdd(float* yr, float* yi, const float* ar, const float* ai, const float* br, const float* bi, long count)
+{
+	for (long i = 0; i < count; i += 4) {
+		__m128 var = _mm_load_ps(&ar[i]), vai = _mm_load_ps(&ai[i]);
+		__m128 vbr = _mm_load_ps(&br[i]), vbi = _mm_load_ps(&bi[i]);
+		_mm_store_ps(&yr[i], _mm_add_ps(_mm_load_ps(&yr[i]), _mm_sub_ps(_mm_mul_ps(var, vbr), _mm_mul_ps(vai, vbi))));
+		_mm_store_ps(&yi[i], _mm_add_ps(_mm_load_ps(&yi[i]), _mm_add_ps(_mm_mul_ps(var, vbi), _mm_mul_ps(vai, vbr))));
+	}
+}
+
+static void complexConjugateMultiplyAdd(float* yr, float* yi, const float* ar, const float* ai, const float* br, const float* bi, long count)
+{
+	for (long i = 0; i < count; i += 4) {
+		__m128 var = _mm_load_ps(&ar[i]), vai = _mm_load_ps(&ai[i]);
+		__m128 vbr = _mm_load_ps(&br[i]), vbi = _mm_load_ps(&bi[i]);
+		_mm_store_ps(&yr[i], _mm_add_ps(_mm_load_ps(&yr[i]), _mm_add_ps(_mm_mul_ps(var, vbr), _mm_mul_ps(vai, vbi))));
+		_mm_store_ps(&yi[i], _mm_add_ps(_mm_load_ps(&yi[i]), _mm_sub_ps(_mm_mul_ps(vai, vbr), _mm_mul_ps(var, vbi))));
+	}
+}
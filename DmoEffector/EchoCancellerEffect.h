@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Effect.h"
+#include "Fft.h"
+
+/*
+	Acoustic echo canceller by partitioned block frequency domain adaptive filter (NLMS).
+
+	The last channel of the node is far-end reference that is the signal output to the speaker.
+	Connect it from the output channel by CEffectChain::connect(CEffectGraph::OutputNode, channel, node, reference).
+	Echo of the reference estimated by adaptive filter is subtracted from other channels (microphone inputs).
+
+	Impulse response of tailTime is divided into partitions of blockSize samples.
+	Each block is processed by FFT of 2 * blockSize samples (overlap-save).
+	Filter weights are updated in frequency domain normalized by power of the reference in each bin.
+	Gradient constraint is applied to one partition per block in round robin.
+
+	The effect is processed by CBlockAdapterEffect in blockSize samples.
+*/
+class CEchoCancellerEffect : public CEffect
+{
+public:
+	enum Parameters {
+		StepSize,		// Step size of NLMS. 0.0 to 1.0, neutral value is 0.5. 0.0 freezes the filter.
+	};
+
+	CEchoCancellerEffect(double tailTime = 0.2, long blockSize = 256);
+
+	virtual LPCTSTR getName() const { return _T("EchoCanceller"); }
+	virtual long getPreferredBlockSize() const { return m_blockSize; }
+	virtual bool requiresFullBlock() const { return true; }
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual ProcessFunction getProcessFunction(void** context) { *context = this; return processEffectOf<CEchoCancellerEffect>; }
+
+	long getPartitionCount() const { return m_partitions; }
+
+protected:
+	float* getSpectrum(CAlignedBuffer<float>& buffer, long partition) const { return &buffer[partition * m_stride]; }
+
+	const double m_tailTime;
+	const long m_blockSize;
+	long m_partitions;
+	long m_bins;
+	long m_stride;					// Count of floats of each spectrum rounded up to multiple of 4.
+	CFft m_fft;
+
+	// Spectra of reference of last m_partitions blocks. m_head is the latest.
+	CAlignedBuffer<float> m_referenceRe;
+	CAlignedBuffer<float> m_referenceIm;
+	long m_head;
+	CAlignedBuffer<float> m_referenceTime;		// Previous and current block of reference.
+	CAlignedBuffer<float> m_power;				// Smoothed power of reference in each bin.
+	float m_powerCoefficient;
+
+	// Filter weights of each partition of each microphone channel.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_weightsRe;
+	std::unique_ptr<CAlignedBuffer<float>[]> m_weightsIm;
+	long m_constrainedPartition;
+
+	// Work buffers.
+	CAlignedBuffer<float> m_time;
+	CAlignedBuffer<float> m_spectrumRe;
+	CAlignedBuffer<float> m_spectrumIm;
+	CAlignedBuffer<float> m_normalizer;
+};
@@ -0,0 +1,55 @@
+#include "stdafx.h"
+#include "Effect.h"
+
+CEffect::CEffect()
+	: m_numChannels(0), m_maxFrames(0), m_sampleRate(0)
+{
+}
+
+CEffect::~CEffect()
+{
+}
+
+/*
+	Prepares parameters.
+
+	Derived class that overrides this method should call this method.
+*/
+HRESULT CEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT(0 < numChannels, E_INVALIDARG);
+
+	m_numChannels = numChannels;
+	m_maxFrames = maxFrames;
+	m_sampleRate = sampleRate;
+
+	for (size_t i = 0; i < m_parameters.size(); i++) {
+		HR_ASSERT_OK(m_parameters[i]->prepare(maxFrames, sampleRate));
+	}
+	return S_OK;
+}
+
+CEffect::ProcessFunction CEffect::getProcessFunction(void** context)
+{
+	*context = this;
+	return processEffect;
+}
+
+/*static*/ void CEffect::processEffect(void* context, const float* const* /*inputs*/, float* const* outputs, uint32_t frames)
+{
+	CEffect* _this = (CEffect*)context;
+	_this->process(outputs, _this->m_numChannels, (long)frames);
+}
+
+void CEffect::renderParameters(LONGLONG position, long frames)
+{
+	for (size_t i = 0; i < m_parameters.size(); i++) {
+		m_parameters[i]->render(position, frames);
+	}
+}
+
+DWORD CEffect::addParameter(CEffectParameter * parameter)
+{
+	m_parameters.push_back(std::unique_ptr<CEffectParameter>(parameter));
+	return (DWORD)(m_parameters.size() - 1);
+}
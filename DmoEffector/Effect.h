@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "EffectParameter.h"
+
+/*
+	Base class of effects in CEffectChain.
+
+	Effect processes float samples of all channels in place.
+	All memory used while running should be allocated by prepare() method
+	that is called out of the real-time thread.
+*/
+class CEffect
+{
+	DISALLOW_COPY_AND_ASSIGN(CEffect);
+
+public:
+	virtual ~CEffect();
+
+	virtual LPCTSTR getName() const = 0;
+
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+
+	// Processes frames(<= maxFrames) samples of each channel.
+	// Called by the real-time thread after parameters are rendered for the frames.
+	virtual void process(float* const* channels, long numChannels, long frames) = 0;
+
+	// Function that CEffectChain calls instead of process() from its plan.
+	// Same signature as process() of EffectPluginDescriptor, so that a plugin is called without a host function.
+	// inputs and outputs of effects processed in place are the same.
+	typedef void (*ProcessFunction)(void* context, const float* const* inputs, float* const* outputs, uint32_t frames);
+	// Returns the function and its context. Called after prepare().
+	// Default function calls process() with numChannels passed to prepare().
+	// Effect class that has no derived class returns processEffectOf<its class> to save the virtual call.
+	virtual ProcessFunction getProcessFunction(void** context);
+
+	// Returns latency in samples added by the effect such as lookahead or FFT block.
+	// Called after prepare(). CEffectChain compensates difference of latency between paths of the graph.
+	virtual long getLatency() const { return 0; }
+	// Returns samples of output that continue after input becomes silent, such as echo or reverb.
+	// Called after prepare().
+	virtual long getTailLength() const { return 0; }
+
+	// Returns block size in which the effect prefers to process samples. 0 means any size.
+	// CEffectChain wraps the effect with CBlockAdapterEffect if this is not 0.
+	virtual long getPreferredBlockSize() const { return 0; }
+	// Returns true if the effect can't process fewer frames than the preferred block size.
+	// Buffer may be split at the time of parameter change. So CBlockAdapterEffect doesn't pass samples directly to such effect.
+	virtual bool requiresFullBlock() const { return false; }
+
+	virtual DWORD getParameterCount() const { return (DWORD)m_parameters.size(); }
+	virtual CEffectParameter* getParameter(DWORD index) const { return (index < m_parameters.size()) ? m_parameters[index].get() : NULL; }
+	virtual void renderParameters(LONGLONG position, long frames);
+
+protected:
+	CEffect();
+
+	// Adds parameter and returns its index.
+	DWORD addParameter(CEffectParameter* parameter);
+
+	static void processEffect(void* context, const float* const* inputs, float* const* outputs, uint32_t frames);
+	// Calls process() of T directly, so that the compiler can inline it into the function.
+	template<class T>
+	static void processEffectOf(void* context, const float* const* /*inputs*/, float* const* outputs, uint32_t frames)
+	{
+		T* _this = (T*)context;
+		_this->T::process(outputs, _this->CEffect::m_numChannels, (long)frames);
+	}
+
+	std::vector<std::unique_ptr<CEffectParameter>> m_parameters;
+
+	long m_numChannels;
+	long m_maxFrames;
+	double m_sampleRate;
+};
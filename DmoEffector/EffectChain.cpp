@@ -0,0 +1,373 @@
+#include "stdafx.h"
+#include "EffectChain.h"
+#include "BlockAdapterEffect.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("EffectChain"));
+
+CEffectChain::CEffectChain()
+	: m_tailLength(0), m_numChannels(0), m_maxFrames(0), m_sampleRate(0), m_defaultDither(CSampleConverter::DitherShape::None)
+	, m_taskFirstStep(0), m_taskPosition(0), m_taskOffset(0), m_taskFrames(0)
+	, m_position(0), m_droppedParameterChanges(0)
+{
+}
+
+CEffectChain::~CEffectChain()
+{
+}
+
+HRESULT CEffectChain::addEffect(CEffect * effect)
+{
+	HR_ASSERT(addNode(effect, CEffectGraph::AllChannels) != -1, E_POINTER);
+	return S_OK;
+}
+
+/*
+	Adds effect as node of the graph.
+
+	Effect that prefers fixed block size is wrapped by CBlockAdapterEffect.
+*/
+long CEffectChain::addNode(CEffect * effect, long numChannels)
+{
+	if (!effect) return -1;
+
+	if (effect->getPreferredBlockSize()) {
+		effect = new CBlockAdapterEffect(effect);
+	}
+
+	m_effects.push_back(std::unique_ptr<CEffect>(effect));
+	return m_graph.addNode(numChannels);
+}
+
+void CEffectChain::setDither(CSampleConverter::DitherShape shape)
+{
+	m_defaultDither = shape;
+	m_ditherShapes.clear();
+}
+
+HRESULT CEffectChain::setDither(long channel, CSampleConverter::DitherShape shape)
+{
+	HR_ASSERT(0 <= channel, E_INVALIDARG);
+
+	if ((long)m_ditherShapes.size() <= channel) m_ditherShapes.resize(channel + 1, m_defaultDither);
+	m_ditherShapes[channel] = shape;
+	return S_OK;
+}
+
+/*
+	Compiles the graph, allocates buffers and prepares all effects.
+
+	Called out of the real-time thread when ASIO buffers are created.
+*/
+HRESULT CEffectChain::prepare(long numChannels, long maxFrames, double sampleRate, ASIOSampleType sampleType)
+{
+	HR_ASSERT(0 < numChannels, E_INVALIDARG);
+	HR_ASSERT(0 < maxFrames, E_INVALIDARG);
+
+	m_numChannels = numChannels;
+	m_maxFrames = maxFrames;
+	m_sampleRate = sampleRate;
+	HR_ASSERT_OK(m_converter.initialize(sampleType));
+	m_dithers.resize(numChannels);
+	for (long channel = 0; channel < numChannels; channel++) {
+		m_dithers[channel].initialize((channel < (long)m_ditherShapes.size()) ? m_ditherShapes[channel] : m_defaultDither, channel);
+	}
+
+	// Effects are prepared before the graph is compiled because latency may depend on sample rate.
+	std::vector<long> latencies(m_effects.size());
+	m_tailLength = 0;
+	for (size_t i = 0; i < m_effects.size(); i++) {
+		CEffect* effect = m_effects[i].get();
+		HR_ASSERT_OK(effect->prepare(m_graph.getNodeChannels((long)i, numChannels), maxFrames, sampleRate));
+		latencies[i] = effect->getLatency();
+		HR_ASSERT(0 <= latencies[i], E_UNEXPECTED);
+		HR_ASSERT(0 <= effect->getTailLength(), E_UNEXPECTED);
+		m_tailLength += effect->getTailLength();
+		LOG4CPLUS_INFO(logger, "Prepared effect " << i << ": " << effect->getName() << ", Latency=" << latencies[i] << ", Tail=" << effect->getTailLength());
+	}
+
+	HR_ASSERT_OK(m_graph.compile(numChannels, latencies));
+	long bufferCount = m_graph.getBufferCount();
+	m_buffers.reset(new CAlignedBuffer<float>[bufferCount]);
+	for (long buffer = 0; buffer < bufferCount; buffer++) {
+		HR_ASSERT_OK(m_buffers[buffer].allocate(maxFrames));
+	}
+
+	const std::vector<CEffectGraph::MixSource>& mixSources = m_graph.getMixSources();
+	m_delayLines.reset(new CDelayLine[max((size_t)1, mixSources.size())]);
+	for (size_t i = 0; i < mixSources.size(); i++) {
+		if (mixSources[i].delay) {
+			HR_ASSERT_OK(m_delayLines[i].initialize(mixSources[i].delay, maxFrames));
+		}
+	}
+	HR_ASSERT_OK(buildPlan());
+
+	// Start worker threads as many as nodes that can be executed concurrently.
+	// The real-time thread itself executes one of them.
+	m_workerPool.stop();
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	long numThreads = min(m_graph.getMaxParallelism(), (long)systemInfo.dwNumberOfProcessors) - 1;
+	if (0 < numThreads) {
+		HR_ASSERT(m_graph.getMaxParallelism() <= CWorkerPool::MaxTasks, E_INVALIDARG);
+		HR_ASSERT_OK(m_workerPool.start(numThreads));
+	}
+
+	if (!m_parameterQueue.isInitialized()) {
+		HR_ASSERT_OK(m_parameterQueue.initialize(MaxParameterChanges));
+	}
+	m_pendingChanges.clear();
+	m_pendingChanges.reserve(MaxParameterChanges);
+	m_position = 0;
+
+	return S_OK;
+}
+
+/*
+	Resolves steps, mixes and buffers of the compiled graph into the plan.
+*/
+HRESULT CEffectChain::buildPlan()
+{
+	const std::vector<CEffectGraph::MixSource>& mixSources = m_graph.getMixSources();
+	m_planSources.resize(mixSources.size());
+	for (size_t i = 0; i < mixSources.size(); i++) {
+		m_planSources[i].buffer = m_buffers[mixSources[i].buffer];
+		m_planSources[i].delayLine = mixSources[i].delay ? &m_delayLines[i] : NULL;
+	}
+
+	const std::vector<CEffectGraph::Mix>& mixes = m_graph.getMixes();
+	m_planMixes.resize(mixes.size());
+	for (size_t i = 0; i < mixes.size(); i++) {
+		m_planMixes[i].buffer = m_buffers[mixes[i].buffer];
+		m_planMixes[i].sources = m_planSources.data() + mixes[i].firstSource;
+		m_planMixes[i].sourceCount = mixes[i].sourceCount;
+	}
+
+	const std::vector<long>& channelBuffers = m_graph.getChannelBuffers();
+	m_planBuffers.resize(channelBuffers.size());
+	m_planChannels.resize(channelBuffers.size());
+	for (size_t i = 0; i < channelBuffers.size(); i++) {
+		m_planBuffers[i] = m_buffers[channelBuffers[i]];
+	}
+
+	const std::vector<CEffectGraph::Step>& steps = m_graph.getSteps();
+	m_planSteps.resize(steps.size());
+	for (size_t i = 0; i < steps.size(); i++) {
+		const CEffectGraph::Step& step = steps[i];
+		CEffect* effect = m_effects[step.node].get();
+		PlanStep& planStep = m_planSteps[i];
+		planStep.process = effect->getProcessFunction(&planStep.context);
+		HR_ASSERT(planStep.process, E_UNEXPECTED);
+		planStep.effect = effect->getParameterCount() ? effect : NULL;
+		planStep.numChannels = step.numChannels;
+		planStep.buffers = m_planBuffers.data() + step.firstChannel;
+		planStep.channels = m_planChannels.data() + step.firstChannel;
+		planStep.mixes = m_planMixes.data() + step.firstMix;
+		planStep.mixCount = step.mixCount;
+	}
+
+	m_inputBuffers.resize(m_numChannels);
+	m_outputBuffers.resize(m_numChannels);
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		const long input = m_graph.getInputBuffers()[channel];
+		m_inputBuffers[channel] = (0 <= input) ? (float*)m_buffers[input] : NULL;
+		m_outputBuffers[channel] = m_buffers[m_graph.getOutputBuffers()[channel]];
+	}
+	return S_OK;
+}
+
+/*
+	Posts change of the parameter.
+
+	Time stamps of the segment are stream time returned by getStreamTime().
+	The change whose rtStart has passed is applied at the start of next buffer.
+	Returns E_NOT_SUFFICIENT_BUFFER if the queue is full.
+*/
+HRESULT CEffectChain::postParameterChange(long effect, DWORD parameter, const MP_ENVELOPE_SEGMENT & segment)
+{
+	HR_ASSERT(getEffect(effect), E_INVALIDARG);
+	HR_ASSERT(getEffect(effect)->getParameter(parameter), E_INVALIDARG);
+	HR_ASSERT(segment.rtStart <= segment.rtEnd, E_INVALIDARG);
+
+	ParameterChange change = { effect, parameter, segment, 0 };
+	HR_ASSERT(m_parameterQueue.push(change), E_NOT_SUFFICIENT_BUFFER);
+	return S_OK;
+}
+
+/*
+	Returns time of the sample to be processed next in 100-nanosecond units.
+*/
+REFERENCE_TIME CEffectChain::getStreamTime() const
+{
+	return (0 < m_sampleRate) ? (REFERENCE_TIME)floor(m_position.load() * 10000000 / m_sampleRate + 0.5) : 0;
+}
+
+/*
+	Runs effects with silent input, so that effects are ready to process without startup cost.
+
+	Called out of the real-time thread after prepare().
+*/
+HRESULT CEffectChain::warmUp(int blocks /*= 2*/)
+{
+	HR_ASSERT(isPrepared(), E_ILLEGAL_METHOD_CALL);
+
+	for (int i = 0; i <= blocks; i++) {
+		for (long buffer = 0; buffer < m_graph.getBufferCount(); buffer++) {
+			m_buffers[buffer].clear();
+		}
+		if (i < blocks) processEffects(0, m_maxFrames);
+	}
+	for (size_t i = 0; i < m_graph.getMixSources().size(); i++) {
+		m_delayLines[i].reset();
+	}
+	return S_OK;
+}
+
+void CEffectChain::process(const void * const * inputs, void * const * outputs, long frames)
+{
+	processToFloat(inputs, frames);
+	outputFromFloat(outputs, frames);
+}
+
+void CEffectChain::processToFloat(const void * const * inputs, long frames)
+{
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		if (m_inputBuffers[channel]) {
+			m_converter.toFloat(inputs[channel], m_inputBuffers[channel], frames);
+		}
+	}
+
+	receiveParameterChanges();
+
+	// Split the buffer at start time of parameter changes.
+	LONGLONG position = m_position.load(std::memory_order_relaxed);
+	long offset = 0;
+	while (offset < frames) {
+		applyParameterChanges(position + offset);
+
+		long next = frames;
+		if (!m_pendingChanges.empty()) {
+			next = (long)min((LONGLONG)frames, m_pendingChanges.front().startSample - position);
+		}
+		processEffects(offset, next - offset);
+		offset = next;
+	}
+	m_position.store(position + frames, std::memory_order_relaxed);
+}
+
+void CEffectChain::outputFromFloat(void * const * outputs, long frames)
+{
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		m_converter.fromFloat(getBuffer(channel), outputs[channel], frames, m_dithers[channel]);
+	}
+}
+
+/*
+	Moves changes in the queue to the pending list sorted by start time.
+*/
+void CEffectChain::receiveParameterChanges()
+{
+	ParameterChange change;
+	while (m_parameterQueue.pop(change)) {
+		if (m_pendingChanges.size() < m_pendingChanges.capacity()) {
+			change.startSample = toSamples(change.segment.rtStart);
+			std::vector<ParameterChange>::iterator i = m_pendingChanges.end();
+			while ((i != m_pendingChanges.begin()) && (change.startSample < (i - 1)->startSample)) i--;
+			m_pendingChanges.insert(i, change);
+		} else {
+			m_droppedParameterChanges++;
+		}
+	}
+}
+
+/*
+	Applies pending changes whose start time has come.
+*/
+void CEffectChain::applyParameterChanges(LONGLONG position)
+{
+	std::vector<ParameterChange>::iterator i = m_pendingChanges.begin();
+	for (; (i != m_pendingChanges.end()) && (i->startSample <= position); i++) {
+		CEffectParameter* parameter = m_effects[i->effect]->getParameter(i->parameter);
+		parameter->addEnvelope(i->segment, i->startSample, toSamples(i->segment.rtEnd));
+	}
+	m_pendingChanges.erase(m_pendingChanges.begin(), i);
+}
+
+/*
+	Executes steps of the plan level by level.
+
+	If the level contains more than one step, steps are executed concurrently by the worker pool.
+	Otherwise steps are executed in order of the plan.
+*/
+void CEffectChain::processEffects(long offset, long frames)
+{
+	LONGLONG position = m_position.load(std::memory_order_relaxed) + offset;
+	const PlanStep* steps = m_planSteps.data();
+	const std::vector<long>& levels = m_graph.getLevels();
+
+	if (m_workerPool.getThreadCount() == 0) {
+		for (size_t i = 0; i < m_planSteps.size(); i++) {
+			executeStep(steps[i], position, offset, frames);
+		}
+	} else {
+		for (long level = 0; level < m_graph.getLevelCount(); level++) {
+			long firstStep = levels[level];
+			long count = levels[level + 1] - firstStep;
+			if (count == 1) {
+				executeStep(steps[firstStep], position, offset, frames);
+			} else {
+				m_taskFirstStep = firstStep;
+				m_taskPosition = position;
+				m_taskOffset = offset;
+				m_taskFrames = frames;
+				m_workerPool.run(executeStepTask, this, count);
+			}
+		}
+	}
+
+	for (size_t i = m_graph.getFirstOutputMix(); i < m_planMixes.size(); i++) {
+		mix(m_planMixes[i], offset, frames);
+	}
+}
+
+/*static*/ void CEffectChain::executeStepTask(void* context, long index)
+{
+	CEffectChain* _this = (CEffectChain*)context;
+	const PlanStep& step = _this->m_planSteps[_this->m_taskFirstStep + index];
+	_this->executeStep(step, _this->m_taskPosition, _this->m_taskOffset, _this->m_taskFrames);
+}
+
+void CEffectChain::executeStep(const PlanStep& step, LONGLONG position, long offset, long frames)
+{
+	for (long i = 0; i < step.mixCount; i++) {
+		mix(step.mixes[i], offset, frames);
+	}
+
+	for (long channel = 0; channel < step.numChannels; channel++) {
+		step.channels[channel] = step.buffers[channel] + offset;
+	}
+
+	if (step.effect) step.effect->renderParameters(position, frames);
+	step.process(step.context, step.channels, step.channels, (uint32_t)frames);
+}
+
+/*static*/ void CEffectChain::mix(const PlanMix& mix, long offset, long frames)
+{
+	float* dst = mix.buffer + offset;
+	if (mix.sourceCount == 0) {
+		vecClear(dst, frames);
+		return;
+	}
+
+	for (long i = 0; i < mix.sourceCount; i++) {
+		const PlanSource& source = mix.sources[i];
+		const float* src = source.buffer + offset;
+		if (i == 0) {
+			if (source.delayLine) source.delayLine->process(src, dst, frames);
+			else vecCopy(dst, src, frames);
+		} else {
+			if (source.delayLine) source.delayLine->processAdd(src, dst, frames);
+			else vecAdd(dst, src, frames);
+		}
+	}
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "DelayLine.h"
+#include "Effect.h"
+#include "EffectGraph.h"
+#include "SampleConverter.h"
+#include "WaitFreeQueue.h"
+#include "WorkerPool.h"
+
+/*
+	Chain of effects that processes ASIO buffers of all channels.
+
+	Samples are converted to float, processed by each effect in order and converted back to ASIO sample type.
+	Effects can also be connected as DAG by addNode() and connect(). See CEffectGraph.
+	prepare() compiles the graph into a flat plan of steps and mixes whose buffers are resolved to pointers,
+	so that the real-time thread walks the plan in order and calls effects through CEffect::ProcessFunction.
+	Nodes in the same level of the graph are executed concurrently by worker threads.
+	Latencies of effects are compensated by delay lines so that all outputs are aligned.
+
+	Parameter changes are posted by the UI thread through wait-free queue with time stamp.
+	The real-time thread splits each buffer at time of changes so that changes are applied sample accurately.
+*/
+class CEffectChain
+{
+	DISALLOW_COPY_AND_ASSIGN(CEffectChain);
+
+public:
+	CEffectChain();
+	virtual ~CEffectChain();
+
+	// Adds effect to the end of the chain and takes ownership of it.
+	// Should be called before prepare().
+	HRESULT addEffect(CEffect* effect);
+	// Adds effect as node of the graph and returns index of it. Returns -1 if effect is NULL.
+	// numChannels: Count of channels processed by the effect. CEffectGraph::AllChannels means all channels of the chain.
+	long addNode(CEffect* effect, long numChannels);
+	// Connects channel of the node to input channel of another node.
+	// CEffectGraph::InputNode as fromNode means input channel and CEffectGraph::OutputNode as toNode means output channel.
+	// CEffectGraph::OutputNode as fromNode means signal output to the channel.
+	HRESULT connect(long fromNode, long fromChannel, long toNode, long toChannel) { return m_graph.connect(fromNode, fromChannel, toNode, toChannel); }
+	// Selects dither of integer output for all channels or for the channel.
+	// Should be called before prepare(). Default is DitherShape::None.
+	void setDither(CSampleConverter::DitherShape shape);
+	HRESULT setDither(long channel, CSampleConverter::DitherShape shape);
+	long getEffectCount() const { return (long)m_effects.size(); }
+	CEffect* getEffect(long index) const { return ((0 <= index) && (index < getEffectCount())) ? m_effects[index].get() : NULL; }
+
+	HRESULT prepare(long numChannels, long maxFrames, double sampleRate, ASIOSampleType sampleType);
+	HRESULT warmUp(int blocks = 2);
+
+	// Called by the UI thread.
+	HRESULT postParameterChange(long effect, DWORD parameter, const MP_ENVELOPE_SEGMENT& segment);
+	REFERENCE_TIME getStreamTime() const;
+
+	// Called by the real-time thread.
+	void process(const void* const* inputs, void* const* outputs, long frames);
+
+	// process() is done by calling processToFloat() and then outputFromFloat().
+	// Float samples can be modified between them through getBuffer().
+	void processToFloat(const void* const* inputs, long frames);
+	void outputFromFloat(void* const* outputs, long frames);
+	float* getBuffer(long channel) const { return m_outputBuffers[channel]; }
+
+	// Position of the sample to be processed next.
+	LONGLONG getPosition() const { return m_position.load(std::memory_order_relaxed); }
+	void setPosition(LONGLONG position) { m_position.store(position, std::memory_order_relaxed); }
+	bool isPrepared() const { return m_buffers.get() != NULL; }
+	long getNumChannels() const { return m_numChannels; }
+	// Latency in samples of the path that has the largest latency. Valid after prepare().
+	long getLatency() const { return m_graph.getLatency(); }
+	// Sum of tail lengths of all effects, which is not less than the tail of any path. Valid after prepare().
+	long getTailLength() const { return m_tailLength; }
+
+	// Count of parameter changes discarded because queue was full.
+	long getDroppedParameterChanges() const { return m_droppedParameterChanges; }
+
+	static const long MaxParameterChanges = 256;
+
+protected:
+	struct ParameterChange {
+		long effect;
+		DWORD parameter;
+		MP_ENVELOPE_SEGMENT segment;
+		LONGLONG startSample;		// Sample position converted from segment.rtStart.
+	};
+
+	void receiveParameterChanges();
+	void applyParameterChanges(LONGLONG position);
+	LONGLONG toSamples(REFERENCE_TIME time) const { return (LONGLONG)floor(time * m_sampleRate / 10000000 + 0.5); }
+
+	// Source of the mix in the plan.
+	struct PlanSource {
+		const float* buffer;
+		CDelayLine* delayLine;		// NULL if the source is not delayed.
+	};
+
+	// Mix in the plan. See CEffectGraph::Mix.
+	struct PlanMix {
+		float* buffer;
+		const PlanSource* sources;
+		long sourceCount;			// If 0, the buffer is cleared.
+	};
+
+	// Step in the plan that executes one node. See CEffectGraph::Step.
+	struct PlanStep {
+		CEffect::ProcessFunction process;
+		void* context;
+		CEffect* effect;			// Used to render parameters. NULL if the effect has no parameter.
+		long numChannels;
+		float* const* buffers;		// Buffer of each channel.
+		float** channels;			// Buffer of each channel at the offset of the sub-block, passed to the effect.
+		const PlanMix* mixes;		// Mixes executed before the effect.
+		long mixCount;
+	};
+
+	HRESULT buildPlan();
+	void processEffects(long offset, long frames);
+	void executeStep(const PlanStep& step, LONGLONG position, long offset, long frames);
+	static void mix(const PlanMix& mix, long offset, long frames);
+	static void executeStepTask(void* context, long index);
+
+	std::vector<std::unique_ptr<CEffect>> m_effects;
+	CEffectGraph m_graph;
+	long m_tailLength;
+
+	long m_numChannels;
+	long m_maxFrames;
+	double m_sampleRate;
+	CSampleConverter m_converter;
+
+	// Dither selected for each channel. Channels not in m_ditherShapes use m_defaultDither.
+	CSampleConverter::DitherShape m_defaultDither;
+	std::vector<CSampleConverter::DitherShape> m_ditherShapes;
+	// State of dither of each output channel. Seeded by the channel number in prepare().
+	std::vector<CSampleConverter::Dither> m_dithers;
+
+	// Float buffers assigned by the graph.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_buffers;
+
+	// Delay line of each source of mixes. Allocated only for source that has delay.
+	std::unique_ptr<CDelayLine[]> m_delayLines;
+
+	// Plan built by prepare(). Steps and mixes are in order of the graph.
+	// Each step has its own range of m_planBuffers and m_planChannels so that steps can be executed concurrently.
+	std::vector<PlanStep> m_planSteps;
+	std::vector<PlanMix> m_planMixes;
+	std::vector<PlanSource> m_planSources;
+	std::vector<float*> m_planBuffers;
+	std::vector<float*> m_planChannels;
+	// Buffer of each input channel, or NULL if the input channel is not used, and buffer of each output channel.
+	std::vector<float*> m_inputBuffers;
+	std::vector<float*> m_outputBuffers;
+
+	// Worker threads used if the graph has level that contains more than one node.
+	CWorkerPool m_workerPool;
+	// Arguments of executeStepTask() set before the level is dispatched to the worker pool.
+	long m_taskFirstStep;
+	LONGLONG m_taskPosition;
+	long m_taskOffset;
+	long m_taskFrames;
+
+	// Count of samples processed since prepare() was called.
+	std::atomic<LONGLONG> m_position;
+
+	// Changes posted by the UI thread.
+	CWaitFreeQueue<ParameterChange> m_parameterQueue;
+
+	// Changes received by the real-time thread and waiting for start time, sorted by start time.
+	// Capacity is reserved by prepare() so that memory is not allocated while running.
+	std::vector<ParameterChange> m_pendingChanges;
+	long m_droppedParameterChanges;
+};
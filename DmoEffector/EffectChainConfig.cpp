@@ -0,0 +1,479 @@
+#include "stdafx.h"
+#include "EffectChainConfig.h"
+#include "CompressorEffect.h"
+#include "EchoCancellerEffect.h"
+#include "GainEffect.h"
+#include "PitchShifterEffect.h"
+
+#include <log4cplus/helpers/property.h>
+#include <set>
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("EffectChainConfig"));
+
+static const tstring Prefix(_T("EffectChain."));
+static const tstring InputNodeName(_T("input"));
+static const tstring OutputNodeName(_T("output"));
+
+/*static*/ const double CEffectChainConfig::TrialSampleRate = 48000;
+
+static const struct {
+	LPCTSTR name;
+	CEffectChainConfig::EffectType type;
+} effectTypes[] = {
+	{ _T("Gain"), CEffectChainConfig::EffectType::Gain },
+	{ _T("Compressor"), CEffectChainConfig::EffectType::Compressor },
+	{ _T("Limiter"), CEffectChainConfig::EffectType::Limiter },
+	{ _T("PitchShifter"), CEffectChainConfig::EffectType::PitchShifter },
+	{ _T("EchoCanceller"), CEffectChainConfig::EffectType::EchoCanceller },
+	{ _T("Plugin"), CEffectChainConfig::EffectType::Plugin },
+};
+
+static const struct {
+	LPCTSTR name;
+	CSampleConverter::DitherShape shape;
+} ditherShapes[] = {
+	{ _T("None"), CSampleConverter::DitherShape::None },
+	{ _T("Tpdf"), CSampleConverter::DitherShape::Tpdf },
+	{ _T("FirstOrder"), CSampleConverter::DitherShape::FirstOrder },
+	{ _T("Weighted"), CSampleConverter::DitherShape::Weighted },
+};
+
+static tstring trim(const tstring& text)
+{
+	static LPCTSTR spaces = _T(" \t\r\n");
+	const size_t first = text.find_first_not_of(spaces);
+	return (first == tstring::npos) ? tstring() : text.substr(first, text.find_last_not_of(spaces) - first + 1);
+}
+
+static bool toLong(const tstring& text, long* value)
+{
+	LPTSTR end;
+	*value = _tcstol(text.c_str(), &end, 10);
+	return !text.empty() && !*end;
+}
+
+/*
+	Reads values of keys without the prefix, and logs errors with the key.
+
+	Keys read are remembered so that keys never read are reported as unknown.
+*/
+class CEffectChainConfig::Parser
+{
+public:
+	Parser(const log4cplus::helpers::Properties& properties) : m_properties(properties) {}
+
+	// Returns S_FALSE if the key doesn't exist.
+	HRESULT getString(const tstring& key, tstring* value)
+	{
+		m_usedKeys.insert(key);
+		if (!m_properties.exists(key)) return S_FALSE;
+		*value = trim(m_properties.getProperty(key));
+		return S_OK;
+	}
+
+	HRESULT getLong(const tstring& key, long* value, long minValue)
+	{
+		tstring text;
+		HRESULT hr = getString(key, &text);
+		if (hr != S_OK) return hr;
+		if (!toLong(text, value) || (*value < minValue)) return error(key, format(_T("Integer not less than %ld is expected."), minValue));
+		return S_OK;
+	}
+
+	HRESULT getDouble(const tstring& key, double* value, double minValue)
+	{
+		tstring text;
+		HRESULT hr = getString(key, &text);
+		if (hr != S_OK) return hr;
+		LPTSTR end;
+		*value = _tcstod(text.c_str(), &end);
+		if (text.empty() || *end || (*value < minValue)) return error(key, format(_T("Number not less than %g is expected."), minValue));
+		return S_OK;
+	}
+
+	// Returns comma separated items. Empty items are errors.
+	HRESULT getList(const tstring& key, std::vector<tstring>* values)
+	{
+		values->clear();
+		tstring text;
+		HRESULT hr = getString(key, &text);
+		if (hr != S_OK) return hr;
+		for (size_t start = 0; start <= text.size();) {
+			size_t end = text.find(_T(','), start);
+			if (end == tstring::npos) end = text.size();
+			values->push_back(trim(text.substr(start, end - start)));
+			if (values->back().empty()) return error(key, _T("Empty item in the list."));
+			start = end + 1;
+		}
+		return S_OK;
+	}
+
+	HRESULT getChannels(const tstring& key, std::vector<long>* channels)
+	{
+		channels->clear();
+		std::vector<tstring> values;
+		HRESULT hr = getList(key, &values);
+		if (hr != S_OK) return hr;
+		for (const tstring& value : values) {
+			long channel;
+			if (!toLong(value, &channel) || (channel < 0)) return error(key, _T("Channel number is expected: ") + value);
+			if (std::find(channels->begin(), channels->end(), channel) != channels->end()) return error(key, _T("Channel is listed twice: ") + value);
+			channels->push_back(channel);
+		}
+		return S_OK;
+	}
+
+	HRESULT getDither(const tstring& key, CSampleConverter::DitherShape* shape)
+	{
+		tstring text;
+		HRESULT hr = getString(key, &text);
+		if (hr != S_OK) return hr;
+		for (const auto& entry : ditherShapes) {
+			if (!_tcsicmp(text.c_str(), entry.name)) {
+				*shape = entry.shape;
+				return S_OK;
+			}
+		}
+		return error(key, _T("None, Tpdf, FirstOrder or Weighted is expected."));
+	}
+
+	// Returns suffixes of keys that start with the prefix, in order of keys.
+	std::vector<tstring> getSuffixes(const tstring& prefix) const
+	{
+		std::vector<tstring> suffixes;
+		for (const tstring& key : m_properties.propertyNames()) {
+			if ((prefix.size() < key.size()) && !key.compare(0, prefix.size(), prefix)) suffixes.push_back(key.substr(prefix.size()));
+		}
+		std::sort(suffixes.begin(), suffixes.end());
+		return suffixes;
+	}
+
+	HRESULT checkUnknownKeys() const
+	{
+		HRESULT hr = S_OK;
+		for (const tstring& key : m_properties.propertyNames()) {
+			if (!m_usedKeys.count(key)) hr = error(key, _T("Unknown key, or the key is not used by the type of the effect."));
+		}
+		return hr;
+	}
+
+	HRESULT error(const tstring& key, const tstring& message) const
+	{
+		LOG4CPLUS_ERROR(logger, (Prefix + key).c_str() << ": " << message.c_str());
+		return E_INVALIDARG;
+	}
+
+	template<typename T>
+	static tstring format(LPCTSTR text, T value)
+	{
+		TCHAR message[100];
+		_stprintf_s(message, text, value);
+		return message;
+	}
+
+protected:
+	const log4cplus::helpers::Properties m_properties;
+	std::set<tstring> m_usedKeys;
+};
+
+CEffectChainConfig::CEffectChainConfig()
+	: m_dither(CSampleConverter::DitherShape::None), m_isLoaded(false)
+{
+}
+
+/*
+	Parses the file and prepares a trial chain.
+
+	All errors of keys are logged before returning, so that the user can fix them at once.
+*/
+HRESULT CEffectChainConfig::load(LPCTSTR path)
+{
+	HR_ASSERT(path, E_POINTER);
+	// Properties ignores the file that can't be opened.
+	WIN32_ASSERT(GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES);
+
+	m_isLoaded = false;
+	m_path = path;
+	m_inputs.clear();
+	m_outputs.clear();
+	m_dither = CSampleConverter::DitherShape::None;
+	m_channelDithers.clear();
+	m_effects.clear();
+	m_connections.clear();
+
+	Parser parser(log4cplus::helpers::Properties(path).getPropertySubset(Prefix));
+	HRESULT hr = S_OK;
+	auto check = [&hr](HRESULT hrKey) { if (FAILED(hrKey) && SUCCEEDED(hr)) hr = hrKey; };
+
+	check(parser.getChannels(_T("inputs"), &m_inputs));
+	check(parser.getChannels(_T("outputs"), &m_outputs));
+	check(parser.getDither(_T("dither"), &m_dither));
+	for (const tstring& suffix : parser.getSuffixes(_T("dither."))) {
+		const tstring key(_T("dither.") + suffix);
+		long channel;
+		CSampleConverter::DitherShape shape;
+		if (!toLong(suffix, &channel) || (channel < 0)) check(parser.error(key, _T("Channel number is expected after dither.")));
+		else if (parser.getDither(key, &shape) == S_OK) m_channelDithers.push_back(std::make_pair(channel, shape));
+	}
+
+	std::vector<tstring> names;
+	check(parser.getList(_T("effects"), &names));
+	for (const tstring& name : names) {
+		const tstring key(_T("effect.") + name);
+		if ((name == InputNodeName) || (name == OutputNodeName) || (name.find_first_of(_T(".:> \t")) != tstring::npos)) {
+			check(parser.error(_T("effects"), _T("Invalid effect name: ") + name));
+			continue;
+		}
+		for (const Effect& other : m_effects) {
+			if (other.name == name) check(parser.error(_T("effects"), _T("Effect name is listed twice: ") + name));
+		}
+
+		Effect effect;
+		effect.name = name;
+		effect.numChannels = CEffectGraph::AllChannels;
+		effect.lookaheadTime = 0.005;
+		effect.sidechainChannels = 0;
+		effect.tailTime = 0.2;
+		tstring type;
+		if (parser.getString(key, &type) != S_OK) {
+			check(parser.error(key, _T("Type of the effect is not specified.")));
+			continue;
+		}
+		bool isKnownType = false;
+		for (const auto& entry : effectTypes) {
+			if (!_tcsicmp(type.c_str(), entry.name)) {
+				effect.type = entry.type;
+				isKnownType = true;
+			}
+		}
+		if (!isKnownType) {
+			check(parser.error(key, _T("Unknown type: ") + type));
+			continue;
+		}
+
+		check(parser.getLong(key + _T(".channels"), &effect.numChannels, 0));
+		switch (effect.type) {
+		case EffectType::Compressor:
+		case EffectType::Limiter:
+			check(parser.getDouble(key + _T(".lookahead"), &effect.lookaheadTime, 0));
+			check(parser.getLong(key + _T(".sidechain"), &effect.sidechainChannels, 0));
+			break;
+		case EffectType::EchoCanceller:
+			check(parser.getDouble(key + _T(".tail"), &effect.tailTime, 0));
+			break;
+		case EffectType::Plugin:
+		{
+			tstring pluginPath;
+			if (parser.getString(key + _T(".path"), &pluginPath) != S_OK) {
+				check(parser.error(key, _T("Plugin requires path.")));
+				break;
+			}
+			// Relative path is relative to the directory of the configuration file.
+			const size_t separator = m_path.find_last_of(_T("\\/"));
+			if ((separator != tstring::npos) && (pluginPath.find_first_of(_T("\\/:")) != 0) && (pluginPath.find(_T(':')) == tstring::npos)) {
+				pluginPath = m_path.substr(0, separator + 1) + pluginPath;
+			}
+			effect.plugin.reset(new CEffectPluginLibrary());
+			if (FAILED(effect.plugin->load(pluginPath.c_str()))) {
+				check(parser.error(key + _T(".path"), _T("Plugin can't be loaded: ") + pluginPath));
+				effect.plugin.reset();
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		const tstring parameterPrefix(key + _T(".parameter."));
+		for (const tstring& parameterName : parser.getSuffixes(parameterPrefix)) {
+			Parameter parameter;
+			parameter.key = parameterPrefix + parameterName;
+			parameter.name = parameterName;
+			double value;
+			if (parser.getDouble(parameter.key, &value, -FLT_MAX) == S_OK) {
+				parameter.value = (MP_DATA)value;
+				effect.parameters.push_back(parameter);
+			} else {
+				check(E_INVALIDARG);
+			}
+		}
+		m_effects.push_back(effect);
+	}
+
+	std::vector<tstring> connections;
+	check(parser.getList(_T("connections"), &connections));
+	for (const tstring& text : connections) {
+		Connection connection;
+		if (FAILED(parseConnection(text, &connection))) {
+			check(parser.error(_T("connections"), _T("<from>:<channel>><to>:<channel> is expected: ") + text));
+		} else {
+			m_connections.push_back(connection);
+		}
+	}
+
+	check(parser.checkUnknownKeys());
+	if (FAILED(hr)) {
+		LOG4CPLUS_ERROR(logger, path << ": Failed to load. See errors above.");
+		return hr;
+	}
+
+	// Builds and prepares a trial chain, so that errors found by effects and the graph are reported now.
+	std::unique_ptr<CEffectChain> chain;
+	hr = build(chain);
+	if (FAILED(hr)) {
+		LOG4CPLUS_ERROR(logger, path << ": Failed to build the chain. See errors above.");
+		return hr;
+	}
+	const long channels = getTrialChannels();
+	hr = chain->prepare(channels, TrialFrames, TrialSampleRate, ASIOSTFloat32LSB);
+	if (FAILED(hr)) {
+		LOG4CPLUS_ERROR(logger, path << ": The chain can't be prepared for " << channels << " channel(s). Check channels of effects and connections.");
+		return hr;
+	}
+
+	m_isLoaded = true;
+	LOG4CPLUS_INFO(logger, "Loaded " << path << ": Effects=" << m_effects.size() << ", Connections=" << m_connections.size()
+		<< ", Latency=" << chain->getLatency() << " at " << TrialSampleRate << " Hz");
+	return S_OK;
+}
+
+/*
+	Parses "<from>:<channel>><to>:<channel>" where <from> and <to> are names of effects, "input" or "output".
+*/
+HRESULT CEffectChainConfig::parseConnection(const tstring& text, Connection* connection) const
+{
+	const size_t arrow = text.find(_T('>'));
+	HR_ASSERT(arrow != tstring::npos, E_INVALIDARG);
+
+	const tstring ends[] = { trim(text.substr(0, arrow)), trim(text.substr(arrow + 1)) };
+	long nodes[2], channels[2];
+	for (int i = 0; i < 2; i++) {
+		const size_t colon = ends[i].find(_T(':'));
+		HR_ASSERT(colon != tstring::npos, E_INVALIDARG);
+		HR_ASSERT(toLong(trim(ends[i].substr(colon + 1)), &channels[i]) && (0 <= channels[i]), E_INVALIDARG);
+
+		const tstring name(trim(ends[i].substr(0, colon)));
+		if (name == InputNodeName) nodes[i] = CEffectGraph::InputNode;
+		else if (name == OutputNodeName) nodes[i] = CEffectGraph::OutputNode;
+		else {
+			nodes[i] = -1;
+			for (size_t effect = 0; effect < m_effects.size(); effect++) {
+				if (m_effects[effect].name == name) nodes[i] = (long)effect;
+			}
+			HR_ASSERT(0 <= nodes[i], E_INVALIDARG);
+		}
+	}
+	// Input channel can't be destination.
+	HR_ASSERT(nodes[1] != CEffectGraph::InputNode, E_INVALIDARG);
+
+	connection->fromNode = nodes[0];
+	connection->fromChannel = channels[0];
+	connection->toNode = nodes[1];
+	connection->toChannel = channels[1];
+	return S_OK;
+}
+
+CEffectChain* CEffectChainConfig::createEffectChain() const
+{
+	if (FAILED(HR_EXPECT(m_isLoaded, E_ILLEGAL_METHOD_CALL))) return NULL;
+
+	std::unique_ptr<CEffectChain> chain;
+	if (FAILED(HR_EXPECT_OK(build(chain)))) return NULL;
+	return chain.release();
+}
+
+/*
+	Builds the chain of effects, initial values of parameters, connections and dither.
+
+	All errors of parameters and connections are logged before returning, as load() does for keys.
+*/
+HRESULT CEffectChainConfig::build(std::unique_ptr<CEffectChain>& chain) const
+{
+	HRESULT hr = S_OK;
+	auto check = [&hr](HRESULT hrItem) { if (FAILED(hrItem) && SUCCEEDED(hr)) hr = hrItem; };
+
+	chain.reset(new CEffectChain());
+	for (const Effect& effect : m_effects) {
+		CEffect* instance = createEffect(effect);
+		HR_ASSERT(chain->addNode(instance, effect.numChannels) != -1, E_FAIL);
+
+		for (const Parameter& parameter : effect.parameters) {
+			CEffectParameter* target = NULL;
+			for (DWORD i = 0; !target && (i < instance->getParameterCount()); i++) {
+				if (!_tcsicmp(instance->getParameter(i)->getName(), parameter.name.c_str())) target = instance->getParameter(i);
+			}
+			if (!target) {
+				LOG4CPLUS_ERROR(logger, (Prefix + parameter.key).c_str() << ": " << instance->getName() << " has no such parameter.");
+				check(E_INVALIDARG);
+			} else if ((parameter.value < target->getMinValue()) || (target->getMaxValue() < parameter.value)) {
+				LOG4CPLUS_ERROR(logger, (Prefix + parameter.key).c_str() << ": Value should be " << target->getMinValue() << " to " << target->getMaxValue());
+				check(E_INVALIDARG);
+			} else {
+				target->setValue(parameter.value);
+			}
+		}
+	}
+
+	for (const Connection& connection : m_connections) {
+		check(HR_EXPECT_OK(chain->connect(connection.fromNode, connection.fromChannel, connection.toNode, connection.toChannel)));
+	}
+
+	chain->setDither(m_dither);
+	for (const auto& channelDither : m_channelDithers) {
+		check(HR_EXPECT_OK(chain->setDither(channelDither.first, channelDither.second)));
+	}
+	return hr;
+}
+
+CEffect* CEffectChainConfig::createEffect(const Effect& effect) const
+{
+	switch (effect.type) {
+	case EffectType::Gain:
+		return new CGainEffect();
+	case EffectType::Compressor:
+		return new CCompressorEffect(CCompressorEffect::Mode::Compressor, effect.lookaheadTime, effect.sidechainChannels);
+	case EffectType::Limiter:
+		return new CCompressorEffect(CCompressorEffect::Mode::Limiter, effect.lookaheadTime, effect.sidechainChannels);
+	case EffectType::PitchShifter:
+		return new CPitchShifterEffect();
+	case EffectType::EchoCanceller:
+		return new CEchoCancellerEffect(effect.tailTime);
+	case EffectType::Plugin:
+		return effect.plugin ? effect.plugin->createEffect() : NULL;
+	default:
+		return NULL;
+	}
+}
+
+long CEffectChainConfig::findEffect(EffectType type) const
+{
+	for (size_t i = 0; i < m_effects.size(); i++) {
+		if (m_effects[i].type == type) return (long)i;
+	}
+	return -1;
+}
+
+/*
+	Returns count of channels of the trial chain.
+
+	The count is that of armed channels if specified.
+	Otherwise it is the smallest count that satisfies channels referred by the file.
+	The chain is prepared again with the count of channels of the device by the engine before the driver starts.
+*/
+long CEffectChainConfig::getTrialChannels() const
+{
+	if (!m_inputs.empty() || !m_outputs.empty()) return (long)max(m_inputs.size(), m_outputs.size());
+
+	long channels = 1;
+	for (const Effect& effect : m_effects) {
+		channels = max(channels, max(effect.numChannels, effect.sidechainChannels + 1));
+	}
+	for (const Connection& connection : m_connections) {
+		if (connection.fromNode < 0) channels = max(channels, connection.fromChannel + 1);
+		if (connection.toNode < 0) channels = max(channels, connection.toChannel + 1);
+	}
+	for (const auto& channelDither : m_channelDithers) {
+		channels = max(channels, channelDither.first + 1);
+	}
+	return channels;
+}
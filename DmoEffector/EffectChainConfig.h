@@ -0,0 +1,109 @@
+#pragma once
+
+#include "EffectChain.h"
+#include "EffectPlugin.h"
+
+/*
+	Effect chain described by a properties file in the same syntax as log4cplus.properties.
+
+	load() parses the file, loads plugins and builds and prepares a trial chain,
+	so that all errors in the file are logged and returned before the driver is set up.
+	createEffectChain() builds a new chain of the configuration, which is compiled into the flat plan by CEffectChain::prepare().
+
+	Keys (all keys start with "EffectChain."):
+	  inputs=<channel>,...           Device input channels armed for the chain. See CAsioHandler::armChannels().
+	  outputs=<channel>,...          Device output channels armed for the chain.
+	                                 Channel n of the chain is the n-th armed channel. Omitted means all channels of the device.
+	  dither=<shape>                 Dither of integer output: None, Tpdf, FirstOrder or Weighted. Default is None.
+	  dither.<channel>=<shape>       Dither of the output channel of the chain.
+	  effects=<name>,...             Effects in order of the chain. Names are used by the keys below and connections.
+	  effect.<name>=<type>           Gain, Compressor, Limiter, PitchShifter, EchoCanceller or Plugin.
+	  effect.<name>.channels=<count> Count of channels of the node. Omitted means all channels of the chain.
+	  effect.<name>.parameter.<parameter name>=<value>
+	                                 Initial value of the parameter.
+	  effect.<name>.lookahead=<seconds>  Lookahead time of Compressor and Limiter.
+	  effect.<name>.sidechain=<count>    Count of sidechain channels of Compressor and Limiter.
+	  effect.<name>.tail=<seconds>       Tail time of EchoCanceller.
+	  effect.<name>.path=<file>          Library of Plugin. Relative path is relative to the directory of the file.
+	  connections=<from>:<channel>><to>:<channel>,...
+	                                 Routing of the graph. "input" and "output" are channels of the chain.
+	                                 "output" as <from> is the signal output to the channel. See CEffectGraph::connect().
+	                                 Omitted means effects are connected linearly.
+	Unknown keys are errors, so that misspelled keys are not ignored.
+*/
+class CEffectChainConfig
+{
+	DISALLOW_COPY_AND_ASSIGN(CEffectChainConfig);
+
+public:
+	ENUM(EffectType,
+		Gain,
+		Compressor,
+		Limiter,
+		PitchShifter,
+		EchoCanceller,
+		Plugin
+	);
+
+	CEffectChainConfig();
+
+	// Returns E_INVALIDARG if the file has an error, which is logged with the key.
+	HRESULT load(LPCTSTR path);
+
+	// Returns new chain of the configuration, or NULL if failed. Called after load().
+	CEffectChain* createEffectChain() const;
+
+	// Device channels to be armed. Both are empty if the file doesn't specify them.
+	const std::vector<long>& getInputs() const { return m_inputs; }
+	const std::vector<long>& getOutputs() const { return m_outputs; }
+
+	long getEffectCount() const { return (long)m_effects.size(); }
+	// Returns index of the first effect of the type in the chain, or -1.
+	long findEffect(EffectType type) const;
+
+	// Format of the trial chain prepared by load().
+	static const long TrialFrames = 512;
+	static const double TrialSampleRate;
+
+protected:
+	struct Parameter {
+		tstring key;
+		tstring name;
+		MP_DATA value;
+	};
+
+	struct Effect {
+		tstring name;
+		EffectType type;
+		long numChannels;
+		double lookaheadTime;
+		long sidechainChannels;
+		double tailTime;
+		std::shared_ptr<CEffectPluginLibrary> plugin;
+		std::vector<Parameter> parameters;
+	};
+
+	struct Connection {
+		long fromNode;
+		long fromChannel;
+		long toNode;
+		long toChannel;
+	};
+
+	class Parser;
+
+	HRESULT parseConnection(const tstring& text, Connection* connection) const;
+	HRESULT build(std::unique_ptr<CEffectChain>& chain) const;
+	CEffect* createEffect(const Effect& effect) const;
+	long getTrialChannels() const;
+
+	tstring m_path;
+	std::vector<long> m_inputs;
+	std::vector<long> m_outputs;
+	CSampleConverter::DitherShape m_dither;
+	std::vector<std::pair<long, CSampleConverter::DitherShape>> m_channelDithers;
+	std::vector<Effect> m_effects;
+	std::vector<Connection> m_connections;
+	// True if the file is loaded and the trial chain is prepared successfully.
+	bool m_isLoaded;
+};
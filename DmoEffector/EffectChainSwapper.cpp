@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "EffectChainSwapper.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("EffectChainSwapper"));
+
+CEffectChainSwapper::CEffectChainSwapper()
+	: m_pending(NULL), m_latest(NULL), m_epoch(0), m_retiring(NULL), m_stopReclaimer(false), m_swapCount(0)
+{
+	m_readers[0] = 0;
+	m_readers[1] = 0;
+}
+
+CEffectChainSwapper::~CEffectChainSwapper()
+{
+	stopReclaimer();
+
+	delete m_pending.exchange(NULL);
+	delete m_retiring;
+}
+
+HRESULT CEffectChainSwapper::initialize(CEffectChain * effectChain)
+{
+	HR_ASSERT(effectChain, E_POINTER);
+
+	delete m_pending.exchange(NULL);
+	m_current.reset(effectChain);
+	m_latest.store(effectChain, std::memory_order_seq_cst);
+
+	if (!m_reclaimerThread) {
+		HR_ASSERT_OK(m_retired.initialize(MaxRetiredChains));
+		HR_ASSERT_OK(m_discarded.initialize(MaxRetiredChains));
+		m_retiredEvent.Attach(CreateEvent(NULL, FALSE, FALSE, NULL));
+		WIN32_ASSERT(NULL != (HANDLE)m_retiredEvent);
+		HR_ASSERT_OK(startReclaimer());
+	}
+	return S_OK;
+}
+
+/*
+	Computes old * cos(theta) and new * sin(theta) gains, where theta goes from 0 to PI/2 over the buffer.
+*/
+HRESULT CEffectChainSwapper::prepare(long frames)
+{
+	HR_ASSERT(0 < frames, E_INVALIDARG);
+
+	static const float halfPi = 1.57079633f;
+
+	HR_ASSERT_OK(m_fadeOutGains.allocate(frames));
+	HR_ASSERT_OK(m_fadeInGains.allocate(frames));
+	for (long i = 0; i < frames; i++) {
+		float theta = halfPi * (i + 0.5f) / frames;
+		m_fadeOutGains[i] = cosf(theta);
+		m_fadeInGains[i] = sinf(theta);
+	}
+	return S_OK;
+}
+
+/*
+	Publishes new chain.
+
+	If the chain published previously has not been taken by the real-time thread yet,
+	it is passed to the reclaimer thread because the real-time thread never uses it.
+	It is not deleted here, because another thread may be reading it through Latest.
+	If the reclaimer thread is behind, this method waits for it.
+*/
+HRESULT CEffectChainSwapper::publish(CEffectChain * effectChain)
+{
+	HR_ASSERT(effectChain, E_POINTER);
+	HR_ASSERT(effectChain->isPrepared(), E_ILLEGAL_METHOD_CALL);
+
+	// The store is ordered before the count of readers loaded by the reclaimer thread. See waitForReaders().
+	m_latest.store(effectChain, std::memory_order_seq_cst);
+	CEffectChain* unused = m_pending.exchange(effectChain);
+	if (unused) {
+		LOG4CPLUS_INFO(logger, "Chain published previously has been discarded without being used.");
+		while (!m_discarded.push(unused)) {
+			SetEvent(m_retiredEvent);
+			Sleep(1);
+		}
+		SetEvent(m_retiredEvent);
+	}
+	return S_OK;
+}
+
+/*
+	Deletes the chain being used, the chains retired and not yet deleted, and takes the chain published last.
+
+	Called before the buffers are re-created, so that every chain left is prepared for the new buffers
+	and no chain holds blocks of the arena allocated for the previous buffers.
+*/
+HRESULT CEffectChainSwapper::flush()
+{
+	HR_ASSERT(m_current, E_ILLEGAL_METHOD_CALL);
+
+	std::unique_ptr<CEffectChain> replaced;
+	CEffectChain* pending = m_pending.exchange(NULL);
+	if (pending) {
+		replaced.reset(m_current.release());
+		m_current.reset(pending);
+	}
+	std::unique_ptr<CEffectChain> retiring(m_retiring);
+	m_retiring = NULL;
+	// Another thread may have taken the chains replaced as the chain published last.
+	waitForReaders();
+	replaced.reset();
+	retiring.reset();
+
+	// The reclaimer thread deletes all chains retired before it exits.
+	stopReclaimer();
+	return startReclaimer();
+}
+
+void CEffectChainSwapper::process(const void * const * inputs, void * const * outputs, long frames)
+{
+	// Pass the chain replaced before to the reclaimer thread if it could not be passed.
+	if (m_retiring) retire();
+
+	CEffectChain* next = (m_retiring ? NULL : m_pending.exchange(NULL));
+	if (next) {
+		crossfade(next, inputs, outputs, frames);
+	} else {
+		m_current->process(inputs, outputs, frames);
+	}
+}
+
+/*
+	Processes the buffer by both old and new chains and outputs them mixed by gains computed by prepare().
+	Then the new chain becomes the current chain.
+
+	If the buffer is not the size prepared, the new chain replaces the old one without crossfade.
+*/
+void CEffectChainSwapper::crossfade(CEffectChain * next, const void * const * inputs, void * const * outputs, long frames)
+{
+	next->setPosition(m_current->getPosition());
+	m_current->processToFloat(inputs, frames);
+	next->processToFloat(inputs, frames);
+
+	long numChannels = (frames == (long)m_fadeOutGains.size()) ? min(m_current->getNumChannels(), next->getNumChannels()) : 0;
+	for (long channel = 0; channel < numChannels; channel++) {
+		const float* oldBuffer = m_current->getBuffer(channel);
+		float* newBuffer = next->getBuffer(channel);
+		for (long i = 0; i < frames; i++) {
+			newBuffer[i] = oldBuffer[i] * m_fadeOutGains[i] + newBuffer[i] * m_fadeInGains[i];
+		}
+	}
+	next->outputFromFloat(outputs, frames);
+
+	m_retiring = m_current.release();
+	m_current.reset(next);
+	m_swapCount++;
+	retire();
+}
+
+/*
+	Passes the replaced chain to the reclaimer thread without blocking.
+*/
+void CEffectChainSwapper::retire()
+{
+	if (m_retired.push(m_retiring)) {
+		m_retiring = NULL;
+		SetEvent(m_retiredEvent);
+	}
+}
+
+/*static*/ DWORD WINAPI CEffectChainSwapper::reclaimerThreadProc(LPVOID param)
+{
+	((CEffectChainSwapper*)param)->reclaim();
+	return 0;
+}
+
+void CEffectChainSwapper::reclaim()
+{
+	while (true) {
+		WaitForSingleObject(m_retiredEvent, INFINITE);
+
+		CEffectChain* chain;
+		while (m_retired.pop(chain) || m_discarded.pop(chain)) {
+			waitForReaders();
+			delete chain;
+		}
+
+		if (m_stopReclaimer) break;
+	}
+}
+
+/*
+	Waits until Latest objects created before this call are destroyed.
+
+	Called after a chain is replaced as the chain published last and before it is deleted.
+	Latest object counted in the new epoch loads m_latest after the replacement, so it can't take the chain.
+	One created before has been counted in the previous epoch before it loaded m_latest,
+	because all of them are sequentially consistent.
+*/
+void CEffectChainSwapper::waitForReaders()
+{
+	CComCritSecLock<CComAutoCriticalSection> lock(m_waitLock);
+	const long parity = m_epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+	while (m_readers[parity].load(std::memory_order_seq_cst)) Sleep(1);
+}
+
+HRESULT CEffectChainSwapper::startReclaimer()
+{
+	m_stopReclaimer = false;
+	m_reclaimerThread.Attach(CreateThread(NULL, 0, reclaimerThreadProc, this, 0, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_reclaimerThread);
+	return S_OK;
+}
+
+void CEffectChainSwapper::stopReclaimer()
+{
+	if (m_reclaimerThread) {
+		m_stopReclaimer = true;
+		SetEvent(m_retiredEvent);
+		WIN32_EXPECT(WAIT_OBJECT_0 == WaitForSingleObject(m_reclaimerThread, INFINITE));
+		m_reclaimerThread.Close();
+	}
+}
+
+CEffectChainSwapper::Latest::Latest(const CEffectChainSwapper& swapper)
+	: m_swapper(swapper)
+{
+	// Counts this object in the current epoch. Retries if the epoch has changed meanwhile,
+	// because the waiter may have checked the count of the epoch before it was incremented.
+	while (true) {
+		const long epoch = m_swapper.m_epoch.load(std::memory_order_seq_cst);
+		m_parity = epoch & 1;
+		m_swapper.m_readers[m_parity].fetch_add(1, std::memory_order_seq_cst);
+		if (m_swapper.m_epoch.load(std::memory_order_seq_cst) == epoch) break;
+		m_swapper.m_readers[m_parity].fetch_sub(1, std::memory_order_release);
+	}
+	m_chain = m_swapper.m_latest.load(std::memory_order_seq_cst);
+}
+
+CEffectChainSwapper::Latest::~Latest()
+{
+	m_swapper.m_readers[m_parity].fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "EffectChain.h"
+
+/*
+	Holds CEffectChain used by the real-time thread and replaces it without stopping the driver.
+
+	New chain is built and prepared by the control thread and published by one atomic pointer exchange.
+	The real-time thread takes the published chain at a buffer boundary and crossfades
+	outputs of the old and new chains over the buffer by equal power curve.
+	Gains of the curve are computed by prepare() for the buffer size.
+	The old chain is deleted by the reclaimer thread, so that the real-time thread never frees memory.
+
+	Threads other than the control thread read the chain published last through Latest.
+	A chain replaced or discarded is deleted only after no Latest object exists,
+	because such a thread may have taken the chain before it was replaced.
+*/
+class CEffectChainSwapper
+{
+	DISALLOW_COPY_AND_ASSIGN(CEffectChainSwapper);
+
+public:
+	CEffectChainSwapper();
+	~CEffectChainSwapper();
+
+	// Sets the chain to be used first and starts the reclaimer thread.
+	// Should not be called while the real-time thread is running.
+	HRESULT initialize(CEffectChain* effectChain);
+
+	// Computes gains of the crossfade for buffers of frames.
+	// Should not be called while the real-time thread is running.
+	HRESULT prepare(long frames);
+
+	// Called by the control thread.
+	// The chain should have been prepared. This object takes ownership.
+	// The chain published previously and not taken by the real-time thread is passed to the reclaimer thread.
+	HRESULT publish(CEffectChain* effectChain);
+
+	// Makes the chain published last the current chain and deletes all other chains.
+	// Should not be called while the real-time thread is running.
+	HRESULT flush();
+
+	// Returns the chain published last.
+	// Should be called by the same thread as publish(). Other threads should use Latest.
+	// Parameter changes should be posted to this chain by the same thread as publish().
+	CEffectChain* getLatest() const { return m_latest.load(std::memory_order_acquire); }
+
+	// Holds the chain published last while this object exists, so that the chain is not deleted.
+	// Should be kept only while the chain is used, because chains replaced meanwhile are not deleted.
+	class Latest
+	{
+		DISALLOW_COPY_AND_ASSIGN(Latest);
+
+	public:
+		Latest(const CEffectChainSwapper& swapper);
+		~Latest();
+
+		CEffectChain* get() const { return m_chain; }
+		CEffectChain* operator->() const { return m_chain; }
+
+	protected:
+		const CEffectChainSwapper& m_swapper;
+		long m_parity;			// Index of m_readers counting this object.
+		CEffectChain* m_chain;
+	};
+
+	// Called by the real-time thread.
+	void process(const void* const* inputs, void* const* outputs, long frames);
+
+	// Count of chains replaced by the real-time thread.
+	long getSwapCount() const { return m_swapCount; }
+
+	static const size_t MaxRetiredChains = 16;
+
+protected:
+	void crossfade(CEffectChain* next, const void* const* inputs, void* const* outputs, long frames);
+	void retire();
+
+	static DWORD WINAPI reclaimerThreadProc(LPVOID param);
+	void reclaim();
+	void waitForReaders();
+	HRESULT startReclaimer();
+	void stopReclaimer();
+
+	// Chain used by the real-time thread.
+	std::unique_ptr<CEffectChain> m_current;
+
+	// Chain published by the control thread and not yet taken by the real-time thread.
+	std::atomic<CEffectChain*> m_pending;
+	// Read by any thread, such as the work queue thread to get latency.
+	std::atomic<CEffectChain*> m_latest;
+	// Count of Latest objects created in even and odd epochs.
+	// waitForReaders() starts new epoch and waits only for readers of the previous one, so that new readers can't delay it.
+	mutable std::atomic<long> m_readers[2];
+	std::atomic<long> m_epoch;
+	// Serializes waitForReaders() of the reclaimer thread and flush().
+	CComAutoCriticalSection m_waitLock;
+
+	// Gains of the old and new chains for each frame of the crossfade.
+	CAlignedBuffer<float> m_fadeOutGains;
+	CAlignedBuffer<float> m_fadeInGains;
+
+	// Chain replaced by the real-time thread and not yet passed to the reclaimer thread.
+	CEffectChain* m_retiring;
+
+	// Chains to be deleted by the reclaimer thread.
+	// Chains replaced by the real-time thread, and chains discarded by publish() without being used.
+	CWaitFreeQueue<CEffectChain*> m_retired;
+	CWaitFreeQueue<CEffectChain*> m_discarded;
+	CHandle m_retiredEvent;
+	CHandle m_reclaimerThread;
+	std::atomic<bool> m_stopReclaimer;
+
+	long m_swapCount;
+};
@@ -0,0 +1,269 @@
+#include "stdafx.h"
+#include "EffectGraph.h"
+
+#include <algorithm>
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("EffectGraph"));
+
+CEffectGraph::CEffectGraph()
+	: m_firstOutputMix(0), m_bufferCount(0), m_maxParallelism(0), m_latency(0)
+{
+}
+
+long CEffectGraph::addNode(long numChannels /*= AllChannels*/)
+{
+	m_nodeChannels.push_back(numChannels);
+	return (long)m_nodeChannels.size() - 1;
+}
+
+HRESULT CEffectGraph::connect(long fromNode, long fromChannel, long toNode, long toChannel)
+{
+	HR_ASSERT((OutputNode <= fromNode) && (fromNode < getNodeCount()), E_INVALIDARG);
+	HR_ASSERT(((toNode == OutputNode) || (0 <= toNode)) && (toNode < getNodeCount()), E_INVALIDARG);
+	HR_ASSERT((0 <= fromChannel) && (0 <= toChannel), E_INVALIDARG);
+
+	Connection connection = { { fromNode, fromChannel }, toNode, toChannel };
+	m_connections.push_back(connection);
+	return S_OK;
+}
+
+/*
+	Compiles the graph into schedule.
+
+	Returns E_INVALIDARG if connections refer to channel that doesn't exist or the graph has a cycle.
+*/
+HRESULT CEffectGraph::compile(long numChannels, const std::vector<long>& latencies)
+{
+	HR_ASSERT(0 < numChannels, E_INVALIDARG);
+	HR_ASSERT(latencies.size() == m_nodeChannels.size(), E_INVALIDARG);
+
+	const long nodeCount = getNodeCount();
+	m_resolvedChannels.resize(nodeCount);
+	for (long node = 0; node < nodeCount; node++) {
+		m_resolvedChannels[node] = getNodeChannels(node, numChannels);
+	}
+	auto channelsOf = [this, numChannels](long node) {
+		return ((node == InputNode) || (node == OutputNode)) ? numChannels : m_resolvedChannels[node];
+	};
+
+	// Connect nodes linearly if no connection is specified.
+	std::vector<Connection> connections(m_connections);
+	if (connections.empty()) {
+		long previous = InputNode;
+		for (long node = 0; node <= nodeCount; node++) {
+			long to = (node < nodeCount) ? node : OutputNode;
+			for (long channel = 0; channel < min(channelsOf(previous), channelsOf(to)); channel++) {
+				Connection connection = { { previous, channel }, to, channel };
+				connections.push_back(connection);
+			}
+			previous = to;
+		}
+	}
+
+	// Sources of each channel of each node and output channels.
+	std::vector<std::vector<std::vector<Source>>> inputs(nodeCount);
+	for (long node = 0; node < nodeCount; node++) inputs[node].resize(m_resolvedChannels[node]);
+	std::vector<std::vector<Source>> outputs(numChannels);
+	for (size_t i = 0; i < connections.size(); i++) {
+		const Connection& c = connections[i];
+		if ((channelsOf(c.from.node) <= c.from.channel) || (channelsOf(c.toNode) <= c.toChannel)) {
+			LOG4CPLUS_ERROR(logger, "Invalid connection: Node " << c.from.node << ":" << c.from.channel << " -> " << c.toNode << ":" << c.toChannel);
+			return E_INVALIDARG;
+		}
+		if (c.from.node == OutputNode) continue;
+		if (c.toNode == OutputNode) outputs[c.toChannel].push_back(c.from);
+		else inputs[c.toNode][c.toChannel].push_back(c.from);
+	}
+	// Connection from output channel is replaced with connections from sources of the output channel.
+	for (size_t i = 0; i < connections.size(); i++) {
+		const Connection& c = connections[i];
+		if (c.from.node != OutputNode) continue;
+		HR_ASSERT(c.toNode != OutputNode, E_INVALIDARG);
+		const std::vector<Source>& sources = outputs[c.from.channel];
+		inputs[c.toNode][c.toChannel].insert(inputs[c.toNode][c.toChannel].end(), sources.begin(), sources.end());
+	}
+
+	// Level of each node is 1 + maximum level of its sources.
+	std::vector<long> levels(nodeCount, 0);
+	std::vector<int> marks(nodeCount, 0);
+	long levelCount = 0;
+	for (long node = 0; node < nodeCount; node++) {
+		HR_ASSERT_OK(computeLevel(node, inputs, levels, marks));
+		levelCount = max(levelCount, levels[node] + 1);
+	}
+
+	// Latency at input and output of each node.
+	// Nodes are visited in order of level so that sources are visited before.
+	std::vector<long> order(nodeCount);
+	for (long node = 0; node < nodeCount; node++) order[node] = node;
+	std::stable_sort(order.begin(), order.end(), [&levels](long a, long b) { return levels[a] < levels[b]; });
+	std::vector<long> inputLatency(nodeCount, 0), outputLatency(nodeCount, 0);
+	auto latencyOf = [&outputLatency](const Source& source) {
+		return (source.node == InputNode) ? 0 : outputLatency[source.node];
+	};
+	for (long i = 0; i < nodeCount; i++) {
+		long node = order[i];
+		for (long channel = 0; channel < m_resolvedChannels[node]; channel++) {
+			const std::vector<Source>& sources = inputs[node][channel];
+			for (size_t j = 0; j < sources.size(); j++) {
+				inputLatency[node] = max(inputLatency[node], latencyOf(sources[j]));
+			}
+		}
+		outputLatency[node] = inputLatency[node] + latencies[node];
+	}
+	m_latency = 0;
+	for (long channel = 0; channel < numChannels; channel++) {
+		for (size_t i = 0; i < outputs[channel].size(); i++) {
+			m_latency = max(m_latency, latencyOf(outputs[channel][i]));
+		}
+	}
+
+	// Key identifies channel of input or node: Input channels come first and then channels of each node.
+	std::vector<long> firstKey(nodeCount);
+	long keyCount = numChannels;
+	for (long node = 0; node < nodeCount; node++) {
+		firstKey[node] = keyCount;
+		keyCount += m_resolvedChannels[node];
+	}
+	auto keyOf = [&firstKey](const Source& source) {
+		return (source.node == InputNode) ? source.channel : firstKey[source.node] + source.channel;
+	};
+
+	// Count consumers and the last level in which each channel is used.
+	// Output channels are used in levelCount.
+	std::vector<long> consumers(keyCount, 0);
+	std::vector<long> lastUse(keyCount, -1);
+	for (long node = 0; node < nodeCount; node++) {
+		for (long channel = 0; channel < m_resolvedChannels[node]; channel++) {
+			lastUse[firstKey[node] + channel] = levels[node];
+			const std::vector<Source>& sources = inputs[node][channel];
+			for (size_t i = 0; i < sources.size(); i++) {
+				long key = keyOf(sources[i]);
+				consumers[key]++;
+				lastUse[key] = max(lastUse[key], levels[node]);
+			}
+		}
+	}
+	for (long channel = 0; channel < numChannels; channel++) {
+		for (size_t i = 0; i < outputs[channel].size(); i++) {
+			long key = keyOf(outputs[channel][i]);
+			consumers[key]++;
+			lastUse[key] = levelCount;
+		}
+	}
+
+	// Buffer allocation.
+	// Buffer used by a channel is released after the last level in which the channel is used.
+	// Buffer released in a level is not reused in the same level because nodes in the level run concurrently.
+	std::vector<long> bufferOf(keyCount, -1);
+	std::vector<long> bufferLastUse;
+	std::vector<bool> bufferFree;
+	auto release = [&](long level) {
+		for (size_t buffer = 0; buffer < bufferLastUse.size(); buffer++) {
+			if (bufferLastUse[buffer] < level) bufferFree[buffer] = true;
+		}
+	};
+	auto allocate = [&](long lastUseLevel) {
+		long buffer = 0;
+		for (; buffer < (long)bufferFree.size(); buffer++) {
+			if (bufferFree[buffer]) break;
+		}
+		if (buffer == (long)bufferFree.size()) {
+			bufferFree.push_back(false);
+			bufferLastUse.push_back(lastUseLevel);
+		}
+		bufferFree[buffer] = false;
+		bufferLastUse[buffer] = lastUseLevel;
+		return buffer;
+	};
+	// Assigns buffer to the channel whose sources should be delayed to be aligned with the latency.
+	// Shares buffer of the source if the channel is the only consumer of it and no delay is necessary.
+	auto assign = [&](const std::vector<Source>& sources, long latency, long lastUseLevel) {
+		if ((sources.size() == 1) && (consumers[keyOf(sources[0])] == 1) && (latencyOf(sources[0]) == latency)) {
+			long buffer = bufferOf[keyOf(sources[0])];
+			bufferLastUse[buffer] = lastUseLevel;
+			return buffer;
+		}
+		long buffer = allocate(lastUseLevel);
+		Mix mix = { buffer, (long)m_mixSources.size(), (long)sources.size() };
+		for (size_t i = 0; i < sources.size(); i++) {
+			MixSource source = { bufferOf[keyOf(sources[i])], latency - latencyOf(sources[i]) };
+			m_mixSources.push_back(source);
+		}
+		m_mixes.push_back(mix);
+		return buffer;
+	};
+
+	m_steps.clear();
+	m_levels.clear();
+	m_channelBuffers.clear();
+	m_mixes.clear();
+	m_mixSources.clear();
+	m_inputBuffers.assign(numChannels, -1);
+	m_outputBuffers.assign(numChannels, -1);
+	m_maxParallelism = 0;
+
+	for (long channel = 0; channel < numChannels; channel++) {
+		if (consumers[channel]) {
+			m_inputBuffers[channel] = bufferOf[channel] = allocate(lastUse[channel]);
+		}
+	}
+
+	for (long level = 0; level < levelCount; level++) {
+		release(level);
+		m_levels.push_back((long)m_steps.size());
+		for (long node = 0; node < nodeCount; node++) {
+			if (levels[node] != level) continue;
+			Step step = { node, m_resolvedChannels[node], (long)m_channelBuffers.size(), (long)m_mixes.size(), 0 };
+			for (long channel = 0; channel < step.numChannels; channel++) {
+				long key = firstKey[node] + channel;
+				bufferOf[key] = assign(inputs[node][channel], inputLatency[node], max(lastUse[key], level));
+				m_channelBuffers.push_back(bufferOf[key]);
+			}
+			step.mixCount = (long)m_mixes.size() - step.firstMix;
+			m_steps.push_back(step);
+		}
+		m_maxParallelism = max(m_maxParallelism, (long)m_steps.size() - m_levels.back());
+	}
+	m_levels.push_back((long)m_steps.size());
+
+	release(levelCount);
+	m_firstOutputMix = (long)m_mixes.size();
+	for (long channel = 0; channel < numChannels; channel++) {
+		m_outputBuffers[channel] = assign(outputs[channel], m_latency, levelCount);
+	}
+
+	m_bufferCount = (long)bufferFree.size();
+	LOG4CPLUS_INFO(logger, "Compiled " << nodeCount << " node(s) into " << levelCount << " level(s): "
+		<< m_bufferCount << " buffer(s), max parallelism=" << m_maxParallelism << ", latency=" << m_latency);
+	return S_OK;
+}
+
+/*
+	Computes level of the node by depth first search.
+
+	marks: 0 = not visited, 1 = visiting, 2 = done. Visiting node again means a cycle.
+*/
+HRESULT CEffectGraph::computeLevel(long node, const std::vector<std::vector<std::vector<Source>>>& inputs, std::vector<long>& levels, std::vector<int>& marks) const
+{
+	if (marks[node] == 2) return S_OK;
+	if (marks[node] == 1) {
+		LOG4CPLUS_ERROR(logger, "Graph has a cycle at node " << node);
+		return E_INVALIDARG;
+	}
+
+	marks[node] = 1;
+	long level = 0;
+	for (size_t channel = 0; channel < inputs[node].size(); channel++) {
+		const std::vector<Source>& sources = inputs[node][channel];
+		for (size_t i = 0; i < sources.size(); i++) {
+			long source = sources[i].node;
+			if (source == InputNode) continue;
+			HR_ASSERT_OK(computeLevel(source, inputs, levels, marks));
+			level = max(level, levels[source] + 1);
+		}
+	}
+	levels[node] = level;
+	marks[node] = 2;
+	return S_OK;
+}
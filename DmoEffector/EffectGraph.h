@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+	Topology of effect nodes compiled into schedule.
+
+	Each node processes its channels in place. Input of each channel of the node is
+	sum of channels of other nodes or input channels of the graph.
+	Output channels of the graph are also sum of channels of nodes.
+
+	compile() method sorts nodes topologically into levels. Nodes in the same level
+	don't depend on each other and can be executed concurrently.
+	Buffers are assigned to channels by lifetime analysis so that scratch memory is minimized.
+	Channel that is the only consumer of its source shares the buffer of the source without copying.
+
+	Latency of each node is compensated by delaying sources that arrive earlier than others,
+	so that all inputs of each node and all output channels are aligned.
+*/
+class CEffectGraph
+{
+public:
+	static const long InputNode = -1;		// Source node that represents input channels of the graph.
+	static const long OutputNode = -2;		// Destination node that represents output channels of the graph.
+	static const long AllChannels = 0;		// Count of channels of the node is the same as the graph.
+
+	CEffectGraph();
+
+	// Adds node and returns index of it.
+	long addNode(long numChannels = AllChannels);
+	long getNodeCount() const { return (long)m_nodeChannels.size(); }
+
+	// Connects channel of the node to input channel of another node or output channel.
+	// OutputNode as fromNode connects sources of the output channel, which is used as reference signal such as echo canceller.
+	// If no connection is made, nodes are connected linearly in order of addition.
+	HRESULT connect(long fromNode, long fromChannel, long toNode, long toChannel);
+
+	long getNodeChannels(long node, long numChannels) const { return m_nodeChannels[node] ? m_nodeChannels[node] : numChannels; }
+
+	// numChannels: Count of input and output channels of the graph.
+	// latencies: Latency of each node in samples.
+	HRESULT compile(long numChannels, const std::vector<long>& latencies);
+
+	// Source of the mix delayed to be aligned with other sources.
+	struct MixSource {
+		long buffer;
+		long delay;				// Delay in samples.
+	};
+
+	// Mix sums source buffers into the buffer.
+	struct Mix {
+		long buffer;
+		long firstSource;		// Index of the first source in getMixSources().
+		long sourceCount;		// If 0, the buffer is cleared.
+	};
+
+	// Step executes one node.
+	struct Step {
+		long node;
+		long numChannels;
+		long firstChannel;		// Index of buffer of the first channel in getChannelBuffers().
+		long firstMix;			// Index of the first mix in getMixes() executed before the node.
+		long mixCount;
+	};
+
+	const std::vector<Step>& getSteps() const { return m_steps; }
+	// Index of the first step of each level followed by count of steps.
+	const std::vector<long>& getLevels() const { return m_levels; }
+	long getLevelCount() const { return (long)m_levels.size() - 1; }
+	const std::vector<long>& getChannelBuffers() const { return m_channelBuffers; }
+	const std::vector<Mix>& getMixes() const { return m_mixes; }
+	const std::vector<MixSource>& getMixSources() const { return m_mixSources; }
+	// Mixes executed after all steps to make output channels.
+	long getFirstOutputMix() const { return m_firstOutputMix; }
+	// Buffer of each input channel. -1 if the input channel is not used.
+	const std::vector<long>& getInputBuffers() const { return m_inputBuffers; }
+	const std::vector<long>& getOutputBuffers() const { return m_outputBuffers; }
+	long getBufferCount() const { return m_bufferCount; }
+	long getMaxParallelism() const { return m_maxParallelism; }
+	// Latency from input channels to output channels in samples.
+	long getLatency() const { return m_latency; }
+
+protected:
+	struct Source {
+		long node;
+		long channel;
+	};
+
+	struct Connection {
+		Source from;
+		long toNode;
+		long toChannel;
+	};
+
+	HRESULT computeLevel(long node, const std::vector<std::vector<std::vector<Source>>>& inputs, std::vector<long>& levels, std::vector<int>& marks) const;
+
+	std::vector<long> m_nodeChannels;
+	std::vector<Connection> m_connections;
+
+	// Compiled schedule.
+	std::vector<long> m_resolvedChannels;
+	std::vector<Step> m_steps;
+	std::vector<long> m_levels;
+	std::vector<long> m_channelBuffers;
+	std::vector<Mix> m_mixes;
+	std::vector<MixSource> m_mixSources;
+	long m_firstOutputMix;
+	std::vector<long> m_inputBuffers;
+	std::vector<long> m_outputBuffers;
+	long m_bufferCount;
+	long m_maxParallelism;
+	long m_latency;
+};
@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "EffectParameter.h"
+#include "VectorOps.h"
+
+CEffectParameter::CEffectParameter(LPCTSTR name, MP_DATA minValue, MP_DATA maxValue, MP_DATA neutralValue,
+									Smoothing smoothing /*= Smoothing::Linear*/, double smoothingTime /*= 0.01*/)
+	: m_name(name), m_minValue(minValue), m_maxValue(maxValue), m_neutralValue(neutralValue)
+	, m_value(neutralValue), m_target(neutralValue)
+	, m_smoothing(smoothing), m_smoothingTime(smoothingTime)
+	, m_rampLength(1), m_rampRemaining(0), m_rampStep(0), m_coefficient(0)
+	, m_hasSegment(false), m_segmentStart(0), m_segmentEnd(0), m_segmentStartValue(0), m_segmentEndValue(0), m_curve(MP_CURVE_JUMP)
+	, m_isConstant(true)
+{
+}
+
+HRESULT CEffectParameter::prepare(long maxFrames, double sampleRate)
+{
+	HR_ASSERT(0 < maxFrames, E_INVALIDARG);
+	HR_ASSERT(0 < sampleRate, E_INVALIDARG);
+
+	HR_ASSERT_OK(m_values.allocate(maxFrames));
+
+	double samples = m_smoothingTime * sampleRate;
+	m_rampLength = max(1, (long)samples);
+	m_coefficient = (float)((1 < samples) ? exp(-1.0 / samples) : 0);
+
+	setValue(m_value);
+	return S_OK;
+}
+
+void CEffectParameter::setValue(MP_DATA value)
+{
+	m_value = m_target = clamp(value);
+	m_rampRemaining = 0;
+	m_hasSegment = false;
+	m_isConstant = true;
+}
+
+/*
+	Starts envelope segment.
+
+	startSample and endSample are sample positions converted from rtStart and rtEnd of the segment.
+	Flags of the segment specify start value:
+		MPF_ENVLP_STANDARD: valStart.
+		MPF_ENVLP_BEGIN_CURRENTVAL: Current value.
+		MPF_ENVLP_BEGIN_NEUTRALVAL: Neutral value.
+*/
+void CEffectParameter::addEnvelope(const MP_ENVELOPE_SEGMENT & segment, LONGLONG startSample, LONGLONG endSample)
+{
+	MP_DATA startValue = clamp(segment.valStart);
+	if (segment.flags & MPF_ENVLP_BEGIN_CURRENTVAL) startValue = m_value;
+	else if (segment.flags & MPF_ENVLP_BEGIN_NEUTRALVAL) startValue = m_neutralValue;
+	MP_DATA endValue = clamp(segment.valEnd);
+
+	if ((segment.iCurve == MP_CURVE_JUMP) || (endSample <= startSample)) {
+		m_hasSegment = false;
+		setTarget(endValue);
+	} else {
+		m_hasSegment = true;
+		m_segmentStart = startSample;
+		m_segmentEnd = endSample;
+		m_segmentStartValue = startValue;
+		m_segmentEndValue = endValue;
+		m_curve = segment.iCurve;
+		m_value = m_target = startValue;
+		m_rampRemaining = 0;
+	}
+}
+
+void CEffectParameter::setTarget(MP_DATA target)
+{
+	m_target = target;
+	switch (m_smoothing) {
+	case Smoothing::Linear:
+		m_rampRemaining = m_rampLength;
+		m_rampStep = (m_target - m_value) / m_rampLength;
+		break;
+	case Smoothing::Exponential:
+		break;
+	default:
+		m_value = m_target;
+		break;
+	}
+}
+
+/*
+	Renders values of frames samples starting at position.
+*/
+void CEffectParameter::render(LONGLONG position, long frames)
+{
+	m_isConstant = true;
+	long offset = 0;
+
+	if (m_hasSegment) {
+		long count = (long)max(0LL, min((LONGLONG)frames, m_segmentEnd - position));
+		if (count) {
+			renderSegment(m_values, position, count);
+			m_isConstant = false;
+			offset = count;
+		}
+		if (offset < frames) {
+			// Segment has ended.
+			m_hasSegment = false;
+			m_value = m_target = m_segmentEndValue;
+		}
+	}
+
+	if (offset < frames) {
+		if (m_value != m_target) {
+			renderSmoothing(&m_values[offset], frames - offset);
+			m_isConstant = false;
+		} else if (!m_isConstant) {
+			vecFill(&m_values[offset], m_value, frames - offset);
+		}
+	}
+}
+
+/*
+	Values are expanded from the end so that they are expanded in place.
+*/
+void CEffectParameter::expand(long frames, long factor)
+{
+	if (m_isConstant) return;
+
+	for (long i = frames - 1; 0 <= i; i--) {
+		vecFill(&m_values[i * factor], m_values[i], factor);
+	}
+}
+
+/*
+	Renders curve of the envelope segment.
+
+	Curves are calculated in the same way as DMO samples using IMediaParams:
+		Linear: t, Square: t^2, Inverse square: sqrt(t), Sine: (sin((t - 0.5) * PI) + 1) / 2
+*/
+void CEffectParameter::renderSegment(float* values, LONGLONG position, long count)
+{
+	const float duration = (float)(m_segmentEnd - m_segmentStart);
+	const float t0 = (float)(position - m_segmentStart) / duration;
+	const float dt = 1.0f / duration;
+	const float range = m_segmentEndValue - m_segmentStartValue;
+
+	// Render t and then convert it to value.
+	vecRamp(values, t0, dt, count);
+
+	const __m128 start = _mm_set1_ps(m_segmentStartValue);
+	const __m128 r = _mm_set1_ps(range);
+	long i = 0;
+	switch (m_curve) {
+	case MP_CURVE_SQUARE:
+		for (; i + 4 <= count; i += 4) {
+			__m128 t = _mm_loadu_ps(&values[i]);
+			_mm_storeu_ps(&values[i], _mm_add_ps(start, _mm_mul_ps(r, _mm_mul_ps(t, t))));
+		}
+		for (; i < count; i++) values[i] = m_segmentStartValue + range * values[i] * values[i];
+		break;
+	case MP_CURVE_INVSQUARE:
+		for (; i + 4 <= count; i += 4) {
+			__m128 t = _mm_loadu_ps(&values[i]);
+			_mm_storeu_ps(&values[i], _mm_add_ps(start, _mm_mul_ps(r, _mm_sqrt_ps(t))));
+		}
+		for (; i < count; i++) values[i] = m_segmentStartValue + range * sqrtf(values[i]);
+		break;
+	case MP_CURVE_SINE:
+		for (; i < count; i++) {
+			static const float pi = 3.14159265f;
+			values[i] = m_segmentStartValue + range * (sinf((values[i] - 0.5f) * pi) + 1.0f) * 0.5f;
+		}
+		break;
+	case MP_CURVE_LINEAR:
+	default:
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_ps(&values[i], _mm_add_ps(start, _mm_mul_ps(r, _mm_loadu_ps(&values[i]))));
+		}
+		for (; i < count; i++) values[i] = m_segmentStartValue + range * values[i];
+		break;
+	}
+
+	m_value = m_target = values[count - 1];
+}
+
+/*
+	Renders values going to the target.
+*/
+void CEffectParameter::renderSmoothing(float * values, long count)
+{
+	switch (m_smoothing) {
+	case Smoothing::Linear:
+		{
+			long n = min(count, m_rampRemaining);
+			vecRamp(values, m_value + m_rampStep, m_rampStep, n);
+			m_rampRemaining -= n;
+			m_value = m_rampRemaining ? values[n - 1] : m_target;
+			vecFill(&values[n], m_value, count - n);
+		}
+		break;
+	case Smoothing::Exponential:
+		{
+			// values[i] = target + (value - target) * a^(i + 1)
+			const float a = m_coefficient;
+			const float a2 = a * a;
+			const float a4 = a2 * a2;
+			const float diff = m_value - m_target;
+			const __m128 target = _mm_set1_ps(m_target);
+			const __m128 step = _mm_set1_ps(a4);
+			__m128 d = _mm_mul_ps(_mm_set1_ps(diff), _mm_setr_ps(a, a2, a2 * a, a4));
+			long i = 0;
+			for (; i + 4 <= count; i += 4) {
+				_mm_storeu_ps(&values[i], _mm_add_ps(target, d));
+				d = _mm_mul_ps(d, step);
+			}
+			float last = (i ? values[i - 1] : m_value) - m_target;
+			for (; i < count; i++) {
+				last *= a;
+				values[i] = m_target + last;
+			}
+			m_value = values[count - 1];
+
+			// Stop smoothing when the difference becomes inaudible.
+			if (fabsf(m_value - m_target) <= (m_maxValue - m_minValue) * 1e-5f) m_value = m_target;
+		}
+		break;
+	default:
+		m_value = m_target;
+		vecFill(values, m_value, count);
+		break;
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <medparam.h>
+
+#include "AlignedBuffer.h"
+
+/*
+	Parameter of the effect that can be changed while running.
+
+	Changes are given as envelope segments that follow semantics of IMediaParams::AddEnvelope().
+	MP_CURVE_JUMP segment changes the value to valEnd immediately and the change is smoothed
+	so that zipper noise is not produced.
+	Other curves change the value from valStart to valEnd between rtStart and rtEnd.
+
+	Values of each sample are rendered by render() method which is called by the real-time thread
+	for each sub-block processed by the effect.
+*/
+class CEffectParameter
+{
+	DISALLOW_COPY_AND_ASSIGN(CEffectParameter);
+
+public:
+	ENUM(Smoothing,
+		None,			/// Value jumps to the target.
+		Linear,			/// Value goes to the target linearly in smoothing time.
+		Exponential		/// Value approaches to the target exponentially with time constant of smoothing time.
+	);
+
+	CEffectParameter(LPCTSTR name, MP_DATA minValue, MP_DATA maxValue, MP_DATA neutralValue,
+					Smoothing smoothing = Smoothing::Linear, double smoothingTime = 0.01);
+
+	HRESULT prepare(long maxFrames, double sampleRate);
+
+	// Sets value immediately without smoothing.
+	// Should not be called while running.
+	void setValue(MP_DATA value);
+
+	// Called by the real-time thread.
+	void addEnvelope(const MP_ENVELOPE_SEGMENT& segment, LONGLONG startSample, LONGLONG endSample);
+	void render(LONGLONG position, long frames);
+	// Repeats each rendered value factor times for the effect that runs at factor times the sample rate.
+	// prepare() should be called with maxFrames multiplied by the factor.
+	void expand(long frames, long factor);
+
+	// Returns true if the value is constant in the frames of last render() call.
+	// In this case, values returned by getValues() are not rendered and getValue() should be used.
+	bool isConstant() const { return m_isConstant; }
+	MP_DATA getValue() const { return m_value; }
+	const float* getValues() const { return m_values; }
+
+	LPCTSTR getName() const { return m_name.c_str(); }
+	MP_DATA getMinValue() const { return m_minValue; }
+	MP_DATA getMaxValue() const { return m_maxValue; }
+	MP_DATA getNeutralValue() const { return m_neutralValue; }
+
+protected:
+	MP_DATA clamp(MP_DATA value) const { return max(m_minValue, min(m_maxValue, value)); }
+	void setTarget(MP_DATA target);
+	void renderSegment(float* values, LONGLONG position, long count);
+	void renderSmoothing(float* values, long count);
+
+	const tstring m_name;
+	const MP_DATA m_minValue;
+	const MP_DATA m_maxValue;
+	const MP_DATA m_neutralValue;
+
+	// Current value and target of smoothing.
+	MP_DATA m_value;
+	MP_DATA m_target;
+
+	Smoothing m_smoothing;
+	double m_smoothingTime;			// Smoothing time in seconds.
+	long m_rampLength;				// Count of samples to reach the target by linear smoothing.
+	long m_rampRemaining;
+	float m_rampStep;
+	float m_coefficient;			// Coefficient per sample of exponential smoothing.
+
+	// Envelope segment in progress.
+	bool m_hasSegment;
+	LONGLONG m_segmentStart;
+	LONGLONG m_segmentEnd;
+	MP_DATA m_segmentStartValue;
+	MP_DATA m_segmentEndValue;
+	MP_CURVE_TYPE m_curve;
+
+	bool m_isConstant;
+	CAlignedBuffer<float> m_values;
+};
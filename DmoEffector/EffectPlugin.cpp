@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "EffectPlugin.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("EffectPlugin"));
+
+CEffectPluginLibrary::CEffectPluginLibrary()
+	: m_module(NULL), m_descriptor(NULL)
+{
+}
+
+CEffectPluginLibrary::~CEffectPluginLibrary()
+{
+	if (m_module) FreeLibrary(m_module);
+}
+
+HRESULT CEffectPluginLibrary::load(LPCTSTR path)
+{
+	HR_ASSERT(path, E_POINTER);
+	HR_ASSERT(!m_module, E_ILLEGAL_METHOD_CALL);
+
+	HMODULE module = LoadLibrary(path);
+	WIN32_ASSERT(module);
+	EffectPluginEntry entry = (EffectPluginEntry)GetProcAddress(module, EffectPluginEntryName);
+	if (!entry) {
+		LOG4CPLUS_ERROR(logger, path << ": " << EffectPluginEntryName << "() is not exported.");
+		FreeLibrary(module);
+		return HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+	}
+
+	const EffectPluginDescriptor* descriptor = entry(EffectPluginAbiVersion);
+	const char* error = validateEffectPluginDescriptor(descriptor);
+	if (error) {
+		LOG4CPLUS_ERROR(logger, path << ": " << error << " ABI version=0x" << std::hex << (descriptor ? descriptor->abiVersion : 0)
+			<< ", Host=0x" << EffectPluginAbiVersion << std::dec);
+		FreeLibrary(module);
+		return HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH);
+	}
+
+	m_module = module;
+	m_descriptor = descriptor;
+	m_name = CA2T(descriptor->name, CP_UTF8);
+	m_path = path;
+	LOG4CPLUS_INFO(logger, "Loaded " << m_name.c_str() << " from " << path << ": ABI version=0x" << std::hex << descriptor->abiVersion << std::dec
+		<< ", Flags=0x" << std::hex << descriptor->flags << std::dec << ", Parameters=" << descriptor->parameterCount);
+	return S_OK;
+}
+
+CEffect* CEffectPluginLibrary::createEffect()
+{
+	if (FAILED(HR_EXPECT(isLoaded(), E_ILLEGAL_METHOD_CALL))) return NULL;
+
+	void* instance = m_descriptor->create();
+	if (FAILED(HR_EXPECT(instance, E_OUTOFMEMORY))) return NULL;
+	return new CPluginEffect(shared_from_this(), instance);
+}
+
+CPluginEffect::CPluginEffect(const std::shared_ptr<CEffectPluginLibrary>& library, void* instance)
+	: m_library(library), m_descriptor(library->getDescriptor()), m_instance(instance)
+	, m_latency(0), m_tailLength(0)
+{
+	for (uint32_t i = 0; i < m_descriptor->parameterCount; i++) {
+		const EffectPluginParameter& parameter = m_descriptor->parameters[i];
+		addParameter(new CEffectParameter(CA2T(parameter.name, CP_UTF8), parameter.minValue, parameter.maxValue, parameter.defaultValue,
+					CEffectParameter::Smoothing::None));
+	}
+	m_sentValues.resize(m_descriptor->parameterCount);
+}
+
+CPluginEffect::~CPluginEffect()
+{
+	m_descriptor->destroy(m_instance);
+}
+
+/*
+	Prepares the plugin and sends current values of all parameters.
+*/
+HRESULT CPluginEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+
+	const int32_t result = m_descriptor->prepare(m_instance, (uint32_t)numChannels, (uint32_t)maxFrames, sampleRate);
+	if (result) {
+		LOG4CPLUS_ERROR(logger, getName() << ": prepare() failed: " << result);
+		return E_FAIL;
+	}
+	m_latency = (m_descriptor->flags & EffectPluginLatency) ? (long)m_descriptor->getLatency(m_instance) : 0;
+	m_tailLength = (m_descriptor->flags & EffectPluginTail) ? (long)m_descriptor->getTailLength(m_instance) : 0;
+
+	for (uint32_t i = 0; i < m_descriptor->parameterCount; i++) {
+		m_sentValues[i] = getParameter(i)->getValue();
+		m_descriptor->setParameter(m_instance, i, m_sentValues[i]);
+	}
+
+	if (m_descriptor->flags & EffectPluginInPlace) {
+		m_inputBuffers.reset();
+		m_inputs.reset();
+	} else {
+		m_inputBuffers.reset(new CAlignedBuffer<float>[numChannels]);
+		m_inputs.reset(new const float*[numChannels]);
+		for (long channel = 0; channel < numChannels; channel++) {
+			HR_ASSERT_OK(m_inputBuffers[channel].allocate(maxFrames));
+			m_inputs[channel] = m_inputBuffers[channel];
+		}
+	}
+	return S_OK;
+}
+
+void CPluginEffect::process(float* const* channels, long /*numChannels*/, long frames)
+{
+	void* context;
+	ProcessFunction function = getProcessFunction(&context);
+	function(context, channels, channels, (uint32_t)frames);
+}
+
+CEffect::ProcessFunction CPluginEffect::getProcessFunction(void** context)
+{
+	if (m_descriptor->flags & EffectPluginInPlace) {
+		*context = m_instance;
+		return m_descriptor->process;
+	}
+	*context = this;
+	return processCopy;
+}
+
+/*static*/ void CPluginEffect::processCopy(void* context, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+	CPluginEffect* _this = (CPluginEffect*)context;
+	for (long channel = 0; channel < _this->m_numChannels; channel++) {
+		vecCopy(_this->m_inputBuffers[channel], inputs[channel], (long)frames);
+	}
+	_this->m_descriptor->process(_this->m_instance, _this->m_inputs.get(), outputs, frames);
+}
+
+/*
+	Renders parameters and sends the first value of the frames that has changed.
+*/
+void CPluginEffect::renderParameters(LONGLONG position, long frames)
+{
+	CEffect::renderParameters(position, frames);
+
+	for (uint32_t i = 0; i < m_descriptor->parameterCount; i++) {
+		const CEffectParameter* parameter = m_parameters[i].get();
+		const float value = parameter->isConstant() ? parameter->getValue() : parameter->getValues()[0];
+		if (value != m_sentValues[i]) {
+			m_sentValues[i] = value;
+			m_descriptor->setParameter(m_instance, i, value);
+		}
+	}
+}
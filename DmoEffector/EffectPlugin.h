@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Effect.h"
+#include "EffectPluginAbi.h"
+
+/*
+	Shared library of the effect plugin that implements the C ABI in EffectPluginAbi.h.
+
+	load() validates the ABI version and the descriptor returned by the library.
+	The library is unloaded when this object and all effects created by it are deleted.
+*/
+class CEffectPluginLibrary : public std::enable_shared_from_this<CEffectPluginLibrary>
+{
+	DISALLOW_COPY_AND_ASSIGN(CEffectPluginLibrary);
+
+public:
+	CEffectPluginLibrary();
+	~CEffectPluginLibrary();
+
+	// Returns HRESULT of ERROR_PROC_NOT_FOUND if the library is not a plugin,
+	// or HRESULT of ERROR_REVISION_MISMATCH if the plugin is not compatible with the ABI of this host.
+	HRESULT load(LPCTSTR path);
+
+	// Creates new instance of the plugin. Returns NULL if failed.
+	// The object should be owned by std::shared_ptr.
+	CEffect* createEffect();
+
+	bool isLoaded() const { return m_descriptor != NULL; }
+	const EffectPluginDescriptor* getDescriptor() const { return m_descriptor; }
+	LPCTSTR getName() const { return m_name.c_str(); }
+	LPCTSTR getPath() const { return m_path.c_str(); }
+
+protected:
+	HMODULE m_module;
+	const EffectPluginDescriptor* m_descriptor;
+	tstring m_name;
+	tstring m_path;
+};
+
+/*
+	Effect that runs an instance of the plugin.
+
+	Parameters of the plugin are CEffectParameter so that they are changed in the same way as other effects.
+	Rendered values are passed to the plugin by setParameter() at the start of each sub-block when they change.
+	The plugin smooths the value if it needs to.
+
+	getProcessFunction() returns process() of the plugin itself if the plugin processes in place.
+	Otherwise inputs are copied to buffers allocated by prepare() before calling the plugin.
+*/
+class CPluginEffect : public CEffect
+{
+public:
+	CPluginEffect(const std::shared_ptr<CEffectPluginLibrary>& library, void* instance);
+	virtual ~CPluginEffect();
+
+	virtual LPCTSTR getName() const { return m_library->getName(); }
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual ProcessFunction getProcessFunction(void** context);
+	virtual long getLatency() const { return m_latency; }
+	virtual long getTailLength() const { return m_tailLength; }
+	virtual void renderParameters(LONGLONG position, long frames);
+
+protected:
+	static void processCopy(void* context, const float* const* inputs, float* const* outputs, uint32_t frames);
+
+	// Keeps the library loaded while the instance exists.
+	const std::shared_ptr<CEffectPluginLibrary> m_library;
+	const EffectPluginDescriptor* m_descriptor;
+	void* m_instance;
+
+	long m_latency;
+	long m_tailLength;
+
+	// Value passed to setParameter() last time for each parameter.
+	std::vector<float> m_sentValues;
+
+	// Copy of inputs for the plugin that doesn't process in place.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_inputBuffers;
+	std::unique_ptr<const float*[]> m_inputs;
+};
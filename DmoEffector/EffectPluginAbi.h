@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	C ABI of effect plugins loaded from shared libraries (.dll or .so) by CEffectPluginLibrary.
+
+	This file doesn't depend on stdafx.h and can be compiled as C99 or C++, so that plugins can be built by any compiler on any platform.
+
+	The library exports EffectPluginEntryName function of EffectPluginEntry type.
+	The host passes EffectPluginAbiVersion it was built with, and the plugin returns its descriptor,
+	or NULL if it doesn't support the host version. The descriptor should be valid until the library is unloaded.
+
+	Major version is changed when existing members are changed. The host loads plugins of the same major version only.
+	Minor version is changed when members are appended to the end of EffectPluginDescriptor.
+	The host loads plugins of older minor version, whose descriptor has fewer members.
+
+	Functions of the instance are called by one thread at a time:
+	  create(), prepare() and destroy() are called out of the real-time thread.
+	  process() and setParameter() are called by the real-time thread and should not block or allocate memory.
+	  getLatency() and getTailLength() are called after prepare() out of the real-time thread.
+	create() may be called concurrently for different instances, for example by the offline renderer.
+*/
+
+#define EFFECT_PLUGIN_ABI_VERSION(major, minor)	(((uint32_t)(major) << 16) | (uint32_t)(minor))
+#define EFFECT_PLUGIN_ABI_MAJOR(version)		((uint32_t)(version) >> 16)
+#define EFFECT_PLUGIN_ABI_MINOR(version)		((uint32_t)(version) & 0xffff)
+
+static const uint32_t EffectPluginAbiVersion = EFFECT_PLUGIN_ABI_VERSION(1, 0);
+static const char EffectPluginEntryName[] = "getEffectPlugin";
+
+#ifdef __cplusplus
+#define EFFECT_PLUGIN_EXTERN_C extern "C"
+#else
+#define EFFECT_PLUGIN_EXTERN_C
+#endif
+#if defined(_MSC_VER) && !defined(__cplusplus)
+#define EFFECT_PLUGIN_INLINE __inline
+#else
+#define EFFECT_PLUGIN_INLINE inline
+#endif
+#ifdef _WIN32
+#define EFFECT_PLUGIN_EXPORT EFFECT_PLUGIN_EXTERN_C __declspec(dllexport)
+#else
+#define EFFECT_PLUGIN_EXPORT EFFECT_PLUGIN_EXTERN_C __attribute__((visibility("default")))
+#endif
+
+/* Capabilities of the plugin in EffectPluginDescriptor::flags. */
+enum EffectPluginFlags {
+	/* process() accepts the same buffers as inputs and outputs. Otherwise the host passes a copy of the inputs. */
+	EffectPluginInPlace = 0x1,
+	/* getLatency() returns samples by which output is delayed. Otherwise latency is 0. */
+	EffectPluginLatency = 0x2,
+	/* getTailLength() returns samples of output that continue after the input becomes silent. Otherwise tail is 0. */
+	EffectPluginTail = 0x4,
+};
+
+typedef struct EffectPluginParameter {
+	const char* name;				/* UTF-8. */
+	float minValue;
+	float maxValue;
+	float defaultValue;
+} EffectPluginParameter;
+
+typedef struct EffectPluginDescriptor {
+	uint32_t abiVersion;			/* EffectPluginAbiVersion the plugin was built with. */
+	uint32_t size;					/* sizeof(EffectPluginDescriptor) the plugin was built with. */
+	const char* name;				/* UTF-8. */
+	uint32_t flags;					/* EffectPluginFlags. */
+	uint32_t parameterCount;
+	const EffectPluginParameter* parameters;
+
+	/* Returns new instance with default parameters, or NULL if failed. */
+	void* (*create)(void);
+	/* Allocates all memory used by process(). Returns 0 if succeeded. May be called again to change the format. */
+	int32_t (*prepare)(void* instance, uint32_t numChannels, uint32_t maxFrames, double sampleRate);
+	/* Processes frames (<= maxFrames) samples of each channel. */
+	void (*process)(void* instance, const float* const* inputs, float* const* outputs, uint32_t frames);
+	/* Sets the parameter clamped in its range. Applied from the next process(). */
+	void (*setParameter)(void* instance, uint32_t index, float value);
+	void (*destroy)(void* instance);
+	/* Required if the flag is set, otherwise may be NULL. */
+	uint32_t (*getLatency)(void* instance);
+	uint32_t (*getTailLength)(void* instance);
+} EffectPluginDescriptor;
+
+typedef const EffectPluginDescriptor* (*EffectPluginEntry)(uint32_t hostAbiVersion);
+
+/* Size of members of EffectPluginDescriptor defined by version 1.0. Members of later minor versions follow them. */
+#define EFFECT_PLUGIN_DESCRIPTOR_SIZE_1_0	(offsetof(EffectPluginDescriptor, getTailLength) + sizeof(((EffectPluginDescriptor*)0)->getTailLength))
+
+/*
+	Returns NULL if the host can use the descriptor, otherwise the reason why it can't.
+
+	Shared by the host and tools that load plugins, so that they accept the same plugins.
+*/
+static EFFECT_PLUGIN_INLINE const char* validateEffectPluginDescriptor(const EffectPluginDescriptor* descriptor)
+{
+	uint32_t i;
+	if (!descriptor) return "The plugin doesn't support the ABI version of the host.";
+	if (EFFECT_PLUGIN_ABI_MAJOR(descriptor->abiVersion) != EFFECT_PLUGIN_ABI_MAJOR(EffectPluginAbiVersion)) return "Major ABI version is different.";
+	if (EFFECT_PLUGIN_ABI_MINOR(EffectPluginAbiVersion) < EFFECT_PLUGIN_ABI_MINOR(descriptor->abiVersion)) return "Minor ABI version is newer than the host.";
+	if (descriptor->size < EFFECT_PLUGIN_DESCRIPTOR_SIZE_1_0) return "Descriptor is smaller than version 1.0.";
+	if (!descriptor->name || !descriptor->name[0]) return "Name is empty.";
+	if (!descriptor->create || !descriptor->prepare || !descriptor->process || !descriptor->destroy) return "Required function is NULL.";
+	if (descriptor->parameterCount && (!descriptor->parameters || !descriptor->setParameter)) return "Parameters are declared without parameters or setParameter().";
+	if ((descriptor->flags & EffectPluginLatency) && !descriptor->getLatency) return "EffectPluginLatency is set without getLatency().";
+	if ((descriptor->flags & EffectPluginTail) && !descriptor->getTailLength) return "EffectPluginTail is set without getTailLength().";
+	for (i = 0; i < descriptor->parameterCount; i++) {
+		const EffectPluginParameter* parameter = &descriptor->parameters[i];
+		if (!parameter->name) return "Parameter name is NULL.";
+		if (!((parameter->minValue <= parameter->defaultValue) && (parameter->defaultValue <= parameter->maxValue))) return "Parameter range is invalid.";
+	}
+	return 0;
+}
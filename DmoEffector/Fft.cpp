@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "Fft.h"
+#include "VectorOps.h"
+
+static const double Pi = 3.14159265358979323846;
+
+CFft::CFft()
+	: m_size(0), m_complexSize(0)
+{
+}
+
+HRESULT CFft::initialize(long size)
+{
+	HR_ASSERT((8 <= size) && ((size & (size - 1)) == 0), E_INVALIDARG);
+
+	m_size = size;
+	m_complexSize = size / 2;
+	const long n = m_complexSize;
+
+	m_swaps.clear();
+	for (long i = 0, j = 0; i < n; i++) {
+		if (i < j) m_swaps.push_back(std::make_pair(i, j));
+		long bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j |= bit;
+	}
+
+	HR_ASSERT_OK(m_twiddleRe.allocate(n));
+	HR_ASSERT_OK(m_twiddleIm.allocate(n));
+	for (long half = 1; half < n; half <<= 1) {
+		for (long j = 0; j < half; j++) {
+			double angle = -Pi * j / half;
+			m_twiddleRe[half + j] = (float)cos(angle);
+			m_twiddleIm[half + j] = (float)sin(angle);
+		}
+	}
+
+	HR_ASSERT_OK(m_realTwiddleRe.allocate(n + 1));
+	HR_ASSERT_OK(m_realTwiddleIm.allocate(n + 1));
+	for (long k = 0; k <= n; k++) {
+		double angle = -2 * Pi * k / size;
+		m_realTwiddleRe[k] = (float)cos(angle);
+		m_realTwiddleIm[k] = (float)sin(angle);
+	}
+
+	HR_ASSERT_OK(m_workRe.allocate(n));
+	HR_ASSERT_OK(m_workIm.allocate(n));
+	return S_OK;
+}
+
+void CFft::forwardComplex(float * re, float * im) const
+{
+	const long n = m_complexSize;
+	for (size_t i = 0; i < m_swaps.size(); i++) {
+		std::swap(re[m_swaps[i].first], re[m_swaps[i].second]);
+		std::swap(im[m_swaps[i].first], im[m_swaps[i].second]);
+	}
+
+	for (long half = 1; half < n; half <<= 1) {
+		const float* wr = &m_twiddleRe[half];
+		const float* wi = &m_twiddleIm[half];
+		for (long start = 0; start < n; start += half * 2) {
+			float* ar = &re[start];
+			float* ai = &im[start];
+			float* br = &re[start + half];
+			float* bi = &im[start + half];
+			long j = 0;
+			for (; j + 4 <= half; j += 4) {
+				__m128 vwr = _mm_load_ps(&wr[j]), vwi = _mm_load_ps(&wi[j]);
+				__m128 vbr = _mm_loadu_ps(&br[j]), vbi = _mm_loadu_ps(&bi[j]);
+				__m128 tr = _mm_sub_ps(_mm_mul_ps(vbr, vwr), _mm_mul_ps(vbi, vwi));
+				__m128 ti = _mm_add_ps(_mm_mul_ps(vbr, vwi), _mm_mul_ps(vbi, vwr));
+				__m128 var = _mm_loadu_ps(&ar[j]), vai = _mm_loadu_ps(&ai[j]);
+				_mm_storeu_ps(&ar[j], _mm_add_ps(var, tr));
+				_mm_storeu_ps(&ai[j], _mm_add_ps(vai, ti));
+				_mm_storeu_ps(&br[j], _mm_sub_ps(var, tr));
+				_mm_storeu_ps(&bi[j], _mm_sub_ps(vai, ti));
+			}
+			for (; j < half; j++) {
+				float tr = br[j] * wr[j] - bi[j] * wi[j];
+				float ti = br[j] * wi[j] + bi[j] * wr[j];
+				br[j] = ar[j] - tr;
+				bi[j] = ai[j] - ti;
+				ar[j] += tr;
+				ai[j] += ti;
+			}
+		}
+	}
+}
+
+/*
+	Inverse FFT is computed by forward FFT with real and imaginary parts swapped.
+*/
+void CFft::inverseComplex(float * re, float * im) const
+{
+	forwardComplex(im, re);
+	float scale = 1.0f / m_complexSize;
+	vecScale(re, scale, m_complexSize);
+	vecScale(im, scale, m_complexSize);
+}
+
+/*
+	Even and odd samples are packed into real and imaginary parts of complex FFT.
+	Then X[k] = E[k] + W^k * O[k] where E and O are FFT of even and odd samples.
+*/
+void CFft::forwardReal(const float * input, float * re, float * im)
+{
+	const long n = m_complexSize;
+	for (long i = 0; i < n; i++) {
+		m_workRe[i] = input[i * 2];
+		m_workIm[i] = input[i * 2 + 1];
+	}
+	forwardComplex(m_workRe, m_workIm);
+
+	for (long k = 0; k <= n; k++) {
+		float zr = m_workRe[k % n], zi = m_workIm[k % n];
+		float cr = m_workRe[(n - k) % n], ci = -m_workIm[(n - k) % n];
+		float er = (zr + cr) * 0.5f, ei = (zi + ci) * 0.5f;
+		// O = (Z - conj(Z[n - k])) / 2i
+		float or_ = (zi - ci) * 0.5f, oi = -(zr - cr) * 0.5f;
+		float wr = m_realTwiddleRe[k], wi = m_realTwiddleIm[k];
+		re[k] = er + or_ * wr - oi * wi;
+		im[k] = ei + or_ * wi + oi * wr;
+	}
+}
+
+void CFft::inverseReal(const float * re, const float * im, float * output)
+{
+	const long n = m_complexSize;
+	for (long k = 0; k < n; k++) {
+		float xr = re[k], xi = im[k];
+		float cr = re[n - k], ci = -im[n - k];
+		float er = (xr + cr) * 0.5f, ei = (xi + ci) * 0.5f;
+		// O = (X - conj(X[n - k])) * conj(W^k) / 2
+		float dr = (xr - cr) * 0.5f, di = (xi - ci) * 0.5f;
+		float wr = m_realTwiddleRe[k], wi = -m_realTwiddleIm[k];
+		float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+		// Z = E + i * O
+		m_workRe[k] = er - oi;
+		m_workIm[k] = ei + or_;
+	}
+	inverseComplex(m_workRe, m_workIm);
+
+	for (long i = 0; i < n; i++) {
+		output[i * 2] = m_workRe[i];
+		output[i * 2 + 1] = m_workIm[i];
+	}
+}
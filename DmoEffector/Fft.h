@@ -0,0 +1,50 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+
+/*
+	Radix-2 FFT of complex samples in split format (separate arrays of real and imaginary parts).
+
+	Butterflies of stages whose half size is 4 or more are computed by SSE.
+	Real FFT of size N is computed by complex FFT of size N/2 and outputs N/2 + 1 bins.
+
+	All tables and work buffers are allocated by initialize().
+	Methods are not thread safe because real FFT uses the work buffer of the object.
+*/
+class CFft
+{
+	DISALLOW_COPY_AND_ASSIGN(CFft);
+
+public:
+	CFft();
+
+	// size: Size of real FFT. Should be power of 2 and 8 or more.
+	HRESULT initialize(long size);
+	long getSize() const { return m_size; }
+	long getBinCount() const { return m_size / 2 + 1; }
+
+	// In-place complex FFT of size / 2 samples.
+	void forwardComplex(float* re, float* im) const;
+	// Inverse of forwardComplex() scaled by 1 / (size / 2).
+	void inverseComplex(float* re, float* im) const;
+
+	// input: size samples, re, im: getBinCount() bins.
+	void forwardReal(const float* input, float* re, float* im);
+	// Inverse of forwardReal(). output: size samples.
+	void inverseReal(const float* re, const float* im, float* output);
+
+protected:
+	long m_size;
+	long m_complexSize;
+
+	// Pairs of indexes swapped by bit reversal.
+	std::vector<std::pair<long, long>> m_swaps;
+	// Twiddle factors of each stage. Stage of half size h starts at index h so that SSE loads are aligned.
+	CAlignedBuffer<float> m_twiddleRe;
+	CAlignedBuffer<float> m_twiddleIm;
+	// Twiddle factors of real FFT: exp(-2 pi i k / size).
+	CAlignedBuffer<float> m_realTwiddleRe;
+	CAlignedBuffer<float> m_realTwiddleIm;
+	CAlignedBuffer<float> m_workRe;
+	CAlignedBuffer<float> m_workIm;
+};
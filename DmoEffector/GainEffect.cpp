@@ -0,0 +1,20 @@
+#include "stdafx.h"
+#include "GainEffect.h"
+#include "VectorOps.h"
+
+CGainEffect::CGainEffect()
+{
+	addParameter(new CEffectParameter(_T("Gain"), 0.0f, 2.0f, 1.0f));
+}
+
+void CGainEffect::process(float* const* channels, long numChannels, long frames)
+{
+	const CEffectParameter* gain = getParameter(Gain);
+	for (long channel = 0; channel < numChannels; channel++) {
+		if (gain->isConstant()) {
+			if (gain->getValue() != 1.0f) vecScale(channels[channel], gain->getValue(), frames);
+		} else {
+			vecMultiply(channels[channel], gain->getValues(), frames);
+		}
+	}
+}
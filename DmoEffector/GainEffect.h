@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Effect.h"
+
+/*
+	Effect that multiplies samples of all channels by Gain parameter.
+*/
+class CGainEffect : public CEffect
+{
+public:
+	enum Parameters {
+		Gain,		// Linear gain. 0.0 to 2.0, neutral value is 1.0.
+	};
+
+	CGainEffect();
+
+	virtual LPCTSTR getName() const { return _T("Gain"); }
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual ProcessFunction getProcessFunction(void** context) { *context = this; return processEffectOf<CGainEffect>; }
+};
@@ -0,0 +1,172 @@
+#include "stdafx.h"
+#include "HalfBandFilter.h"
+#include "VectorOps.h"
+
+static const double Pi = 3.14159265358979323846;
+
+/*static*/ const double CHalfBandFilter::TransitionBandWidth = 0.04;
+
+static double besselI0(double x);
+static void computeAllpassCoefficients(float* coefficients, long count, double transition);
+
+CHalfBandFilter::CHalfBandFilter()
+	: m_phase(Phase::Linear)
+{
+}
+
+HRESULT CHalfBandFilter::initialize(Phase phase, long maxFrames)
+{
+	m_phase = phase;
+	if (phase == Phase::Linear) {
+		// Kaiser windowed sinc of 2 * Taps - 1 taps whose center is Taps - 1.
+		// Taps of even index are odd offsets from the center and are non-zero.
+		// Interpolation gain 2 is included.
+		const long center = Taps - 1;
+		const double beta = 8.0;
+		for (long j = 0; j < Taps; j++) {
+			long offset = j * 2 - center;
+			double sinc = sin(Pi * offset / 2) / (Pi * offset);
+			double r = (double)offset / (center + 1);
+			double window = besselI0(beta * sqrt(1 - r * r)) / besselI0(beta);
+			m_taps[j] = (float)(sinc * window * 2);
+		}
+		HR_ASSERT_OK(m_history.allocate(Taps - 1 + maxFrames));
+		HR_ASSERT_OK(m_oddHistory.allocate(Taps / 2 + maxFrames));
+		HR_ASSERT_OK(m_branch.allocate(maxFrames));
+	} else {
+		computeAllpassCoefficients(m_coefficients, AllpassCoefficients, TransitionBandWidth);
+	}
+	reset();
+	return S_OK;
+}
+
+void CHalfBandFilter::reset()
+{
+	m_history.clear();
+	m_oddHistory.clear();
+	ZeroMemory(m_x, sizeof(m_x));
+	ZeroMemory(m_y, sizeof(m_y));
+}
+
+/*
+	Linear phase: Even output samples are filtered by taps of even index.
+	Odd output samples are input delayed by Taps / 2 - 1 samples, which is the center tap 0.5 multiplied by gain 2.
+*/
+void CHalfBandFilter::upsample(const float* src, float* dst, long frames)
+{
+	if (m_phase == Phase::Linear) {
+		filterBranch(src, m_branch, frames);
+		for (long i = 0; i < frames; i++) {
+			dst[i * 2] = m_branch[i];
+			dst[i * 2 + 1] = m_history[i + Taps / 2];
+		}
+		memmove(m_history, &m_history[frames], sizeof(float) * (Taps - 1));
+	} else {
+		for (long i = 0; i < frames; i++) {
+			dst[i * 2] = processAllpass(src[i], m_coefficients, m_x, m_y, 0);
+			dst[i * 2 + 1] = processAllpass(src[i], m_coefficients, m_x, m_y, 1);
+		}
+	}
+}
+
+/*
+	Linear phase: Even input samples are filtered by taps of even index.
+	Odd input samples are delayed by Taps / 2 samples and multiplied by the center tap 0.5.
+*/
+void CHalfBandFilter::downsample(const float* src, float* dst, long frames)
+{
+	if (m_phase == Phase::Linear) {
+		for (long i = 0; i < frames; i++) {
+			m_branch[i] = src[i * 2];
+			m_oddHistory[Taps / 2 + i] = src[i * 2 + 1];
+		}
+		filterBranch(m_branch, dst, frames);
+		vecAdd(dst, m_oddHistory, frames);
+		vecScale(dst, 0.5f, frames);
+		memmove(m_history, &m_history[frames], sizeof(float) * (Taps - 1));
+		memmove(m_oddHistory, &m_oddHistory[frames], sizeof(float) * (Taps / 2));
+	} else {
+		for (long i = 0; i < frames; i++) {
+			float even = processAllpass(src[i * 2 + 1], m_coefficients, m_x, m_y, 0);
+			float odd = processAllpass(src[i * 2], m_coefficients, m_x, m_y, 1);
+			dst[i] = (even + odd) * 0.5f;
+		}
+	}
+}
+
+/*
+	dst[i] = sum(m_taps[j] * src[i - (Taps - 1) + j])
+	src is appended to the history so that the filter is computed by SSE over contiguous samples.
+	Caller shifts the history after using it.
+*/
+void CHalfBandFilter::filterBranch(const float* src, float* dst, long frames)
+{
+	vecCopy(&m_history[Taps - 1], src, frames);
+	vecClear(dst, frames);
+	for (long j = 0; j < Taps; j++) {
+		vecMultiplyAdd(dst, &m_history[j], m_taps[j], frames);
+	}
+}
+
+/*
+	Processes the sample by allpass filters of the path.
+	Path 0 uses coefficients of even index and path 1 uses odd index.
+	Each filter is A(z) = (a + z^-1) / (1 + a * z^-1) at the lower rate.
+*/
+/*static*/ float CHalfBandFilter::processAllpass(float sample, const float* coefficients, float* x, float* y, long first)
+{
+	for (long i = first; i < AllpassCoefficients; i += 2) {
+		float output = (sample - y[i]) * coefficients[i] + x[i];
+		x[i] = sample;
+		y[i] = output;
+		sample = output;
+	}
+	return sample;
+}
+
+static double besselI0(double x)
+{
+	double sum = 1, term = 1;
+	for (int k = 1; k < 50; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12) break;
+	}
+	return sum;
+}
+
+/*
+	Computes coefficients of polyphase IIR half-band filter with elliptic response.
+	transition: Transition band width relative to the sample rate. (0 < transition < 0.5)
+*/
+static void computeAllpassCoefficients(float* coefficients, long count, double transition)
+{
+	double k = tan((1 - transition * 2) * Pi / 4);
+	k *= k;
+	double kksqrt = pow(1 - k * k, 0.25);
+	double e = 0.5 * (1 - kksqrt) / (1 + kksqrt);
+	double e2 = e * e;
+	double e4 = e2 * e2;
+	double q = e * (1 + e4 * (2 + e4 * (15 + 150 * e4)));
+
+	const long order = count * 2 + 1;
+	for (long index = 0; index < count; index++) {
+		const long c = index + 1;
+		double num = 0;
+		for (long i = 0, sign = 1; ; i++, sign = -sign) {
+			double term = pow(q, (double)(i * (i + 1))) * sin((i * 2 + 1) * c * Pi / order) * sign;
+			num += term;
+			if (fabs(term) < 1e-100) break;
+		}
+		double den = 0;
+		for (long i = 1, sign = -1; ; i++, sign = -sign) {
+			double term = pow(q, (double)(i * i)) * cos(i * 2 * c * Pi / order) * sign;
+			den += term;
+			if (fabs(term) < 1e-100) break;
+		}
+		double ww = num * pow(q, 0.25) / (den + 0.5);
+		double wwsq = ww * ww;
+		double x = sqrt((1 - wwsq * k) * (1 - wwsq / k)) / (1 + wwsq);
+		coefficients[index] = (float)((1 - x) / (1 + x));
+	}
+}
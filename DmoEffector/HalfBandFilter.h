@@ -0,0 +1,60 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+
+/*
+	Half-band filter that upsamples or downsamples by factor of 2.
+
+	Linear phase: FIR of 2 * Taps - 1 taps whose odd taps except the center are 0. Polyphase branch of
+	non-zero taps is computed by SSE over samples. Delay is Taps - 1 samples of the higher rate.
+
+	Minimum phase: Two paths of cascaded first order allpass filters (polyphase IIR).
+	Coefficients are computed for elliptic half-band response.
+
+	Each object holds state of one channel in one direction.
+*/
+class CHalfBandFilter
+{
+	DISALLOW_COPY_AND_ASSIGN(CHalfBandFilter);
+
+public:
+	ENUM(Phase,
+		Linear,
+		Minimum
+	);
+
+	CHalfBandFilter();
+
+	// maxFrames: Maximum count of samples of the lower rate.
+	HRESULT initialize(Phase phase, long maxFrames);
+	void reset();
+
+	// src: frames samples, dst: frames * 2 samples.
+	void upsample(const float* src, float* dst, long frames);
+	// src: frames * 2 samples, dst: frames samples.
+	void downsample(const float* src, float* dst, long frames);
+
+	// Count of non-zero taps of each polyphase branch of FIR.
+	static const long Taps = 32;
+	// Count of allpass coefficients and transition band width relative to the higher sample rate.
+	static const long AllpassCoefficients = 10;
+	static const double TransitionBandWidth;
+
+protected:
+	void filterBranch(const float* src, float* dst, long frames);
+	static float processAllpass(float sample, const float* coefficients, float* x, float* y, long first);
+
+	Phase m_phase;
+
+	// FIR: Non-zero taps, samples of the branch with history of Taps - 1 samples
+	// and odd samples with history of Taps / 2 samples used by downsample().
+	float m_taps[Taps];
+	CAlignedBuffer<float> m_history;
+	CAlignedBuffer<float> m_oddHistory;
+	CAlignedBuffer<float> m_branch;
+
+	// IIR: Coefficients and state of allpass filters of both paths.
+	float m_coefficients[AllpassCoefficients];
+	float m_x[AllpassCoefficients];
+	float m_y[AllpassCoefficients];
+};
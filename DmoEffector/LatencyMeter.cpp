@@ -0,0 +1,271 @@
+#include "stdafx.h"
+#include "LatencyMeter.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("LatencyMeter"));
+
+static const double Pi = 3.14159265358979323846;
+
+/*static*/ const float CLatencyMeter::Level = 0.25f;
+/*static*/ const double CLatencyMeter::MinPeakToNoise = 20.0;
+
+// Registry key of the calibration under HKEY_CURRENT_USER. Each driver has its own subkey.
+static LPCTSTR CalibrationKeyName = _T("SOFTWARE\\DmoEffector\\LatencyCalibration");
+// Feedback mask of Galois LFSR for x^13 + x^4 + x^3 + x + 1.
+static const DWORD LfsrMask = 0x100d;
+// Lags around the peak excluded from the noise.
+static const long PeakWidth = 32;
+
+#define CREGKEY_ASSERT_OK(exp) HR_ASSERT_OK(HRESULT_FROM_WIN32(exp))
+
+static tstring getCalibrationKeyName(LPCSTR driverName);
+static tstring getCalibrationValueName(double sampleRate, long bufferSize);
+
+CLatencyMeter::CLatencyMeter()
+	: m_state(Idle), m_numChannels(0), m_bufferSize(0)
+	, m_inputChannel(0), m_outputChannel(0), m_runs(0), m_position(0)
+{
+}
+
+/*
+	Generates the test signal and allocates all buffers used by process() and analyze().
+*/
+HRESULT CLatencyMeter::initialize(long numChannels, long bufferSize, ASIOSampleType sampleType)
+{
+	HR_ASSERT(!isMeasuring(), E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT((0 < numChannels) && (0 < bufferSize), E_INVALIDARG);
+
+	m_state = Idle;
+	m_numChannels = numChannels;
+	m_bufferSize = bufferSize;
+	HR_ASSERT_OK(m_converter.initialize(sampleType));
+	HR_ASSERT_OK(m_work.allocate(bufferSize));
+	HR_ASSERT_OK(m_capture.allocate(MaxRuns * SequenceLength));
+
+	// Sequence of +Level and -Level.
+	HR_ASSERT_OK(m_signal.allocate(SequenceLength));
+	DWORD lfsr = 1;
+	for (long i = 0; i < SequenceLength; i++) {
+		m_signal[i] = (lfsr & 1) ? Level : -Level;
+		lfsr = (lfsr >> 1) ^ ((lfsr & 1) ? LfsrMask : 0);
+	}
+
+	HR_ASSERT_OK(m_fft.initialize(FftSize));
+	const long stride = (m_fft.getBinCount() + 3) & ~3;
+	HR_ASSERT_OK(m_time.allocate(FftSize));
+	HR_ASSERT_OK(m_correlation.allocate(FftSize));
+	HR_ASSERT_OK(m_re.allocate(stride));
+	HR_ASSERT_OK(m_im.allocate(stride));
+	HR_ASSERT_OK(m_sequenceRe.allocate(stride));
+	HR_ASSERT_OK(m_sequenceIm.allocate(stride));
+	vecCopy(m_time, m_signal, SequenceLength);
+	vecCopy(&m_time[SequenceLength], m_signal, SequenceLength);
+	vecClear(&m_time[SequenceLength * 2], FftSize - SequenceLength * 2);
+	m_fft.forwardReal(m_time, m_sequenceRe, m_sequenceIm);
+	return S_OK;
+}
+
+/*
+	Starts measurement at the next buffer.
+
+	Output channel is replaced by the test signal until the measurement completes.
+*/
+HRESULT CLatencyMeter::start(long inputChannel, long outputChannel, long runs /*= DefaultRuns*/)
+{
+	HR_ASSERT(m_signal, E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT(!isMeasuring(), E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT((0 <= inputChannel) && (inputChannel < m_numChannels), E_INVALIDARG);
+	HR_ASSERT((0 <= outputChannel) && (outputChannel < m_numChannels), E_INVALIDARG);
+	HR_ASSERT((0 < runs) && (runs <= MaxRuns), E_INVALIDARG);
+
+	m_inputChannel = inputChannel;
+	m_outputChannel = outputChannel;
+	m_runs = runs;
+	m_position = 0;
+	m_state.store(Measuring, std::memory_order_release);
+	LOG4CPLUS_INFO(logger, "Started: Output " << outputChannel << " -> Input " << inputChannel << ", " << runs << " runs");
+	return S_OK;
+}
+
+/*
+	Captures the input channel and outputs the test signal to the output channel.
+
+	Input is captured from the second period of the sequence, when the loop has been filled with the sequence.
+*/
+void CLatencyMeter::process(const void* const* inputs, void* const* outputs)
+{
+	if (m_state.load(std::memory_order_acquire) != Measuring) return;
+
+	const long total = getTotalSamples();
+	m_converter.toFloat(inputs[m_inputChannel], m_work, m_bufferSize);
+	for (long i = 0; i < m_bufferSize; i++) {
+		const long position = m_position + i;
+		if ((SequenceLength <= position) && (position < total)) m_capture[position - SequenceLength] = m_work[i];
+	}
+
+	for (long i = 0; i < m_bufferSize; i++) {
+		const long position = m_position + i;
+		m_work[i] = (position < total) ? m_signal[position % SequenceLength] : 0;
+	}
+	m_converter.fromFloat(m_work, outputs[m_outputChannel], m_bufferSize);
+
+	m_position += m_bufferSize;
+	if (total <= m_position) {
+		m_state.store(Completed, std::memory_order_release);
+	}
+}
+
+/*
+	Computes latency of each run and their statistics.
+
+	Returns E_FAIL if any run doesn't have clear peak, which means that the output is not looped back to the input.
+*/
+HRESULT CLatencyMeter::analyze(Result* result)
+{
+	HR_ASSERT(result, E_POINTER);
+	const long state = m_state.load(std::memory_order_acquire);
+	if (state == Measuring) return S_FALSE;
+	HR_ASSERT(state == Completed, E_ILLEGAL_METHOD_CALL);
+	m_state.store(Idle, std::memory_order_relaxed);
+
+	ZeroMemory(result, sizeof(*result));
+	result->runs = m_runs;
+	result->peakToNoise = HUGE_VAL;
+	result->minLatency = HUGE_VAL;
+	result->maxLatency = -HUGE_VAL;
+	double sum = 0, sumOfSquares = 0;
+	for (long run = 0; run < m_runs; run++) {
+		double latency, peakToNoise;
+		HR_ASSERT_OK(analyzeRun(run, &latency, &peakToNoise));
+		LOG4CPLUS_DEBUG(logger, "Run " << run << ": Latency=" << latency << ", Peak to noise=" << peakToNoise << " dB");
+		sum += latency;
+		sumOfSquares += latency * latency;
+		result->minLatency = min(result->minLatency, latency);
+		result->maxLatency = max(result->maxLatency, latency);
+		result->peakToNoise = min(result->peakToNoise, peakToNoise);
+	}
+	result->latency = sum / m_runs;
+	const double variance = (1 < m_runs) ? (sumOfSquares - sum * result->latency) / (m_runs - 1) : 0;
+	result->jitter = sqrt(max(0.0, variance));
+
+	LOG4CPLUS_INFO(logger, "Latency=" << result->latency << " samples, Jitter=" << result->jitter
+		<< ", Range=" << result->minLatency << " - " << result->maxLatency << ", Peak to noise=" << result->peakToNoise << " dB");
+	HR_ASSERT(MinPeakToNoise <= result->peakToNoise, E_FAIL);
+	return S_OK;
+}
+
+/*
+	Circularly cross-correlates captured input of the run with the sequence and returns latency of the peak.
+
+	Run r captures the period starting at (r + 1) * SequenceLength samples, where the input is the sequence delayed by latency.
+	Correlation c[j] = sum(input[n] * sequence[(n + j) % SequenceLength]) has the peak at j = -latency modulo SequenceLength.
+	It is computed as linear correlation with two periods of the sequence, which doesn't wrap in FftSize.
+*/
+HRESULT CLatencyMeter::analyzeRun(long run, double* latency, double* peakToNoise)
+{
+	vecCopy(m_time, &m_capture[run * SequenceLength], SequenceLength);
+	vecClear(&m_time[SequenceLength], FftSize - SequenceLength);
+	m_fft.forwardReal(m_time, m_re, m_im);
+
+	// Sequence spectrum multiplied by conjugate of the input spectrum.
+	for (long k = 0; k < m_fft.getBinCount(); k++) {
+		const float xr = m_re[k], xi = m_im[k];
+		const float sr = m_sequenceRe[k], si = m_sequenceIm[k];
+		m_re[k] = sr * xr + si * xi;
+		m_im[k] = si * xr - sr * xi;
+	}
+	m_fft.inverseReal(m_re, m_im, m_correlation);
+
+	long peak = 0;
+	for (long lag = 1; lag < SequenceLength; lag++) {
+		if (fabs(m_correlation[peak]) < fabs(m_correlation[lag])) peak = lag;
+	}
+	double noise = 0;
+	long count = 0;
+	for (long lag = 0; lag < SequenceLength; lag++) {
+		const long distance = abs(lag - peak);
+		if (PeakWidth < min(distance, SequenceLength - distance)) {
+			noise += (double)m_correlation[lag] * m_correlation[lag];
+			count++;
+		}
+	}
+	const double peakValue = fabs(m_correlation[peak]);
+	HR_ASSERT(0 < peakValue, E_FAIL);
+	*peakToNoise = (0 < noise) ? 20 * log10(peakValue / sqrt(noise / count)) : HUGE_VAL;
+
+	// Searches fraction of the peak by steps of 1/32 sample and refines it by parabola.
+	// Sign of the peak is ignored, so that inverted polarity of the loopback is measured as well.
+	static const long Steps = 32;
+	double values[Steps * 2 + 1];
+	long best = Steps;
+	for (long step = 0; step <= Steps * 2; step++) {
+		values[step] = fabs(interpolate(peak, (double)(step - Steps) / Steps));
+		if (values[best] < values[step]) best = step;
+	}
+	double fraction = (double)(best - Steps) / Steps;
+	if ((0 < best) && (best < Steps * 2)) {
+		const double previous = values[best - 1], next = values[best + 1];
+		const double denominator = previous - 2 * values[best] + next;
+		if (denominator < 0) fraction += 0.5 * (previous - next) / denominator / Steps;
+	}
+	*latency = SequenceLength - (peak + fraction);
+	if (SequenceLength <= *latency) *latency -= SequenceLength;
+	return S_OK;
+}
+
+/*
+	Returns correlation at lag + fraction.
+
+	Correlation is periodic in SequenceLength and band limited,
+	so that it is interpolated exactly by periodic sinc (Dirichlet kernel) of odd length.
+*/
+double CLatencyMeter::interpolate(long lag, double fraction) const
+{
+	if (fraction == floor(fraction)) return m_correlation[(lag + (long)fraction + SequenceLength) % SequenceLength];
+
+	// sin(Pi * (fraction - k)) alternates its sign with k.
+	const double numerator = sin(Pi * fraction) / SequenceLength;
+	double sum = 0;
+	for (long k = -(SequenceLength / 2); k <= SequenceLength / 2; k++) {
+		const double weight = numerator / sin(Pi * (fraction - k) / SequenceLength);
+		sum += m_correlation[(lag + k + SequenceLength) % SequenceLength] * ((k & 1) ? -weight : weight);
+	}
+	return sum;
+}
+
+/*static*/ HRESULT CLatencyMeter::saveCalibration(LPCSTR driverName, double sampleRate, long bufferSize, long latency)
+{
+	HR_ASSERT(driverName, E_POINTER);
+
+	CRegKey key;
+	CREGKEY_ASSERT_OK(key.Create(HKEY_CURRENT_USER, getCalibrationKeyName(driverName).c_str()));
+	CREGKEY_ASSERT_OK(key.SetDWORDValue(getCalibrationValueName(sampleRate, bufferSize).c_str(), (DWORD)latency));
+	LOG4CPLUS_INFO(logger, "Saved calibration of '" << driverName << "': " << latency << " samples");
+	return S_OK;
+}
+
+/*static*/ HRESULT CLatencyMeter::loadCalibration(LPCSTR driverName, double sampleRate, long bufferSize, long* latency)
+{
+	HR_ASSERT(driverName && latency, E_POINTER);
+
+	*latency = 0;
+	CRegKey key;
+	if (key.Open(HKEY_CURRENT_USER, getCalibrationKeyName(driverName).c_str(), KEY_READ) != ERROR_SUCCESS) return S_FALSE;
+	DWORD value;
+	if (key.QueryDWORDValue(getCalibrationValueName(sampleRate, bufferSize).c_str(), value) != ERROR_SUCCESS) return S_FALSE;
+	*latency = (long)value;
+	LOG4CPLUS_INFO(logger, "Loaded calibration of '" << driverName << "': " << *latency << " samples");
+	return S_OK;
+}
+
+static tstring getCalibrationKeyName(LPCSTR driverName)
+{
+	return tstring(CalibrationKeyName) + _T("\\") + (LPCTSTR)CA2T(driverName);
+}
+
+static tstring getCalibrationValueName(double sampleRate, long bufferSize)
+{
+	TCHAR name[64];
+	_stprintf_s(name, _T("%.0f Hz, %ld samples"), sampleRate, bufferSize);
+	return name;
+}
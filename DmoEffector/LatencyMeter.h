@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+
+#include "AlignedBuffer.h"
+#include "SampleConverter.h"
+#include "Fft.h"
+
+/*
+	Measures round trip latency by test signal looped back from an output channel to an input channel.
+
+	MLS (maximum length sequence) is output repeatedly, one period before the first run and one period for each run.
+	Input captured in each run is circularly cross-correlated with the sequence by FFT.
+	Circular autocorrelation of MLS is flat except the peak, so that the peak is not biased by side lobes
+	and is located with sub-sample precision by periodic sinc interpolation.
+	Jitter is standard deviation of latencies of the runs.
+
+	start() and analyze() are called by the UI thread.
+	process() is called by the real-time thread after the effect chain, and replaces the output channel by the test signal.
+	Latency is measured from the output buffer to the input buffer of the same process() call,
+	so that it includes latencies reported by the driver and latency added by the engine.
+*/
+class CLatencyMeter
+{
+	DISALLOW_COPY_AND_ASSIGN(CLatencyMeter);
+
+public:
+	struct Result {
+		long runs;
+		double latency;			// Mean of round trip latency in samples.
+		double jitter;			// Standard deviation of latencies in samples.
+		double minLatency;
+		double maxLatency;
+		double peakToNoise;		// Ratio of correlation peak to RMS of other lags in dB. Minimum of all runs.
+	};
+
+	static const long Order = 13;
+	// Samples of each run. Latency should be less than SequenceLength, otherwise it is measured modulo SequenceLength.
+	static const long SequenceLength = (1 << Order) - 1;
+	// Size of FFT correlating one period of input with two periods of the sequence without wrapping.
+	static const long FftSize = 1 << (Order + 2);
+	static const long DefaultRuns = 8;
+	static const long MaxRuns = 32;
+	// Amplitude of the test signal in full scale.
+	static const float Level;
+	// Runs whose peak to noise ratio is less than this value are regarded as no loopback.
+	static const double MinPeakToNoise;
+
+	CLatencyMeter();
+
+	// Called out of the real-time thread when buffers are created.
+	HRESULT initialize(long numChannels, long bufferSize, ASIOSampleType sampleType);
+
+	// Called by the UI thread.
+	HRESULT start(long inputChannel, long outputChannel, long runs = DefaultRuns);
+	void cancel() { m_state.store(Idle, std::memory_order_release); }
+	bool isMeasuring() const { return m_state.load(std::memory_order_acquire) == Measuring; }
+	// Returns S_FALSE while measuring. Each measurement is analyzed once.
+	HRESULT analyze(Result* result);
+
+	// Called by the real-time thread.
+	void process(const void* const* inputs, void* const* outputs);
+
+	// Stores round trip latency not reported by the driver, for each driver, sample rate and buffer size.
+	static HRESULT saveCalibration(LPCSTR driverName, double sampleRate, long bufferSize, long latency);
+	// Returns S_FALSE if the calibration has not been saved.
+	static HRESULT loadCalibration(LPCSTR driverName, double sampleRate, long bufferSize, long* latency);
+
+protected:
+	enum States {
+		Idle,
+		Measuring,
+		Completed,
+	};
+
+	long getTotalSamples() const { return (m_runs + 1) * SequenceLength; }
+
+	HRESULT analyzeRun(long run, double* latency, double* peakToNoise);
+	double interpolate(long lag, double fraction) const;
+
+	std::atomic<long> m_state;
+	long m_numChannels;
+	long m_bufferSize;
+	CSampleConverter m_converter;
+
+	// Set by start() before m_state is set to Measuring.
+	long m_inputChannel;
+	long m_outputChannel;
+	long m_runs;
+
+	// Used by the real-time thread.
+	long m_position;				// Samples output since start().
+	CAlignedBuffer<float> m_signal;	// One period of the sequence.
+	CAlignedBuffer<float> m_capture;	// Captured input of MaxRuns runs, each of SequenceLength samples.
+	CAlignedBuffer<float> m_work;	// One buffer converted from/to ASIO sample type.
+
+	// Used by analyze().
+	CFft m_fft;
+	CAlignedBuffer<float> m_sequenceRe;		// Spectrum of two periods of the sequence.
+	CAlignedBuffer<float> m_sequenceIm;
+	CAlignedBuffer<float> m_time;
+	CAlignedBuffer<float> m_re;
+	CAlignedBuffer<float> m_im;
+	CAlignedBuffer<float> m_correlation;
+};
@@ -0,0 +1,323 @@
+#include "stdafx.h"
+#include "LoopbackDriver.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("LoopbackDriver"));
+
+static const double Pi = 3.14159265358979323846;
+
+CLoopbackDriver::CLoopbackDriver(long numChannels, long bufferSize, double sampleRate, double loopbackDelay /*= 0*/)
+	: m_refCount(1), m_numChannels(numChannels), m_bufferSize(bufferSize), m_sampleRate(sampleRate)
+	, m_integerDelay((long)floor(loopbackDelay))
+	, m_callbacks(NULL), m_isTimeInfoSupported(false), m_lineSize(0), m_samplePosition(0), m_systemTime(0)
+{
+	// Blackman windowed sinc delaying the fraction.
+	// Tap k is applied to the sample played k - (Taps / 2 - 1) samples before the position delayed by the integer delay.
+	const double fraction = loopbackDelay - m_integerDelay;
+	HR_EXPECT_OK(m_filter.allocate(Taps));
+	double sum = 0;
+	for (long k = 0; k < Taps; k++) {
+		const double t = k - (Taps / 2 - 1) - fraction;
+		const double sinc = (t == 0) ? 1 : sin(Pi * t) / (Pi * t);
+		const double r = (t + Taps / 2) / Taps;
+		const double window = ((0 < r) && (r < 1)) ? 0.42 - 0.5 * cos(2 * Pi * r) + 0.08 * cos(4 * Pi * r) : 0;
+		m_filter[k] = (float)(sinc * window);
+		sum += m_filter[k];
+	}
+	for (long k = 0; k < Taps; k++) m_filter[k] = (float)(m_filter[k] / sum);
+}
+
+CLoopbackDriver::~CLoopbackDriver()
+{
+	stop();
+	disposeBuffers();
+}
+
+/*static*/ DWORD WINAPI CLoopbackDriver::threadProc(LPVOID param)
+{
+	((CLoopbackDriver*)param)->run();
+	return 0;
+}
+
+/*
+	Switches buffers every bufferSize samples of the performance counter until stop event is set.
+*/
+void CLoopbackDriver::run()
+{
+	LARGE_INTEGER frequency, start;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	for (LONGLONG bufferIndex = 0; ; bufferIndex++) {
+		const LONGLONG due = start.QuadPart + (LONGLONG)(bufferIndex * m_bufferSize * frequency.QuadPart / m_sampleRate);
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		const DWORD wait = (now.QuadPart < due) ? (DWORD)((due - now.QuadPart) * 1000 / frequency.QuadPart) : 0;
+		if (WaitForSingleObject(m_stopEvent, wait) == WAIT_OBJECT_0) break;
+
+		// Waits for the rest less than a millisecond.
+		do {
+			YieldProcessor();
+			QueryPerformanceCounter(&now);
+		} while (now.QuadPart < due);
+		switchBuffers(bufferIndex, (LONGLONG)(due * 1e9 / frequency.QuadPart));
+	}
+}
+
+/*
+	Plays output buffers processed at the previous switch and passes input buffers recorded during the previous buffer.
+*/
+void CLoopbackDriver::switchBuffers(LONGLONG bufferIndex, LONGLONG systemTime)
+{
+	const long doubleBufferIndex = (long)(bufferIndex & 1);
+	const LONGLONG played = bufferIndex * m_bufferSize;
+	const long mask = m_lineSize - 1;
+
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		float* line = m_lines[channel];
+		const float* output = m_outputBuffers[doubleBufferIndex ^ 1][channel];
+		for (long i = 0; i < m_bufferSize; i++) {
+			line[(played + i) & mask] = (0 < bufferIndex) ? output[i] : 0;
+		}
+
+		// Input sample at position p is the sample played at p - delay.
+		// Taps after the integer delay are played by the buffer above, because bufferSize is at least Taps / 2.
+		float* input = m_inputBuffers[doubleBufferIndex][channel];
+		for (long i = 0; i < m_bufferSize; i++) {
+			const LONGLONG latest = played - m_bufferSize + i - m_integerDelay + (Taps / 2 - 1);
+			float sum = 0;
+			for (long k = 0; k < Taps; k++) {
+				sum += line[(latest - k) & mask] * m_filter[k];
+			}
+			input[i] = sum;
+		}
+	}
+
+	m_samplePosition.store(played, std::memory_order_relaxed);
+	m_systemTime.store(systemTime, std::memory_order_relaxed);
+	if (m_isTimeInfoSupported) {
+		ASIOTime time;
+		ZeroMemory(&time, sizeof(time));
+		time.timeInfo.flags = kSystemTimeValid | kSamplePositionValid | kSampleRateValid;
+		time.timeInfo.sampleRate = m_sampleRate;
+		time.timeInfo.samplePosition.hi = (unsigned long)(played >> 32);
+		time.timeInfo.samplePosition.lo = (unsigned long)played;
+		time.timeInfo.systemTime.hi = (unsigned long)(systemTime >> 32);
+		time.timeInfo.systemTime.lo = (unsigned long)systemTime;
+		m_callbacks->bufferSwitchTimeInfo(&time, doubleBufferIndex, ASIOFalse);
+	} else {
+		m_callbacks->bufferSwitch(doubleBufferIndex, ASIOFalse);
+	}
+}
+
+HRESULT STDMETHODCALLTYPE CLoopbackDriver::QueryInterface(REFIID riid, void** ppvObject)
+{
+	HR_ASSERT(ppvObject, E_POINTER);
+
+	// IASIO doesn't have its own IID. Driver is identified by CLSID.
+	if (riid != IID_IUnknown) {
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	*ppvObject = (IUnknown*)this;
+	AddRef();
+	return S_OK;
+}
+
+ULONG STDMETHODCALLTYPE CLoopbackDriver::AddRef()
+{
+	return ++m_refCount;
+}
+
+ULONG STDMETHODCALLTYPE CLoopbackDriver::Release()
+{
+	ULONG count = --m_refCount;
+	if (!count) delete this;
+	return count;
+}
+
+ASIOBool CLoopbackDriver::init(void* sysHandle)
+{
+	return ((0 < m_numChannels) && (MinBufferSize <= m_bufferSize) && (0 < m_sampleRate)) ? ASIOTrue : ASIOFalse;
+}
+
+void CLoopbackDriver::getDriverName(char* name)
+{
+	strcpy_s(name, 32, "Loopback");
+}
+
+long CLoopbackDriver::getDriverVersion()
+{
+	return 1;
+}
+
+void CLoopbackDriver::getErrorMessage(char* string)
+{
+	strcpy_s(string, 124, "");
+}
+
+ASIOError CLoopbackDriver::start()
+{
+	if (!m_callbacks) return ASE_InvalidMode;
+	if (m_thread) return ASE_OK;
+
+	m_stopEvent.Attach(CreateEvent(NULL, TRUE, FALSE, NULL));
+	if (!m_stopEvent) return ASE_HWMalfunction;
+	m_thread.Attach(CreateThread(NULL, 0, threadProc, this, 0, NULL));
+	if (!m_thread) return ASE_HWMalfunction;
+	WIN32_EXPECT(SetThreadPriority(m_thread, THREAD_PRIORITY_TIME_CRITICAL));
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::stop()
+{
+	if (m_thread) {
+		SetEvent(m_stopEvent);
+		WIN32_EXPECT(WAIT_OBJECT_0 == WaitForSingleObject(m_thread, INFINITE));
+		m_thread.Close();
+		m_stopEvent.Close();
+	}
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::getChannels(long* numInputChannels, long* numOutputChannels)
+{
+	*numInputChannels = *numOutputChannels = m_numChannels;
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::getLatencies(long* inputLatency, long* outputLatency)
+{
+	*inputLatency = *outputLatency = m_bufferSize;
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity)
+{
+	*minSize = *maxSize = *preferredSize = m_bufferSize;
+	*granularity = 0;
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::canSampleRate(ASIOSampleRate sampleRate)
+{
+	return (sampleRate == m_sampleRate) ? ASE_OK : ASE_NoClock;
+}
+
+ASIOError CLoopbackDriver::getSampleRate(ASIOSampleRate* sampleRate)
+{
+	*sampleRate = m_sampleRate;
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::setSampleRate(ASIOSampleRate sampleRate)
+{
+	return canSampleRate(sampleRate);
+}
+
+ASIOError CLoopbackDriver::getClockSources(ASIOClockSource* clocks, long* numSources)
+{
+	ZeroMemory(clocks, sizeof(*clocks));
+	clocks->associatedChannel = clocks->associatedGroup = -1;
+	clocks->isCurrentSource = ASIOTrue;
+	strcpy_s(clocks->name, "Performance Counter");
+	*numSources = 1;
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::setClockSource(long reference)
+{
+	return (reference == 0) ? ASE_OK : ASE_InvalidParameter;
+}
+
+ASIOError CLoopbackDriver::getSamplePosition(ASIOSamples* samplePosition, ASIOTimeStamp* timeStamp)
+{
+	const LONGLONG position = m_samplePosition.load(std::memory_order_relaxed);
+	const LONGLONG time = m_systemTime.load(std::memory_order_relaxed);
+	samplePosition->hi = (unsigned long)(position >> 32);
+	samplePosition->lo = (unsigned long)position;
+	timeStamp->hi = (unsigned long)(time >> 32);
+	timeStamp->lo = (unsigned long)time;
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::getChannelInfo(ASIOChannelInfo* info)
+{
+	if ((info->channel < 0) || (m_numChannels <= info->channel)) return ASE_InvalidParameter;
+
+	info->isActive = ASIOTrue;
+	info->channelGroup = 0;
+	info->type = ASIOSTFloat32LSB;
+	// Channel number fits in int, so that the name fits in 32 characters.
+	sprintf_s(info->name, "%s %d", info->isInput ? "Loopback In" : "Loopback Out", (int)(info->channel + 1));
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks)
+{
+	if ((bufferSize != m_bufferSize) || !callbacks) return ASE_InvalidMode;
+	disposeBuffers();
+
+	// All channels of the driver have buffers, so that the loop doesn't depend on channels created.
+	if (FAILED(m_bufferMemory.allocate(m_bufferSize * m_numChannels * 4))) return ASE_NoMemory;
+	vecClear(m_bufferMemory, m_bufferSize * m_numChannels * 4);
+	for (int index = 0; index < 2; index++) {
+		m_inputBuffers[index].resize(m_numChannels);
+		m_outputBuffers[index].resize(m_numChannels);
+		for (long channel = 0; channel < m_numChannels; channel++) {
+			m_inputBuffers[index][channel] = &m_bufferMemory[m_bufferSize * ((channel * 2 + 0) * 2 + index)];
+			m_outputBuffers[index][channel] = &m_bufferMemory[m_bufferSize * ((channel * 2 + 1) * 2 + index)];
+		}
+	}
+	for (long i = 0; i < numChannels; i++) {
+		ASIOBufferInfo& info = bufferInfos[i];
+		if ((info.channelNum < 0) || (m_numChannels <= info.channelNum)) return ASE_InvalidParameter;
+		for (int index = 0; index < 2; index++) {
+			info.buffers[index] = (info.isInput ? m_inputBuffers : m_outputBuffers)[index][info.channelNum];
+		}
+	}
+
+	// Line holds samples played during 2 buffers, the delay and taps of the filter.
+	long lineSize = 1;
+	while (lineSize < m_bufferSize * 2 + m_integerDelay + Taps) lineSize <<= 1;
+	m_lineSize = lineSize;
+	m_lines.reset(new CAlignedBuffer<float>[m_numChannels]);
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		if (FAILED(m_lines[channel].allocate(lineSize))) return ASE_NoMemory;
+		vecClear(m_lines[channel], lineSize);
+	}
+
+	m_callbacks = callbacks;
+	m_isTimeInfoSupported = (callbacks->asioMessage(kAsioSupportsTimeInfo, 0, NULL, NULL) == ASIOTrue);
+	LOG4CPLUS_INFO(logger, m_numChannels << " channels, " << m_bufferSize << " samples, " << m_sampleRate
+		<< " Hz, Loopback delay=" << m_integerDelay << " samples + fraction");
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::disposeBuffers()
+{
+	if (m_thread) return ASE_InvalidMode;
+
+	m_callbacks = NULL;
+	for (int index = 0; index < 2; index++) {
+		m_inputBuffers[index].clear();
+		m_outputBuffers[index].clear();
+	}
+	m_lines.reset();
+	return ASE_OK;
+}
+
+ASIOError CLoopbackDriver::controlPanel()
+{
+	return ASE_NotPresent;
+}
+
+ASIOError CLoopbackDriver::future(long selector, void* opt)
+{
+	return ASE_InvalidParameter;
+}
+
+ASIOError CLoopbackDriver::outputReady()
+{
+	return ASE_NotPresent;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+
+/*
+	IASIO implementation that loops each output channel back to the input channel of the same number.
+
+	Used to test round trip latency measurement without audio device. See CLatencyMeter.
+	The driver calls back from its own thread paced by the performance counter, as a device would.
+	Output buffers processed at buffer switch n are played at switch n + 1, and input buffers passed at
+	switch n have been recorded during the previous buffer. So that round trip latency from output buffer to
+	input buffer of the same switch is 2 * bufferSize + loopbackDelay samples, of which
+	bufferSize is reported as input latency and output latency each.
+	Fraction of loopbackDelay is made by windowed sinc interpolation.
+	Samples are Float32LSB.
+*/
+class CLoopbackDriver : public IASIO
+{
+	DISALLOW_COPY_AND_ASSIGN(CLoopbackDriver);
+
+public:
+	/*
+		loopbackDelay: Delay in samples not reported by getLatencies(), like delay of converters of the device.
+	*/
+	CLoopbackDriver(long numChannels, long bufferSize, double sampleRate, double loopbackDelay = 0);
+	virtual ~CLoopbackDriver();
+
+	static const long Taps = 32;
+	static const long MinBufferSize = Taps / 2;
+
+#pragma region IUnknown
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject);
+	virtual ULONG STDMETHODCALLTYPE AddRef();
+	virtual ULONG STDMETHODCALLTYPE Release();
+#pragma endregion
+
+#pragma region IASIO
+	virtual ASIOBool init(void* sysHandle);
+	virtual void getDriverName(char* name);
+	virtual long getDriverVersion();
+	virtual void getErrorMessage(char* string);
+	virtual ASIOError start();
+	virtual ASIOError stop();
+	virtual ASIOError getChannels(long* numInputChannels, long* numOutputChannels);
+	virtual ASIOError getLatencies(long* inputLatency, long* outputLatency);
+	virtual ASIOError getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity);
+	virtual ASIOError canSampleRate(ASIOSampleRate sampleRate);
+	virtual ASIOError getSampleRate(ASIOSampleRate* sampleRate);
+	virtual ASIOError setSampleRate(ASIOSampleRate sampleRate);
+	virtual ASIOError getClockSources(ASIOClockSource* clocks, long* numSources);
+	virtual ASIOError setClockSource(long reference);
+	virtual ASIOError getSamplePosition(ASIOSamples* samplePosition, ASIOTimeStamp* timeStamp);
+	virtual ASIOError getChannelInfo(ASIOChannelInfo* info);
+	virtual ASIOError createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks);
+	virtual ASIOError disposeBuffers();
+	virtual ASIOError controlPanel();
+	virtual ASIOError future(long selector, void* opt);
+	virtual ASIOError outputReady();
+#pragma endregion
+
+protected:
+	static DWORD WINAPI threadProc(LPVOID param);
+	void run();
+	void switchBuffers(LONGLONG bufferIndex, LONGLONG systemTime);
+
+	std::atomic<ULONG> m_refCount;
+
+	long m_numChannels;
+	long m_bufferSize;
+	double m_sampleRate;
+	long m_integerDelay;
+	CAlignedBuffer<float> m_filter;		// Fractional delay filter of Taps.
+
+	// Buffers created by createBuffers(). Index is double buffer index.
+	ASIOCallbacks* m_callbacks;
+	bool m_isTimeInfoSupported;
+	CAlignedBuffer<float> m_bufferMemory;
+	std::vector<float*> m_inputBuffers[2];
+	std::vector<float*> m_outputBuffers[2];
+
+	// Samples played by each output channel. Index is sample position masked by m_lineSize - 1.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_lines;
+	long m_lineSize;
+
+	// Position and time of the last buffer switch. Written by the driver thread.
+	std::atomic<LONGLONG> m_samplePosition;
+	std::atomic<LONGLONG> m_systemTime;
+
+	CHandle m_thread;
+	CHandle m_stopEvent;
+};
@@ -2,13 +2,17 @@
 #include "MainController.h"
 
 #include "Device.h"
+#include "GainEffect.h"
 
 static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("MainController"));
 
+/*static*/ std::vector<std::shared_ptr<CEffectPluginLibrary>> CMainController::m_effectPlugins;
+/*static*/ std::unique_ptr<CEffectChainConfig> CMainController::m_effectChainConfig;
+
 
 
 CMainController::CMainController()
-	: m_asioHandler(CAsioHandler::getInstance())
+	: m_asioHandler(new CAsioHandler())
 {
 }
 
@@ -17,12 +21,93 @@ CMainController::~CMainController()
 {
 }
 
-HRESULT CMainController::setup(IASIO* asio, HWND hwnd)
+HRESULT CMainController::setup(IASIO* asio, HWND hwnd, long lookaheadBuffers /*= 0*/)
+{
+	std::unique_ptr<CEffectChain> effectChain(createEffectChain());
+	HR_ASSERT(effectChain, E_OUTOFMEMORY);
+
+	if (m_effectChainConfig && (!m_effectChainConfig->getInputs().empty() || !m_effectChainConfig->getOutputs().empty())) {
+		HR_ASSERT_OK(m_asioHandler->armChannels(m_effectChainConfig->getInputs(), m_effectChainConfig->getOutputs()));
+	}
+	HR_ASSERT_OK(m_asioHandler->setup(asio, hwnd, lookaheadBuffers, effectChain.release()));
+	return S_OK;
+}
+
+/*
+	Creates the chain used by both live processing and offline rendering.
+
+	Returns NULL if failed.
+*/
+/*static*/ CEffectChain* CMainController::createEffectChain()
+{
+	if (m_effectChainConfig) return m_effectChainConfig->createEffectChain();
+
+	// Effects should be added in order of Effects enum.
+	std::unique_ptr<CEffectChain> effectChain(new CEffectChain());
+	if (FAILED(HR_EXPECT_OK(effectChain->addEffect(new CGainEffect())))) return NULL;
+	for (const std::shared_ptr<CEffectPluginLibrary>& plugin : m_effectPlugins) {
+		if (FAILED(HR_EXPECT_OK(effectChain->addEffect(plugin->createEffect())))) return NULL;
+	}
+	// Integer outputs are dithered so that low level signal after gain is not distorted by rounding.
+	effectChain->setDither(CSampleConverter::DitherShape::Weighted);
+
+	return effectChain.release();
+}
+
+/*static*/ HRESULT CMainController::loadEffectPlugin(LPCTSTR path)
+{
+	std::shared_ptr<CEffectPluginLibrary> plugin(new CEffectPluginLibrary());
+	HR_ASSERT_OK(plugin->load(path));
+	m_effectPlugins.push_back(plugin);
+	return S_OK;
+}
+
+/*static*/ HRESULT CMainController::loadEffectChainConfig(LPCTSTR path)
 {
-	HR_ASSERT_OK(m_asioHandler->setup(asio, hwnd));
+	std::unique_ptr<CEffectChainConfig> config(new CEffectChainConfig());
+	HR_ASSERT_OK(config->load(path));
+	if (!m_effectPlugins.empty()) {
+		LOG4CPLUS_WARN(logger, "Plugins specified by /plugin: are not added to the chain of " << path << ". Use effect.<name>=Plugin in the file.");
+	}
+	m_effectChainConfig = std::move(config);
 	return S_OK;
 }
 
+/*
+	Renders WAV files to the output directory by the same effect chain as live processing.
+
+	Output file has the same name and format as the input file.
+	Files are rendered in parallel by all processors. See COfflineRenderer.
+*/
+/*static*/ HRESULT CMainController::renderFiles(const std::vector<tstring>& inputPaths, LPCTSTR outputDirectory, long bufferSize /*= COfflineRenderer::DefaultBufferSize*/)
+{
+	HR_ASSERT(outputDirectory, E_POINTER);
+
+	std::vector<COfflineRenderer::Job> jobs(inputPaths.size());
+	for (size_t i = 0; i < inputPaths.size(); i++) {
+		const tstring& input = inputPaths[i];
+		size_t separator = input.find_last_of(_T("\\/:"));
+		jobs[i].inputPath = input;
+		jobs[i].outputPath = tstring(outputDirectory) + _T("\\") + input.substr((separator == tstring::npos) ? 0 : separator + 1);
+	}
+
+	std::vector<COfflineRenderer::Result> results;
+	return COfflineRenderer::renderFiles(jobs, createEffectChain, bufferSize, 0, results);
+}
+
+/*static*/ HRESULT CMainController::replayTrace(LPCTSTR path, bool isRealTime)
+{
+	HR_ASSERT(path, E_POINTER);
+
+	CTraceReplayer replayer(createEffectChain);
+	HR_ASSERT_OK(replayer.load(path));
+	CTraceReplayer::Result result;
+	HR_ASSERT_OK(replayer.replay(isRealTime, &result));
+
+	// Returns S_FALSE if the trace has not been replayed entirely.
+	return result.skippedBufferSwitches ? S_FALSE : S_OK;
+}
+
 HRESULT CMainController::shutdown()
 {
 	HR_EXPECT_OK(stop());
@@ -39,6 +124,14 @@ HRESULT CMainController::start(CDevice * inputDevice, CDevice* outputDevice)
 
 	HR_ASSERT_OK(stop());
 
+	// Processed buffers are rendered to the output device if it is a waveOut device.
+	UINT waveOutId;
+	if (HR_EXPECT_OK(outputDevice->getWaveOutId(&waveOutId)) == S_OK) {
+		m_asioHandler->outputRenderer.configure(waveOutId);
+	} else {
+		m_asioHandler->outputRenderer.disable();
+	}
+
 	HR_ASSERT_OK(m_asioHandler->start());
 
 	return S_OK;
@@ -50,3 +143,40 @@ HRESULT CMainController::stop()
 
 	return S_OK;
 }
+
+/*
+	Changes gain of all channels.
+
+	Called by the UI thread. The change is smoothed by CGainEffect.
+	The first Gain effect is changed if the chain is loaded from the file. Returns S_FALSE if the chain has no Gain effect.
+*/
+HRESULT CMainController::setGain(MP_DATA gain)
+{
+	const long effectIndex = m_effectChainConfig ? m_effectChainConfig->findEffect(CEffectChainConfig::EffectType::Gain) : GainEffect;
+	if (effectIndex < 0) return S_FALSE;
+
+	MP_ENVELOPE_SEGMENT segment;
+	ZeroMemory(&segment, sizeof(segment));
+	segment.rtStart = segment.rtEnd = m_asioHandler->getStreamTime();
+	segment.valStart = segment.valEnd = gain;
+	segment.iCurve = MP_CURVE_JUMP;
+	segment.flags = MPF_ENVLP_STANDARD;
+
+	return m_asioHandler->postParameterChange(effectIndex, CGainEffect::Gain, segment);
+}
+
+/*
+	Called by the UI thread. The selection is applied by the work queue thread from the next buffer.
+*/
+void CMainController::setSpectrumChannels(DWORD channelMask)
+{
+	m_asioHandler->spectrumAnalyzer.setChannels(channelMask);
+}
+
+/*
+	Called by the UI thread before setup().
+*/
+void CMainController::setSharedTap(LPCTSTR name, DWORD inputMask, DWORD outputMask)
+{
+	m_asioHandler->sharedTap.configure(name, inputMask, outputMask);
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "AsioHandler.h"
+#include "EffectChainConfig.h"
+#include "EffectPlugin.h"
+#include "OfflineRenderer.h"
+#include "TraceReplayer.h"
 
 class CDevice;
 
@@ -10,11 +14,58 @@ public:
 	CMainController();
 	~CMainController();
 
-	HRESULT setup(IASIO* asio, HWND hwnd);
+	HRESULT setup(IASIO* asio, HWND hwnd, long lookaheadBuffers = 0);
 	HRESULT shutdown();
 	HRESULT start(CDevice* inputDevice, CDevice* outputDevice);
 	HRESULT stop();
 
+	HRESULT setGain(MP_DATA gain);
+
+	static CEffectChain* createEffectChain();
+	// Loads the effect plugin that is appended to chains created after this call. See EffectPluginAbi.h.
+	// Called before setup(), renderFiles() and replayTrace().
+	static HRESULT loadEffectPlugin(LPCTSTR path);
+	// Loads the chain from the properties file used instead of the default chain. See CEffectChainConfig.
+	// Errors in the file are logged and returned by this call. Called before setup(), renderFiles() and replayTrace().
+	static HRESULT loadEffectChainConfig(LPCTSTR path);
+	static HRESULT renderFiles(const std::vector<tstring>& inputPaths, LPCTSTR outputDirectory, long bufferSize = COfflineRenderer::DefaultBufferSize);
+	// Replays the trace recorded by setTraceRecording() with the effect chain of this application.
+	static HRESULT replayTrace(LPCTSTR path, bool isRealTime);
+
+	// Selects device channels to be created and processed. See CAsioHandler::armChannels().
+	HRESULT armChannels(const std::vector<long>& inputs, const std::vector<long>& outputs) { return m_asioHandler->armChannels(inputs, outputs); }
+
+	// Selects channels shown by the spectrum analyzer. Bit n is channel n.
+	void setSpectrumChannels(DWORD channelMask);
+	CSpectrumAnalyzer& getSpectrumAnalyzer() { return m_asioHandler->spectrumAnalyzer; }
+
+	// Returns deviation of the sample rate of the device measured by the system clock in ppm.
+	double getDriftPpm() const { return m_asioHandler->sampleClock.getDriftPpm(); }
+
+	// Publishes channels to shared memory of the name from the next setup(). Empty name disables publishing.
+	void setSharedTap(LPCTSTR name, DWORD inputMask, DWORD outputMask);
+
+	// Measures round trip latency while running. Output channel should be looped back to the input channel.
+	// getLatencyMeasurement() returns S_FALSE until the measurement completes.
+	HRESULT startLatencyMeasurement(long inputChannel, long outputChannel) { return m_asioHandler->startLatencyMeasurement(inputChannel, outputChannel); }
+	HRESULT getLatencyMeasurement(CLatencyMeter::Result* result) { return m_asioHandler->getLatencyMeasurement(result); }
+
+	// Allocates buffers of the next setup() from large pages, if the user has "Lock pages in memory" privilege.
+	void setLargePages(bool useLargePages) { m_asioHandler->arena.configure(useLargePages); }
+
+	// Records trace from the next setup() to shutdown(). Empty path disables recording.
+	void setTraceRecording(LPCTSTR path, bool recordInput) { m_asioHandler->traceRecorder.configure(path, recordInput); }
+
 protected:
 	std::unique_ptr<CAsioHandler> m_asioHandler;
+
+	// Index of effects in the default chain.
+	enum Effects {
+		GainEffect,
+		FirstPluginEffect,		// Followed by the rest of plugins in order of loadEffectPlugin() calls.
+	};
+
+	static std::vector<std::shared_ptr<CEffectPluginLibrary>> m_effectPlugins;
+	// NULL if the default chain is used.
+	static std::unique_ptr<CEffectChainConfig> m_effectChainConfig;
 };
@@ -0,0 +1,207 @@
+#include "stdafx.h"
+#include "OfflineRenderer.h"
+#include "WaveFileDriver.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("OfflineRenderer"));
+
+/*static*/ ASIOCallbacks COfflineRenderer::m_callbacks = { NULL, NULL, NULL, NULL };
+
+COfflineRenderer::COfflineRenderer(EffectChainFactory factory, long bufferSize /*= DefaultBufferSize*/)
+	: CAsioHandlerContext(0), m_factory(factory), m_bufferSize(bufferSize), m_isHandling(false)
+{
+	ZeroMemory(&statistics, sizeof(statistics));
+	ZeroMemory(&driverInfo, sizeof(driverInfo));
+	asioCallbacks = &m_callbacks;
+}
+
+COfflineRenderer::~COfflineRenderer()
+{
+}
+
+/*
+	Renders the input file to the output file.
+
+	Buffers are processed through Setup, Start, Data and Stop events in the same way as CAsioHandler.
+*/
+HRESULT COfflineRenderer::render(const Job& job, Result* result)
+{
+	HR_ASSERT(result, E_POINTER);
+	HR_ASSERT(m_factory, E_ILLEGAL_METHOD_CALL);
+	ZeroMemory(result, sizeof(*result));
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	CComPtr<CWaveFileDriver> driver;
+	driver.Attach(new CWaveFileDriver(m_bufferSize));
+	HRESULT hr = driver->open(job.inputPath.c_str(), job.outputPath.c_str());
+	if (SUCCEEDED(hr)) {
+		numChannels = driver->getInput().getNumChannels();
+		hr = effectChains.initialize(m_factory());
+	}
+	if (SUCCEEDED(hr)) {
+		currentState.reset(CAsioHandlerState::createInitialState(this));
+		hr = process(driver);
+		if (currentState->type != CAsioHandlerState::Types::NotInitialized) {
+			HRESULT hrShutdown = HR_EXPECT_OK(triggerEvent(CComPtr<CAsioHandlerEvent>(new ShutdownEvent())));
+			if (SUCCEEDED(hr)) hr = hrShutdown;
+		}
+	}
+	if (asio) {
+		ASIO_EXPECT_OK(asio->disposeBuffers());
+		asio.Release();
+	}
+	HRESULT hrClose = HR_EXPECT_OK(driver->close());
+	if (SUCCEEDED(hr)) hr = hrClose;
+
+	QueryPerformanceCounter(&end);
+	result->hr = hr;
+	result->frames = driver->getOutputFrames();
+	result->duration = SUCCEEDED(hr) ? driver->getInput().getFrames() / driver->getInput().getSampleRate() : 0;
+	result->elapsed = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+	return hr;
+}
+
+/*
+	Processes all buffers of the input file.
+
+	Output is delayed by the latency added by the engine, so that the driver discards
+	the first frames as many as the latency and the renderer continues until the end of the input appears.
+	Then the tail of the effect chain is rendered from silent input.
+*/
+HRESULT COfflineRenderer::process(CWaveFileDriver* driver)
+{
+	HR_ASSERT_OK(triggerEvent(CComPtr<CAsioHandlerEvent>(new SetupEvent(driver, NULL, numChannels, 0))));
+	driver->setOutputOffset(getAddedLatency());
+	// The chain has been prepared by Setup event.
+	driver->setOutputTail(effectChains.getLatest()->getTailLength());
+	HR_ASSERT_OK(triggerEvent(CComPtr<CAsioHandlerEvent>(new StartEvent())));
+
+	HRESULT hr = S_OK;
+	for (long doubleBufferIndex = 0; SUCCEEDED(hr) && !driver->isCompleted(); doubleBufferIndex ^= 1) {
+		hr = processBuffer(driver, doubleBufferIndex);
+	}
+
+	// Stops even if failed, so that threads started by Start event are stopped.
+	HRESULT hrStop = triggerEvent(CComPtr<CAsioHandlerEvent>(new StopEvent()));
+	return FAILED(hr) ? hr : hrStop;
+}
+
+/*
+	Processes one buffer as the driver calls bufferSwitchTimeInfo() of CAsioHandler.
+*/
+HRESULT COfflineRenderer::processBuffer(CWaveFileDriver* driver, long doubleBufferIndex)
+{
+	HR_ASSERT_OK(driver->readInputs(doubleBufferIndex));
+
+	ASIOTime time;
+	ZeroMemory(&time, sizeof(time));
+	ASIO_ASSERT_OK(driver->getSamplePosition(&time.timeInfo.samplePosition, &time.timeInfo.systemTime));
+	time.timeInfo.flags = kSystemTimeValid | kSamplePositionValid;
+	statistics.bufferSwitch[doubleBufferIndex]++;
+	CComPtr<CAsioHandlerEvent> event(new DataEvent(&time, doubleBufferIndex, sampleClock.getEstimate()));
+	HR_ASSERT_OK(triggerEvent(event));
+
+	return driver->writeOutputs(doubleBufferIndex);
+}
+
+/*
+	Handles the event synchronously.
+
+	If the event is triggered while handling another event, it is handled after that event
+	as the work queue of CAsioHandler does.
+	Returns error of any event handled.
+*/
+HRESULT COfflineRenderer::triggerEvent(CAsioHandlerEvent* event)
+{
+	HR_ASSERT(event, E_POINTER);
+
+	m_events.push_back(event);
+	if (m_isHandling) return S_OK;
+
+	HRESULT hr = S_OK;
+	m_isHandling = true;
+	while (!m_events.empty()) {
+		CComPtr<CAsioHandlerEvent> next(m_events.front());
+		m_events.pop_front();
+		HRESULT hrEvent = handleStateEvent(next);
+		if (SUCCEEDED(hr)) hr = hrEvent;
+	}
+	m_isHandling = false;
+	return hr;
+}
+
+/*static*/ HRESULT COfflineRenderer::renderFiles(const std::vector<Job>& jobs, EffectChainFactory factory, long bufferSize, long numThreads, std::vector<Result>& results)
+{
+	HR_ASSERT(factory, E_POINTER);
+	HR_ASSERT(0 < bufferSize, E_INVALIDARG);
+
+	if (numThreads <= 0) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		numThreads = (long)info.dwNumberOfProcessors;
+	}
+	numThreads = max(1L, min(numThreads, (long)jobs.size()));
+
+	results.assign(jobs.size(), Result());
+	Batch batch;
+	batch.jobs = &jobs;
+	batch.results = &results;
+	batch.factory = factory;
+	batch.bufferSize = bufferSize;
+	batch.next = 0;
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	std::vector<HANDLE> threads;
+	for (long i = 0; i < numThreads; i++) {
+		HANDLE thread = CreateThread(NULL, 0, workerThreadProc, &batch, 0, NULL);
+		if (FAILED(WIN32_EXPECT(NULL != thread))) break;
+		threads.push_back(thread);
+	}
+	// Jobs are rendered by the calling thread if no worker thread could be created.
+	if (threads.empty()) workerThreadProc(&batch);
+	for (HANDLE thread : threads) {
+		WIN32_EXPECT(WAIT_OBJECT_0 == WaitForSingleObject(thread, INFINITE));
+		CloseHandle(thread);
+	}
+	QueryPerformanceCounter(&end);
+
+	// Report
+	double duration = 0;
+	long failed = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const Result& result = results[i];
+		if (SUCCEEDED(result.hr)) {
+			LOG4CPLUS_INFO(logger, jobs[i].inputPath.c_str() << ": " << result.duration << " seconds in " << result.elapsed
+				<< " seconds, Realtime factor=" << result.getRealtimeFactor());
+			duration += result.duration;
+		} else {
+			LOG4CPLUS_ERROR(logger, jobs[i].inputPath.c_str() << ": Failed. HRESULT=0x" << std::hex << result.hr << std::dec);
+			failed++;
+		}
+	}
+	const double elapsed = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+	LOG4CPLUS_INFO(logger, "Rendered " << (jobs.size() - failed) << " of " << jobs.size() << " file(s) by " << max((size_t)1, threads.size())
+		<< " thread(s): " << duration << " seconds in " << elapsed << " seconds, Realtime factor=" << ((0 < elapsed) ? duration / elapsed : 0));
+	return failed ? S_FALSE : S_OK;
+}
+
+/*
+	Worker thread of renderFiles().
+
+	Each worker has its own engine and renders jobs one by one until all jobs are taken.
+*/
+/*static*/ DWORD WINAPI COfflineRenderer::workerThreadProc(LPVOID param)
+{
+	Batch* batch = (Batch*)param;
+	COfflineRenderer renderer(batch->factory, batch->bufferSize);
+	const long count = (long)batch->jobs->size();
+	for (long i; (i = batch->next++) < count;) {
+		renderer.render((*batch->jobs)[i], &(*batch->results)[i]);
+	}
+	return 0;
+}
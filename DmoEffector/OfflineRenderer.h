@@ -0,0 +1,82 @@
+#pragma once
+
+#include "AsioHandlerEvent.h"
+#include "AsioHandlerState.h"
+#include "AsioHandlerContext.h"
+
+#include <deque>
+
+class CWaveFileDriver;
+
+/*
+	Engine that processes WAV files by the same states and effect chain as CAsioHandler, without ASIO driver.
+
+	CWaveFileDriver takes place of the driver. Events are handled synchronously by the calling thread
+	instead of the work queue, and each buffer is processed by RunningState as Data event.
+	So output is bit-identical to live processing of the same input with the same buffer size,
+	except that latency added by the engine is removed.
+	Output is longer than input by the tail of the effect chain, so that echoes and reverbs are not cut off.
+
+	Each object is used by one thread. renderFiles() processes files in parallel by objects on worker threads.
+*/
+class COfflineRenderer : public CAsioHandlerContext
+{
+	DISALLOW_COPY_AND_ASSIGN(COfflineRenderer);
+
+public:
+	// Creates new chain for each file.
+	typedef CEffectChain* (*EffectChainFactory)();
+
+	struct Job {
+		tstring inputPath;
+		tstring outputPath;
+	};
+
+	struct Result {
+		HRESULT hr;
+		LONGLONG frames;		// Count of frames rendered, including the tail.
+		double duration;		// Duration of the input file in seconds.
+		double elapsed;			// Time taken to render in seconds.
+		// Returns how many times faster than real time.
+		double getRealtimeFactor() const { return (0 < elapsed) ? duration / elapsed : 0; }
+	};
+
+	COfflineRenderer(EffectChainFactory factory, long bufferSize = DefaultBufferSize);
+	virtual ~COfflineRenderer();
+
+	HRESULT render(const Job& job, Result* result);
+
+	// Renders all jobs by numThreads worker threads. 0 means count of processors.
+	// Result of each job is returned in the same order as jobs. Returns S_FALSE if any job failed.
+	static HRESULT renderFiles(const std::vector<Job>& jobs, EffectChainFactory factory, long bufferSize, long numThreads, std::vector<Result>& results);
+
+#pragma region CAsioHandlerContext
+	virtual HRESULT triggerEvent(CAsioHandlerEvent* event);
+#pragma endregion
+
+	static const long DefaultBufferSize = 512;
+
+protected:
+	HRESULT process(CWaveFileDriver* driver);
+	HRESULT processBuffer(CWaveFileDriver* driver, long doubleBufferIndex);
+
+	EffectChainFactory m_factory;
+	long m_bufferSize;
+
+	// Events triggered while handling an event. Handled after it in order.
+	std::deque<CComPtr<CAsioHandlerEvent>> m_events;
+	bool m_isHandling;
+
+	// The driver never calls back.
+	static ASIOCallbacks m_callbacks;
+
+	// Jobs shared by worker threads of renderFiles().
+	struct Batch {
+		const std::vector<Job>* jobs;
+		std::vector<Result>* results;
+		EffectChainFactory factory;
+		long bufferSize;
+		std::atomic<long> next;		// Index of the job to be rendered next.
+	};
+	static DWORD WINAPI workerThreadProc(LPVOID param);
+};
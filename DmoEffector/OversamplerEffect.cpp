@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "OversamplerEffect.h"
+
+COversamplerEffect::COversamplerEffect(CEffect* effect, long factor, CHalfBandFilter::Phase phase /*= CHalfBandFilter::Phase::Linear*/)
+	: m_effect(effect), m_factor(factor), m_phase(phase), m_stageCount(0), m_latency(0)
+{
+}
+
+HRESULT COversamplerEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT((m_factor == 2) || (m_factor == 4) || (m_factor == 8), E_INVALIDARG);
+	HR_ASSERT(m_effect->getPreferredBlockSize() == 0, E_INVALIDARG);
+	HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+
+	const long highRateFrames = maxFrames * m_factor;
+	HR_ASSERT_OK(m_effect->prepare(numChannels, highRateFrames, sampleRate * m_factor));
+	for (DWORD i = 0; i < m_effect->getParameterCount(); i++) {
+		HR_ASSERT_OK(m_effect->getParameter(i)->prepare(highRateFrames, sampleRate));
+	}
+
+	for (m_stageCount = 0; (1 << m_stageCount) < m_factor; m_stageCount++);
+	m_filters.reset(new CHalfBandFilter[numChannels * m_stageCount * 2]);
+	m_buffers.reset(new CAlignedBuffer<float>[numChannels * m_stageCount]);
+	m_highRateChannels.reset(new float*[numChannels]);
+	m_paddings.reset(new CDelayLine[numChannels]);
+	for (long channel = 0; channel < numChannels; channel++) {
+		for (long stage = 0; stage < m_stageCount; stage++) {
+			long frames = maxFrames << stage;
+			HR_ASSERT_OK(getFilter(channel, stage, true).initialize(m_phase, frames));
+			HR_ASSERT_OK(getFilter(channel, stage, false).initialize(m_phase, frames));
+			HR_ASSERT_OK(m_buffers[channel * m_stageCount + stage].allocate(frames * 2));
+		}
+		m_highRateChannels[channel] = m_buffers[channel * m_stageCount + m_stageCount - 1];
+	}
+
+	// Pad delay at the higher rate so that latency is integer samples of the original rate.
+	double delay = measureDelay() * m_factor + m_effect->getLatency();
+	m_latency = (long)ceil(delay / m_factor - 0.01);
+	long padding = max(0L, (long)floor(m_latency * m_factor - delay + 0.5));
+	for (long channel = 0; channel < numChannels; channel++) {
+		HR_ASSERT_OK(m_paddings[channel].initialize(padding, highRateFrames));
+	}
+	return S_OK;
+}
+
+/*
+	Returns group delay of up and down filters at DC in samples of the original rate.
+
+	Impulse response through filters of channel 0 is measured and then filters are reset.
+	Centroid of the impulse response is the group delay at DC.
+*/
+double COversamplerEffect::measureDelay()
+{
+	const long frames = 256;
+	const long chunk = min(frames, m_maxFrames);
+	CAlignedBuffer<float> response;
+	if (FAILED(response.allocate(frames))) return 0;
+	response[0] = 1;
+
+	for (long position = 0; position < frames; position += chunk) {
+		long count = min(chunk, frames - position);
+		float* samples = &response[position];
+		for (long stage = 0; stage < m_stageCount; stage++) {
+			const float* src = stage ? (float*)m_buffers[stage - 1] : samples;
+			getFilter(0, stage, true).upsample(src, m_buffers[stage], count << stage);
+		}
+		for (long stage = m_stageCount - 1; 0 <= stage; stage--) {
+			float* dst = stage ? (float*)m_buffers[stage - 1] : samples;
+			getFilter(0, stage, false).downsample(m_buffers[stage], dst, count << stage);
+		}
+	}
+	for (long stage = 0; stage < m_stageCount; stage++) {
+		getFilter(0, stage, true).reset();
+		getFilter(0, stage, false).reset();
+	}
+
+	double sum = 0, moment = 0;
+	for (long i = 0; i < frames; i++) {
+		sum += response[i];
+		moment += response[i] * i;
+	}
+	return moment / sum;
+}
+
+/*
+	Parameters are rendered at the original rate and expanded to the higher rate.
+*/
+void COversamplerEffect::renderParameters(LONGLONG position, long frames)
+{
+	m_effect->renderParameters(position, frames);
+	for (DWORD i = 0; i < m_effect->getParameterCount(); i++) {
+		m_effect->getParameter(i)->expand(frames, m_factor);
+	}
+}
+
+void COversamplerEffect::process(float* const* channels, long numChannels, long frames)
+{
+	const long highRateFrames = frames * m_factor;
+
+	for (long channel = 0; channel < numChannels; channel++) {
+		CAlignedBuffer<float>* buffers = &m_buffers[channel * m_stageCount];
+		for (long stage = 0; stage < m_stageCount; stage++) {
+			const float* src = stage ? (float*)buffers[stage - 1] : channels[channel];
+			getFilter(channel, stage, true).upsample(src, buffers[stage], frames << stage);
+		}
+	}
+
+	m_effect->process(m_highRateChannels.get(), numChannels, highRateFrames);
+
+	for (long channel = 0; channel < numChannels; channel++) {
+		CAlignedBuffer<float>* buffers = &m_buffers[channel * m_stageCount];
+		if (m_paddings[channel].getDelay()) {
+			m_paddings[channel].process(m_highRateChannels[channel], m_highRateChannels[channel], highRateFrames);
+		}
+		for (long stage = m_stageCount - 1; 0 <= stage; stage--) {
+			float* dst = stage ? (float*)buffers[stage - 1] : channels[channel];
+			getFilter(channel, stage, false).downsample(buffers[stage], dst, frames << stage);
+		}
+	}
+}
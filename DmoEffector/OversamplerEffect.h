@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Effect.h"
+#include "HalfBandFilter.h"
+#include "DelayLine.h"
+
+/*
+	Effect that runs another effect at 2, 4 or 8 times the sample rate to reduce aliasing of nonlinear processing.
+
+	Sample rate is converted by cascaded half-band filters of 2x each.
+	The effect is prepared with maxFrames and sample rate multiplied by the factor.
+	Its parameters are smoothed at the original sample rate and each value is repeated factor times.
+
+	Latency is group delay of the filters at DC plus latency of the effect, rounded up to the original sample rate.
+	The fraction is padded by delay at the higher rate.
+	The effect whose preferred block size is not 0 should be wrapped by CBlockAdapterEffect before passed to this effect.
+*/
+class COversamplerEffect : public CEffect
+{
+public:
+	// Takes ownership of the effect.
+	COversamplerEffect(CEffect* effect, long factor, CHalfBandFilter::Phase phase = CHalfBandFilter::Phase::Linear);
+
+	virtual LPCTSTR getName() const { return m_effect->getName(); }
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual long getLatency() const { return m_latency; }
+
+	virtual DWORD getParameterCount() const { return m_effect->getParameterCount(); }
+	virtual CEffectParameter* getParameter(DWORD index) const { return m_effect->getParameter(index); }
+	virtual void renderParameters(LONGLONG position, long frames);
+
+	long getFactor() const { return m_factor; }
+
+protected:
+	double measureDelay();
+	CHalfBandFilter& getFilter(long channel, long stage, bool isUp) { return m_filters[(channel * m_stageCount + stage) * 2 + (isUp ? 0 : 1)]; }
+
+	std::unique_ptr<CEffect> m_effect;
+	const long m_factor;
+	const CHalfBandFilter::Phase m_phase;
+	long m_stageCount;
+	long m_latency;
+
+	// Filters of up and down for each stage of each channel.
+	std::unique_ptr<CHalfBandFilter[]> m_filters;
+	// Buffer of each stage of each channel. Buffer of stage s holds maxFrames * 2^(s + 1) samples.
+	std::unique_ptr<CAlignedBuffer<float>[]> m_buffers;
+	// Buffers of the last stage passed to the effect.
+	std::unique_ptr<float*[]> m_highRateChannels;
+	// Delay at the higher rate that pads latency to integer samples of the original rate.
+	std::unique_ptr<CDelayLine[]> m_paddings;
+};
@@ -0,0 +1,224 @@
+#include "stdafx.h"
+#include "PitchShifterEffect.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("PitchShifterEffect"));
+
+static const double Pi = 3.14159265358979323846;
+
+/*static*/ const float CPitchShifterEffect::TransientThreshold = 0.5f;
+/*static*/ const float CPitchShifterEffect::TransientRise = 2.0f;
+
+// Wraps phase into [-pi, pi).
+static float wrapPhase(float phase);
+// magnitude = |re + i * im|, phase = arg(re + i * im)
+static void toPolar(const float* re, const float* im, float* magnitude, float* phase, long count);
+// re + i * im = magnitude * exp(i * phase)
+static void toComplex(const float* magnitude, const float* phase, float* re, float* im, long count);
+
+CPitchShifterEffect::CPitchShifterEffect()
+	: m_frameSize(0), m_hopSize(0), m_bins(0), m_stride(0), m_fill(0)
+{
+	addParameter(new CEffectParameter(_T("Pitch"), -12.0f, 12.0f, 0.0f, CEffectParameter::Smoothing::None));
+}
+
+HRESULT CPitchShifterEffect::prepare(long numChannels, long maxFrames, double sampleRate)
+{
+	HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+
+	long size = 8;
+	while (((size < maxFrames * 4) || (size < sampleRate * 0.02)) && (size < MaxFrameSize)) size *= 2;
+	m_frameSize = size;
+	m_hopSize = size / 4;
+	HR_ASSERT_OK(m_fft.initialize(size));
+	m_bins = m_fft.getBinCount();
+	m_stride = (m_bins + 3) & ~3;
+
+	// Periodic Hann window. Sum of squared windows overlapped by 4 is 1.5.
+	HR_ASSERT_OK(m_window.allocate(size));
+	for (long i = 0; i < size; i++) {
+		m_window[i] = (float)(0.5 * (1 - cos(2 * Pi * i / size)));
+	}
+
+	m_channels.reset(new Channel[numChannels]);
+	for (long channel = 0; channel < numChannels; channel++) {
+		Channel& c = m_channels[channel];
+		HR_ASSERT_OK(c.input.allocate(size));
+		HR_ASSERT_OK(c.output.allocate(size));
+		HR_ASSERT_OK(c.ready.allocate(m_hopSize));
+		HR_ASSERT_OK(c.magnitude.allocate(m_stride));
+		HR_ASSERT_OK(c.phase.allocate(m_stride));
+		HR_ASSERT_OK(c.synthesisPhase.allocate(m_stride));
+	}
+	m_fill = 0;
+
+	HR_ASSERT_OK(m_time.allocate(size));
+	HR_ASSERT_OK(m_re.allocate(m_stride));
+	HR_ASSERT_OK(m_im.allocate(m_stride));
+	HR_ASSERT_OK(m_magnitude.allocate(m_stride));
+	HR_ASSERT_OK(m_phase.allocate(m_stride));
+	HR_ASSERT_OK(m_outputMagnitude.allocate(m_stride));
+	HR_ASSERT_OK(m_outputPhase.allocate(m_stride));
+	HR_ASSERT_OK(m_peaks.allocate(m_bins));
+
+	LOG4CPLUS_INFO(logger, "Frame size=" << m_frameSize << ", Hop size=" << m_hopSize);
+	return S_OK;
+}
+
+/*
+	Input samples are written to the end of the frame and output samples are taken from the hop synthesized before.
+	When the hop is filled, frame of each channel is processed by the pitch at the last sample of the hop.
+*/
+void CPitchShifterEffect::process(float* const* channels, long numChannels, long frames)
+{
+	for (long done = 0; done < frames; ) {
+		long count = min(frames - done, m_hopSize - m_fill);
+		for (long channel = 0; channel < numChannels; channel++) {
+			Channel& c = m_channels[channel];
+			float* samples = &channels[channel][done];
+			vecCopy(&c.input[m_frameSize - m_hopSize + m_fill], samples, count);
+			vecCopy(samples, &c.ready[m_fill], count);
+		}
+		m_fill += count;
+		done += count;
+
+		if (m_fill == m_hopSize) {
+			const CEffectParameter* pitch = m_parameters[Pitch].get();
+			float semitones = pitch->isConstant() ? pitch->getValue() : pitch->getValues()[done - 1];
+			float ratio = powf(2.0f, semitones / 12);
+			for (long channel = 0; channel < numChannels; channel++) {
+				processFrame(channel, ratio);
+			}
+			m_fill = 0;
+		}
+	}
+}
+
+void CPitchShifterEffect::processFrame(long channel, float ratio)
+{
+	Channel& c = m_channels[channel];
+
+	vecCopy(m_time, c.input, m_frameSize);
+	vecMultiply(m_time, m_window, m_frameSize);
+	m_fft.forwardReal(m_time, m_re, m_im);
+	toPolar(m_re, m_im, m_magnitude, m_phase, m_stride);
+
+	// Spectrum is output as is if pitch is not shifted.
+	if (ratio != 1.0f) {
+		shiftPeaks(channel, ratio, detectTransient(channel));
+		toComplex(m_outputMagnitude, m_outputPhase, m_re, m_im, m_stride);
+		m_im[0] = m_im[m_bins - 1] = 0;
+	} else {
+		vecCopy(c.synthesisPhase, m_phase, m_stride);
+	}
+	m_fft.inverseReal(m_re, m_im, m_time);
+	vecMultiply(m_time, m_window, m_frameSize);
+	vecMultiplyAdd(c.output, m_time, 1 / 1.5f, m_frameSize);
+
+	vecCopy(c.ready, c.output, m_hopSize);
+	memmove(c.output, &c.output[m_hopSize], sizeof(float) * (m_frameSize - m_hopSize));
+	vecClear(&c.output[m_frameSize - m_hopSize], m_hopSize);
+	memmove(c.input, &c.input[m_hopSize], sizeof(float) * (m_frameSize - m_hopSize));
+	vecCopy(c.magnitude, m_magnitude, m_stride);
+	vecCopy(c.phase, m_phase, m_stride);
+}
+
+/*
+	Returns true if rise of magnitude from the previous frame is more than TransientThreshold of total magnitude.
+*/
+bool CPitchShifterEffect::detectTransient(long channel)
+{
+	const float* previous = m_channels[channel].magnitude;
+	__m128 rise = _mm_setzero_ps();
+	__m128 total = _mm_setzero_ps();
+	for (long k = 0; k < m_stride; k += 4) {
+		__m128 m = _mm_load_ps(&m_magnitude[k]);
+		rise = _mm_add_ps(rise, _mm_max_ps(_mm_sub_ps(m, _mm_load_ps(&previous[k])), _mm_setzero_ps()));
+		total = _mm_add_ps(total, m);
+	}
+	float r[4], t[4];
+	_mm_storeu_ps(r, rise);
+	_mm_storeu_ps(t, total);
+	float sumTotal = t[0] + t[1] + t[2] + t[3];
+	return (0 < sumTotal) && (sumTotal * TransientThreshold < r[0] + r[1] + r[2] + r[3]);
+}
+
+/*
+	Moves region of bins around each peak to the shifted frequency.
+
+	Peak is the bin whose magnitude is larger than 2 bins of each side. Region is bounded by the middle of adjacent peaks.
+	Phase of the shifted peak advances by instantaneous frequency of the peak multiplied by the ratio.
+	Other bins of the region keep phase difference to the peak.
+	At the transient, analyzed phases are used for regions of peaks that rise by TransientRise.
+*/
+void CPitchShifterEffect::shiftPeaks(long channel, float ratio, bool isTransient)
+{
+	Channel& c = m_channels[channel];
+	const float* magnitude = m_magnitude;
+	const float* phase = m_phase;
+	vecClear(m_outputMagnitude, m_stride);
+	vecClear(m_outputPhase, m_stride);
+
+	long peakCount = 0;
+	for (long k = 2; k < m_bins - 2; k++) {
+		float m = magnitude[k];
+		if ((magnitude[k - 2] < m) && (magnitude[k - 1] < m) && (magnitude[k + 1] <= m) && (magnitude[k + 2] <= m)) {
+			m_peaks[peakCount++] = k;
+		}
+	}
+
+	// Expected phase advance of bin 1 in the hop.
+	const float binAdvance = (float)(2 * Pi * m_hopSize / m_frameSize);
+	for (long i = 0; i < peakCount; i++) {
+		const long peak = m_peaks[i];
+		const long target = (long)floor(peak * ratio + 0.5f);
+		if (m_bins <= target) break;
+		const long shift = target - peak;
+		const long start = i ? (m_peaks[i - 1] + peak + 1) / 2 : 0;
+		const long end = (i + 1 < peakCount) ? (peak + m_peaks[i + 1] + 1) / 2 : m_bins;
+
+		// Only peaks that rise at the transient are reset so that sustained partials keep continuity.
+		const bool isResetRegion = isTransient && (c.magnitude[peak] * TransientRise < magnitude[peak]);
+		float peakPhase = phase[peak];
+		if (!isResetRegion) {
+			float advance = binAdvance * peak + wrapPhase(phase[peak] - c.phase[peak] - binAdvance * peak);
+			peakPhase = wrapPhase(c.synthesisPhase[target] + advance * ratio);
+		}
+		for (long k = max(start, -shift); k < min(end, m_bins - shift); k++) {
+			if (m_outputMagnitude[k + shift] < magnitude[k]) {
+				m_outputMagnitude[k + shift] = magnitude[k];
+				m_outputPhase[k + shift] = isResetRegion ? phase[k] : wrapPhase(peakPhase + phase[k] - phase[peak]);
+			}
+		}
+	}
+	vecCopy(c.synthesisPhase, m_outputPhase, m_stride);
+}
+
+static float wrapPhase(float phase)
+{
+	const float twoPi = (float)(2 * Pi);
+	return phase - twoPi * floorf(phase / twoPi + 0.5f);
+}
+
+// count should be multiple of 4 and buffers should be aligned.
+static void toPolar(const float* re, const float* im, float* magnitude, float* phase, long count)
+{
+	for (long i = 0; i < count; i += 4) {
+		__m128 r = _mm_load_ps(&re[i]);
+		__m128 m = _mm_load_ps(&im[i]);
+		_mm_store_ps(&magnitude[i], _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m))));
+		_mm_store_ps(&phase[i], atan2Ps(m, r));
+	}
+}
+
+// count should be multiple of 4 and buffers should be aligned.
+static void toComplex(const float* magnitude, const float* phase, float* re, float* im, long count)
+{
+	for (long i = 0; i < count; i += 4) {
+		__m128 m = _mm_load_ps(&magnitude[i]);
+		__m128 s, c;
+		sinCosPs(_mm_load_ps(&phase[i]), &s, &c);
+		_mm_store_ps(&re[i], _mm_mul_ps(m, c));
+		_mm_store_ps(&im[i], _mm_mul_ps(m, s));
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Effect.h"
+#include "Fft.h"
+
+/*
+	Pitch shifter by phase vocoder with identity phase locking.
+
+	Each frame is windowed by Hann window and analyzed by FFT with overlap of 4.
+	Spectral peaks are moved to the shifted frequency and bins around each peak are moved with the peak
+	keeping phase difference to the peak (identity phase locking), which preserves timbre of each partial.
+	When a transient is detected by rise of spectral magnitude, phases of rising peaks are reset to the analyzed phases
+	so that the attack is not dispersed.
+
+	Frame size is chosen by prepare() from maxFrames (ASIO buffer size) and the sample rate:
+	Power of 2 that is 4 * maxFrames or more and 20 milliseconds or more, up to MaxFrameSize.
+	Hop size is frame size / 4. So each buffer processes one frame if the buffer size is power of 2 and 256 or more at 48kHz.
+	Samples are buffered by the effect itself and latency is the frame size.
+*/
+class CPitchShifterEffect : public CEffect
+{
+public:
+	enum Parameters {
+		Pitch,		// Pitch shift in semitones. -12.0 to 12.0, neutral value is 0.0.
+	};
+
+	CPitchShifterEffect();
+
+	virtual LPCTSTR getName() const { return _T("PitchShifter"); }
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate);
+	virtual void process(float* const* channels, long numChannels, long frames);
+	virtual ProcessFunction getProcessFunction(void** context) { *context = this; return processEffectOf<CPitchShifterEffect>; }
+	virtual long getLatency() const { return m_frameSize; }
+
+	long getFrameSize() const { return m_frameSize; }
+	long getHopSize() const { return m_hopSize; }
+
+	static const long MaxFrameSize = 8192;
+	// Ratio of rise of spectral magnitude to total magnitude that is detected as transient.
+	static const float TransientThreshold;
+	// Ratio of magnitude of the peak to the previous frame whose phases are reset at the transient.
+	static const float TransientRise;
+
+protected:
+	void processFrame(long channel, float ratio);
+	bool detectTransient(long channel);
+	void shiftPeaks(long channel, float ratio, bool isTransient);
+
+	long m_frameSize;
+	long m_hopSize;
+	long m_bins;
+	long m_stride;					// Count of floats of each spectrum rounded up to multiple of 4.
+	CFft m_fft;
+	CAlignedBuffer<float> m_window;	// Hann window used by both analysis and synthesis.
+
+	// State of each channel.
+	struct Channel {
+		CAlignedBuffer<float> input;		// Last frameSize input samples.
+		CAlignedBuffer<float> output;		// Overlap-add of synthesized frames.
+		CAlignedBuffer<float> ready;		// Output samples of the hop.
+		CAlignedBuffer<float> magnitude;	// Magnitude of the previous frame.
+		CAlignedBuffer<float> phase;		// Analyzed phase of the previous frame.
+		CAlignedBuffer<float> synthesisPhase;
+	};
+	std::unique_ptr<Channel[]> m_channels;
+	long m_fill;
+
+	// Work buffers.
+	CAlignedBuffer<float> m_time;
+	CAlignedBuffer<float> m_re;
+	CAlignedBuffer<float> m_im;
+	CAlignedBuffer<float> m_magnitude;
+	CAlignedBuffer<float> m_phase;
+	CAlignedBuffer<float> m_outputMagnitude;
+	CAlignedBuffer<float> m_outputPhase;
+	CAlignedBuffer<long> m_peaks;
+};
@@ -0,0 +1,239 @@
+#include "stdafx.h"
+#include "RealTimeArena.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("RealTimeArena"));
+
+// Arena of the current Scope and size of the current Meter on each thread.
+static thread_local CRealTimeArena* currentArena = NULL;
+static thread_local size_t* currentMeter = NULL;
+
+static size_t roundUp(size_t size, size_t unit) { return (size + unit - 1) / unit * unit; }
+static bool enableLockMemoryPrivilege();
+
+CRealTimeArena::CRealTimeArena()
+	: m_useLargePages(false), m_base(NULL), m_capacity(0), m_isLocked(false), m_isLargePage(false), m_workingSetIncrease(0)
+	, m_used(0), m_peak(0)
+{
+}
+
+CRealTimeArena::~CRealTimeArena()
+{
+	release();
+}
+
+HRESULT CRealTimeArena::reserve(size_t size)
+{
+	HR_ASSERT(0 < size, E_INVALIDARG);
+
+	CComCritSecLock<CComAutoCriticalSection> lock(m_lock);
+	if (size <= m_capacity) {
+		LOG4CPLUS_INFO(logger, "Kept " << m_capacity << " bytes for " << size << " bytes");
+		return S_FALSE;
+	}
+	HR_ASSERT(m_allocatedBlocks.empty(), E_ILLEGAL_METHOD_CALL);
+
+	release();
+	HR_ASSERT_OK(allocateRegion(size));
+	m_freeBlocks[0] = m_capacity;
+	m_used = m_peak = 0;
+	LOG4CPLUS_INFO(logger, "Reserved " << m_capacity << " bytes for " << size << " bytes: Locked=" << m_isLocked << ", Large page=" << m_isLargePage);
+	return S_OK;
+}
+
+HRESULT CRealTimeArena::allocateRegion(size_t size)
+{
+	if (m_useLargePages) {
+		const SIZE_T largePage = GetLargePageMinimum();
+		if (largePage && enableLockMemoryPrivilege()) {
+			const size_t largeSize = roundUp(size, largePage);
+			m_base = (BYTE*)VirtualAlloc(NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (m_base) {
+				m_capacity = largeSize;
+				m_isLargePage = m_isLocked = true;
+				return S_OK;
+			}
+		}
+		LOG4CPLUS_WARN(logger, "Large pages are not available. Hold SeLockMemoryPrivilege to use large pages.");
+	}
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const size_t pageSize = info.dwPageSize;
+	m_capacity = roundUp(size, pageSize);
+	m_base = (BYTE*)VirtualAlloc(NULL, m_capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!m_base) m_capacity = 0;
+	WIN32_ASSERT(m_base);
+
+	// Touches every page so that the real-time thread doesn't cause demand-zero page fault.
+	for (size_t offset = 0; offset < m_capacity; offset += pageSize) {
+		((volatile BYTE*)m_base)[offset] = 0;
+	}
+
+	// Minimum working set limits the size that can be locked.
+	// Failure is not fatal because the pages are resident unless the system is short of memory.
+	SIZE_T minimumWorkingSet, maximumWorkingSet;
+	if (SUCCEEDED(WIN32_EXPECT(GetProcessWorkingSetSize(GetCurrentProcess(), &minimumWorkingSet, &maximumWorkingSet)))
+		&& SUCCEEDED(WIN32_EXPECT(SetProcessWorkingSetSize(GetCurrentProcess(), minimumWorkingSet + m_capacity, maximumWorkingSet + m_capacity)))) {
+		m_workingSetIncrease = m_capacity;
+	}
+	m_isLocked = SUCCEEDED(WIN32_EXPECT(VirtualLock(m_base, m_capacity)));
+	return S_OK;
+}
+
+/*
+	Frees the region.
+
+	Blocks allocated should have been freed.
+*/
+void CRealTimeArena::release()
+{
+	CComCritSecLock<CComAutoCriticalSection> lock(m_lock);
+	if (!m_base) return;
+
+	if (!m_allocatedBlocks.empty()) {
+		LOG4CPLUS_ERROR(logger, m_allocatedBlocks.size() << " block(s) are not freed. The region is leaked.");
+	} else {
+		if (m_isLocked && !m_isLargePage) WIN32_EXPECT(VirtualUnlock(m_base, m_capacity));
+		WIN32_EXPECT(VirtualFree(m_base, 0, MEM_RELEASE));
+	}
+	if (m_workingSetIncrease) {
+		SIZE_T minimumWorkingSet, maximumWorkingSet;
+		if (SUCCEEDED(WIN32_EXPECT(GetProcessWorkingSetSize(GetCurrentProcess(), &minimumWorkingSet, &maximumWorkingSet)))) {
+			WIN32_EXPECT(SetProcessWorkingSetSize(GetCurrentProcess(), minimumWorkingSet - m_workingSetIncrease, maximumWorkingSet - m_workingSetIncrease));
+		}
+	}
+	m_base = NULL;
+	m_capacity = 0;
+	m_isLocked = m_isLargePage = false;
+	m_workingSetIncrease = 0;
+	m_freeBlocks.clear();
+	m_allocatedBlocks.clear();
+	m_used = 0;
+}
+
+/*
+	Returns memory of the size aligned to the alignment, or NULL if the arena doesn't have enough free block.
+
+	Memory is not cleared.
+*/
+void* CRealTimeArena::allocate(size_t size, size_t alignment)
+{
+	const size_t blockSize = roundUp(max(size, (size_t)1), CacheLine);
+	CComCritSecLock<CComAutoCriticalSection> lock(m_lock);
+
+	// First fit. Leading part of the free block skipped for the alignment remains free.
+	for (std::map<size_t, size_t>::iterator it = m_freeBlocks.begin(); it != m_freeBlocks.end(); it++) {
+		const size_t freeOffset = it->first;
+		const size_t freeSize = it->second;
+		const size_t offset = roundUp((size_t)m_base + freeOffset, max(alignment, CacheLine)) - (size_t)m_base;
+		if (freeOffset + freeSize < offset + blockSize) continue;
+
+		m_freeBlocks.erase(it);
+		if (freeOffset < offset) m_freeBlocks[freeOffset] = offset - freeOffset;
+		if (offset + blockSize < freeOffset + freeSize) m_freeBlocks[offset + blockSize] = freeOffset + freeSize - (offset + blockSize);
+		m_allocatedBlocks[offset] = blockSize;
+		m_used += blockSize;
+		m_peak = max(m_peak, m_used);
+		return m_base + offset;
+	}
+
+	LOG4CPLUS_ERROR(logger, "Exhausted: " << size << " bytes requested, " << (m_capacity - m_used) << " of " << m_capacity << " bytes free");
+	return NULL;
+}
+
+void CRealTimeArena::free(void* data)
+{
+	if (!data) return;
+
+	CComCritSecLock<CComAutoCriticalSection> lock(m_lock);
+	std::map<size_t, size_t>::iterator allocated = m_allocatedBlocks.find((BYTE*)data - m_base);
+	if (allocated == m_allocatedBlocks.end()) {
+		LOG4CPLUS_ERROR(logger, "Freeing block not allocated: " << data);
+		return;
+	}
+	size_t offset = allocated->first;
+	size_t size = allocated->second;
+	m_allocatedBlocks.erase(allocated);
+	m_used -= size;
+
+	// Merges with the adjacent free blocks.
+	std::map<size_t, size_t>::iterator next = m_freeBlocks.lower_bound(offset);
+	if ((next != m_freeBlocks.end()) && (next->first == offset + size)) {
+		size += next->second;
+		next = m_freeBlocks.erase(next);
+	}
+	if (next != m_freeBlocks.begin()) {
+		std::map<size_t, size_t>::iterator previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			m_freeBlocks.erase(previous);
+		}
+	}
+	m_freeBlocks[offset] = size;
+}
+
+/*static*/ size_t CRealTimeArena::getBlockSize(size_t size, size_t alignment)
+{
+	// Alignment larger than the cache line could skip up to (alignment - CacheLine) bytes.
+	return roundUp(max(size, (size_t)1), CacheLine) + ((CacheLine < alignment) ? (alignment - CacheLine) : 0);
+}
+
+/*static*/ void* CRealTimeArena::allocateAligned(size_t size, size_t alignment, CRealTimeArena** arena)
+{
+	*arena = currentArena;
+	if (currentArena) return currentArena->allocate(size, alignment);
+
+	if (currentMeter) *currentMeter += getBlockSize(size, alignment);
+	return _aligned_malloc(size, alignment);
+}
+
+/*static*/ void CRealTimeArena::freeAligned(CRealTimeArena* arena, void* data)
+{
+	if (arena) arena->free(data);
+	else _aligned_free(data);
+}
+
+CRealTimeArena::Scope::Scope(CRealTimeArena* arena)
+	: m_previous(currentArena)
+{
+	// Arena that has not been reserved, for example the engine running offline, is not used.
+	currentArena = (arena && arena->getCapacity()) ? arena : NULL;
+}
+
+CRealTimeArena::Scope::~Scope()
+{
+	currentArena = m_previous;
+}
+
+CRealTimeArena::Meter::Meter(size_t* size)
+	: m_previous(currentMeter)
+{
+	currentMeter = size;
+}
+
+CRealTimeArena::Meter::~Meter()
+{
+	currentMeter = m_previous;
+}
+
+/*
+	Enables SeLockMemoryPrivilege of the process token, which is required to allocate large pages.
+
+	The privilege should have been granted to the user by "Lock pages in memory" policy.
+*/
+static bool enableLockMemoryPrivilege()
+{
+	CHandle token;
+	HANDLE handle;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &handle)) return false;
+	token.Attach(handle);
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (!LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)) return false;
+
+	// AdjustTokenPrivileges() succeeds with ERROR_NOT_ALL_ASSIGNED if the privilege is not granted.
+	return AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && (GetLastError() == ERROR_SUCCESS);
+}
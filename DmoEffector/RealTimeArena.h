@@ -0,0 +1,105 @@
+#pragma once
+
+#include <map>
+
+/*
+	Memory region for all buffers used by the real-time threads.
+
+	The region is allocated by reserve() out of the real-time thread, every page is touched so that
+	it never page-faults on first touch, and locked in the working set.
+	Large pages are used if configured and SeLockMemoryPrivilege is held. Large pages are never paged out.
+
+	CAlignedBuffer allocates from the arena selected by Scope on the calling thread, or from the heap otherwise.
+	Meter counts bytes that the allocations would take from an arena, so that the arena can be sized
+	by the needs of the effect chain and the engine before it is reserved.
+
+	allocate() and free() take the lock and should not be called by the real-time thread.
+	allocate() returns NULL if the arena is exhausted, so that the caller fails out of the real-time thread.
+*/
+class CRealTimeArena
+{
+	DISALLOW_COPY_AND_ASSIGN(CRealTimeArena);
+
+public:
+	CRealTimeArena();
+	~CRealTimeArena();
+
+	// Called by the UI thread before CAsioHandler::setup().
+	void configure(bool useLargePages) { m_useLargePages = useLargePages; }
+
+	/*
+		Allocates, pre-faults and locks the region of the size.
+
+		The region is kept if it is large enough, otherwise it is replaced.
+		Returns E_ILLEGAL_METHOD_CALL if it should be replaced while blocks are allocated.
+	*/
+	HRESULT reserve(size_t size);
+	void release();
+
+	void* allocate(size_t size, size_t alignment);
+	void free(void* data);
+	bool contains(const void* data) const { return (m_base <= (const BYTE*)data) && ((const BYTE*)data < m_base + m_capacity); }
+
+	size_t getCapacity() const { return m_capacity; }
+	size_t getUsed() const { return m_used; }
+	size_t getPeak() const { return m_peak; }
+	bool isLocked() const { return m_isLocked; }
+	bool isLargePage() const { return m_isLargePage; }
+
+	// Returns size of the block taken from the arena by allocate().
+	static size_t getBlockSize(size_t size, size_t alignment);
+
+	// Called by CAlignedBuffer.
+	// Allocates from the arena of the current Scope, or from the heap. arena receives the arena allocated from or NULL.
+	static void* allocateAligned(size_t size, size_t alignment, CRealTimeArena** arena);
+	static void freeAligned(CRealTimeArena* arena, void* data);
+
+	// Routes allocations of CAlignedBuffer on this thread to the arena while this object exists.
+	// Allocations go to the heap if the arena is NULL or has not been reserved.
+	class Scope
+	{
+		DISALLOW_COPY_AND_ASSIGN(Scope);
+
+	public:
+		Scope(CRealTimeArena* arena);
+		~Scope();
+
+	protected:
+		CRealTimeArena* m_previous;
+	};
+
+	// Adds size of blocks allocated from the heap on this thread to *size while this object exists.
+	class Meter
+	{
+		DISALLOW_COPY_AND_ASSIGN(Meter);
+
+	public:
+		Meter(size_t* size);
+		~Meter();
+
+	protected:
+		size_t* m_previous;
+	};
+
+	// Granularity of blocks. Every block is aligned to the cache line.
+	static const size_t CacheLine = 64;
+
+protected:
+	HRESULT allocateRegion(size_t size);
+
+	bool m_useLargePages;
+
+	BYTE* m_base;
+	size_t m_capacity;
+	bool m_isLocked;
+	bool m_isLargePage;
+	size_t m_workingSetIncrease;	// Bytes added to the minimum working set to lock the region.
+
+	CComAutoCriticalSection m_lock;
+	// Offset and size of free blocks. Adjacent free blocks are merged.
+	std::map<size_t, size_t> m_freeBlocks;
+	// Offset and size of allocated blocks.
+	std::map<size_t, size_t> m_allocatedBlocks;
+	size_t m_used;
+	size_t m_peak;
+};
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "SampleClock.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("SampleClock"));
+
+static const double Pi = 3.14159265358979323846;
+
+/*static*/ const double CSampleClock::DefaultBandwidth = 0.05;
+/*static*/ const double CSampleClock::LockBandwidth = 1.0;
+/*static*/ const double CSampleClock::LockSeconds = 3.0;
+/*static*/ const double CSampleClock::MaxError = 0.01;
+
+CSampleClock::CSampleClock()
+	: m_nominalSampleRate(0), m_bandwidth(DefaultBandwidth)
+	, m_baseTime(0), m_position(0), m_time(0), m_period(0), m_lockedTime(0)
+	, m_driftPpm(0), m_resetCount(0)
+{
+	ZeroMemory(&m_estimate, sizeof(m_estimate));
+}
+
+void CSampleClock::reset(double nominalSampleRate, double bandwidth /*= DefaultBandwidth*/)
+{
+	m_nominalSampleRate = nominalSampleRate;
+	m_bandwidth = bandwidth;
+	m_period = 0;
+	ZeroMemory(&m_estimate, sizeof(m_estimate));
+	m_estimate.sampleRate = nominalSampleRate;
+	m_driftPpm = 0;
+	m_resetCount = 0;
+}
+
+/*
+	Filters the pair of the sample position and the system time by the loop.
+
+	Coefficients of the loop are computed from the count of samples since the last update,
+	so that buffers skipped by the driver don't disturb the loop.
+*/
+const CSampleClock::Estimate& CSampleClock::update(LONGLONG samplePosition, LONGLONG systemTime)
+{
+	const LONGLONG samples = samplePosition - m_position;
+	if (!m_period || (samples <= 0)) {
+		restart(samplePosition, systemTime);
+		return m_estimate;
+	}
+
+	const double predicted = m_time + samples * m_period;
+	const double error = (systemTime - m_baseTime) * 1e-9 - predicted;
+	if (MaxError < fabs(error)) {
+		LOG4CPLUS_WARN(logger, "Reset by error " << error * 1000 << " ms at position " << samplePosition);
+		restart(samplePosition, systemTime);
+		return m_estimate;
+	}
+
+	const bool isLocked = (m_lockedTime <= predicted);
+	const double omega = 2 * Pi * (isLocked ? m_bandwidth : LockBandwidth) * samples * m_period;
+	m_time = predicted + sqrt(2.0) * omega * error;
+	m_period += omega * omega * error / samples;
+	m_position = samplePosition;
+
+	m_estimate.position = samplePosition;
+	m_estimate.systemTime = m_baseTime + (LONGLONG)floor(m_time * 1e9 + 0.5);
+	m_estimate.sampleRate = 1 / m_period;
+	m_estimate.isLocked = isLocked;
+	m_driftPpm.store((m_estimate.sampleRate / m_nominalSampleRate - 1) * 1e6, std::memory_order_relaxed);
+	return m_estimate;
+}
+
+/*static*/ LONGLONG CSampleClock::getSystemTime(const Estimate& estimate, LONGLONG position)
+{
+	return estimate.systemTime + (LONGLONG)floor((position - estimate.position) * 1e9 / estimate.sampleRate + 0.5);
+}
+
+/*
+	Starts the loop from the pair.
+	Duration of a sample estimated before is kept because discontinuity doesn't change the clock of the device.
+*/
+void CSampleClock::restart(LONGLONG samplePosition, LONGLONG systemTime)
+{
+	if (m_period) m_resetCount.store(getResetCount() + 1, std::memory_order_relaxed);
+
+	m_baseTime = systemTime;
+	m_position = samplePosition;
+	m_time = 0;
+	if (!m_period) m_period = 1 / m_nominalSampleRate;
+	m_lockedTime = LockSeconds;
+
+	m_estimate.position = samplePosition;
+	m_estimate.systemTime = systemTime;
+	m_estimate.sampleRate = 1 / m_period;
+	m_estimate.isLocked = false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+
+/*
+	Delay-locked loop that filters pairs of sample position and system time reported by the driver.
+
+	Each buffer switch gives a sample position and the system time of it, which has jitter of the driver and the timer.
+	The loop predicts the time of the next pair from the filtered time and the estimated duration of one sample,
+	and corrects them by the error of the prediction with the second order loop filter.
+	So the filtered time is a smooth function of the sample position and the duration gives the true sample rate.
+
+	The loop locks quickly by LockBandwidth for LockSeconds after reset, and then filters jitter by the bandwidth.
+	Discontinuity of the position or the time resets the loop.
+*/
+class CSampleClock
+{
+	DISALLOW_COPY_AND_ASSIGN(CSampleClock);
+
+public:
+	// Result of the loop for a buffer.
+	struct Estimate {
+		LONGLONG position;		// Sample position of the buffer.
+		LONGLONG systemTime;	// Filtered system time of the position in nanoseconds.
+		double sampleRate;		// Estimated true sample rate in Hz measured by the system clock.
+		bool isLocked;			// False while the loop is locking after reset.
+	};
+
+	CSampleClock();
+
+	// Called while the driver is not running.
+	// bandwidth: Bandwidth of the loop in Hz after it has locked.
+	void reset(double nominalSampleRate, double bandwidth = DefaultBandwidth);
+
+	// Called by the driver thread for each buffer.
+	const Estimate& update(LONGLONG samplePosition, LONGLONG systemTime);
+	const Estimate& getEstimate() const { return m_estimate; }
+
+	// Returns filtered system time of the position in nanoseconds extrapolated from the estimate.
+	static LONGLONG getSystemTime(const Estimate& estimate, LONGLONG position);
+
+	// Called by any thread.
+	// Returns deviation of the estimated sample rate from the nominal sample rate in ppm.
+	double getDriftPpm() const { return m_driftPpm.load(std::memory_order_relaxed); }
+	long getResetCount() const { return m_resetCount.load(std::memory_order_relaxed); }
+
+	static LONGLONG toLongLong(const ASIOSamples& samples) { return ((LONGLONG)samples.hi << 32) | samples.lo; }
+	static LONGLONG toLongLong(const ASIOTimeStamp& timeStamp) { return ((LONGLONG)timeStamp.hi << 32) | timeStamp.lo; }
+
+	static const double DefaultBandwidth;
+	static const double LockBandwidth;
+	static const double LockSeconds;
+	// Error of prediction in seconds that resets the loop.
+	static const double MaxError;
+
+protected:
+	void restart(LONGLONG samplePosition, LONGLONG systemTime);
+
+	double m_nominalSampleRate;
+	double m_bandwidth;
+
+	LONGLONG m_baseTime;		// System time in nanoseconds where m_time is 0.
+	LONGLONG m_position;		// Sample position of the last update.
+	double m_time;				// Filtered time of m_position in seconds from m_baseTime.
+	double m_period;			// Estimated duration of one sample in seconds.
+	double m_lockedTime;		// Value of m_time when the loop is regarded as locked.
+
+	Estimate m_estimate;
+	std::atomic<double> m_driftPpm;
+	std::atomic<long> m_resetCount;
+};
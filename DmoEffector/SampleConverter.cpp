@@ -0,0 +1,458 @@
+#include "stdafx.h"
+#include "SampleConverter.h"
+
+#include <emmintrin.h>
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("SampleConverter"));
+
+// Coefficients of error feedback filter for each DitherShape.
+// Noise transfer function is 1 - (h0 z^-1 + h1 z^-2 + h2 z^-3).
+static const float shapingFilters[][3] = {
+	{ 0, 0, 0 },				// None
+	{ 0, 0, 0 },				// Tpdf
+	{ 1.0f, 0, 0 },				// FirstOrder
+	{ 1.623f, -0.982f, 0.109f },	// Weighted: F-weighted 3 tap filter by Wannamaker.
+};
+
+// Count of frames swapped at once for big endian types, within a buffer on the stack.
+static const long SwapBlockFrames = 256;
+
+static __m128 nextUniform(__m128i& state);
+static ASIOSampleType toLsbType(ASIOSampleType type);
+
+CSampleConverter::CSampleConverter()
+	: m_type(ASIOSTLastEntry), m_toFloat(float32ToFloat), m_fromFloat(floatToFloat32), m_fromFloatDithered(NULL)
+	, m_lsbToFloat(NULL), m_lsbFromFloat(NULL), m_lsbFromFloatDithered(NULL), m_sampleSize(sizeof(float))
+	, m_scale(1.0f), m_inverseScale(1.0f), m_maxValue(1.0f)
+{
+}
+
+/*
+	Selects conversion functions for the sample type.
+
+	Big endian type is converted by the functions of little endian type through swapBytes().
+	Returns S_FALSE if the type can't be converted. See canConvert().
+*/
+HRESULT CSampleConverter::initialize(ASIOSampleType type)
+{
+	if (!canConvert(type)) {
+		LOG4CPLUS_WARN(logger, "Sample type " << type << " can't be converted. Samples should be passed through without effects.");
+		m_type = type;
+		m_toFloat = silenceToFloat;
+		m_fromFloat = floatToNothing;
+		m_fromFloatDithered = NULL;
+		return S_FALSE;
+	}
+
+	const ASIOSampleType lsbType = toLsbType(type);
+	if (lsbType != type) {
+		HR_ASSERT_OK(initialize(lsbType));
+		m_lsbToFloat = m_toFloat;
+		m_lsbFromFloat = m_fromFloat;
+		m_lsbFromFloatDithered = m_fromFloatDithered;
+		m_toFloat = msbToFloat;
+		m_fromFloat = floatToMsb;
+		m_fromFloatDithered = m_lsbFromFloatDithered ? floatToMsbDithered : NULL;
+		m_type = type;
+		return S_OK;
+	}
+
+	int bits = 0;
+	m_fromFloatDithered = NULL;
+	m_sampleSize = 4;
+	switch (type) {
+	case ASIOSTInt16LSB:
+		m_toFloat = int16ToFloat;
+		m_fromFloat = floatToInt16;
+		m_fromFloatDithered = floatToInt16Dithered;
+		m_sampleSize = 2;
+		bits = 16;
+		break;
+	case ASIOSTInt24LSB:
+		m_toFloat = int24ToFloat;
+		m_fromFloat = floatToInt24;
+		m_fromFloatDithered = floatToInt24Dithered;
+		m_sampleSize = 3;
+		bits = 24;
+		break;
+	case ASIOSTInt32LSB:
+		bits = 32;
+		break;
+	case ASIOSTInt32LSB16:
+		bits = 16;
+		break;
+	case ASIOSTInt32LSB18:
+		bits = 18;
+		break;
+	case ASIOSTInt32LSB20:
+		bits = 20;
+		break;
+	case ASIOSTInt32LSB24:
+		bits = 24;
+		break;
+	case ASIOSTFloat32LSB:
+		m_toFloat = float32ToFloat;
+		m_fromFloat = floatToFloat32;
+		break;
+	case ASIOSTFloat64LSB:
+		m_toFloat = float64ToFloat;
+		m_fromFloat = floatToFloat64;
+		m_sampleSize = 8;
+		break;
+	default:
+		LOG4CPLUS_ERROR(logger, "Sample type " << type << " is not supported.");
+		return E_NOTIMPL;
+	}
+
+	switch (type) {
+	case ASIOSTInt32LSB:
+	case ASIOSTInt32LSB16:
+	case ASIOSTInt32LSB18:
+	case ASIOSTInt32LSB20:
+	case ASIOSTInt32LSB24:
+		// Samples are stored in 32 bit container aligned to LSB.
+		m_toFloat = int32ToFloat;
+		m_fromFloat = floatToInt32;
+		// Dither of 32 bit is smaller than precision of float.
+		if (type != ASIOSTInt32LSB) m_fromFloatDithered = floatToInt32Dithered;
+		break;
+	}
+
+	m_type = type;
+	if (bits) {
+		m_scale = (float)(1 << (bits - 1));
+		if (bits == 32) m_scale = 2147483648.0f;
+		m_inverseScale = 1.0f / m_scale;
+		// float has 24 bit mantissa. 2147483520 is the maximum float less than 2^31.
+		m_maxValue = (bits <= 24) ? (m_scale - 1.0f) : 2147483520.0f;
+	}
+	return S_OK;
+}
+
+/*static*/ bool CSampleConverter::canConvert(ASIOSampleType type)
+{
+	switch (type) {
+	case ASIOSTDSDInt8LSB1:
+	case ASIOSTDSDInt8MSB1:
+	case ASIOSTDSDInt8NER8:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/*
+	Returns little endian type of the same format as big endian type.
+	Other types are returned as is.
+*/
+static ASIOSampleType toLsbType(ASIOSampleType type)
+{
+	switch (type) {
+	case ASIOSTInt16MSB: return ASIOSTInt16LSB;
+	case ASIOSTInt24MSB: return ASIOSTInt24LSB;
+	case ASIOSTInt32MSB: return ASIOSTInt32LSB;
+	case ASIOSTFloat32MSB: return ASIOSTFloat32LSB;
+	case ASIOSTFloat64MSB: return ASIOSTFloat64LSB;
+	case ASIOSTInt32MSB16: return ASIOSTInt32LSB16;
+	case ASIOSTInt32MSB18: return ASIOSTInt32LSB18;
+	case ASIOSTInt32MSB20: return ASIOSTInt32LSB20;
+	case ASIOSTInt32MSB24: return ASIOSTInt32LSB24;
+	default: return type;
+	}
+}
+
+void CSampleConverter::int16ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter)
+{
+	const short* s = (const short*)src;
+	__m128 scale = _mm_set1_ps(converter.m_inverseScale);
+	long i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*)&s[i]);
+		// Sign extend 16 bit to 32 bit.
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		_mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(&dst[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	for (; i < frames; i++) dst[i] = s[i] * converter.m_inverseScale;
+}
+
+void CSampleConverter::floatToInt16(const float* src, void* dst, long frames, const CSampleConverter& converter)
+{
+	short* d = (short*)dst;
+	__m128 scale = _mm_set1_ps(converter.m_scale);
+	long i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		// _mm_packs_epi32() saturates to 16 bit.
+		__m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&src[i]), scale));
+		__m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale));
+		_mm_storeu_si128((__m128i*)&d[i], _mm_packs_epi32(lo, hi));
+	}
+	for (; i < frames; i++) {
+		float x = src[i] * converter.m_scale;
+		x = max(-converter.m_scale, min(converter.m_maxValue, x));
+		d[i] = (short)_mm_cvtss_si32(_mm_set_ss(x));
+	}
+}
+
+void CSampleConverter::int24ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter)
+{
+	const BYTE* s = (const BYTE*)src;
+	for (long i = 0; i < frames; i++, s += 3) {
+		// Shift to MSB of 32 bit and shift back to extend sign.
+		int x = (int)(((unsigned int)s[0] << 8) | ((unsigned int)s[1] << 16) | ((unsigned int)s[2] << 24)) >> 8;
+		dst[i] = x * converter.m_inverseScale;
+	}
+}
+
+void CSampleConverter::floatToInt24(const float* src, void* dst, long frames, const CSampleConverter& converter)
+{
+	BYTE* d = (BYTE*)dst;
+	for (long i = 0; i < frames; i++, d += 3) {
+		float x = src[i] * converter.m_scale;
+		x = max(-converter.m_scale, min(converter.m_maxValue, x));
+		int n = _mm_cvtss_si32(_mm_set_ss(x));
+		d[0] = (BYTE)n;
+		d[1] = (BYTE)(n >> 8);
+		d[2] = (BYTE)(n >> 16);
+	}
+}
+
+void CSampleConverter::int32ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter)
+{
+	const INT32* s = (const INT32*)src;
+	__m128 scale = _mm_set1_ps(converter.m_inverseScale);
+	long i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)&s[i]);
+		_mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+	}
+	for (; i < frames; i++) dst[i] = s[i] * converter.m_inverseScale;
+}
+
+void CSampleConverter::floatToInt32(const float* src, void* dst, long frames, const CSampleConverter& converter)
+{
+	INT32* d = (INT32*)dst;
+	__m128 scale = _mm_set1_ps(converter.m_scale);
+	__m128 minValue = _mm_set1_ps(-converter.m_scale);
+	__m128 maxValue = _mm_set1_ps(converter.m_maxValue);
+	long i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(&src[i]), scale);
+		x = _mm_max_ps(minValue, _mm_min_ps(maxValue, x));
+		_mm_storeu_si128((__m128i*)&d[i], _mm_cvtps_epi32(x));
+	}
+	for (; i < frames; i++) {
+		float x = src[i] * converter.m_scale;
+		x = max(-converter.m_scale, min(converter.m_maxValue, x));
+		d[i] = _mm_cvtss_si32(_mm_set_ss(x));
+	}
+}
+
+void CSampleConverter::float32ToFloat(const void* src, float* dst, long frames, const CSampleConverter& /*converter*/)
+{
+	CopyMemory(dst, src, sizeof(float) * frames);
+}
+
+void CSampleConverter::floatToFloat32(const float* src, void* dst, long frames, const CSampleConverter& /*converter*/)
+{
+	CopyMemory(dst, src, sizeof(float) * frames);
+}
+
+void CSampleConverter::float64ToFloat(const void* src, float* dst, long frames, const CSampleConverter& /*converter*/)
+{
+	const double* s = (const double*)src;
+	for (long i = 0; i < frames; i++) dst[i] = (float)s[i];
+}
+
+void CSampleConverter::floatToFloat64(const float* src, void* dst, long frames, const CSampleConverter& /*converter*/)
+{
+	double* d = (double*)dst;
+	for (long i = 0; i < frames; i++) d[i] = src[i];
+}
+
+void CSampleConverter::msbToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter)
+{
+	const BYTE* s = (const BYTE*)src;
+	BYTE block[SwapBlockFrames * sizeof(double)];
+	for (long i = 0; i < frames; i += SwapBlockFrames) {
+		long count = min(SwapBlockFrames, frames - i);
+		swapBytes(&s[i * converter.m_sampleSize], block, count, converter.m_sampleSize);
+		converter.m_lsbToFloat(block, &dst[i], count, converter);
+	}
+}
+
+void CSampleConverter::floatToMsb(const float* src, void* dst, long frames, const CSampleConverter& converter)
+{
+	BYTE* d = (BYTE*)dst;
+	BYTE block[SwapBlockFrames * sizeof(double)];
+	for (long i = 0; i < frames; i += SwapBlockFrames) {
+		long count = min(SwapBlockFrames, frames - i);
+		converter.m_lsbFromFloat(&src[i], block, count, converter);
+		swapBytes(block, &d[i * converter.m_sampleSize], count, converter.m_sampleSize);
+	}
+}
+
+void CSampleConverter::floatToMsbDithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither)
+{
+	BYTE* d = (BYTE*)dst;
+	BYTE block[SwapBlockFrames * sizeof(double)];
+	for (long i = 0; i < frames; i += SwapBlockFrames) {
+		long count = min(SwapBlockFrames, frames - i);
+		converter.m_lsbFromFloatDithered(&src[i], block, count, converter, dither);
+		swapBytes(block, &d[i * converter.m_sampleSize], count, converter.m_sampleSize);
+	}
+}
+
+/*
+	Reverses byte order of each sample.
+*/
+void CSampleConverter::swapBytes(const void* src, void* dst, long frames, long sampleSize)
+{
+	const BYTE* s = (const BYTE*)src;
+	BYTE* d = (BYTE*)dst;
+	for (long i = 0; i < frames; i++, s += sampleSize, d += sampleSize) {
+		for (long k = 0; k < sampleSize; k++) d[k] = s[sampleSize - 1 - k];
+	}
+}
+
+void CSampleConverter::silenceToFloat(const void* /*src*/, float* dst, long frames, const CSampleConverter& /*converter*/)
+{
+	ZeroMemory(dst, sizeof(float) * frames);
+}
+
+void CSampleConverter::floatToNothing(const float* /*src*/, void* /*dst*/, long /*frames*/, const CSampleConverter& /*converter*/)
+{
+}
+
+/*
+	Sets shape and seeds random number generator of 4 lanes.
+
+	Seed of each lane is mixed by the finalizer of MurmurHash3, so that close seeds make unrelated streams.
+*/
+void CSampleConverter::Dither::initialize(DitherShape shape, UINT32 seed)
+{
+	this->shape = shape;
+	for (int lane = 0; lane < 4; lane++) {
+		UINT32 x = seed * 4 + lane + 1;
+		x ^= x >> 16; x *= 0x85ebca6b;
+		x ^= x >> 13; x *= 0xc2b2ae35;
+		x ^= x >> 16;
+		// xorshift32 never leaves state 0.
+		random[lane] = x ? x : 0x9e3779b9;
+	}
+	ZeroMemory(error, sizeof(error));
+}
+
+void CSampleConverter::floatToInt16Dithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither)
+{
+	short* d = (short*)dst;
+	__m128 scale = _mm_set1_ps(converter.m_scale);
+	long i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		__m128i lo = quantize(_mm_mul_ps(_mm_loadu_ps(&src[i]), scale), 4, converter, dither);
+		__m128i hi = quantize(_mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale), 4, converter, dither);
+		_mm_storeu_si128((__m128i*)&d[i], _mm_packs_epi32(lo, hi));
+	}
+	for (; i < frames; i += 4) {
+		long count = min(4L, frames - i);
+		float x[4] = { 0 };
+		for (long k = 0; k < count; k++) x[k] = src[i + k];
+		int n[4];
+		_mm_storeu_si128((__m128i*)n, quantize(_mm_mul_ps(_mm_loadu_ps(x), scale), count, converter, dither));
+		for (long k = 0; k < count; k++) d[i + k] = (short)n[k];
+	}
+}
+
+void CSampleConverter::floatToInt24Dithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither)
+{
+	BYTE* d = (BYTE*)dst;
+	__m128 scale = _mm_set1_ps(converter.m_scale);
+	for (long i = 0; i < frames; i += 4) {
+		long count = min(4L, frames - i);
+		float x[4] = { 0 };
+		for (long k = 0; k < count; k++) x[k] = src[i + k];
+		int n[4];
+		_mm_storeu_si128((__m128i*)n, quantize(_mm_mul_ps(_mm_loadu_ps(x), scale), count, converter, dither));
+		for (long k = 0; k < count; k++, d += 3) {
+			d[0] = (BYTE)n[k];
+			d[1] = (BYTE)(n[k] >> 8);
+			d[2] = (BYTE)(n[k] >> 16);
+		}
+	}
+}
+
+void CSampleConverter::floatToInt32Dithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither)
+{
+	INT32* d = (INT32*)dst;
+	__m128 scale = _mm_set1_ps(converter.m_scale);
+	long i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		_mm_storeu_si128((__m128i*)&d[i], quantize(_mm_mul_ps(_mm_loadu_ps(&src[i]), scale), 4, converter, dither));
+	}
+	if (i < frames) {
+		long count = frames - i;
+		float x[4] = { 0 };
+		for (long k = 0; k < count; k++) x[k] = src[i + k];
+		int n[4];
+		_mm_storeu_si128((__m128i*)n, quantize(_mm_mul_ps(_mm_loadu_ps(x), scale), count, converter, dither));
+		for (long k = 0; k < count; k++) d[i + k] = n[k];
+	}
+}
+
+/*
+	Returns 4 samples of x (scaled to LSB) quantized with dither and saturated.
+
+	Random numbers of 4 lanes are generated at once. Sum of 2 uniform numbers makes TPDF.
+	Error feedback is done sample by sample because each error depends on the previous one,
+	and only first count samples update the errors.
+*/
+inline __m128i CSampleConverter::quantize(__m128 x, long count, const CSampleConverter& converter, Dither& dither)
+{
+	__m128i state = _mm_loadu_si128((const __m128i*)dither.random);
+	__m128 tpdf = _mm_add_ps(nextUniform(state), nextUniform(state));
+	_mm_storeu_si128((__m128i*)dither.random, state);
+
+	const __m128 minValue = _mm_set1_ps(-converter.m_scale);
+	const __m128 maxValue = _mm_set1_ps(converter.m_maxValue);
+	if (dither.shape == DitherShape::Tpdf) {
+		return _mm_cvtps_epi32(_mm_max_ps(minValue, _mm_min_ps(maxValue, _mm_add_ps(x, tpdf))));
+	}
+
+	const float* h = shapingFilters[dither.shape];
+	float values[4], noise[4];
+	_mm_storeu_ps(values, x);
+	_mm_storeu_ps(noise, tpdf);
+	float e0 = dither.error[0], e1 = dither.error[1], e2 = dither.error[2];
+	for (long k = 0; k < count; k++) {
+		// Older errors are subtracted first to shorten the dependency on the last error.
+		// Target is saturated before adding dither, so that error of saturated sample is as small as the dither.
+		// _mm_min_ss() returns the second operand if the first is NaN.
+		const float older = values[k] - (h[1] * e1 + h[2] * e2);
+		__m128 target = _mm_set_ss(older - h[0] * e0);
+		target = _mm_max_ss(_mm_min_ss(target, maxValue), minValue);
+		// Rounded in the register without moving to integer register.
+		__m128 rounded = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_add_ss(target, _mm_set_ss(noise[k]))));
+		e2 = e1;
+		e1 = e0;
+		e0 = _mm_cvtss_f32(_mm_sub_ss(rounded, target));
+		values[k] = _mm_cvtss_f32(rounded);
+	}
+	dither.error[0] = e0;
+	dither.error[1] = e1;
+	dither.error[2] = e2;
+	return _mm_cvtps_epi32(_mm_max_ps(minValue, _mm_min_ps(maxValue, _mm_loadu_ps(values))));
+}
+
+/*
+	Advances xorshift32 of 4 lanes and returns uniform random numbers in [-0.5, 0.5).
+*/
+static __m128 nextUniform(__m128i& state)
+{
+	state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+	state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+	state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+	// Upper 23 bits as mantissa make [1.0, 2.0).
+	__m128 x = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state, 9), _mm_set1_epi32(0x3f800000)));
+	return _mm_sub_ps(x, _mm_set1_ps(1.5f));
+}
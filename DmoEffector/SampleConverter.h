@@ -0,0 +1,104 @@
+#pragma once
+
+#include <emmintrin.h>
+
+/*
+	Converts samples between ASIO sample type and float.
+
+	Float sample has full scale of [-1.0, 1.0].
+	Integer output is rounded and saturated.
+
+	Integer output of 24 bits or less can be dithered by fromFloat() with Dither state of the channel.
+	Dither is added in the same pass as the conversion.
+
+	Big endian types are converted by swapping bytes block by block and converting as little endian.
+	DSD types can't be converted. See canConvert().
+*/
+class CSampleConverter
+{
+public:
+	CSampleConverter();
+
+	HRESULT initialize(ASIOSampleType type);
+
+	// Returns false if samples of the type have no float representation, such as DSD.
+	// Such samples should be passed through without effects. toFloat() returns silence and fromFloat() writes nothing.
+	static bool canConvert(ASIOSampleType type);
+
+	// Shape of the spectrum of dither and quantization noise.
+	ENUM(DitherShape,
+		None,			// Rounded without dither.
+		Tpdf,			// Triangular PDF dither of 2 LSB peak to peak. Flat spectrum.
+		FirstOrder,		// TPDF dither with 1st order error feedback. Noise rises 6 dB/oct.
+		Weighted		// TPDF dither with 3 tap error feedback weighted by hearing. Designed for 44.1/48 kHz.
+	);
+
+	/*
+		Dither state of one channel.
+
+		Each channel should have its own state initialized by different seed,
+		so that dither of channels is not correlated.
+	*/
+	struct Dither {
+		Dither() { initialize(DitherShape::None, 0); }
+		void initialize(DitherShape shape, UINT32 seed);
+
+		DitherShape shape;
+		UINT32 random[4];		// State of xorshift32 of 4 lanes.
+		float error[3];			// Quantization errors of the last samples in LSB, newest first.
+	};
+
+	void toFloat(const void* src, float* dst, long frames) const { m_toFloat(src, dst, frames, *this); }
+	void fromFloat(const float* src, void* dst, long frames) const { m_fromFloat(src, dst, frames, *this); }
+	// Samples are rounded without dither if the type is float or integer of more than 24 bits.
+	void fromFloat(const float* src, void* dst, long frames, Dither& dither) const {
+		if (m_fromFloatDithered && (dither.shape != DitherShape::None)) m_fromFloatDithered(src, dst, frames, *this, dither);
+		else m_fromFloat(src, dst, frames, *this);
+	}
+
+	ASIOSampleType getType() const { return m_type; }
+
+protected:
+	typedef void(*ToFloat)(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	typedef void(*FromFloat)(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	typedef void(*FromFloatDithered)(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither);
+
+	static void int16ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToInt16(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void int24ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToInt24(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void int32ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToInt32(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void float32ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToFloat32(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void float64ToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToFloat64(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void msbToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToMsb(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void floatToMsbDithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither);
+	static void swapBytes(const void* src, void* dst, long frames, long sampleSize);
+	static void silenceToFloat(const void* src, float* dst, long frames, const CSampleConverter& converter);
+	static void floatToNothing(const float* src, void* dst, long frames, const CSampleConverter& converter);
+	static void floatToInt16Dithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither);
+	static void floatToInt24Dithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither);
+	static void floatToInt32Dithered(const float* src, void* dst, long frames, const CSampleConverter& converter, Dither& dither);
+	static __m128i quantize(__m128 x, long count, const CSampleConverter& converter, Dither& dither);
+
+	ASIOSampleType m_type;
+	ToFloat m_toFloat;
+	FromFloat m_fromFloat;
+	FromFloatDithered m_fromFloatDithered;		// NULL if the type is not dithered.
+
+	// Functions of little endian type called after or before swapping bytes of big endian type.
+	ToFloat m_lsbToFloat;
+	FromFloat m_lsbFromFloat;
+	FromFloatDithered m_lsbFromFloatDithered;
+	long m_sampleSize;
+
+	// Full scale value of integer sample and its inverse.
+	float m_scale;
+	float m_inverseScale;
+
+	// Maximum value of integer sample that is exactly represented by float.
+	float m_maxValue;
+};
@@ -0,0 +1,108 @@
+#include "stdafx.h"
+#include "SharedTap.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("SharedTap"));
+
+/*static*/ const double CSharedTap::RingSeconds = 0.5;
+
+CSharedTap::CSharedTap()
+	: m_inputMask(0), m_outputMask(0), m_writeInputMask(0), m_writeOutputMask(0), m_bufferBytes(0), m_sequence(0), m_position(0)
+{
+}
+
+CSharedTap::~CSharedTap()
+{
+	close();
+}
+
+void CSharedTap::configure(LPCTSTR name, DWORD inputMask, DWORD outputMask)
+{
+	m_name = name ? name : _T("");
+	m_inputMask = inputMask;
+	m_outputMask = outputMask;
+}
+
+/*
+	Creates or opens the shared memory and formats it.
+
+	If readers keep the shared memory of the previous session open, the memory is reused.
+	Readers detect the change of format by SharedTapHeader::generation.
+*/
+HRESULT CSharedTap::open(long numChannels, long bufferSize, ASIOSampleType sampleType, long sampleSize, double sampleRate)
+{
+	close();
+	if (m_name.empty()) return S_FALSE;
+
+	const DWORD validMask = (numChannels < 32) ? ((1UL << numChannels) - 1) : ~0UL;
+	const DWORD inputMask = m_inputMask & validMask;
+	const DWORD outputMask = m_outputMask & validMask;
+	long channels = 0;
+	for (DWORD mask = inputMask; mask; mask &= mask - 1) channels++;
+	for (DWORD mask = outputMask; mask; mask &= mask - 1) channels++;
+	HR_ASSERT(0 < channels, E_INVALIDARG);
+
+	uint32_t blockCount = 8;
+	while (blockCount * bufferSize < sampleRate * RingSeconds) blockCount <<= 1;
+	const size_t size = getSharedTapSize(channels, bufferSize, sampleSize, blockCount);
+
+	m_mapping.Attach(CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((ULONGLONG)size >> 32), (DWORD)size, m_name.c_str()));
+	WIN32_ASSERT(NULL != (HANDLE)m_mapping);
+	// If the existing mapping is smaller than size, MapViewOfFile() fails.
+	void* memory = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!memory) {
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		LOG4CPLUS_ERROR(logger, "Shared memory '" << m_name.c_str() << "' of " << size << " bytes can not be mapped. Close readers of the previous session.");
+		m_mapping.Close();
+		return hr;
+	}
+	// Memory mapped is locked so that writing by the work queue thread doesn't cause page fault.
+	// Failure is not fatal because only the work queue thread could be delayed.
+	WIN32_EXPECT(VirtualLock(memory, size));
+
+	m_ring = CSharedTapRing(memory);
+	m_ring.format(inputMask, outputMask, channels, bufferSize, sampleType, sampleSize, sampleRate, blockCount);
+	m_writeInputMask = inputMask;
+	m_writeOutputMask = outputMask;
+	m_bufferBytes = (size_t)bufferSize * sampleSize;
+	m_sequence = 0;
+	m_position = 0;
+
+	LOG4CPLUS_INFO(logger, "Shared memory '" << m_name.c_str() << "': " << channels << " channel(s), " << blockCount << " blocks, " << size << " bytes");
+	return S_OK;
+}
+
+void CSharedTap::close()
+{
+	if (isOpen()) {
+		WIN32_EXPECT(UnmapViewOfFile(m_ring.getHeader()));
+		m_ring = CSharedTapRing();
+		m_mapping.Close();
+	}
+}
+
+/*
+	Copies buffers of selected channels to the next block of the ring.
+
+	Called by the work queue thread after the effect chain has processed the buffers.
+*/
+void CSharedTap::write(const void* const* inputs, const void* const* outputs)
+{
+	if (!isOpen()) return;
+
+	BYTE* data = m_ring.beginWrite(m_sequence);
+	for (DWORD mask = m_writeInputMask, channel = 0; mask; mask >>= 1, channel++) {
+		if (mask & 1) {
+			memcpy(data, inputs[channel], m_bufferBytes);
+			data += m_bufferBytes;
+		}
+	}
+	for (DWORD mask = m_writeOutputMask, channel = 0; mask; mask >>= 1, channel++) {
+		if (mask & 1) {
+			memcpy(data, outputs[channel], m_bufferBytes);
+			data += m_bufferBytes;
+		}
+	}
+	m_ring.endWrite(m_sequence, m_position);
+	m_sequence++;
+	m_position += m_ring.getHeader()->blockFrames;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "SharedTapRing.h"
+
+/*
+	Publishes buffers of selected input and output channels to named shared memory.
+
+	External processes such as loudness logger can read live streams without opening the ASIO driver.
+	See SharedTapRing.h for layout of the shared memory and the protocol for readers.
+	The writer never waits for readers. Readers that fall behind detect overrun by themselves.
+*/
+class CSharedTap
+{
+	DISALLOW_COPY_AND_ASSIGN(CSharedTap);
+
+public:
+	CSharedTap();
+	~CSharedTap();
+
+	// Called by the UI thread before CAsioHandler::setup().
+	// Empty name disables the tap. Bit n of the masks is channel n.
+	void configure(LPCTSTR name, DWORD inputMask, DWORD outputMask);
+
+	// Called by the work queue thread while the real-time processing is not running.
+	// Creates the shared memory if the tap has been configured.
+	HRESULT open(long numChannels, long bufferSize, ASIOSampleType sampleType, long sampleSize, double sampleRate);
+	void close();
+	bool isOpen() const { return m_ring.getHeader() != NULL; }
+
+	// Called by the work queue thread for each buffer.
+	void write(const void* const* inputs, const void* const* outputs);
+
+	// Minimum length of the ring in seconds.
+	static const double RingSeconds;
+
+protected:
+	tstring m_name;
+	DWORD m_inputMask;
+	DWORD m_outputMask;
+
+	CHandle m_mapping;
+	CSharedTapRing m_ring;
+	DWORD m_writeInputMask;			// Channels written. Channels not in use are removed from the masks configured.
+	DWORD m_writeOutputMask;
+	size_t m_bufferBytes;
+	uint64_t m_sequence;			// Sequence number of the next block.
+	uint64_t m_position;			// Sample position of the next block.
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+/*
+	Layout and protocol of the ring of audio blocks shared between the engine and external reader processes.
+
+	This file doesn't depend on stdafx.h so that it can be included by reader processes on any platform.
+
+	Shared memory consists of SharedTapHeader followed by blockCount blocks of blockSize bytes.
+	Each block consists of SharedTapBlockHeader followed by buffers of published channels in ASIO sample format.
+	Buffers of selected input channels come first, and then buffers of selected output channels, in order of channel number.
+
+	Writer never waits for readers. Block n (0, 1, 2, ...) is written to the slot n % blockCount.
+	Readers read blocks in place and check that the block has not been overwritten after reading it, like seqlock.
+	If a reader falls behind by more than blockCount blocks, it detects overrun and skips to the latest blocks.
+*/
+
+static const uint32_t SharedTapMagic = 0x50415444;	// 'DTAP'
+static const uint32_t SharedTapVersion = 1;
+
+struct SharedTapHeader {
+	uint32_t magic;
+	uint32_t version;
+	// Incremented twice by the writer each time format is changed. Odd while format is being changed.
+	std::atomic<uint32_t> generation;
+	uint32_t headerSize;			// Offset of the first block.
+
+	uint32_t inputMask;				// Input channels published. Bit n is channel n.
+	uint32_t outputMask;			// Output channels published.
+	uint32_t numChannels;			// Count of buffers in each block.
+	uint32_t blockFrames;			// Count of samples of each buffer. Same as ASIO buffer size.
+	uint32_t sampleType;			// ASIOSampleType.
+	uint32_t sampleSize;			// Size of one sample in bytes.
+	double sampleRate;
+	uint32_t blockCount;			// Power of 2.
+	uint32_t blockSize;				// Size of each block in bytes including SharedTapBlockHeader.
+
+	// Count of blocks published.
+	alignas(64) std::atomic<uint64_t> writeSequence;
+};
+
+struct SharedTapBlockHeader {
+	// Sequence number of the block. SharedTapWriting while the block is being written.
+	std::atomic<uint64_t> sequence;
+	uint64_t position;				// Sample position of the first sample of the block.
+};
+
+static const uint64_t SharedTapWriting = ~(uint64_t)0;
+static const uint32_t SharedTapHeaderSize = (sizeof(SharedTapHeader) + 63) & ~63;
+static const uint32_t SharedTapBlockHeaderSize = 64;
+
+// Returns size of shared memory in bytes.
+inline size_t getSharedTapSize(uint32_t numChannels, uint32_t blockFrames, uint32_t sampleSize, uint32_t blockCount)
+{
+	size_t blockSize = (SharedTapBlockHeaderSize + (size_t)numChannels * blockFrames * sampleSize + 63) & ~(size_t)63;
+	return SharedTapHeaderSize + blockSize * blockCount;
+}
+
+/*
+	View of the shared memory mapped by the writer or readers.
+*/
+class CSharedTapRing
+{
+public:
+	CSharedTapRing(void* memory = NULL) : m_header((SharedTapHeader*)memory) {}
+
+	SharedTapHeader* getHeader() const { return m_header; }
+
+	// Called by the writer.
+	// Initializes header and all blocks. Readers that attached before reattach by the change of generation.
+	void format(uint32_t inputMask, uint32_t outputMask, uint32_t numChannels, uint32_t blockFrames,
+				uint32_t sampleType, uint32_t sampleSize, double sampleRate, uint32_t blockCount)
+	{
+		SharedTapHeader* h = m_header;
+		const uint32_t generation = (h->magic == SharedTapMagic) ? h->generation.load(std::memory_order_relaxed) : 0;
+		h->generation.store(generation | 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		h->magic = SharedTapMagic;
+		h->version = SharedTapVersion;
+		h->headerSize = SharedTapHeaderSize;
+		h->inputMask = inputMask;
+		h->outputMask = outputMask;
+		h->numChannels = numChannels;
+		h->blockFrames = blockFrames;
+		h->sampleType = sampleType;
+		h->sampleSize = sampleSize;
+		h->sampleRate = sampleRate;
+		h->blockCount = blockCount;
+		h->blockSize = (uint32_t)((getSharedTapSize(numChannels, blockFrames, sampleSize, blockCount) - SharedTapHeaderSize) / blockCount);
+		for (uint32_t i = 0; i < blockCount; i++) {
+			getBlockHeader(i)->sequence.store(SharedTapWriting, std::memory_order_relaxed);
+		}
+		h->writeSequence.store(0, std::memory_order_relaxed);
+
+		h->generation.store((generation | 1) + 1, std::memory_order_release);
+	}
+
+	// Called by the writer.
+	// Returns pointer to buffers of block n. Buffers should be written and then endWrite() should be called.
+	uint8_t* beginWrite(uint64_t n)
+	{
+		SharedTapBlockHeader* block = getBlockHeader(n);
+		block->sequence.store(SharedTapWriting, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return (uint8_t*)block + SharedTapBlockHeaderSize;
+	}
+
+	void endWrite(uint64_t n, uint64_t position)
+	{
+		SharedTapBlockHeader* block = getBlockHeader(n);
+		block->position = position;
+		block->sequence.store(n, std::memory_order_release);
+		m_header->writeSequence.store(n + 1, std::memory_order_release);
+	}
+
+	// Called by readers.
+	// Returns true if the memory has been formatted by the writer and is not being formatted.
+	bool isFormatted(uint32_t* generation) const
+	{
+		*generation = m_header->generation.load(std::memory_order_acquire);
+		return (m_header->magic == SharedTapMagic) && (m_header->version == SharedTapVersion) && *generation && !(*generation & 1);
+	}
+
+	uint64_t getWriteSequence() const { return m_header->writeSequence.load(std::memory_order_acquire); }
+
+	// Called by readers.
+	// Returns pointer to buffers of block n, or NULL if block n has not been written or has been overwritten.
+	// Content of the block should be used only if isValid(n) returns true after reading it.
+	const uint8_t* beginRead(uint64_t n, uint64_t* position) const
+	{
+		const SharedTapBlockHeader* block = getBlockHeader(n);
+		if (block->sequence.load(std::memory_order_acquire) != n) return NULL;
+		*position = block->position;
+		return (const uint8_t*)block + SharedTapBlockHeaderSize;
+	}
+
+	bool isValid(uint64_t n) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return getBlockHeader(n)->sequence.load(std::memory_order_relaxed) == n;
+	}
+
+protected:
+	SharedTapBlockHeader* getBlockHeader(uint64_t n) const
+	{
+		size_t slot = (size_t)(n & (m_header->blockCount - 1));
+		return (SharedTapBlockHeader*)((uint8_t*)m_header + SharedTapHeaderSize + slot * m_header->blockSize);
+	}
+
+	SharedTapHeader* m_header;
+};
@@ -0,0 +1,278 @@
+#include "stdafx.h"
+#include "SpectrumAnalyzer.h"
+#include "VectorOps.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("SpectrumAnalyzer"));
+
+static const double Pi = 3.14159265358979323846;
+
+CSpectrumAnalyzer::CSpectrumAnalyzer()
+	: m_numChannels(0), m_bufferSize(0), m_sampleSize(0), m_bufferBytes(0), m_sampleRate(0), m_hopSize(0)
+	, m_channelMask(0), m_tapPosition(0), m_droppedBuffers(0)
+	, m_powerScale(0), m_historyMask(0), m_historyChannels(0)
+	, m_written(0), m_nextHopEnd(0), m_nextPosition(0), m_skippedHops(0)
+{
+}
+
+CSpectrumAnalyzer::~CSpectrumAnalyzer()
+{
+	stop();
+}
+
+/*
+	sampleSize: Size of one sample of sampleType in bytes.
+*/
+HRESULT CSpectrumAnalyzer::initialize(long numChannels, long bufferSize, ASIOSampleType sampleType, long sampleSize, double sampleRate, const Config& config /*= Config()*/)
+{
+	HR_ASSERT(!m_thread, E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT((0 < config.overlap) && (config.overlap <= config.fftSize), E_INVALIDARG);
+	HR_ASSERT((0 < config.bands) && (config.bands <= MaxBands), E_INVALIDARG);
+	HR_ASSERT((0 < config.minFrequency) && (config.minFrequency < sampleRate / 2), E_INVALIDARG);
+
+	m_config = config;
+	m_numChannels = min(numChannels, (long)MaxChannels);
+	m_bufferSize = bufferSize;
+	m_sampleRate = sampleRate;
+	m_hopSize = config.fftSize / config.overlap;
+	HR_ASSERT_OK(m_converter.initialize(sampleType));
+	m_sampleSize = sampleSize;
+	m_bufferBytes = bufferSize * sampleSize;
+
+	// Tap ring holds buffers of about 100 milliseconds that is much longer than PollInterval.
+	long numBlocks = max(4L, (long)ceil(sampleRate * 0.1 / bufferSize));
+	HR_ASSERT_OK(m_tap.initialize(TapHeaderSize + m_bufferBytes * m_numChannels, numBlocks));
+	m_tapPosition = 0;
+	m_droppedBuffers = 0;
+
+	const long size = config.fftSize;
+	HR_ASSERT_OK(m_fft.initialize(size));
+	const long stride = (m_fft.getBinCount() + 3) & ~3;
+	HR_ASSERT_OK(m_window.allocate(size));
+	for (long i = 0; i < size; i++) {
+		m_window[i] = (float)(0.5 * (1 - cos(2 * Pi * i / size)));
+	}
+	HR_ASSERT_OK(m_time.allocate(size));
+	HR_ASSERT_OK(m_re.allocate(stride));
+	HR_ASSERT_OK(m_im.allocate(stride));
+	HR_ASSERT_OK(m_bandPower.allocate((config.bands + 3) & ~3));
+	// Magnitude of full scale sine is size / 4 by Hann window and power summed over the main lobe is 1.5 times the peak.
+	m_powerScale = 16.0f / (1.5f * size * size);
+
+	// Edges of bands are rounded to FFT bins. Each band has at least one bin.
+	m_bandEdges.resize(config.bands + 1);
+	const long bins = m_fft.getBinCount();
+	for (long band = 0; band <= config.bands; band++) {
+		double frequency = config.minFrequency * pow(sampleRate / 2 / config.minFrequency, (double)band / config.bands);
+		long bin = (long)floor(frequency * size / sampleRate + 0.5);
+		if (band) bin = max(bin, m_bandEdges[band - 1] + 1);
+		m_bandEdges[band] = min(bin, bins);
+	}
+
+	long historySize = 1;
+	while (historySize < size + numBlocks * bufferSize) historySize <<= 1;
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		HR_ASSERT_OK(m_history[channel].allocate(historySize));
+	}
+	// History of channels no longer analyzed would hold blocks of the arena.
+	for (long channel = m_numChannels; channel < MaxChannels; channel++) {
+		m_history[channel].free();
+	}
+	m_historyMask = historySize - 1;
+	m_historyChannels = 0;
+	m_written = 0;
+	m_nextHopEnd = size;
+	m_nextPosition = 0;
+	m_skippedHops = 0;
+
+	LOG4CPLUS_INFO(logger, "FFT size=" << size << ", Hop size=" << m_hopSize << ", Bands=" << config.bands << ", Tap ring=" << numBlocks << " buffers");
+	return S_OK;
+}
+
+HRESULT CSpectrumAnalyzer::start()
+{
+	HR_ASSERT(!m_thread, E_ILLEGAL_METHOD_CALL);
+
+	// Buffers tapped before stop() are discarded. The real-time thread is not running yet.
+	m_tap.reset();
+	m_stopEvent.Attach(CreateEvent(NULL, TRUE, FALSE, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_stopEvent);
+	m_thread.Attach(CreateThread(NULL, 0, threadProc, this, 0, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_thread);
+	WIN32_EXPECT(SetThreadPriority(m_thread, THREAD_PRIORITY_BELOW_NORMAL));
+	return S_OK;
+}
+
+void CSpectrumAnalyzer::stop()
+{
+	if (m_thread) {
+		SetEvent(m_stopEvent);
+		WIN32_EXPECT(WAIT_OBJECT_0 == WaitForSingleObject(m_thread, INFINITE));
+		m_thread.Close();
+		m_stopEvent.Close();
+		LOG4CPLUS_INFO(logger, "Stopped: Dropped buffers=" << getDroppedBuffers() << ", Skipped hops=" << getSkippedHops());
+	}
+}
+
+void CSpectrumAnalyzer::setChannels(DWORD channelMask)
+{
+	m_channelMask.store(channelMask);
+}
+
+double CSpectrumAnalyzer::getBandFrequency(long band) const
+{
+	return m_config.minFrequency * pow(m_sampleRate / 2 / m_config.minFrequency, (band + 0.5) / m_config.bands);
+}
+
+/*
+	Copies buffers of selected channels to the tap ring.
+
+	Only memcpy() is done here. If the ring is full, the buffers are dropped.
+*/
+void CSpectrumAnalyzer::tap(void* const* buffers)
+{
+	const LONGLONG position = m_tapPosition;
+	m_tapPosition += m_bufferSize;
+
+	const DWORD channelMask = m_channelMask.load(std::memory_order_relaxed) & ((1 << m_numChannels) - 1);
+	if (!channelMask) return;
+
+	BYTE* block = m_tap.getWritableBlock();
+	if (!block) {
+		m_droppedBuffers.store(m_droppedBuffers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	}
+	TapHeader* header = (TapHeader*)block;
+	header->channelMask = channelMask;
+	header->position = position;
+	BYTE* data = &block[TapHeaderSize];
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		if (channelMask & (1 << channel)) {
+			memcpy(data, buffers[channel], m_bufferBytes);
+			data += m_bufferBytes;
+		}
+	}
+	m_tap.push();
+}
+
+/*static*/ DWORD WINAPI CSpectrumAnalyzer::threadProc(LPVOID param)
+{
+	((CSpectrumAnalyzer*)param)->run();
+	return 0;
+}
+
+void CSpectrumAnalyzer::run()
+{
+	while (WaitForSingleObject(m_stopEvent, PollInterval) == WAIT_TIMEOUT) {
+		analyze();
+	}
+}
+
+/*
+	Analyzes hops read from the tap ring and publishes the frame.
+
+	If more hops than overlap are waiting, older hops are skipped.
+	So the analyzer processes at most one FFT size of samples in each poll.
+*/
+void CSpectrumAnalyzer::analyze()
+{
+	readTap();
+	if (m_written < m_nextHopEnd) return;
+
+	long hops = (long)((m_written - m_nextHopEnd) / m_hopSize) + 1;
+	if (m_config.overlap < hops) {
+		long skipped = hops - m_config.overlap;
+		m_nextHopEnd += (LONGLONG)skipped * m_hopSize;
+		m_skippedHops.store(getSkippedHops() + skipped, std::memory_order_relaxed);
+	}
+
+	Frame& frame = m_frames.getWriteBuffer();
+	for (bool isFirst = true; m_nextHopEnd <= m_written; isFirst = false) {
+		analyzeHop(m_nextHopEnd, frame, isFirst);
+		m_nextHopEnd += m_hopSize;
+	}
+	frame.channelMask = m_historyChannels;
+	frame.position = m_nextPosition - (m_written - (m_nextHopEnd - m_hopSize));
+	m_frames.publish();
+}
+
+/*
+	Reads all blocks in the tap ring and writes samples to the history.
+
+	If blocks were dropped or selected channels were changed, the history restarts.
+*/
+void CSpectrumAnalyzer::readTap()
+{
+	const BYTE* block;
+	while ((block = m_tap.getReadableBlock()) != NULL) {
+		const TapHeader* header = (const TapHeader*)block;
+		if ((header->position != m_nextPosition) || (header->channelMask != m_historyChannels)) {
+			m_historyChannels = header->channelMask;
+			m_written = 0;
+			m_nextHopEnd = m_config.fftSize;
+		}
+
+		const long offset = (long)(m_written & m_historyMask);
+		const long first = min(m_bufferSize, m_historyMask + 1 - offset);
+		const BYTE* data = &block[TapHeaderSize];
+		for (long channel = 0; channel < m_numChannels; channel++) {
+			if (m_historyChannels & (1 << channel)) {
+				m_converter.toFloat(data, &m_history[channel][offset], first);
+				if (first < m_bufferSize) {
+					m_converter.toFloat(&data[m_sampleSize * first], m_history[channel], m_bufferSize - first);
+				}
+				data += m_bufferBytes;
+			}
+		}
+		m_written += m_bufferSize;
+		m_nextPosition = header->position + m_bufferSize;
+		m_tap.pop();
+	}
+}
+
+/*
+	Computes levels of bands of the hop that ends at end of the history.
+	Levels of the frame are set if isFirst is true. Otherwise maximum levels are held.
+*/
+void CSpectrumAnalyzer::analyzeHop(LONGLONG end, Frame& frame, bool isFirst)
+{
+	const long size = m_config.fftSize;
+	const long bands = m_config.bands;
+	const long start = (long)((end - size) & m_historyMask);
+	const long first = min(size, m_historyMask + 1 - start);
+
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		if (!(m_historyChannels & (1 << channel))) continue;
+
+		vecCopy(m_time, &m_history[channel][start], first);
+		vecCopy(&m_time[first], m_history[channel], size - first);
+		vecMultiply(m_time, m_window, size);
+		m_fft.forwardReal(m_time, m_re, m_im);
+
+		// Power of each bin is computed in place of the real part.
+		const long stride = (m_fft.getBinCount() + 3) & ~3;
+		const __m128 scale = _mm_set1_ps(m_powerScale);
+		for (long k = 0; k < stride; k += 4) {
+			__m128 re = _mm_load_ps(&m_re[k]);
+			__m128 im = _mm_load_ps(&m_im[k]);
+			_mm_store_ps(&m_re[k], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)), scale));
+		}
+		for (long band = 0; band < bands; band++) {
+			float sum = 0;
+			for (long k = m_bandEdges[band]; k < m_bandEdges[band + 1]; k++) sum += m_re[k];
+			m_bandPower[band] = sum;
+		}
+
+		// Level in dB = 10 * log10(power) = 10 * log10(2) * log2(power)
+		float* levels = frame.levels[channel];
+		const __m128 tenLog10Of2 = _mm_set1_ps(3.0103000f);
+		const __m128 minPower = _mm_set1_ps(1e-20f);
+		for (long band = 0; band < bands; band += 4) {
+			__m128 level = _mm_mul_ps(log2Ps(_mm_max_ps(_mm_load_ps(&m_bandPower[band]), minPower)), tenLog10Of2);
+			float values[4];
+			_mm_storeu_ps(values, level);
+			for (long i = 0; (i < 4) && (band + i < bands); i++) {
+				levels[band + i] = isFirst ? values[i] : max(levels[band + i], values[i]);
+			}
+		}
+	}
+}
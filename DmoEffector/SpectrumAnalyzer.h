@@ -0,0 +1,123 @@
+#pragma once
+
+#include "BlockFifo.h"
+#include "TripleBuffer.h"
+#include "SampleConverter.h"
+#include "Fft.h"
+
+/*
+	Spectrum analyzer that runs on its own thread fed by the tap of the real-time thread.
+
+	tap() called by the real-time thread only copies buffers of selected channels to the tap ring.
+	If the ring is full, the buffers are dropped. So the real-time thread never waits for the analyzer.
+
+	The analyzer thread polls the ring and computes Hann windowed FFT of each selected channel
+	for each hop of fftSize / overlap samples. Power of FFT bins is summed into bands of logarithmic frequency,
+	and maximum level of the hops analyzed in one poll is published by triple buffer.
+	When the analyzer falls behind, older hops are skipped so that frame rate of the analyzer is lowered.
+*/
+class CSpectrumAnalyzer
+{
+	DISALLOW_COPY_AND_ASSIGN(CSpectrumAnalyzer);
+
+public:
+	static const long MaxChannels = 8;
+	static const long MaxBands = 128;
+
+	struct Config {
+		Config() : fftSize(2048), overlap(4), bands(64), minFrequency(20) {}
+
+		long fftSize;			// Power of 2.
+		long overlap;			// Count of FFT frames overlapped. Hop size is fftSize / overlap.
+		long bands;				// Count of bands of logarithmic frequency. (<= MaxBands)
+		double minFrequency;	// Lower edge of the lowest band. Upper edge of the highest band is the Nyquist frequency.
+	};
+
+	struct Frame {
+		DWORD channelMask;		// Channels analyzed. Bit n is channel n.
+		LONGLONG position;		// Sample position of the end of the last hop analyzed.
+		float levels[MaxChannels][MaxBands];	// Power of each band in dBFS. Full scale sine is 0 dB.
+	};
+
+	CSpectrumAnalyzer();
+	~CSpectrumAnalyzer();
+
+	// Called by the control thread while the real-time thread is not running.
+	HRESULT initialize(long numChannels, long bufferSize, ASIOSampleType sampleType, long sampleSize, double sampleRate, const Config& config = Config());
+	HRESULT start();
+	void stop();
+
+	// Selects channels to be analyzed. Bit n is channel n. 0 stops copying buffers.
+	// Called by any thread. Selection is kept by initialize() and bits of channels not in use are ignored.
+	void setChannels(DWORD channelMask);
+
+	// Called by the real-time thread.
+	void tap(void* const* buffers);
+
+	// Called by the UI thread. Returns true if new frame is available by getFrame().
+	bool update() { return m_frames.update(); }
+	const Frame& getFrame() const { return m_frames.getReadBuffer(); }
+
+	long getBandCount() const { return m_config.bands; }
+	// Returns center frequency of the band in Hz.
+	double getBandFrequency(long band) const;
+
+	long getDroppedBuffers() const { return m_droppedBuffers.load(std::memory_order_relaxed); }
+	long getSkippedHops() const { return m_skippedHops.load(std::memory_order_relaxed); }
+
+	// Interval of polling the tap ring in milliseconds.
+	static const DWORD PollInterval = 10;
+
+protected:
+	// Header of each block of the tap ring followed by buffers of selected channels.
+	struct TapHeader {
+		DWORD channelMask;
+		LONGLONG position;
+	};
+	static const size_t TapHeaderSize = 16;
+
+	static DWORD WINAPI threadProc(LPVOID param);
+	void run();
+	void analyze();
+	void readTap();
+	void analyzeHop(LONGLONG end, Frame& frame, bool isFirst);
+
+	Config m_config;
+	long m_numChannels;
+	long m_bufferSize;
+	long m_sampleSize;
+	size_t m_bufferBytes;
+	double m_sampleRate;
+	long m_hopSize;
+
+	// Members used by the real-time thread.
+	CBlockFifo m_tap;
+	std::atomic<DWORD> m_channelMask;
+	LONGLONG m_tapPosition;
+	std::atomic<long> m_droppedBuffers;
+
+	// Members used by the analyzer thread.
+	CSampleConverter m_converter;
+	CFft m_fft;
+	CAlignedBuffer<float> m_window;
+	CAlignedBuffer<float> m_time;
+	CAlignedBuffer<float> m_re;
+	CAlignedBuffer<float> m_im;
+	CAlignedBuffer<float> m_bandPower;
+	std::vector<long> m_bandEdges;		// FFT bin of lower edge of each band and upper edge of the highest band.
+	float m_powerScale;					// Normalizes power so that full scale sine is 1.0.
+
+	// History of samples of each channel in ring buffer of power of 2 size.
+	CAlignedBuffer<float> m_history[MaxChannels];
+	long m_historyMask;
+	DWORD m_historyChannels;
+	LONGLONG m_written;					// Count of samples written to the history.
+	LONGLONG m_nextHopEnd;				// Value of m_written at the end of the next hop to be analyzed.
+	LONGLONG m_nextPosition;			// Position of the next block expected in the tap ring.
+	std::atomic<long> m_skippedHops;
+
+	CTripleBuffer<Frame> m_frames;
+
+	CHandle m_thread;
+	CHandle m_stopEvent;
+};
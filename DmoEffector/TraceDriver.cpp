@@ -0,0 +1,267 @@
+#include "stdafx.h"
+#include "TraceDriver.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("TraceDriver"));
+
+CTraceDriver::CTraceDriver(const TraceRecord& format)
+	: m_refCount(1), m_format(format), m_callbacks(NULL), m_isTimeInfoSupported(false), m_isStarted(false)
+	, m_samplePosition(0), m_systemTime(0), m_switchCounter(0)
+	, m_startedEvent(CreateEvent(NULL, TRUE, FALSE, NULL))
+	, m_processedEvent(CreateEvent(NULL, FALSE, FALSE, NULL))
+{
+	WIN32_EXPECT(NULL != (HANDLE)m_startedEvent);
+	WIN32_EXPECT(NULL != (HANDLE)m_processedEvent);
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_frequency = frequency.QuadPart;
+}
+
+CTraceDriver::~CTraceDriver()
+{
+	disposeBuffers();
+}
+
+/*
+	Fills input buffers of the record and calls back the engine with time info of the record.
+*/
+void CTraceDriver::switchBuffers(const TraceRecord& record, const BYTE* payload)
+{
+	if (!m_isStarted) return;
+
+	const long doubleBufferIndex = record.bufferSwitch.doubleBufferIndex & 1;
+	const size_t bufferBytes = (size_t)m_format.format.bufferSize * m_format.format.sampleSize;
+	std::vector<void*>& buffers = m_inputBuffers[doubleBufferIndex];
+	for (size_t channel = 0; channel < buffers.size(); channel++) {
+		if (!buffers[channel]) continue;
+		if (payload && record.payloadSize) CopyMemory(buffers[channel], &payload[channel * bufferBytes], bufferBytes);
+		else ZeroMemory(buffers[channel], bufferBytes);
+	}
+
+	m_samplePosition.store(record.bufferSwitch.samplePosition, std::memory_order_relaxed);
+	m_systemTime.store(record.bufferSwitch.systemTime, std::memory_order_relaxed);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	m_switchCounter.store(counter.QuadPart, std::memory_order_release);
+
+	if (m_isTimeInfoSupported) {
+		ASIOTime time;
+		ZeroMemory(&time, sizeof(time));
+		time.timeInfo.flags = record.bufferSwitch.flags;
+		time.timeInfo.sampleRate = m_format.format.sampleRate;
+		time.timeInfo.samplePosition.hi = (unsigned long)(record.bufferSwitch.samplePosition >> 32);
+		time.timeInfo.samplePosition.lo = (unsigned long)record.bufferSwitch.samplePosition;
+		time.timeInfo.systemTime.hi = (unsigned long)(record.bufferSwitch.systemTime >> 32);
+		time.timeInfo.systemTime.lo = (unsigned long)record.bufferSwitch.systemTime;
+		m_callbacks->bufferSwitchTimeInfo(&time, doubleBufferIndex, ASIOFalse);
+	} else {
+		m_callbacks->bufferSwitch(doubleBufferIndex, ASIOFalse);
+	}
+}
+
+long CTraceDriver::sendMessage(long selector, long value)
+{
+	return m_callbacks ? m_callbacks->asioMessage(selector, value, NULL, NULL) : 0;
+}
+
+HRESULT STDMETHODCALLTYPE CTraceDriver::QueryInterface(REFIID riid, void** ppvObject)
+{
+	HR_ASSERT(ppvObject, E_POINTER);
+
+	// IASIO doesn't have its own IID. Driver is identified by CLSID.
+	if (riid != IID_IUnknown) {
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	*ppvObject = (IUnknown*)this;
+	AddRef();
+	return S_OK;
+}
+
+ULONG STDMETHODCALLTYPE CTraceDriver::AddRef()
+{
+	return ++m_refCount;
+}
+
+ULONG STDMETHODCALLTYPE CTraceDriver::Release()
+{
+	ULONG count = --m_refCount;
+	if (!count) delete this;
+	return count;
+}
+
+ASIOBool CTraceDriver::init(void* sysHandle)
+{
+	return ((0 < m_format.format.numChannels) && (0 < m_format.format.bufferSize) && (0 < m_format.format.sampleSize)) ? ASIOTrue : ASIOFalse;
+}
+
+void CTraceDriver::getDriverName(char* name)
+{
+	strcpy_s(name, 32, "Trace");
+}
+
+long CTraceDriver::getDriverVersion()
+{
+	return 1;
+}
+
+void CTraceDriver::getErrorMessage(char* string)
+{
+	strcpy_s(string, 124, "");
+}
+
+ASIOError CTraceDriver::start()
+{
+	if (!m_callbacks) return ASE_InvalidMode;
+
+	m_isStarted = true;
+	SetEvent(m_startedEvent);
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::stop()
+{
+	m_isStarted = false;
+	ResetEvent(m_startedEvent);
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::getChannels(long* numInputChannels, long* numOutputChannels)
+{
+	*numInputChannels = *numOutputChannels = m_format.format.numChannels;
+	return ASE_OK;
+}
+
+/*
+	Latencies are not recorded. Returns the buffer size as most of drivers do.
+*/
+ASIOError CTraceDriver::getLatencies(long* inputLatency, long* outputLatency)
+{
+	*inputLatency = *outputLatency = m_format.format.bufferSize;
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity)
+{
+	*minSize = *maxSize = *preferredSize = m_format.format.bufferSize;
+	*granularity = 0;
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::canSampleRate(ASIOSampleRate sampleRate)
+{
+	return (sampleRate == m_format.format.sampleRate) ? ASE_OK : ASE_NoClock;
+}
+
+ASIOError CTraceDriver::getSampleRate(ASIOSampleRate* sampleRate)
+{
+	*sampleRate = m_format.format.sampleRate;
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::setSampleRate(ASIOSampleRate sampleRate)
+{
+	return canSampleRate(sampleRate);
+}
+
+ASIOError CTraceDriver::getClockSources(ASIOClockSource* clocks, long* numSources)
+{
+	ZeroMemory(clocks, sizeof(*clocks));
+	clocks->associatedChannel = clocks->associatedGroup = -1;
+	clocks->isCurrentSource = ASIOTrue;
+	strcpy_s(clocks->name, "Trace");
+	*numSources = 1;
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::setClockSource(long reference)
+{
+	return (reference == 0) ? ASE_OK : ASE_InvalidParameter;
+}
+
+/*
+	Returns position and time of the last buffer switch recorded.
+*/
+ASIOError CTraceDriver::getSamplePosition(ASIOSamples* samplePosition, ASIOTimeStamp* timeStamp)
+{
+	const LONGLONG position = m_samplePosition.load(std::memory_order_relaxed);
+	const LONGLONG time = m_systemTime.load(std::memory_order_relaxed);
+	samplePosition->hi = (unsigned long)(position >> 32);
+	samplePosition->lo = (unsigned long)position;
+	timeStamp->hi = (unsigned long)(time >> 32);
+	timeStamp->lo = (unsigned long)time;
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::getChannelInfo(ASIOChannelInfo* info)
+{
+	if ((info->channel < 0) || (m_format.format.numChannels <= info->channel)) return ASE_InvalidParameter;
+
+	info->isActive = ASIOTrue;
+	info->channelGroup = 0;
+	info->type = (ASIOSampleType)m_format.format.sampleType;
+	sprintf_s(info->name, "%s %ld", info->isInput ? "Trace In" : "Trace Out", info->channel + 1);
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks)
+{
+	if ((bufferSize != m_format.format.bufferSize) || !callbacks) return ASE_InvalidMode;
+	disposeBuffers();
+
+	// Input buffers of channels not created are skipped when the recorded input is copied.
+	const size_t bufferBytes = (size_t)bufferSize * m_format.format.sampleSize;
+	m_bufferMemory.reset(new BYTE[bufferBytes * numChannels * 2]);
+	ZeroMemory(m_bufferMemory.get(), bufferBytes * numChannels * 2);
+	for (int index = 0; index < 2; index++) {
+		m_inputBuffers[index].assign(m_format.format.numChannels, NULL);
+	}
+	for (long i = 0; i < numChannels; i++) {
+		ASIOBufferInfo& info = bufferInfos[i];
+		if ((info.channelNum < 0) || (m_format.format.numChannels <= info.channelNum)) return ASE_InvalidParameter;
+		for (int index = 0; index < 2; index++) {
+			info.buffers[index] = &m_bufferMemory[bufferBytes * (i * 2 + index)];
+			if (info.isInput) m_inputBuffers[index][info.channelNum] = info.buffers[index];
+		}
+	}
+
+	m_callbacks = callbacks;
+	m_isTimeInfoSupported = (callbacks->asioMessage(kAsioSupportsTimeInfo, 0, NULL, NULL) == ASIOTrue);
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::disposeBuffers()
+{
+	m_callbacks = NULL;
+	for (int index = 0; index < 2; index++) {
+		m_inputBuffers[index].clear();
+	}
+	m_bufferMemory.reset();
+	return ASE_OK;
+}
+
+ASIOError CTraceDriver::controlPanel()
+{
+	return ASE_NotPresent;
+}
+
+ASIOError CTraceDriver::future(long selector, void* opt)
+{
+	return ASE_InvalidParameter;
+}
+
+/*
+	Records time taken by the engine from the last buffer switch.
+
+	Called by the engine when it probes the driver while setting up, before any buffer switch.
+*/
+ASIOError CTraceDriver::outputReady()
+{
+	const LONGLONG switchCounter = m_switchCounter.exchange(0, std::memory_order_acq_rel);
+	if (switchCounter) {
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		m_processingTimes.push_back((double)(counter.QuadPart - switchCounter) / m_frequency);
+		SetEvent(m_processedEvent);
+	}
+	return ASE_OK;
+}
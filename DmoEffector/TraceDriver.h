@@ -0,0 +1,88 @@
+#pragma once
+
+#include "TraceFormat.h"
+
+/*
+	IASIO implementation that replays buffer switches and messages recorded in the trace.
+
+	Used by CTraceReplayer in place of ASIO driver. The driver has no thread and no clock.
+	The replayer calls switchBuffers() and sendMessage() for each record at the time of the record.
+	Input buffers are filled with the input recorded, or silence if input has not been recorded.
+	Format of the buffers is that of TraceFormat record.
+
+	outputReady() is supported so that the replayer can measure time taken by the engine to process each buffer.
+*/
+class CTraceDriver : public IASIO
+{
+	DISALLOW_COPY_AND_ASSIGN(CTraceDriver);
+
+public:
+	CTraceDriver(const TraceRecord& format);
+	virtual ~CTraceDriver();
+
+	// Called by the replayer thread.
+	void switchBuffers(const TraceRecord& record, const BYTE* payload);
+	long sendMessage(long selector, long value);
+	// Returns false if the engine has not started the driver, or has not processed the buffer, within the timeout.
+	bool waitStarted(DWORD timeout) { return WaitForSingleObject(m_startedEvent, timeout) == WAIT_OBJECT_0; }
+	bool waitProcessed(DWORD timeout) { return WaitForSingleObject(m_processedEvent, timeout) == WAIT_OBJECT_0; }
+	bool isStarted() const { return m_isStarted; }
+	const TraceRecord& getFormat() const { return m_format; }
+
+	// Seconds from each buffer switch to outputReady() called by the engine.
+	const std::vector<double>& getProcessingTimes() const { return m_processingTimes; }
+
+#pragma region IUnknown
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject);
+	virtual ULONG STDMETHODCALLTYPE AddRef();
+	virtual ULONG STDMETHODCALLTYPE Release();
+#pragma endregion
+
+#pragma region IASIO
+	virtual ASIOBool init(void* sysHandle);
+	virtual void getDriverName(char* name);
+	virtual long getDriverVersion();
+	virtual void getErrorMessage(char* string);
+	virtual ASIOError start();
+	virtual ASIOError stop();
+	virtual ASIOError getChannels(long* numInputChannels, long* numOutputChannels);
+	virtual ASIOError getLatencies(long* inputLatency, long* outputLatency);
+	virtual ASIOError getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity);
+	virtual ASIOError canSampleRate(ASIOSampleRate sampleRate);
+	virtual ASIOError getSampleRate(ASIOSampleRate* sampleRate);
+	virtual ASIOError setSampleRate(ASIOSampleRate sampleRate);
+	virtual ASIOError getClockSources(ASIOClockSource* clocks, long* numSources);
+	virtual ASIOError setClockSource(long reference);
+	virtual ASIOError getSamplePosition(ASIOSamples* samplePosition, ASIOTimeStamp* timeStamp);
+	virtual ASIOError getChannelInfo(ASIOChannelInfo* info);
+	virtual ASIOError createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks);
+	virtual ASIOError disposeBuffers();
+	virtual ASIOError controlPanel();
+	virtual ASIOError future(long selector, void* opt);
+	virtual ASIOError outputReady();
+#pragma endregion
+
+protected:
+	std::atomic<ULONG> m_refCount;
+
+	TraceRecord m_format;
+	ASIOCallbacks* m_callbacks;
+	bool m_isTimeInfoSupported;
+	std::atomic<bool> m_isStarted;
+
+	// Buffers created by createBuffers(). Index is double buffer index.
+	std::unique_ptr<BYTE[]> m_bufferMemory;
+	std::vector<void*> m_inputBuffers[2];
+
+	// Sample position and system time of the last buffer switch.
+	std::atomic<LONGLONG> m_samplePosition;
+	std::atomic<LONGLONG> m_systemTime;
+
+	// Performance counter of the buffer switch waiting for outputReady(). 0 if none.
+	std::atomic<LONGLONG> m_switchCounter;
+	LONGLONG m_frequency;
+	std::vector<double> m_processingTimes;
+
+	CHandle m_startedEvent;
+	CHandle m_processedEvent;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Layout of the trace file recorded by CTraceRecorder and replayed by CTraceReplayer.
+
+	This file doesn't depend on stdafx.h so that it can be included by tools on any platform.
+
+	The file consists of TraceFileHeader followed by records mostly in order of time. A record that was late to reach
+	the writer may follow records of later time, so readers should sort records by time instead of assuming the order.
+	Each record consists of TraceRecord followed by payloadSize bytes.
+	Payload of TraceBufferSwitch record is input buffers of all channels in ASIO sample format, if input is recorded.
+	Other records have no payload. All values are little endian.
+*/
+
+static const uint32_t TraceMagic = 0x52544d44;		// 'DMTR'
+static const uint32_t TraceVersion = 1;
+
+struct TraceFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;			// Offset of the first record.
+	uint32_t recordSize;			// sizeof(TraceRecord).
+};
+
+enum TraceRecordTypes {
+	// Recorded by the work queue thread when buffers are created.
+	TraceFormat = 1,
+	// Recorded by the driver thread.
+	TraceBufferSwitch,
+	TraceAsioMessage,
+	// Recorded by the UI thread for each method of CAsioHandler called.
+	TraceSetup,
+	TraceStart,
+	TraceStop,
+	TraceShutdown,
+	TraceReplaceEffectChain,
+	TraceParameterChange,
+	TraceLatencyMeasurement,
+	// Recorded by the writer thread when records have been dropped because the writer fell behind.
+	TraceOverrun,
+};
+
+struct TraceRecord {
+	uint32_t type;					// TraceRecordTypes.
+	uint32_t payloadSize;			// Size of the payload following this record in bytes.
+	int64_t time;					// Nanoseconds since the recording started.
+
+	union {
+		struct {
+			int32_t numChannels;
+			int32_t bufferSize;
+			int32_t sampleType;		// ASIOSampleType.
+			int32_t sampleSize;
+			double sampleRate;
+			uint32_t hasInput;		// Non zero if TraceBufferSwitch records have input buffers.
+		} format;
+		struct {
+			int32_t doubleBufferIndex;
+			uint32_t flags;			// AsioTimeInfo::flags.
+			int64_t samplePosition;
+			int64_t systemTime;
+		} bufferSwitch;
+		struct {
+			int32_t selector;
+			int32_t value;
+		} message;
+		struct {
+			int32_t lookaheadBuffers;
+			int32_t numChannels;
+		} setup;
+		// Fields of MP_ENVELOPE_SEGMENT.
+		struct {
+			int32_t effect;
+			uint32_t parameter;
+			int64_t start;
+			int64_t end;
+			float startValue;
+			float endValue;
+			uint32_t curve;
+			uint32_t flags;
+		} parameterChange;
+		struct {
+			int32_t inputChannel;
+			int32_t outputChannel;
+			int32_t runs;
+		} latencyMeasurement;
+		struct {
+			uint32_t droppedRecords;	// Total count of records dropped.
+		} overrun;
+		uint8_t reserved[48];
+	};
+};
+
+static_assert(sizeof(TraceRecord) == 64, "Size of TraceRecord should be 64 bytes.");
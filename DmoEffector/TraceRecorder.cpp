@@ -0,0 +1,249 @@
+#include "stdafx.h"
+#include "TraceRecorder.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("TraceRecorder"));
+
+/*static*/ const double CTraceRecorder::LaneSeconds = 2.0;
+
+// Count of control records that can wait for the writer thread.
+static const long ControlLaneRecords = 256;
+
+CTraceRecorder::CTraceRecorder()
+	: m_recordInput(false), m_frequency(0), m_start(0)
+	, m_numChannels(0), m_bufferBytes(0), m_inputBufferInfos(NULL), m_hasFormat(false)
+	, m_isControlBusy(false), m_droppedRecords(0), m_writtenDroppedRecords(0), m_isOpen(false)
+{
+}
+
+CTraceRecorder::~CTraceRecorder()
+{
+	HR_EXPECT_OK(close());
+}
+
+void CTraceRecorder::configure(LPCTSTR path, bool recordInput)
+{
+	m_path = path ? path : _T("");
+	m_recordInput = recordInput;
+}
+
+HRESULT CTraceRecorder::open()
+{
+	HR_ASSERT_OK(close());
+	if (m_path.empty()) return S_FALSE;
+
+	HANDLE file = CreateFile(m_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	WIN32_ASSERT(INVALID_HANDLE_VALUE != file);
+	m_file.Attach(file);
+	TraceFileHeader header = { TraceMagic, TraceVersion, sizeof(TraceFileHeader), sizeof(TraceRecord) };
+	DWORD written;
+	WIN32_ASSERT(WriteFile(m_file, &header, sizeof(header), &written, NULL));
+
+	HR_ASSERT_OK(m_controlLane.initialize(sizeof(TraceRecord), ControlLaneRecords));
+	m_hasFormat = false;
+	m_droppedRecords = 0;
+	m_writtenDroppedRecords = 0;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&counter);
+	m_frequency = counter.QuadPart;
+	QueryPerformanceCounter(&counter);
+	m_start = counter.QuadPart;
+
+	m_stopEvent.Attach(CreateEvent(NULL, TRUE, FALSE, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_stopEvent);
+	m_writerThread.Attach(CreateThread(NULL, 0, writerThreadProc, this, 0, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_writerThread);
+	m_isOpen.store(true, std::memory_order_release);
+	LOG4CPLUS_INFO(logger, "Recording trace to " << m_path.c_str());
+	return S_OK;
+}
+
+/*
+	Stops the writer thread after all records have been written, and closes the file.
+*/
+HRESULT CTraceRecorder::close()
+{
+	if (!m_writerThread) return S_FALSE;
+
+	m_isOpen.store(false, std::memory_order_release);
+	SetEvent(m_stopEvent);
+	WIN32_EXPECT(WAIT_OBJECT_0 == WaitForSingleObject(m_writerThread, INFINITE));
+	m_writerThread.Close();
+	m_stopEvent.Close();
+	m_file.Close();
+	m_hasFormat = false;
+	LOG4CPLUS_INFO(logger, "Closed trace. Dropped " << getDroppedRecords() << " record(s)");
+	return S_OK;
+}
+
+/*
+	Allocates data lane for the format and records it.
+
+	inputBufferInfos: Buffer infos of input channels. Used while recording if input is recorded.
+*/
+HRESULT CTraceRecorder::setFormat(long numChannels, long bufferSize, ASIOSampleType sampleType, long sampleSize, double sampleRate, const ASIOBufferInfo* inputBufferInfos)
+{
+	if (!isOpen()) return S_FALSE;
+	HR_ASSERT(!m_hasFormat, E_ILLEGAL_METHOD_CALL);
+	HR_ASSERT(inputBufferInfos, E_POINTER);
+
+	m_numChannels = numChannels;
+	m_bufferBytes = (size_t)bufferSize * sampleSize;
+	m_inputBufferInfos = inputBufferInfos;
+	long numBlocks = 16;
+	while (numBlocks * bufferSize < sampleRate * LaneSeconds) numBlocks <<= 1;
+	const size_t payloadSize = m_recordInput ? m_bufferBytes * numChannels : 0;
+	HR_ASSERT_OK(m_dataLane.initialize(sizeof(TraceRecord) + payloadSize, numBlocks));
+
+	TraceRecord format;
+	ZeroMemory(&format, sizeof(format));
+	format.format.numChannels = numChannels;
+	format.format.bufferSize = bufferSize;
+	format.format.sampleType = sampleType;
+	format.format.sampleSize = sampleSize;
+	format.format.sampleRate = sampleRate;
+	format.format.hasInput = m_recordInput;
+	record(TraceFormat, &format);
+
+	m_hasFormat.store(true, std::memory_order_release);
+	return S_OK;
+}
+
+/*
+	Records time info and doubleBufferIndex passed by the driver, and input buffers if configured.
+*/
+void CTraceRecorder::recordBufferSwitch(const ASIOTime& params, long doubleBufferIndex)
+{
+	if (!m_hasFormat.load(std::memory_order_acquire)) return;
+
+	BYTE* block = m_dataLane.getWritableBlock();
+	if (!block) {
+		m_droppedRecords++;
+		return;
+	}
+
+	TraceRecord* record = (TraceRecord*)block;
+	ZeroMemory(record, sizeof(*record));
+	record->type = TraceBufferSwitch;
+	record->time = getTime();
+	record->bufferSwitch.doubleBufferIndex = doubleBufferIndex;
+	record->bufferSwitch.flags = params.timeInfo.flags;
+	record->bufferSwitch.samplePosition = ((LONGLONG)params.timeInfo.samplePosition.hi << 32) | params.timeInfo.samplePosition.lo;
+	record->bufferSwitch.systemTime = ((LONGLONG)params.timeInfo.systemTime.hi << 32) | params.timeInfo.systemTime.lo;
+	if (m_recordInput) {
+		record->payloadSize = (uint32_t)(m_bufferBytes * m_numChannels);
+		BYTE* payload = &block[sizeof(TraceRecord)];
+		for (long channel = 0; channel < m_numChannels; channel++) {
+			CopyMemory(&payload[channel * m_bufferBytes], m_inputBufferInfos[channel].buffers[doubleBufferIndex], m_bufferBytes);
+		}
+	}
+	m_dataLane.push();
+}
+
+void CTraceRecorder::record(TraceRecordTypes type, TraceRecord* record /*= NULL*/)
+{
+	if (!isOpen()) return;
+
+	CComCritSecLock<CComAutoCriticalSection> lock(m_controlLock);
+	// Only recordMessage() of another thread could hold the lane, for a moment.
+	while (m_isControlBusy.exchange(true, std::memory_order_acquire)) Sleep(0);
+	pushControl(type, record);
+	m_isControlBusy.store(false, std::memory_order_release);
+}
+
+/*
+	Records asioMessage() without blocking.
+
+	If another thread is writing the control lane, the record is dropped and counted as the data lane does.
+*/
+void CTraceRecorder::recordMessage(long selector, long value)
+{
+	if (!isOpen()) return;
+
+	if (m_isControlBusy.exchange(true, std::memory_order_acquire)) {
+		m_droppedRecords++;
+		return;
+	}
+	TraceRecord record;
+	ZeroMemory(&record, sizeof(record));
+	record.message.selector = selector;
+	record.message.value = value;
+	pushControl(TraceAsioMessage, &record);
+	m_isControlBusy.store(false, std::memory_order_release);
+}
+
+/*
+	Pushes the record to the control lane. Called while m_isControlBusy is held.
+*/
+void CTraceRecorder::pushControl(TraceRecordTypes type, const TraceRecord* record)
+{
+	TraceRecord* block = (TraceRecord*)m_controlLane.getWritableBlock();
+	if (!block) {
+		m_droppedRecords++;
+		return;
+	}
+	if (record) CopyMemory(block, record, sizeof(*block));
+	else ZeroMemory(block, sizeof(*block));
+	block->type = type;
+	block->payloadSize = 0;
+	block->time = getTime();
+	m_controlLane.push();
+}
+
+LONGLONG CTraceRecorder::getTime() const
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	const LONGLONG ticks = counter.QuadPart - m_start;
+	// Divided into seconds and the rest so that the product doesn't overflow.
+	return (ticks / m_frequency) * 1000000000 + (ticks % m_frequency) * 1000000000 / m_frequency;
+}
+
+/*static*/ DWORD WINAPI CTraceRecorder::writerThreadProc(LPVOID param)
+{
+	HR_EXPECT_OK(((CTraceRecorder*)param)->write());
+	return 0;
+}
+
+HRESULT CTraceRecorder::write()
+{
+	while (WaitForSingleObject(m_stopEvent, WriteInterval) == WAIT_TIMEOUT) {
+		HR_ASSERT_OK(writeLanes());
+	}
+	return writeLanes();
+}
+
+/*
+	Writes all records in the lanes in order of time.
+
+	Records in each lane are in order of time, so that the record of the earlier head is written first.
+	A record pushed after this method has written later records of the other lane is written out of order.
+*/
+HRESULT CTraceRecorder::writeLanes()
+{
+	const bool hasFormat = m_hasFormat.load(std::memory_order_acquire);
+	DWORD written;
+	while (true) {
+		const TraceRecord* control = (const TraceRecord*)m_controlLane.getReadableBlock();
+		const TraceRecord* data = hasFormat ? (const TraceRecord*)m_dataLane.getReadableBlock() : NULL;
+		if (!control && !data) break;
+
+		const bool isControl = control && (!data || (control->time <= data->time));
+		const TraceRecord* record = isControl ? control : data;
+		WIN32_ASSERT(WriteFile(m_file, record, sizeof(TraceRecord) + record->payloadSize, &written, NULL));
+		if (isControl) m_controlLane.pop();
+		else m_dataLane.pop();
+	}
+
+	const long droppedRecords = getDroppedRecords();
+	if (m_writtenDroppedRecords != droppedRecords) {
+		LOG4CPLUS_WARN(logger, "Dropped " << droppedRecords - m_writtenDroppedRecords << " record(s)");
+		TraceRecord overrun;
+		ZeroMemory(&overrun, sizeof(overrun));
+		overrun.type = TraceOverrun;
+		overrun.time = getTime();
+		overrun.overrun.droppedRecords = droppedRecords;
+		WIN32_ASSERT(WriteFile(m_file, &overrun, sizeof(overrun), &written, NULL));
+		m_writtenDroppedRecords = droppedRecords;
+	}
+	return S_OK;
+}
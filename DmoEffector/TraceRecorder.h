@@ -0,0 +1,88 @@
+#pragma once
+
+#include "TraceFormat.h"
+#include "BlockFifo.h"
+
+/*
+	Records callbacks of the driver and methods of CAsioHandler called by the user to the trace file.
+
+	The trace is replayed by CTraceReplayer to reproduce glitches with the timing of the real device.
+	See TraceFormat.h for layout of the file.
+
+	Records are passed to the writer thread through 2 lanes, and the writer thread merges the heads of the lanes in order of time.
+	A record is stamped before it is pushed, so a record pushed late may be written after later records of the other lane.
+	Data lane is written by the driver thread without blocking. If it is full, records are dropped and counted.
+	Control lane is written by the other threads under the lock. asioMessage() could be called by any thread including
+	the driver thread, so that its record is dropped and counted instead of waiting for the lane.
+*/
+class CTraceRecorder
+{
+	DISALLOW_COPY_AND_ASSIGN(CTraceRecorder);
+
+public:
+	CTraceRecorder();
+	~CTraceRecorder();
+
+	// Called by the UI thread before CAsioHandler::setup(). Empty path disables recording.
+	void configure(LPCTSTR path, bool recordInput);
+
+	// Called by CAsioHandler::setup() and shutdown().
+	// Creates the file and starts the writer thread if recording has been configured.
+	HRESULT open();
+	HRESULT close();
+	// Called by any thread.
+	bool isOpen() const { return m_isOpen.load(std::memory_order_acquire); }
+
+	// Called by the work queue thread after buffers have been created and before the driver starts.
+	HRESULT setFormat(long numChannels, long bufferSize, ASIOSampleType sampleType, long sampleSize, double sampleRate, const ASIOBufferInfo* inputBufferInfos);
+
+	// Called by the driver thread.
+	void recordBufferSwitch(const ASIOTime& params, long doubleBufferIndex);
+
+	// Called by any thread except the driver thread. Time and type are set by this method.
+	// Record should be zero cleared before its fields are set. NULL records the type only.
+	void record(TraceRecordTypes type, TraceRecord* record = NULL);
+	// Called by asioMessage() of any thread. Doesn't block.
+	void recordMessage(long selector, long value);
+
+	long getDroppedRecords() const { return m_droppedRecords.load(std::memory_order_relaxed); }
+
+	// Minimum length of the data lane in seconds.
+	static const double LaneSeconds;
+	// Interval of the writer thread in milliseconds.
+	static const DWORD WriteInterval = 20;
+
+protected:
+	LONGLONG getTime() const;
+	static DWORD WINAPI writerThreadProc(LPVOID param);
+	HRESULT write();
+	HRESULT writeLanes();
+	void pushControl(TraceRecordTypes type, const TraceRecord* record);
+
+	tstring m_path;
+	bool m_recordInput;
+
+	LONGLONG m_frequency;
+	LONGLONG m_start;				// Performance counter when the recording started.
+
+	// Set by setFormat() before m_hasFormat is set.
+	long m_numChannels;
+	size_t m_bufferBytes;
+	const ASIOBufferInfo* m_inputBufferInfos;
+	std::atomic<bool> m_hasFormat;
+
+	CBlockFifo m_dataLane;
+	CBlockFifo m_controlLane;
+	CComAutoCriticalSection m_controlLock;
+	// Held while the control lane is written. Taken under m_controlLock, or tried by recordMessage().
+	std::atomic<bool> m_isControlBusy;
+	std::atomic<long> m_droppedRecords;
+	long m_writtenDroppedRecords;	// Count of dropped records written to the file by the writer thread.
+
+	CHandle m_file;
+	CHandle m_writerThread;
+	CHandle m_stopEvent;
+	// Set after the writer thread has started and cleared before it stops.
+	// Read by isOpen() of other threads while m_writerThread is assigned by open() and close().
+	std::atomic<bool> m_isOpen;
+};
@@ -0,0 +1,227 @@
+#include "stdafx.h"
+#include "TraceReplayer.h"
+#include "TraceDriver.h"
+#include "AsioHandler.h"
+
+#include <algorithm>
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("TraceReplayer"));
+
+CTraceReplayer::CTraceReplayer(EffectChainFactory factory)
+	: m_factory(factory), m_isStarted(false), m_frequency(0), m_origin(0)
+{
+}
+
+CTraceReplayer::~CTraceReplayer()
+{
+}
+
+/*
+	Reads all records of the trace file.
+
+	Record truncated at the end of the file, by crash of the recording process for example, is ignored.
+	Records are sorted by time, because the recorder may write a record after later records. See TraceFormat.h.
+*/
+HRESULT CTraceReplayer::load(LPCTSTR path)
+{
+	HR_ASSERT(path, E_POINTER);
+
+	CHandle file;
+	HANDLE handle = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	WIN32_ASSERT(INVALID_HANDLE_VALUE != handle);
+	file.Attach(handle);
+	LARGE_INTEGER size;
+	WIN32_ASSERT(GetFileSizeEx(file, &size));
+	HR_ASSERT(sizeof(TraceFileHeader) <= (ULONGLONG)size.QuadPart, E_INVALIDARG);
+	m_trace.resize((size_t)size.QuadPart);
+	DWORD read;
+	WIN32_ASSERT(ReadFile(file, &m_trace[0], (DWORD)m_trace.size(), &read, NULL));
+	HR_ASSERT(read == m_trace.size(), HRESULT_FROM_WIN32(ERROR_HANDLE_EOF));
+
+	const TraceFileHeader* header = (const TraceFileHeader*)&m_trace[0];
+	HR_ASSERT((header->magic == TraceMagic) && (header->version == TraceVersion), E_INVALIDARG);
+	HR_ASSERT(header->recordSize == sizeof(TraceRecord), E_INVALIDARG);
+
+	m_offsets.clear();
+	for (size_t offset = header->headerSize; offset + sizeof(TraceRecord) <= m_trace.size(); ) {
+		const TraceRecord* record = (const TraceRecord*)&m_trace[offset];
+		const size_t next = offset + sizeof(TraceRecord) + record->payloadSize;
+		if (m_trace.size() < next) break;
+		m_offsets.push_back(offset);
+		offset = next;
+	}
+	// Records of the same time keep the order in the file.
+	std::stable_sort(m_offsets.begin(), m_offsets.end(), [this](size_t a, size_t b) {
+		return ((const TraceRecord*)&m_trace[a])->time < ((const TraceRecord*)&m_trace[b])->time;
+	});
+	LOG4CPLUS_INFO(logger, "Loaded " << m_offsets.size() << " records from " << path);
+	return S_OK;
+}
+
+/*
+	Replays all records loaded.
+
+	The engine is stopped and shut down at the end of the trace if the trace doesn't have those records.
+*/
+HRESULT CTraceReplayer::replay(bool isRealTime, Result* result)
+{
+	HR_ASSERT(result, E_POINTER);
+	HR_ASSERT(m_factory, E_ILLEGAL_METHOD_CALL);
+	ZeroMemory(result, sizeof(*result));
+	if (m_offsets.empty()) return S_FALSE;
+
+	m_processingTimes.clear();
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&counter);
+	m_frequency = counter.QuadPart;
+	QueryPerformanceCounter(&counter);
+	m_origin = counter.QuadPart - (LONGLONG)(getRecord(0).time * 1e-9 * m_frequency);
+
+	HRESULT hr = S_OK;
+	for (size_t index = 0; SUCCEEDED(hr) && (index < m_offsets.size()); index++) {
+		if (isRealTime) waitUntil(getRecord(index).time);
+		hr = replayRecord(index, isRealTime, result);
+	}
+	if (m_handler) {
+		HRESULT hrShutdown = shutdown(result);
+		if (SUCCEEDED(hr)) hr = hrShutdown;
+	}
+
+	QueryPerformanceCounter(&counter);
+	result->elapsed = (double)(counter.QuadPart - m_origin) / m_frequency - getRecord(0).time * 1e-9;
+	result->duration = (getRecord(m_offsets.size() - 1).time - getRecord(0).time) * 1e-9;
+	double sum = 0;
+	for (size_t i = 0; i < m_processingTimes.size(); i++) {
+		sum += m_processingTimes[i];
+		result->maxProcessing = max(result->maxProcessing, m_processingTimes[i]);
+	}
+	result->meanProcessing = m_processingTimes.empty() ? 0 : sum / m_processingTimes.size();
+
+	LOG4CPLUS_INFO(logger, "Replayed " << result->bufferSwitches << " buffers (" << result->skippedBufferSwitches << " skipped) in "
+		<< result->elapsed << " seconds of " << result->duration << ": Xrun=" << result->xrun << ", Dropped=" << result->droppedBuffers
+		<< ", Late=" << result->lateBuffers << ", Processing mean=" << result->meanProcessing * 1e6 << " us, max=" << result->maxProcessing * 1e6 << " us");
+	return hr;
+}
+
+HRESULT CTraceReplayer::replayRecord(size_t index, bool isRealTime, Result* result)
+{
+	const TraceRecord& record = getRecord(index);
+	switch (record.type) {
+	case TraceSetup:
+		return setup(index);
+	case TraceStart:
+		HR_ASSERT(m_handler, E_ILLEGAL_METHOD_CALL);
+		m_isStarted = true;
+		return m_handler->start();
+	case TraceStop:
+		HR_ASSERT(m_handler, E_ILLEGAL_METHOD_CALL);
+		m_isStarted = false;
+		return m_handler->stop();
+	case TraceShutdown:
+		return shutdown(result);
+	case TraceReplaceEffectChain:
+		HR_ASSERT(m_handler, E_ILLEGAL_METHOD_CALL);
+		return m_handler->replaceEffectChain(m_factory());
+	case TraceParameterChange:
+		{
+			HR_ASSERT(m_handler, E_ILLEGAL_METHOD_CALL);
+			MP_ENVELOPE_SEGMENT segment;
+			ZeroMemory(&segment, sizeof(segment));
+			segment.rtStart = record.parameterChange.start;
+			segment.rtEnd = record.parameterChange.end;
+			segment.valStart = record.parameterChange.startValue;
+			segment.valEnd = record.parameterChange.endValue;
+			segment.iCurve = (MP_CURVE_TYPE)record.parameterChange.curve;
+			segment.flags = record.parameterChange.flags;
+			return m_handler->postParameterChange(record.parameterChange.effect, record.parameterChange.parameter, segment);
+		}
+	case TraceLatencyMeasurement:
+		HR_ASSERT(m_handler, E_ILLEGAL_METHOD_CALL);
+		return m_handler->startLatencyMeasurement(record.latencyMeasurement.inputChannel, record.latencyMeasurement.outputChannel, record.latencyMeasurement.runs);
+	case TraceBufferSwitch:
+		// The engine starts the driver asynchronously after Start record.
+		if (!m_driver || !m_driver->waitStarted(Timeout)) {
+			result->skippedBufferSwitches++;
+			return S_OK;
+		}
+		m_driver->switchBuffers(record, getPayload(index));
+		result->bufferSwitches++;
+		if (!isRealTime) m_driver->waitProcessed(Timeout);
+		return S_OK;
+	case TraceAsioMessage:
+		if (m_driver) m_driver->sendMessage(record.message.selector, record.message.value);
+		return S_OK;
+	case TraceOverrun:
+		result->droppedRecords = record.overrun.droppedRecords;
+		return S_OK;
+	case TraceFormat:
+		// Used by setup().
+		return S_OK;
+	default:
+		LOG4CPLUS_WARN(logger, "Unknown record type " << record.type << " at " << record.time << " ns");
+		return S_OK;
+	}
+}
+
+/*
+	Sets up new engine with the driver of the format recorded after the setup.
+*/
+HRESULT CTraceReplayer::setup(size_t index)
+{
+	HR_ASSERT(!m_handler, E_ILLEGAL_METHOD_CALL);
+
+	size_t format = index + 1;
+	while ((format < m_offsets.size()) && (getRecord(format).type != TraceFormat)) format++;
+	HR_ASSERT(format < m_offsets.size(), E_INVALIDARG);
+
+	const TraceRecord& record = getRecord(index);
+	m_driver.Attach(new CTraceDriver(getRecord(format)));
+	m_handler.reset(new CAsioHandler(record.setup.numChannels));
+	return m_handler->setup(m_driver, NULL, record.setup.lookaheadBuffers, m_factory());
+}
+
+/*
+	Stops the engine if running, and shuts it down.
+
+	Statistics of the engine and processing times of the driver are added to the result.
+*/
+HRESULT CTraceReplayer::shutdown(Result* result)
+{
+	if (!m_handler) return S_FALSE;
+
+	if (m_isStarted) HR_EXPECT_OK(m_handler->stop());
+	m_isStarted = false;
+	HRESULT hr = HR_EXPECT_OK(m_handler->shutdown());
+	result->xrun += m_handler->statistics.xrun;
+	result->droppedBuffers += m_handler->statistics.droppedBuffers;
+	m_handler.reset();
+
+	// Buffer is late if the device would have played the previous output again.
+	const TraceRecord& format = m_driver->getFormat();
+	const std::vector<double>& processingTimes = m_driver->getProcessingTimes();
+	const double bufferDuration = format.format.bufferSize / format.format.sampleRate;
+	for (size_t i = 0; i < processingTimes.size(); i++) {
+		if (bufferDuration < processingTimes[i]) result->lateBuffers++;
+	}
+	m_processingTimes.insert(m_processingTimes.end(), processingTimes.begin(), processingTimes.end());
+	m_driver.Release();
+	return hr;
+}
+
+/*
+	Waits until the time of the trace in nanoseconds.
+*/
+void CTraceReplayer::waitUntil(LONGLONG time) const
+{
+	const LONGLONG due = m_origin + (LONGLONG)(time * 1e-9 * m_frequency);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	if (now.QuadPart < due) {
+		Sleep((DWORD)((due - now.QuadPart) * 1000 / m_frequency));
+	}
+	// Waits for the rest less than a millisecond.
+	do {
+		YieldProcessor();
+		QueryPerformanceCounter(&now);
+	} while (now.QuadPart < due);
+}
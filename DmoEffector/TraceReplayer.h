@@ -0,0 +1,73 @@
+#pragma once
+
+#include "TraceFormat.h"
+#include "OfflineRenderer.h"
+
+class CAsioHandler;
+class CTraceDriver;
+
+/*
+	Replays the trace recorded by CTraceRecorder through CAsioHandler.
+
+	Records are replayed in order by the calling thread, which takes place of both the UI thread and the driver thread.
+	Methods of CAsioHandler recorded are called with the same arguments, and CTraceDriver calls back the engine
+	with doubleBufferIndex, time info, messages and input recorded. So that the state machine, the work queue
+	and the effect chain run as they did on the device.
+
+	Real time mode replays each record at the time it was recorded, to reproduce timing pattern of the device.
+	Otherwise records are replayed as fast as possible. Each buffer switch waits for the engine to process the previous buffer,
+	so that elapsed time measures the processing path for performance regression tests.
+*/
+class CTraceReplayer
+{
+	DISALLOW_COPY_AND_ASSIGN(CTraceReplayer);
+
+public:
+	// Creates new chain for each setup and replacement of the chain.
+	typedef COfflineRenderer::EffectChainFactory EffectChainFactory;
+
+	struct Result {
+		long bufferSwitches;		// Count of buffer switches replayed.
+		long skippedBufferSwitches;	// Count of buffer switches not replayed because the engine has not started the driver.
+		long droppedRecords;		// Count of records dropped while recording.
+		long xrun;					// Total of CAsioHandlerContext::Statistics.
+		long droppedBuffers;
+		long lateBuffers;			// Count of buffers processed after the duration of the buffer.
+		double meanProcessing;		// Mean of seconds from buffer switch to outputReady(). Excludes the work queue in lookahead mode.
+		double maxProcessing;
+		double duration;			// Seconds from the first record to the last record.
+		double elapsed;				// Seconds taken to replay.
+	};
+
+	CTraceReplayer(EffectChainFactory factory);
+	~CTraceReplayer();
+
+	HRESULT load(LPCTSTR path);
+	HRESULT replay(bool isRealTime, Result* result);
+
+	// Timeout of waiting for the engine in milliseconds.
+	static const DWORD Timeout = 1000;
+
+protected:
+	const TraceRecord& getRecord(size_t index) const { return *(const TraceRecord*)&m_trace[m_offsets[index]]; }
+	const BYTE* getPayload(size_t index) const { return &m_trace[m_offsets[index] + sizeof(TraceRecord)]; }
+
+	HRESULT replayRecord(size_t index, bool isRealTime, Result* result);
+	HRESULT setup(size_t index);
+	HRESULT shutdown(Result* result);
+	void waitUntil(LONGLONG time) const;
+
+	EffectChainFactory m_factory;
+	std::vector<BYTE> m_trace;
+	std::vector<size_t> m_offsets;	// Offset of each record in m_trace.
+
+	std::unique_ptr<CAsioHandler> m_handler;
+	CComPtr<CTraceDriver> m_driver;
+	// True between Start record and Stop record. The engine stops the driver asynchronously after stop().
+	bool m_isStarted;
+	std::vector<double> m_processingTimes;
+
+	// Performance counter corresponding to time 0 of the trace.
+	LONGLONG m_frequency;
+	LONGLONG m_origin;
+};
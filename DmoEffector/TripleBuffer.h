@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+
+/*
+	Triple buffer that passes the latest value from one writer thread to one reader thread.
+
+	Writer fills the write buffer and publishes it by exchanging it with the middle buffer.
+	Reader takes the middle buffer by exchanging it with the read buffer if it has been published.
+	Neither thread waits for the other. Values published while reader doesn't update are overwritten.
+*/
+template<class T>
+class CTripleBuffer
+{
+	DISALLOW_COPY_AND_ASSIGN(CTripleBuffer);
+
+public:
+	CTripleBuffer() : m_writeIndex(0), m_middle(1), m_readIndex(2) {}
+
+	// Called by writer thread.
+	T& getWriteBuffer() { return m_buffers[m_writeIndex]; }
+	void publish()
+	{
+		m_writeIndex = m_middle.exchange(m_writeIndex | Published, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// Called by reader thread.
+	// Returns true if new value has been published and the read buffer is updated.
+	bool update()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & Published)) return false;
+		m_readIndex = m_middle.exchange(m_readIndex, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	const T& getReadBuffer() const { return m_buffers[m_readIndex]; }
+
+protected:
+	static const int IndexMask = 3;
+	static const int Published = 4;
+
+	T m_buffers[3];
+	int m_writeIndex;
+	// Index of the middle buffer and Published flag.
+	std::atomic<int> m_middle;
+	int m_readIndex;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <math.h>
+
+/*
+	Inline SSE functions that operate on float vectors.
+
+	Pointers are not required to be aligned and count may be any value.
+	Remainder of count that is not multiple of 4 is processed by scalar code.
+*/
+
+// dst[i] = 0
+inline void vecClear(float* dst, long count)
+{
+	ZeroMemory(dst, sizeof(float) * count);
+}
+
+// dst[i] = src[i]
+inline void vecCopy(float* dst, const float* src, long count)
+{
+	CopyMemory(dst, src, sizeof(float) * count);
+}
+
+// dst[i] = value
+inline void vecFill(float* dst, float value, long count)
+{
+	long i = 0;
+	__m128 v = _mm_set1_ps(value);
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(&dst[i], v);
+	for (; i < count; i++) dst[i] = value;
+}
+
+// dst[i] *= gain
+inline void vecScale(float* dst, float gain, long count)
+{
+	long i = 0;
+	__m128 g = _mm_set1_ps(gain);
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_loadu_ps(&dst[i]), g));
+	for (; i < count; i++) dst[i] *= gain;
+}
+
+// dst[i] *= src[i]
+inline void vecMultiply(float* dst, const float* src, long count)
+{
+	long i = 0;
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_loadu_ps(&dst[i]), _mm_loadu_ps(&src[i])));
+	for (; i < count; i++) dst[i] *= src[i];
+}
+
+// dst[i] += src[i]
+inline void vecAdd(float* dst, const float* src, long count)
+{
+	long i = 0;
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_loadu_ps(&dst[i]), _mm_loadu_ps(&src[i])));
+	for (; i < count; i++) dst[i] += src[i];
+}
+
+// dst[i] += src[i] * gain
+inline void vecMultiplyAdd(float* dst, const float* src, float gain, long count)
+{
+	long i = 0;
+	__m128 g = _mm_set1_ps(gain);
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_loadu_ps(&dst[i]), _mm_mul_ps(_mm_loadu_ps(&src[i]), g)));
+	for (; i < count; i++) dst[i] += src[i] * gain;
+}
+
+// dst[i] = start + step * i
+inline void vecRamp(float* dst, float start, float step, long count)
+{
+	long i = 0;
+	__m128 v = _mm_setr_ps(start, start + step, start + step * 2, start + step * 3);
+	__m128 inc = _mm_set1_ps(step * 4);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(&dst[i], v);
+		v = _mm_add_ps(v, inc);
+	}
+	for (; i < count; i++) dst[i] = start + step * i;
+}
+
+// Returns max(|src[i]|)
+inline float vecMaxAbs(const float* src, long count)
+{
+	long i = 0;
+	__m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 m = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(&src[i]), mask));
+	float r[4];
+	_mm_storeu_ps(r, m);
+	float ret = max(max(r[0], r[1]), max(r[2], r[3]));
+	for (; i < count; i++) ret = max(ret, fabsf(src[i]));
+	return ret;
+}
+
+// dst[i] = max(dst[i], |src[i]|)
+inline void vecMaxAbsAccumulate(float* dst, const float* src, long count)
+{
+	long i = 0;
+	__m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(&dst[i], _mm_max_ps(_mm_loadu_ps(&dst[i]), _mm_and_ps(_mm_loadu_ps(&src[i]), mask)));
+	for (; i < count; i++) dst[i] = max(dst[i], fabsf(src[i]));
+}
+
+// Approximation of log2(x) for x > 0. Absolute error is less than 2e-5.
+// log2(m) of mantissa m in [1, 2) is computed by series of atanh((m - 1) / (m + 1)).
+inline __m128 log2Ps(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+	__m128 t2 = _mm_mul_ps(t, t);
+	__m128 p = _mm_add_ps(_mm_set1_ps(1.0f / 5), _mm_mul_ps(t2, _mm_set1_ps(1.0f / 7)));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 3), _mm_mul_ps(t2, p));
+	p = _mm_add_ps(one, _mm_mul_ps(t2, p));
+	return _mm_add_ps(exponent, _mm_mul_ps(_mm_mul_ps(t, p), _mm_set1_ps(2.0f / 0.69314718f)));
+}
+
+// Approximation of 2^x. Relative error is less than 2e-5.
+// x is clamped to [-126, 126]. Fraction is computed by Taylor series of exp(f * ln2).
+inline __m128 exp2Ps(__m128 x)
+{
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+	__m128i i = _mm_cvttps_epi32(x);
+	__m128 fi = _mm_cvtepi32_ps(i);
+	// Truncation rounds negative value toward 0. Adjust to floor.
+	__m128 adjust = _mm_and_ps(_mm_cmpgt_ps(fi, x), _mm_set1_ps(1.0f));
+	fi = _mm_sub_ps(fi, adjust);
+	i = _mm_cvtps_epi32(fi);
+	__m128 f = _mm_mul_ps(_mm_sub_ps(x, fi), _mm_set1_ps(0.69314718f));
+	__m128 p = _mm_add_ps(_mm_set1_ps(1.0f / 120), _mm_mul_ps(f, _mm_set1_ps(1.0f / 720)));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 24), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 6), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 2), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, p));
+	__m128i scale = _mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+}
+
+// Approximation of atan2(y, x). Absolute error is less than 1e-5 radian.
+// atan(a) of a = min(|x|, |y|) / max(|x|, |y|) in [0, 1] is computed by minimax polynomial and then moved to the quadrant.
+inline __m128 atan2Ps(__m128 y, __m128 x)
+{
+	const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 ax = _mm_andnot_ps(sign, x);
+	__m128 ay = _mm_andnot_ps(sign, y);
+	__m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+	__m128 a2 = _mm_mul_ps(a, a);
+	__m128 p = _mm_add_ps(_mm_set1_ps(0.05265332f), _mm_mul_ps(a2, _mm_set1_ps(-0.01172120f)));
+	p = _mm_add_ps(_mm_set1_ps(-0.11643287f), _mm_mul_ps(a2, p));
+	p = _mm_add_ps(_mm_set1_ps(0.19354346f), _mm_mul_ps(a2, p));
+	p = _mm_add_ps(_mm_set1_ps(-0.33262347f), _mm_mul_ps(a2, p));
+	p = _mm_add_ps(_mm_set1_ps(0.99997726f), _mm_mul_ps(a2, p));
+	__m128 r = _mm_mul_ps(a, p);
+	// |y| > |x|: pi / 2 - r, x < 0: pi - r, y < 0: -r
+	__m128 swapped = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(swapped, _mm_sub_ps(_mm_set1_ps(1.57079633f), r)), _mm_andnot_ps(swapped, r));
+	__m128 negativeX = _mm_cmplt_ps(x, _mm_setzero_ps());
+	r = _mm_or_ps(_mm_and_ps(negativeX, _mm_sub_ps(_mm_set1_ps(3.14159265f), r)), _mm_andnot_ps(negativeX, r));
+	return _mm_or_ps(r, _mm_and_ps(sign, y));
+}
+
+// Approximation of sin(x) and cos(x) for |x| <= 2^20. Absolute error is less than 1e-6 for |x| <= pi.
+// x is reduced to r in [-pi / 4, pi / 4] by quadrant q and both are computed by Taylor series of r.
+inline void sinCosPs(__m128 x, __m128* s, __m128* c)
+{
+	__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977f)));
+	__m128 fq = _mm_cvtepi32_ps(q);
+	// Subtract q * pi / 2 in two steps to keep precision.
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(fq, _mm_set1_ps(1.5703125f)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(4.8382679e-4f)));
+	__m128 r2 = _mm_mul_ps(r, r);
+	__m128 sr = _mm_add_ps(_mm_set1_ps(1.0f / 120), _mm_mul_ps(r2, _mm_set1_ps(-1.0f / 5040)));
+	sr = _mm_add_ps(_mm_set1_ps(-1.0f / 6), _mm_mul_ps(r2, sr));
+	sr = _mm_mul_ps(r, _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, sr)));
+	__m128 cr = _mm_add_ps(_mm_set1_ps(-1.0f / 720), _mm_mul_ps(r2, _mm_set1_ps(1.0f / 40320)));
+	cr = _mm_add_ps(_mm_set1_ps(1.0f / 24), _mm_mul_ps(r2, cr));
+	cr = _mm_add_ps(_mm_set1_ps(-1.0f / 2), _mm_mul_ps(r2, cr));
+	cr = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, cr));
+	// Odd quadrant swaps sin and cos. Quadrant 2 and 3 negate sin, 1 and 2 negate cos.
+	__m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 sv = _mm_or_ps(_mm_and_ps(odd, cr), _mm_andnot_ps(odd, sr));
+	__m128 cv = _mm_or_ps(_mm_and_ps(odd, sr), _mm_andnot_ps(odd, cr));
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+	*s = _mm_xor_ps(sv, sinSign);
+	*c = _mm_xor_ps(cv, cosSign);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+
+/*
+	Bounded queue for one producer thread and one consumer thread.
+
+	push() and pop() complete in bounded steps without locking and without allocating memory.
+	Memory is allocated by initialize() method.
+*/
+template<class T>
+class CWaitFreeQueue
+{
+	DISALLOW_COPY_AND_ASSIGN(CWaitFreeQueue);
+
+public:
+	CWaitFreeQueue() : m_mask(0), m_head(0), m_tail(0) {}
+
+	// Allocates items. Capacity is rounded up to power of 2.
+	HRESULT initialize(size_t capacity)
+	{
+		HR_ASSERT(0 < capacity, E_INVALIDARG);
+
+		size_t size = 1;
+		while (size < capacity) size <<= 1;
+		m_items.reset(new T[size]);
+		m_mask = size - 1;
+		m_head.store(0, std::memory_order_relaxed);
+		m_tail.store(0, std::memory_order_relaxed);
+		return S_OK;
+	}
+
+	// Called by producer thread.
+	// Returns false if the queue is full.
+	bool push(const T& item)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (m_mask < tail - m_head.load(std::memory_order_acquire)) return false;
+		m_items[tail & m_mask] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Called by consumer thread.
+	// Returns false if the queue is empty.
+	bool pop(T& item)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) return false;
+		item = m_items[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t getCount() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+	bool isInitialized() const { return m_items.get() != NULL; }
+
+protected:
+	std::unique_ptr<T[]> m_items;
+	size_t m_mask;
+
+	// Total count of items popped and pushed.
+	std::atomic<size_t> m_head;
+	std::atomic<size_t> m_tail;
+};
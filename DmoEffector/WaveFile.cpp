@@ -0,0 +1,268 @@
+#include "stdafx.h"
+#include "WaveFile.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("WaveFile"));
+
+static const WORD FormatPcm = 1;			// WAVE_FORMAT_PCM
+static const WORD FormatFloat = 3;			// WAVE_FORMAT_IEEE_FLOAT
+static const WORD FormatExtensible = 0xfffe;	// WAVE_FORMAT_EXTENSIBLE
+
+struct ChunkHeader {
+	char id[4];
+	UINT32 size;
+};
+
+static bool isChunk(const ChunkHeader& header, const char* id) { return memcmp(header.id, id, 4) == 0; }
+
+// Copies samples of size bytes between interleaved block and buffer of the channel.
+static void deinterleave(const BYTE* block, void* buffer, long sampleSize, long frameSize, long frames);
+static void interleave(const void* buffer, BYTE* block, long sampleSize, long frameSize, long frames);
+
+CWaveFile::CWaveFile()
+	: m_isWriting(false), m_numChannels(0), m_sampleRate(0), m_sampleType(ASIOSTLastEntry), m_sampleSize(0), m_frameSize(0)
+	, m_frames(0), m_position(0), m_dataOffset(0)
+{
+}
+
+CWaveFile::~CWaveFile()
+{
+	HR_EXPECT_OK(close());
+}
+
+HRESULT CWaveFile::open(LPCTSTR path)
+{
+	HR_ASSERT(path, E_POINTER);
+	HR_ASSERT_OK(close());
+
+	HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	WIN32_ASSERT(INVALID_HANDLE_VALUE != file);
+	m_file.Attach(file);
+	m_isWriting = false;
+	m_position = 0;
+	HR_ASSERT_OK(readChunks());
+
+	LOG4CPLUS_DEBUG(logger, "Opened " << path << ": " << m_numChannels << " channel(s), " << m_sampleRate << " Hz, Type=" << m_sampleType << ", " << m_frames << " frames");
+	return S_OK;
+}
+
+HRESULT CWaveFile::create(LPCTSTR path, const CWaveFile& format)
+{
+	HR_ASSERT(path, E_POINTER);
+	HR_ASSERT(!format.m_format.empty(), E_INVALIDARG);
+	HR_ASSERT_OK(close());
+
+	HANDLE file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	WIN32_ASSERT(INVALID_HANDLE_VALUE != file);
+	m_file.Attach(file);
+	m_isWriting = true;
+	m_format = format.m_format;
+	m_numChannels = format.m_numChannels;
+	m_sampleRate = format.m_sampleRate;
+	m_sampleType = format.m_sampleType;
+	m_sampleSize = format.m_sampleSize;
+	m_frameSize = format.m_frameSize;
+	m_frames = 0;
+
+	// Sizes of RIFF and data chunk are written by close().
+	ChunkHeader riff = { { 'R', 'I', 'F', 'F' }, 0 };
+	HR_ASSERT_OK(writeBytes(&riff, sizeof(riff)));
+	HR_ASSERT_OK(writeBytes("WAVE", 4));
+	ChunkHeader fmt = { { 'f', 'm', 't', ' ' }, (UINT32)m_format.size() };
+	HR_ASSERT_OK(writeBytes(&fmt, sizeof(fmt)));
+	HR_ASSERT_OK(writeBytes(&m_format[0], (DWORD)m_format.size()));
+	if (m_format.size() & 1) HR_ASSERT_OK(writeBytes("", 1));
+	m_dataOffset = sizeof(riff) + 4 + sizeof(fmt) + ((m_format.size() + 1) & ~1);
+	ChunkHeader data = { { 'd', 'a', 't', 'a' }, 0 };
+	HR_ASSERT_OK(writeBytes(&data, sizeof(data)));
+	return S_OK;
+}
+
+HRESULT CWaveFile::close()
+{
+	if (!m_file) return S_FALSE;
+
+	HRESULT hr = S_OK;
+	if (m_isWriting) {
+		const LONGLONG dataSize = m_frames * m_frameSize;
+		const DWORD pad = (DWORD)(dataSize & 1);
+		if (pad) hr = writeBytes("", 1);
+		// Size of RIFF chunk doesn't include its header.
+		const UINT32 riffSize = (UINT32)(m_dataOffset + dataSize + pad);
+		const UINT32 size = (UINT32)dataSize;
+		if (SUCCEEDED(hr)) hr = seek(offsetof(ChunkHeader, size));
+		if (SUCCEEDED(hr)) hr = writeBytes(&riffSize, sizeof(riffSize));
+		if (SUCCEEDED(hr)) hr = seek(m_dataOffset + offsetof(ChunkHeader, size));
+		if (SUCCEEDED(hr)) hr = writeBytes(&size, sizeof(size));
+	}
+	m_file.Close();
+	return hr;
+}
+
+/*
+	Reads chunks until data chunk and leaves the file pointer at the first sample.
+*/
+HRESULT CWaveFile::readChunks()
+{
+	ChunkHeader riff;
+	char wave[4];
+	HR_ASSERT_OK(readBytes(&riff, sizeof(riff)));
+	HR_ASSERT_OK(readBytes(wave, sizeof(wave)));
+	HR_ASSERT(isChunk(riff, "RIFF") && !memcmp(wave, "WAVE", 4), E_INVALIDARG);
+
+	m_format.clear();
+	for (;;) {
+		ChunkHeader header;
+		HR_ASSERT_OK(readBytes(&header, sizeof(header)));
+		if (isChunk(header, "data")) {
+			// fmt chunk should precede data chunk.
+			HR_ASSERT(!m_format.empty(), E_INVALIDARG);
+			m_frames = header.size / m_frameSize;
+			return S_OK;
+		}
+
+		// Chunk is padded to even size.
+		DWORD skipped = header.size + (header.size & 1);
+		if (isChunk(header, "fmt ")) {
+			HR_ASSERT((16 <= header.size) && (header.size <= 64), E_INVALIDARG);
+			m_format.resize(header.size);
+			HR_ASSERT_OK(readBytes(&m_format[0], header.size));
+			HR_ASSERT_OK(readFormat(&m_format[0], header.size));
+			skipped -= header.size;
+		}
+		LARGE_INTEGER distance;
+		distance.QuadPart = skipped;
+		WIN32_ASSERT(SetFilePointerEx(m_file, distance, NULL, FILE_CURRENT));
+	}
+}
+
+/*
+	Determines ASIOSampleType from content of fmt chunk (WAVEFORMATEX or WAVEFORMATEXTENSIBLE).
+*/
+HRESULT CWaveFile::readFormat(const BYTE* format, DWORD size)
+{
+	WORD tag = *(const WORD*)&format[0];
+	m_numChannels = *(const WORD*)&format[2];
+	m_sampleRate = *(const UINT32*)&format[4];
+	const WORD blockAlign = *(const WORD*)&format[12];
+	const WORD bits = *(const WORD*)&format[14];
+	if (tag == FormatExtensible) {
+		// First 2 bytes of SubFormat GUID is the format tag.
+		HR_ASSERT(40 <= size, E_INVALIDARG);
+		tag = *(const WORD*)&format[24];
+	}
+
+	m_sampleType = ASIOSTLastEntry;
+	switch (tag) {
+	case FormatPcm:
+		switch (bits) {
+		case 16: m_sampleType = ASIOSTInt16LSB; break;
+		case 24: m_sampleType = ASIOSTInt24LSB; break;
+		case 32: m_sampleType = ASIOSTInt32LSB; break;
+		}
+		break;
+	case FormatFloat:
+		switch (bits) {
+		case 32: m_sampleType = ASIOSTFloat32LSB; break;
+		case 64: m_sampleType = ASIOSTFloat64LSB; break;
+		}
+		break;
+	}
+	if (m_sampleType == ASIOSTLastEntry) {
+		LOG4CPLUS_ERROR(logger, "Format not supported: Tag=" << tag << ", Bits=" << bits);
+		return E_NOTIMPL;
+	}
+
+	m_sampleSize = bits / 8;
+	m_frameSize = m_sampleSize * m_numChannels;
+	HR_ASSERT((0 < m_numChannels) && (blockAlign == m_frameSize) && (0 < m_sampleRate), E_INVALIDARG);
+	return S_OK;
+}
+
+HRESULT CWaveFile::read(void* const* buffers, long frames, long* pFrames)
+{
+	HR_ASSERT(buffers && pFrames, E_POINTER);
+	HR_ASSERT(m_file && !m_isWriting, E_ILLEGAL_METHOD_CALL);
+
+	const long count = (long)min((LONGLONG)frames, m_frames - m_position);
+	m_block.resize((size_t)frames * m_frameSize);
+	if (count) HR_ASSERT_OK(readBytes(&m_block[0], count * m_frameSize));
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		BYTE* buffer = (BYTE*)buffers[channel];
+		deinterleave(&m_block[channel * m_sampleSize], buffer, m_sampleSize, m_frameSize, count);
+		ZeroMemory(&buffer[count * m_sampleSize], (frames - count) * m_sampleSize);
+	}
+	m_position += count;
+	*pFrames = count;
+	return S_OK;
+}
+
+HRESULT CWaveFile::write(const void* const* buffers, long frames)
+{
+	HR_ASSERT(buffers, E_POINTER);
+	HR_ASSERT(m_file && m_isWriting, E_ILLEGAL_METHOD_CALL);
+	// Size of data chunk is 32 bits.
+	HR_ASSERT((m_frames + frames) * m_frameSize < MAXDWORD, E_BOUNDS);
+	if (!frames) return S_FALSE;
+
+	m_block.resize((size_t)frames * m_frameSize);
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		interleave(buffers[channel], &m_block[channel * m_sampleSize], m_sampleSize, m_frameSize, frames);
+	}
+	HR_ASSERT_OK(writeBytes(&m_block[0], frames * m_frameSize));
+	m_frames += frames;
+	return S_OK;
+}
+
+HRESULT CWaveFile::readBytes(void* data, DWORD size)
+{
+	DWORD read;
+	WIN32_ASSERT(ReadFile(m_file, data, size, &read, NULL));
+	HR_ASSERT(read == size, HRESULT_FROM_WIN32(ERROR_HANDLE_EOF));
+	return S_OK;
+}
+
+HRESULT CWaveFile::writeBytes(const void* data, DWORD size)
+{
+	DWORD written;
+	WIN32_ASSERT(WriteFile(m_file, data, size, &written, NULL));
+	HR_ASSERT(written == size, E_FAIL);
+	return S_OK;
+}
+
+HRESULT CWaveFile::seek(LONGLONG position)
+{
+	LARGE_INTEGER distance;
+	distance.QuadPart = position;
+	WIN32_ASSERT(SetFilePointerEx(m_file, distance, NULL, FILE_BEGIN));
+	return S_OK;
+}
+
+static void deinterleave(const BYTE* block, void* buffer, long sampleSize, long frameSize, long frames)
+{
+	switch (sampleSize) {
+	case 2:
+		for (long i = 0; i < frames; i++) ((WORD*)buffer)[i] = *(const WORD*)&block[i * frameSize];
+		break;
+	case 4:
+		for (long i = 0; i < frames; i++) ((UINT32*)buffer)[i] = *(const UINT32*)&block[i * frameSize];
+		break;
+	default:
+		for (long i = 0; i < frames; i++) memcpy(&((BYTE*)buffer)[i * sampleSize], &block[i * frameSize], sampleSize);
+		break;
+	}
+}
+
+static void interleave(const void* buffer, BYTE* block, long sampleSize, long frameSize, long frames)
+{
+	switch (sampleSize) {
+	case 2:
+		for (long i = 0; i < frames; i++) *(WORD*)&block[i * frameSize] = ((const WORD*)buffer)[i];
+		break;
+	case 4:
+		for (long i = 0; i < frames; i++) *(UINT32*)&block[i * frameSize] = ((const UINT32*)buffer)[i];
+		break;
+	default:
+		for (long i = 0; i < frames; i++) memcpy(&block[i * frameSize], &((const BYTE*)buffer)[i * sampleSize], sampleSize);
+		break;
+	}
+}
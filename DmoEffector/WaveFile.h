@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+	WAV file read or written by blocks of ASIO buffers.
+
+	Samples in the file are interleaved. read() deinterleaves them to the buffer of each channel
+	and write() interleaves buffers of all channels.
+	Format is PCM of 16, 24 or 32 bits, or IEEE float of 32 or 64 bits, which is represented by ASIOSampleType.
+*/
+class CWaveFile
+{
+	DISALLOW_COPY_AND_ASSIGN(CWaveFile);
+
+public:
+	CWaveFile();
+	~CWaveFile();
+
+	// Opens existing file to read.
+	HRESULT open(LPCTSTR path);
+	// Creates file to write with the same format as the file opened to read.
+	HRESULT create(LPCTSTR path, const CWaveFile& format);
+	// Writes size of the data if the file has been created.
+	HRESULT close();
+
+	long getNumChannels() const { return m_numChannels; }
+	double getSampleRate() const { return m_sampleRate; }
+	ASIOSampleType getSampleType() const { return m_sampleType; }
+	long getSampleSize() const { return m_sampleSize; }
+	// Count of frames in the file opened to read, or count of frames written.
+	LONGLONG getFrames() const { return m_frames; }
+
+	// Reads frames to the buffer of each channel. Buffers are filled with silence after the end of the file.
+	// Returns count of frames read from the file in *pFrames.
+	HRESULT read(void* const* buffers, long frames, long* pFrames);
+	HRESULT write(const void* const* buffers, long frames);
+
+protected:
+	HRESULT readChunks();
+	HRESULT readFormat(const BYTE* format, DWORD size);
+	HRESULT readBytes(void* data, DWORD size);
+	HRESULT writeBytes(const void* data, DWORD size);
+	HRESULT seek(LONGLONG position);
+
+	CHandle m_file;
+	bool m_isWriting;
+
+	// Content of fmt chunk. Copied to the file created.
+	std::vector<BYTE> m_format;
+	long m_numChannels;
+	double m_sampleRate;
+	ASIOSampleType m_sampleType;
+	long m_sampleSize;				// Size of one sample in bytes.
+	long m_frameSize;				// Size of samples of all channels.
+
+	LONGLONG m_frames;
+	LONGLONG m_position;			// Count of frames read.
+	LONGLONG m_dataOffset;			// Offset of data chunk header in the file created.
+
+	// Interleaved samples of the block.
+	std::vector<BYTE> m_block;
+};
@@ -0,0 +1,248 @@
+#include "stdafx.h"
+#include "WaveFileDriver.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("WaveFileDriver"));
+
+CWaveFileDriver::CWaveFileDriver(long bufferSize)
+	: m_refCount(1), m_bufferSize(bufferSize), m_outputOffset(0), m_outputTail(0), m_samplePosition(0)
+{
+}
+
+CWaveFileDriver::~CWaveFileDriver()
+{
+	HR_EXPECT_OK(close());
+}
+
+HRESULT CWaveFileDriver::open(LPCTSTR inputPath, LPCTSTR outputPath)
+{
+	HR_ASSERT_OK(m_input.open(inputPath));
+	HR_ASSERT_OK(m_output.create(outputPath, m_input));
+	m_outputOffset = 0;
+	m_outputTail = 0;
+	m_samplePosition = 0;
+	return S_OK;
+}
+
+HRESULT CWaveFileDriver::close()
+{
+	HRESULT hr = m_output.close();
+	HR_EXPECT_OK(m_input.close());
+	return hr;
+}
+
+/*
+	Reads next frames of the input file to input buffers of the index.
+*/
+HRESULT CWaveFileDriver::readInputs(long doubleBufferIndex)
+{
+	HR_ASSERT(m_inputBuffers[doubleBufferIndex].size() == (size_t)m_input.getNumChannels(), E_ILLEGAL_METHOD_CALL);
+
+	long frames;
+	HR_ASSERT_OK(m_input.read(&m_inputBuffers[doubleBufferIndex][0], m_bufferSize, &frames));
+	m_samplePosition += m_bufferSize;
+	return S_OK;
+}
+
+/*
+	Writes output buffers of the index to the output file.
+
+	Frames before the output offset and after the length of the input and the tail are not written.
+*/
+HRESULT CWaveFileDriver::writeOutputs(long doubleBufferIndex)
+{
+	std::vector<void*>& buffers = m_outputBuffers[doubleBufferIndex];
+	HR_ASSERT(buffers.size() == (size_t)m_output.getNumChannels(), E_ILLEGAL_METHOD_CALL);
+
+	const long skipped = min(m_outputOffset, m_bufferSize);
+	m_outputOffset -= skipped;
+	const long frames = (long)min((LONGLONG)(m_bufferSize - skipped), getOutputFrames() - m_output.getFrames());
+	if (frames <= 0) return S_FALSE;
+
+	const long offset = skipped * m_output.getSampleSize();
+	m_writeBuffers.resize(buffers.size());
+	for (size_t channel = 0; channel < buffers.size(); channel++) {
+		m_writeBuffers[channel] = &((BYTE*)buffers[channel])[offset];
+	}
+	return m_output.write(&m_writeBuffers[0], frames);
+}
+
+HRESULT STDMETHODCALLTYPE CWaveFileDriver::QueryInterface(REFIID riid, void** ppvObject)
+{
+	HR_ASSERT(ppvObject, E_POINTER);
+
+	// IASIO doesn't have its own IID. Driver is identified by CLSID.
+	if (riid != IID_IUnknown) {
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	*ppvObject = (IUnknown*)this;
+	AddRef();
+	return S_OK;
+}
+
+ULONG STDMETHODCALLTYPE CWaveFileDriver::AddRef()
+{
+	return ++m_refCount;
+}
+
+ULONG STDMETHODCALLTYPE CWaveFileDriver::Release()
+{
+	ULONG count = --m_refCount;
+	if (!count) delete this;
+	return count;
+}
+
+ASIOBool CWaveFileDriver::init(void* sysHandle)
+{
+	return (0 < m_input.getNumChannels()) ? ASIOTrue : ASIOFalse;
+}
+
+void CWaveFileDriver::getDriverName(char* name)
+{
+	strcpy_s(name, 32, "Wave File");
+}
+
+long CWaveFileDriver::getDriverVersion()
+{
+	return 1;
+}
+
+void CWaveFileDriver::getErrorMessage(char* string)
+{
+	strcpy_s(string, 124, "");
+}
+
+ASIOError CWaveFileDriver::start()
+{
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::stop()
+{
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::getChannels(long* numInputChannels, long* numOutputChannels)
+{
+	*numInputChannels = *numOutputChannels = m_input.getNumChannels();
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::getLatencies(long* inputLatency, long* outputLatency)
+{
+	*inputLatency = *outputLatency = 0;
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity)
+{
+	*minSize = *maxSize = *preferredSize = m_bufferSize;
+	*granularity = 0;
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::canSampleRate(ASIOSampleRate sampleRate)
+{
+	return (sampleRate == m_input.getSampleRate()) ? ASE_OK : ASE_NoClock;
+}
+
+ASIOError CWaveFileDriver::getSampleRate(ASIOSampleRate* sampleRate)
+{
+	*sampleRate = m_input.getSampleRate();
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::setSampleRate(ASIOSampleRate sampleRate)
+{
+	return canSampleRate(sampleRate);
+}
+
+ASIOError CWaveFileDriver::getClockSources(ASIOClockSource* clocks, long* numSources)
+{
+	ZeroMemory(clocks, sizeof(*clocks));
+	clocks->associatedChannel = clocks->associatedGroup = -1;
+	clocks->isCurrentSource = ASIOTrue;
+	strcpy_s(clocks->name, "Input File");
+	*numSources = 1;
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::setClockSource(long reference)
+{
+	return (reference == 0) ? ASE_OK : ASE_InvalidParameter;
+}
+
+/*
+	Returns position of the buffer read last and time of the position on the timeline of the input file.
+*/
+ASIOError CWaveFileDriver::getSamplePosition(ASIOSamples* samplePosition, ASIOTimeStamp* timeStamp)
+{
+	const LONGLONG position = m_samplePosition - m_bufferSize;
+	const LONGLONG time = (LONGLONG)(position * 1e9 / m_input.getSampleRate());
+	samplePosition->hi = (unsigned long)(position >> 32);
+	samplePosition->lo = (unsigned long)position;
+	timeStamp->hi = (unsigned long)(time >> 32);
+	timeStamp->lo = (unsigned long)time;
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::getChannelInfo(ASIOChannelInfo* info)
+{
+	if ((info->channel < 0) || (m_input.getNumChannels() <= info->channel)) return ASE_InvalidParameter;
+
+	info->isActive = ASIOTrue;
+	info->channelGroup = 0;
+	info->type = m_input.getSampleType();
+	sprintf_s(info->name, "%s %ld", info->isInput ? "Input" : "Output", info->channel + 1);
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks)
+{
+	if (bufferSize != m_bufferSize) return ASE_InvalidMode;
+	disposeBuffers();
+
+	const size_t bufferBytes = (size_t)bufferSize * m_input.getSampleSize();
+	m_bufferMemory.reset(new BYTE[bufferBytes * numChannels * 2]);
+	ZeroMemory(m_bufferMemory.get(), bufferBytes * numChannels * 2);
+	for (long i = 0; i < numChannels; i++) {
+		ASIOBufferInfo& info = bufferInfos[i];
+		if ((info.channelNum < 0) || (m_input.getNumChannels() <= info.channelNum)) return ASE_InvalidParameter;
+		for (int index = 0; index < 2; index++) {
+			info.buffers[index] = &m_bufferMemory[bufferBytes * (i * 2 + index)];
+			std::vector<void*>& buffers = info.isInput ? m_inputBuffers[index] : m_outputBuffers[index];
+			buffers.resize(max((long)buffers.size(), info.channelNum + 1));
+			buffers[info.channelNum] = info.buffers[index];
+		}
+	}
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::disposeBuffers()
+{
+	for (int index = 0; index < 2; index++) {
+		m_inputBuffers[index].clear();
+		m_outputBuffers[index].clear();
+	}
+	m_bufferMemory.reset();
+	return ASE_OK;
+}
+
+ASIOError CWaveFileDriver::controlPanel()
+{
+	return ASE_NotPresent;
+}
+
+ASIOError CWaveFileDriver::future(long selector, void* opt)
+{
+	return ASE_InvalidParameter;
+}
+
+/*
+	Not supported, so that the engine doesn't call this method.
+	Output buffers are written by writeOutputs() after each buffer has been processed.
+*/
+ASIOError CWaveFileDriver::outputReady()
+{
+	return ASE_NotPresent;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "WaveFile.h"
+
+/*
+	IASIO implementation that reads input buffers from WAV file and writes output buffers to WAV file.
+
+	Used by COfflineRenderer in place of ASIO driver.
+	The driver never calls back and has no clock. The renderer calls readInputs() and writeOutputs()
+	around each buffer processed, so that buffers are processed as fast as possible.
+	Count of channels, sample type and sample rate are those of the input file.
+*/
+class CWaveFileDriver : public IASIO
+{
+	DISALLOW_COPY_AND_ASSIGN(CWaveFileDriver);
+
+public:
+	CWaveFileDriver(long bufferSize);
+	virtual ~CWaveFileDriver();
+
+	// Output file is created with the same format as the input file.
+	HRESULT open(LPCTSTR inputPath, LPCTSTR outputPath);
+	HRESULT close();
+
+	// Discards frames at the start of output to compensate latency added by the engine.
+	// Frames of the input are appended as silence until the output has as many frames as the input and the tail.
+	void setOutputOffset(long frames) { m_outputOffset = frames; }
+	// Appends frames to the output after the end of the input, so that the tail of the effects is rendered.
+	void setOutputTail(long frames) { m_outputTail = frames; }
+	LONGLONG getOutputFrames() const { return m_input.getFrames() + m_outputTail; }
+
+	HRESULT readInputs(long doubleBufferIndex);
+	HRESULT writeOutputs(long doubleBufferIndex);
+	bool isCompleted() const { return getOutputFrames() <= m_output.getFrames(); }
+	const CWaveFile& getInput() const { return m_input; }
+
+#pragma region IUnknown
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject);
+	virtual ULONG STDMETHODCALLTYPE AddRef();
+	virtual ULONG STDMETHODCALLTYPE Release();
+#pragma endregion
+
+#pragma region IASIO
+	virtual ASIOBool init(void* sysHandle);
+	virtual void getDriverName(char* name);
+	virtual long getDriverVersion();
+	virtual void getErrorMessage(char* string);
+	virtual ASIOError start();
+	virtual ASIOError stop();
+	virtual ASIOError getChannels(long* numInputChannels, long* numOutputChannels);
+	virtual ASIOError getLatencies(long* inputLatency, long* outputLatency);
+	virtual ASIOError getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity);
+	virtual ASIOError canSampleRate(ASIOSampleRate sampleRate);
+	virtual ASIOError getSampleRate(ASIOSampleRate* sampleRate);
+	virtual ASIOError setSampleRate(ASIOSampleRate sampleRate);
+	virtual ASIOError getClockSources(ASIOClockSource* clocks, long* numSources);
+	virtual ASIOError setClockSource(long reference);
+	virtual ASIOError getSamplePosition(ASIOSamples* samplePosition, ASIOTimeStamp* timeStamp);
+	virtual ASIOError getChannelInfo(ASIOChannelInfo* info);
+	virtual ASIOError createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks);
+	virtual ASIOError disposeBuffers();
+	virtual ASIOError controlPanel();
+	virtual ASIOError future(long selector, void* opt);
+	virtual ASIOError outputReady();
+#pragma endregion
+
+protected:
+	std::atomic<ULONG> m_refCount;
+
+	long m_bufferSize;
+	CWaveFile m_input;
+	CWaveFile m_output;
+	long m_outputOffset;			// Count of frames to be discarded yet.
+	long m_outputTail;				// Count of frames of the output after the end of the input.
+	LONGLONG m_samplePosition;		// Sample position of the buffer read last.
+
+	// Buffers created by createBuffers(). Index is double buffer index.
+	std::unique_ptr<BYTE[]> m_bufferMemory;
+	std::vector<void*> m_inputBuffers[2];
+	std::vector<void*> m_outputBuffers[2];
+	std::vector<const void*> m_writeBuffers;	// Output buffers from the output offset.
+};
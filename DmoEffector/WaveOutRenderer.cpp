@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include "WaveOutRenderer.h"
+
+#include <mmreg.h>
+
+#pragma comment(lib, "winmm.lib")
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("WaveOutRenderer"));
+
+CWaveOutRenderer::CWaveOutRenderer()
+	: m_isEnabled(false), m_deviceId(WAVE_MAPPER), m_numChannels(0), m_bufferSize(0), m_waveOut(NULL), m_outputFrames(0)
+{
+	ZeroMemory(m_headers, sizeof(m_headers));
+}
+
+CWaveOutRenderer::~CWaveOutRenderer()
+{
+	stop();
+}
+
+void CWaveOutRenderer::configure(UINT deviceId)
+{
+	m_deviceId = deviceId;
+	m_isEnabled = true;
+}
+
+/*
+	Opens the waveOut device at the sample rate of ASIO and starts the render thread.
+
+	The device plays silence until the bridge is filled up to its target.
+*/
+HRESULT CWaveOutRenderer::start(long numChannels, long bufferSize, ASIOSampleType sampleType, double sampleRate)
+{
+	HR_ASSERT(!isRunning(), E_ILLEGAL_METHOD_CALL);
+	if (!m_isEnabled) return S_FALSE;
+
+	m_numChannels = min(numChannels, MaxChannels);
+	m_bufferSize = bufferSize;
+	m_outputFrames = (long)(sampleRate * BufferMilliseconds / 1000);
+	HR_ASSERT_OK(m_converter.initialize(sampleType));
+	HR_ASSERT_OK(m_bridge.initialize(m_numChannels, sampleRate, sampleRate, bufferSize, m_outputFrames));
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		HR_ASSERT_OK(m_input[channel].allocate(bufferSize));
+		HR_ASSERT_OK(m_output[channel].allocate(m_outputFrames));
+	}
+
+	WAVEFORMATEX format;
+	ZeroMemory(&format, sizeof(format));
+	format.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+	format.nChannels = (WORD)m_numChannels;
+	format.nSamplesPerSec = (DWORD)sampleRate;
+	format.wBitsPerSample = 32;
+	format.nBlockAlign = (WORD)(sizeof(float) * m_numChannels);
+	format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+
+	m_doneEvent.Attach(CreateEvent(NULL, FALSE, FALSE, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_doneEvent);
+	MMRESULT result = waveOutOpen(&m_waveOut, m_deviceId, &format, (DWORD_PTR)(HANDLE)m_doneEvent, 0, CALLBACK_EVENT);
+	if (result != MMSYSERR_NOERROR) {
+		LOG4CPLUS_ERROR(logger, "waveOutOpen(" << m_deviceId << ") failed: MMRESULT=" << result);
+		m_waveOut = NULL;
+		m_doneEvent.Close();
+		return E_FAIL;
+	}
+
+	m_samples.reset(new float[m_outputFrames * m_numChannels * BufferCount]);
+	for (long i = 0; i < BufferCount; i++) {
+		WAVEHDR& header = m_headers[i];
+		ZeroMemory(&header, sizeof(header));
+		header.lpData = (LPSTR)&m_samples[m_outputFrames * m_numChannels * i];
+		header.dwBufferLength = (DWORD)(sizeof(float) * m_outputFrames * m_numChannels);
+		HR_ASSERT(MMSYSERR_NOERROR == waveOutPrepareHeader(m_waveOut, &header, sizeof(header)), E_FAIL);
+	}
+
+	m_stopEvent.Attach(CreateEvent(NULL, TRUE, FALSE, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_stopEvent);
+	m_thread.Attach(CreateThread(NULL, 0, threadProc, this, 0, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_thread);
+	WIN32_EXPECT(SetThreadPriority(m_thread, THREAD_PRIORITY_TIME_CRITICAL));
+
+	LOG4CPLUS_INFO(logger, "Started device " << m_deviceId << ": " << m_numChannels << " channel(s), " << m_outputFrames << " frames x " << BufferCount << " buffers");
+	return S_OK;
+}
+
+void CWaveOutRenderer::stop()
+{
+	if (m_thread) {
+		SetEvent(m_stopEvent);
+		WIN32_EXPECT(WAIT_OBJECT_0 == WaitForSingleObject(m_thread, INFINITE));
+		m_thread.Close();
+		m_stopEvent.Close();
+	}
+	if (m_waveOut) {
+		waveOutReset(m_waveOut);
+		for (WAVEHDR& header : m_headers) {
+			waveOutUnprepareHeader(m_waveOut, &header, sizeof(header));
+		}
+		waveOutClose(m_waveOut);
+		m_waveOut = NULL;
+		m_doneEvent.Close();
+		LOG4CPLUS_INFO(logger, "Stopped: Underruns=" << m_bridge.getUnderruns() << ", Overflows=" << m_bridge.getOverflows()
+			<< ", Correction=" << m_bridge.getCorrectionPpm() << " ppm");
+	}
+}
+
+void CWaveOutRenderer::write(void* const* buffers)
+{
+	if (!isRunning()) return;
+
+	float* channels[MaxChannels];
+	for (long channel = 0; channel < m_numChannels; channel++) {
+		m_converter.toFloat(buffers[channel], m_input[channel], m_bufferSize);
+		channels[channel] = m_input[channel];
+	}
+	m_bridge.write(channels, m_bufferSize);
+}
+
+/*static*/ DWORD WINAPI CWaveOutRenderer::threadProc(LPVOID param)
+{
+	((CWaveOutRenderer*)param)->run();
+	return 0;
+}
+
+/*
+	Queues all buffers and refills each buffer when the device has done it.
+*/
+void CWaveOutRenderer::run()
+{
+	for (WAVEHDR& header : m_headers) {
+		if (FAILED(render(header))) return;
+	}
+
+	HANDLE events[] = { m_stopEvent, m_doneEvent };
+	while (WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+		for (WAVEHDR& header : m_headers) {
+			if (header.dwFlags & WHDR_DONE) {
+				if (FAILED(render(header))) return;
+			}
+		}
+	}
+}
+
+HRESULT CWaveOutRenderer::render(WAVEHDR& header)
+{
+	float* channels[MaxChannels];
+	for (long channel = 0; channel < m_numChannels; channel++) channels[channel] = m_output[channel];
+	m_bridge.read(channels, m_outputFrames);
+
+	float* samples = (float*)header.lpData;
+	for (long i = 0; i < m_outputFrames; i++) {
+		for (long channel = 0; channel < m_numChannels; channel++) {
+			*(samples++) = channels[channel][i];
+		}
+	}
+	header.dwFlags &= ~WHDR_DONE;
+	HR_ASSERT(MMSYSERR_NOERROR == waveOutWrite(m_waveOut, &header, sizeof(header)), E_FAIL);
+	return S_OK;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mmsystem.h>
+
+#include "ClockBridge.h"
+#include "SampleConverter.h"
+
+/*
+	Renders processed buffers to a waveOut device that runs by its own clock.
+
+	The work queue thread writes ASIO buffers to CClockBridge and the render thread of this object
+	reads the bridge for each waveOut buffer done by the device.
+	The bridge adapts the resampling ratio to the drift between the ASIO device and the waveOut device.
+*/
+class CWaveOutRenderer
+{
+	DISALLOW_COPY_AND_ASSIGN(CWaveOutRenderer);
+
+public:
+	CWaveOutRenderer();
+	~CWaveOutRenderer();
+
+	// Called by the UI thread before CAsioHandler::start().
+	// Device ID of waveOut or WAVE_MAPPER.
+	void configure(UINT deviceId);
+	void disable() { m_isEnabled = false; }
+
+	// Called by the work queue thread while ASIO is not running.
+	// Does nothing if not configured.
+	HRESULT start(long numChannels, long bufferSize, ASIOSampleType sampleType, double sampleRate);
+	void stop();
+	bool isRunning() const { return m_thread != NULL; }
+
+	// Called by the work queue thread for each buffer.
+	void write(void* const* buffers);
+
+	static const long MaxChannels = 2;
+	static const long BufferCount = 4;
+	static const DWORD BufferMilliseconds = 10;
+
+protected:
+	static DWORD WINAPI threadProc(LPVOID param);
+	void run();
+	HRESULT render(WAVEHDR& header);
+
+	bool m_isEnabled;
+	UINT m_deviceId;
+
+	long m_numChannels;
+	long m_bufferSize;
+	CSampleConverter m_converter;
+	CAlignedBuffer<float> m_input[MaxChannels];		// ASIO buffers converted to float.
+	CClockBridge m_bridge;
+
+	// Members used by the render thread.
+	HWAVEOUT m_waveOut;
+	long m_outputFrames;
+	CAlignedBuffer<float> m_output[MaxChannels];	// Frames read from the bridge.
+	WAVEHDR m_headers[BufferCount];
+	std::unique_ptr<float[]> m_samples;				// Interleaved samples of all headers.
+
+	CHandle m_doneEvent;
+	CHandle m_stopEvent;
+	CHandle m_thread;
+};
@@ -0,0 +1,116 @@
+#include "stdafx.h"
+#include "WorkerPool.h"
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("WorkerPool"));
+
+CWorkerPool::CWorkerPool()
+	: m_stop(false), m_sleepingThreads(0)
+	, m_next(0), m_done(0), m_generation(0)
+	, m_task(NULL), m_context(NULL)
+{
+}
+
+CWorkerPool::~CWorkerPool()
+{
+	stop();
+}
+
+HRESULT CWorkerPool::start(long numThreads)
+{
+	HR_ASSERT(m_threads.empty(), E_ILLEGAL_METHOD_CALL);
+
+	m_wakeSemaphore.Attach(CreateSemaphore(NULL, 0, MAXLONG, NULL));
+	WIN32_ASSERT(NULL != (HANDLE)m_wakeSemaphore);
+
+	m_stop = false;
+	for (long i = 0; i < numThreads; i++) {
+		HANDLE thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+		WIN32_ASSERT(NULL != thread);
+		WIN32_EXPECT(SetThreadPriority(thread, THREAD_PRIORITY_HIGHEST));
+		m_threads.push_back(thread);
+	}
+
+	LOG4CPLUS_INFO(logger, "Started " << numThreads << " worker thread(s)");
+	return S_OK;
+}
+
+void CWorkerPool::stop()
+{
+	if (m_threads.empty()) return;
+
+	m_stop = true;
+	ReleaseSemaphore(m_wakeSemaphore, (LONG)m_threads.size(), NULL);
+	WaitForMultipleObjects((DWORD)m_threads.size(), &m_threads[0], TRUE, INFINITE);
+	for (size_t i = 0; i < m_threads.size(); i++) {
+		CloseHandle(m_threads[i]);
+	}
+	m_threads.clear();
+	m_wakeSemaphore.Close();
+}
+
+void CWorkerPool::run(Task task, void* context, long count)
+{
+	// Previous run() has been completed. So no worker is accessing these members.
+	m_task = task;
+	m_context = context;
+	m_done.store(0, std::memory_order_relaxed);
+	unsigned long generation = ++m_generation;
+	m_next.store(((unsigned long long)generation << 32) | ((unsigned long long)count << 16));
+
+	long sleepingThreads = m_sleepingThreads.load();
+	if ((0 < sleepingThreads) && (1 < count)) {
+		ReleaseSemaphore(m_wakeSemaphore, min(sleepingThreads, count - 1), NULL);
+	}
+
+	executeTasks(generation);
+	while (m_done.load(std::memory_order_acquire) < count) {
+		YieldProcessor();
+	}
+}
+
+/*
+	Claims and executes tasks until all tasks of the generation are claimed.
+*/
+void CWorkerPool::executeTasks(unsigned long generation)
+{
+	unsigned long long next = m_next.load();
+	while (((unsigned long)(next >> 32) == generation) && ((long)(next & 0xffff) < (long)((next >> 16) & 0xffff))) {
+		if (m_next.compare_exchange_weak(next, next + 1)) {
+			m_task(m_context, (long)(next & 0xffff));
+			m_done.fetch_add(1, std::memory_order_release);
+			next = m_next.load();
+		}
+	}
+}
+
+/*static*/ DWORD WINAPI CWorkerPool::threadProc(LPVOID param)
+{
+	((CWorkerPool*)param)->work();
+	return 0;
+}
+
+void CWorkerPool::work()
+{
+	unsigned long seen = 0;
+	long spin = 0;
+	while (!m_stop) {
+		unsigned long generation = (unsigned long)(m_next.load() >> 32);
+		if (generation != seen) {
+			executeTasks(generation);
+			seen = generation;
+			spin = 0;
+		} else if (spin < SpinCount) {
+			YieldProcessor();
+			spin++;
+		} else {
+			// Check generation again after registering as sleeping thread,
+			// so that run() called before registration is not missed.
+			m_sleepingThreads++;
+			if ((unsigned long)(m_next.load() >> 32) == seen) {
+				WaitForSingleObject(m_wakeSemaphore, INFINITE);
+			}
+			m_sleepingThreads--;
+			spin = 0;
+		}
+	}
+}
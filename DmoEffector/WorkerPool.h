@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+	Pool of worker threads that execute tasks together with the calling real-time thread.
+
+	Workers spin for a while waiting for tasks so that tasks dispatched in each buffer period
+	start without latency of waking up the thread. Then workers sleep until next run() is called.
+
+	Tasks are claimed by atomic counter that holds generation of run(), count and index of the task.
+	The calling thread executes tasks too, so that all tasks are done even if no worker is awake.
+*/
+class CWorkerPool
+{
+	DISALLOW_COPY_AND_ASSIGN(CWorkerPool);
+
+public:
+	typedef void (*Task)(void* context, long index);
+
+	CWorkerPool();
+	virtual ~CWorkerPool();
+
+	HRESULT start(long numThreads);
+	void stop();
+	long getThreadCount() const { return (long)m_threads.size(); }
+
+	// Executes task with index from 0 to count - 1 and returns when all of them are done.
+	// count should not exceed MaxTasks. Called by the real-time thread.
+	void run(Task task, void* context, long count);
+
+	// Count of spin loops before worker sleeps.
+	static const long SpinCount = 20000;
+	// Maximum count of tasks of one run().
+	static const long MaxTasks = 0xffff;
+
+protected:
+	static DWORD WINAPI threadProc(LPVOID param);
+	void work();
+	void executeTasks(unsigned long generation);
+
+	std::vector<HANDLE> m_threads;
+	CHandle m_wakeSemaphore;
+	std::atomic<bool> m_stop;
+	std::atomic<long> m_sleepingThreads;
+
+	// Upper 32 bits: Generation of run(), Next 16 bits: Count of tasks, Lower 16 bits: Index of the next task.
+	// Count is in the same word as generation, so that index is never compared with count of another generation.
+	std::atomic<unsigned long long> m_next;
+	std::atomic<long> m_done;
+	unsigned long m_generation;
+	Task m_task;
+	void* m_context;
+};
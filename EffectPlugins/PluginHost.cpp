@@ -0,0 +1,188 @@
+// PluginHost.cpp : Sample host that loads effect plugins and checks their behavior outside DmoEffector.
+//
+// Usage:
+//   PluginHost [/rate:<sample rate>] [/buffer:<frames>] <plugin library>...
+//
+// Each plugin is validated in the same way as DmoEffector, and then processes an impulse.
+// Prints latency and tail reported by the plugin with the measured delay and decay of the impulse,
+// and checks that in-place plugins produce the same output in place and out of place.
+// Exit code is the count of plugins that failed.
+//
+// See ../DmoEffector/EffectPluginAbi.h for the ABI.
+
+#include "EffectPluginAbi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HMODULE Module;
+static Module openLibrary(const char* path) { return LoadLibraryA(path); }
+static void* findSymbol(Module module, const char* name) { return (void*)GetProcAddress(module, name); }
+static void closeLibrary(Module module) { FreeLibrary(module); }
+#else
+#include <dlfcn.h>
+typedef void* Module;
+static Module openLibrary(const char* path) { return dlopen(path, RTLD_NOW | RTLD_LOCAL); }
+static void* findSymbol(Module module, const char* name) { return dlsym(module, name); }
+static void closeLibrary(Module module) { dlclose(module); }
+#endif
+
+static const uint32_t NumChannels = 2;
+
+// Buffers of all channels and pointers to them.
+struct Buffers {
+	std::vector<std::vector<float>> data;
+	std::vector<float*> channels;
+
+	Buffers(uint32_t frames) : data(NumChannels, std::vector<float>(frames)), channels(NumChannels)
+	{
+		for (uint32_t channel = 0; channel < NumChannels; channel++) channels[channel] = data[channel].data();
+	}
+	void clear() { for (std::vector<float>& buffer : data) std::fill(buffer.begin(), buffer.end(), 0.0f); }
+};
+
+// Runs an impulse on channel 0 through a new instance for frames samples, and returns output of channel 0.
+// If inPlace is true, input and output buffers are the same.
+static bool runImpulse(const EffectPluginDescriptor* descriptor, uint32_t bufferSize, double sampleRate, uint64_t frames, bool inPlace, std::vector<float>& output)
+{
+	void* instance = descriptor->create();
+	if (!instance) {
+		printf("  create() failed.\n");
+		return false;
+	}
+	int32_t result = descriptor->prepare(instance, NumChannels, bufferSize, sampleRate);
+	if (result) {
+		printf("  prepare() failed: %d\n", result);
+		descriptor->destroy(instance);
+		return false;
+	}
+
+	Buffers inputs(bufferSize), outputs(bufferSize);
+	Buffers& target = inPlace ? inputs : outputs;
+	bool isInputKept = true;
+	output.clear();
+	output.reserve((size_t)frames);
+	for (uint64_t position = 0; position < frames; position += bufferSize) {
+		const uint32_t count = (uint32_t)std::min<uint64_t>(bufferSize, frames - position);
+		inputs.clear();
+		if (position == 0) inputs.data[0][0] = 1.0f;
+		descriptor->process(instance, inputs.channels.data(), target.channels.data(), count);
+		output.insert(output.end(), target.data[0].begin(), target.data[0].begin() + count);
+		if (!inPlace && (position == 0) && (inputs.data[0][0] != 1.0f)) isInputKept = false;
+	}
+	descriptor->destroy(instance);
+
+	if (!isInputKept) printf("  process() modified the input buffer.\n");
+	return isInputKept;
+}
+
+static bool checkPlugin(const char* path, uint32_t bufferSize, double sampleRate)
+{
+	printf("%s\n", path);
+	Module module = openLibrary(path);
+	if (!module) {
+		printf("  Can't load the library.\n");
+		return false;
+	}
+	EffectPluginEntry entry = (EffectPluginEntry)findSymbol(module, EffectPluginEntryName);
+	if (!entry) {
+		printf("  %s() is not exported.\n", EffectPluginEntryName);
+		closeLibrary(module);
+		return false;
+	}
+
+	const EffectPluginDescriptor* descriptor = entry(EffectPluginAbiVersion);
+	const char* error = validateEffectPluginDescriptor(descriptor);
+	if (error) {
+		printf("  %s\n", error);
+		closeLibrary(module);
+		return false;
+	}
+	printf("  %s: ABI %u.%u, Flags=0x%x (%s%s%s)\n", descriptor->name,
+		EFFECT_PLUGIN_ABI_MAJOR(descriptor->abiVersion), EFFECT_PLUGIN_ABI_MINOR(descriptor->abiVersion), descriptor->flags,
+		(descriptor->flags & EffectPluginInPlace) ? "InPlace " : "", (descriptor->flags & EffectPluginLatency) ? "Latency " : "",
+		(descriptor->flags & EffectPluginTail) ? "Tail " : "");
+	for (uint32_t i = 0; i < descriptor->parameterCount; i++) {
+		const EffectPluginParameter& parameter = descriptor->parameters[i];
+		printf("  Parameter %u: %s %g to %g, default %g\n", i, parameter.name, parameter.minValue, parameter.maxValue, parameter.defaultValue);
+	}
+	bool succeeded = true;
+	if (entry(EFFECT_PLUGIN_ABI_VERSION(EFFECT_PLUGIN_ABI_MAJOR(EffectPluginAbiVersion) + 1, 0))) {
+		printf("  Warning: The plugin accepts the next major ABI version.\n");
+	}
+
+	// Latency and tail are reported after prepare().
+	uint32_t latency = 0, tail = 0;
+	void* instance = descriptor->create();
+	if (instance && !descriptor->prepare(instance, NumChannels, bufferSize, sampleRate)) {
+		if (descriptor->flags & EffectPluginLatency) latency = descriptor->getLatency(instance);
+		if (descriptor->flags & EffectPluginTail) tail = descriptor->getTailLength(instance);
+	}
+	if (instance) descriptor->destroy(instance);
+
+	// Impulse response continues until latency + tail, and then one more second should be silent.
+	const uint64_t frames = (uint64_t)latency + tail + (uint64_t)sampleRate;
+	std::vector<float> response;
+	if (!runImpulse(descriptor, bufferSize, sampleRate, frames, false, response)) {
+		closeLibrary(module);
+		return false;
+	}
+	size_t first = 0;
+	while ((first < response.size()) && (response[first] == 0.0f)) first++;
+	float peak = 0, residual = 0;
+	for (size_t i = 0; i < response.size(); i++) {
+		if (i <= (size_t)latency + tail) peak = std::max(peak, fabsf(response[i]));
+		else residual = std::max(residual, fabsf(response[i]));
+	}
+	printf("  Latency=%u, Tail=%u, First output=%d, Residual after tail=%.1f dB\n", latency, tail,
+		(first < response.size()) ? (int)first : -1, (0 < peak) ? 20 * log10(std::max(residual, 1e-10f) / peak) : 0.0);
+	if ((first < response.size()) && (first != latency)) {
+		printf("  Impulse appears at %d, not at the latency.\n", (int)first);
+		succeeded = false;
+	}
+	if ((0 < peak) && (peak * 0.001f < residual)) {
+		printf("  Output doesn't decay by 60 dB within the tail.\n");
+		succeeded = false;
+	}
+
+	if (descriptor->flags & EffectPluginInPlace) {
+		std::vector<float> inPlace;
+		if (!runImpulse(descriptor, bufferSize, sampleRate, frames, true, inPlace)) succeeded = false;
+		else if (memcmp(inPlace.data(), response.data(), response.size() * sizeof(float))) {
+			printf("  Output in place is different from output out of place.\n");
+			succeeded = false;
+		}
+	}
+
+	closeLibrary(module);
+	printf("  %s\n", succeeded ? "OK" : "FAILED");
+	return succeeded;
+}
+
+int main(int argc, char* argv[])
+{
+	double sampleRate = 48000;
+	uint32_t bufferSize = 256;
+	int arg = 1;
+	for (; arg < argc; arg++) {
+		if (!strncmp(argv[arg], "/rate:", 6)) sampleRate = atof(&argv[arg][6]);
+		else if (!strncmp(argv[arg], "/buffer:", 8)) bufferSize = (uint32_t)atoi(&argv[arg][8]);
+		else break;
+	}
+	if ((arg == argc) || (sampleRate <= 0) || (bufferSize == 0)) {
+		printf("Usage: PluginHost [/rate:<sample rate>] [/buffer:<frames>] <plugin library>...\n");
+		return -1;
+	}
+
+	int failed = 0;
+	for (; arg < argc; arg++) {
+		if (!checkPlugin(argv[arg], bufferSize, sampleRate)) failed++;
+	}
+	return failed;
+}
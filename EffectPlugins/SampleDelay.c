@@ -0,0 +1,85 @@
+/*
+	SampleDelay: Sample effect plugin that delays all channels by 10 ms.
+
+	Reports the delay as latency, so that the host compensates it on parallel paths and in offline rendering.
+	Processes in place. See ../DmoEffector/EffectPluginAbi.h for the ABI.
+*/
+
+#include "EffectPluginAbi.h"
+
+#include <stdlib.h>
+
+typedef struct Instance {
+	uint32_t numChannels;
+	uint32_t delay;				/* Samples. */
+	uint32_t position;			/* Write position in the ring of each channel. */
+	float* ring;				/* Ring of delay samples for each channel. */
+} Instance;
+
+static void* create(void)
+{
+	return calloc(1, sizeof(Instance));
+}
+
+static int32_t prepare(void* context, uint32_t numChannels, uint32_t maxFrames, double sampleRate)
+{
+	Instance* instance = (Instance*)context;
+	(void)maxFrames;
+	free(instance->ring);
+	instance->numChannels = numChannels;
+	instance->delay = (uint32_t)(0.01 * sampleRate + 0.5);
+	instance->position = 0;
+	instance->ring = (float*)calloc((size_t)numChannels * instance->delay, sizeof(float));
+	return instance->ring ? 0 : -1;
+}
+
+static void process(void* context, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+	Instance* instance = (Instance*)context;
+	uint32_t channel, i;
+	for (channel = 0; channel < instance->numChannels; channel++) {
+		float* ring = &instance->ring[channel * instance->delay];
+		uint32_t position = instance->position;
+		for (i = 0; i < frames; i++) {
+			/* Reads input before writing output of the same sample, so that the buffers may be the same. */
+			float input = inputs[channel][i];
+			outputs[channel][i] = ring[position];
+			ring[position] = input;
+			if (++position == instance->delay) position = 0;
+		}
+	}
+	instance->position = (uint32_t)((instance->position + frames) % instance->delay);
+}
+
+static void destroy(void* context)
+{
+	Instance* instance = (Instance*)context;
+	free(instance->ring);
+	free(instance);
+}
+
+static uint32_t getLatency(void* context)
+{
+	return ((Instance*)context)->delay;
+}
+
+static const EffectPluginDescriptor descriptor = {
+	EFFECT_PLUGIN_ABI_VERSION(1, 0),
+	sizeof(EffectPluginDescriptor),
+	"SampleDelay",
+	EffectPluginInPlace | EffectPluginLatency,
+	0,
+	NULL,
+	create,
+	prepare,
+	process,
+	NULL,
+	destroy,
+	getLatency,
+	NULL,
+};
+
+EFFECT_PLUGIN_EXPORT const EffectPluginDescriptor* getEffectPlugin(uint32_t hostAbiVersion)
+{
+	return (EFFECT_PLUGIN_ABI_MAJOR(hostAbiVersion) == 1) ? &descriptor : NULL;
+}
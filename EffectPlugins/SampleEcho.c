@@ -0,0 +1,127 @@
+/*
+	SampleEcho: Sample effect plugin that adds feedback echo to each channel.
+
+	Reports tail length that is enough for the echo to decay by 60 dB at the maximum time and feedback.
+	Doesn't declare in-place processing, so that the host passes a copy of inputs.
+	See ../DmoEffector/EffectPluginAbi.h for the ABI.
+*/
+
+#include "EffectPluginAbi.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+enum Parameters {
+	Time,						/* Milliseconds. */
+	Feedback,
+	Mix,
+	ParameterCount
+};
+
+static const EffectPluginParameter parameters[ParameterCount] = {
+	{ "Time", 10.0f, 1000.0f, 250.0f },
+	{ "Feedback", 0.0f, 0.9f, 0.5f },
+	{ "Mix", 0.0f, 1.0f, 0.5f },
+};
+
+typedef struct Instance {
+	float values[ParameterCount];
+	uint32_t numChannels;
+	double sampleRate;
+	uint32_t ringSize;			/* Samples of the maximum time. */
+	uint32_t position;
+	float* ring;				/* Ring of ringSize samples for each channel. */
+} Instance;
+
+static float clampParameter(uint32_t index, float value)
+{
+	if (value < parameters[index].minValue) return parameters[index].minValue;
+	if (parameters[index].maxValue < value) return parameters[index].maxValue;
+	return value;
+}
+
+static void* create(void)
+{
+	Instance* instance = (Instance*)calloc(1, sizeof(Instance));
+	uint32_t i;
+	if (instance) {
+		for (i = 0; i < ParameterCount; i++) instance->values[i] = parameters[i].defaultValue;
+	}
+	return instance;
+}
+
+static int32_t prepare(void* context, uint32_t numChannels, uint32_t maxFrames, double sampleRate)
+{
+	Instance* instance = (Instance*)context;
+	(void)maxFrames;
+	free(instance->ring);
+	instance->numChannels = numChannels;
+	instance->sampleRate = sampleRate;
+	instance->ringSize = (uint32_t)(parameters[Time].maxValue * sampleRate / 1000) + 1;
+	instance->position = 0;
+	instance->ring = (float*)calloc((size_t)numChannels * instance->ringSize, sizeof(float));
+	return instance->ring ? 0 : -1;
+}
+
+static void process(void* context, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+	Instance* instance = (Instance*)context;
+	const uint32_t time = (uint32_t)(instance->values[Time] * instance->sampleRate / 1000);
+	const float feedback = instance->values[Feedback];
+	const float mix = instance->values[Mix];
+	uint32_t channel, i;
+	for (channel = 0; channel < instance->numChannels; channel++) {
+		float* ring = &instance->ring[channel * instance->ringSize];
+		uint32_t position = instance->position;
+		for (i = 0; i < frames; i++) {
+			uint32_t read = (position < time) ? position + instance->ringSize - time : position - time;
+			float echo = ring[read];
+			ring[position] = inputs[channel][i] + echo * feedback;
+			outputs[channel][i] = inputs[channel][i] + echo * mix;
+			if (++position == instance->ringSize) position = 0;
+		}
+	}
+	instance->position = (uint32_t)((instance->position + frames) % instance->ringSize);
+}
+
+static void setParameter(void* context, uint32_t index, float value)
+{
+	Instance* instance = (Instance*)context;
+	if (index < ParameterCount) instance->values[index] = clampParameter(index, value);
+}
+
+static void destroy(void* context)
+{
+	Instance* instance = (Instance*)context;
+	free(instance->ring);
+	free(instance);
+}
+
+static uint32_t getTailLength(void* context)
+{
+	Instance* instance = (Instance*)context;
+	/* Count of echoes until feedback^n < -60 dB. */
+	const double echoes = ceil(log(0.001) / log(parameters[Feedback].maxValue));
+	return (uint32_t)(echoes * parameters[Time].maxValue * instance->sampleRate / 1000);
+}
+
+static const EffectPluginDescriptor descriptor = {
+	EFFECT_PLUGIN_ABI_VERSION(1, 0),
+	sizeof(EffectPluginDescriptor),
+	"SampleEcho",
+	EffectPluginTail,
+	ParameterCount,
+	parameters,
+	create,
+	prepare,
+	process,
+	setParameter,
+	destroy,
+	NULL,
+	getTailLength,
+};
+
+EFFECT_PLUGIN_EXPORT const EffectPluginDescriptor* getEffectPlugin(uint32_t hostAbiVersion)
+{
+	return (EFFECT_PLUGIN_ABI_MAJOR(hostAbiVersion) == 1) ? &descriptor : NULL;
+}
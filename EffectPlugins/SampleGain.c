@@ -0,0 +1,91 @@
+/*
+	SampleGain: Sample effect plugin that multiplies all channels by gain in dB.
+
+	Processes in place. Gain is smoothed per sample so that changes don't produce zipper noise.
+	See ../DmoEffector/EffectPluginAbi.h for the ABI.
+*/
+
+#include "EffectPluginAbi.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+typedef struct Instance {
+	uint32_t numChannels;
+	float target;				/* Linear gain set by setParameter(). */
+	float gain;					/* Current linear gain. */
+	float coefficient;			/* Smoothing coefficient per sample. */
+} Instance;
+
+static const EffectPluginParameter parameters[] = {
+	{ "Gain", -60.0f, 12.0f, 0.0f },
+};
+
+static void* create(void)
+{
+	Instance* instance = (Instance*)calloc(1, sizeof(Instance));
+	if (instance) instance->target = instance->gain = 1.0f;
+	return instance;
+}
+
+static int32_t prepare(void* context, uint32_t numChannels, uint32_t maxFrames, double sampleRate)
+{
+	Instance* instance = (Instance*)context;
+	(void)maxFrames;
+	instance->numChannels = numChannels;
+	/* Time constant of 5 ms. */
+	instance->coefficient = (float)(1.0 - exp(-1.0 / (0.005 * sampleRate)));
+	instance->gain = instance->target;
+	return 0;
+}
+
+static void process(void* context, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+	Instance* instance = (Instance*)context;
+	uint32_t channel, i;
+	float gain = instance->gain;
+	for (i = 0; i < frames; i++) {
+		gain += (instance->target - gain) * instance->coefficient;
+		for (channel = 0; channel < instance->numChannels; channel++) {
+			outputs[channel][i] = inputs[channel][i] * gain;
+		}
+	}
+	/* Snaps to the target so that constant gain is exact. */
+	instance->gain = (fabsf(instance->target - gain) < 1e-6f) ? instance->target : gain;
+}
+
+static void setParameter(void* context, uint32_t index, float value)
+{
+	Instance* instance = (Instance*)context;
+	if (index == 0) {
+		if (value < parameters[0].minValue) value = parameters[0].minValue;
+		if (parameters[0].maxValue < value) value = parameters[0].maxValue;
+		instance->target = powf(10.0f, value / 20.0f);
+	}
+}
+
+static void destroy(void* context)
+{
+	free(context);
+}
+
+static const EffectPluginDescriptor descriptor = {
+	EFFECT_PLUGIN_ABI_VERSION(1, 0),
+	sizeof(EffectPluginDescriptor),
+	"SampleGain",
+	EffectPluginInPlace,
+	sizeof(parameters) / sizeof(parameters[0]),
+	parameters,
+	create,
+	prepare,
+	process,
+	setParameter,
+	destroy,
+	NULL,
+	NULL,
+};
+
+EFFECT_PLUGIN_EXPORT const EffectPluginDescriptor* getEffectPlugin(uint32_t hostAbiVersion)
+{
+	return (EFFECT_PLUGIN_ABI_MAJOR(hostAbiVersion) == 1) ? &descriptor : NULL;
+}
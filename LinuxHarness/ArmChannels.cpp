@@ -0,0 +1,206 @@
+// ArmChannels.cpp : Checks arming of channels of CAsioHandler while it runs.
+//
+// Usage:
+//   ArmChannels [seconds]
+//
+// CAsioHandler of SetupChannels runs on CLoopbackDriver of MaxChannels channels with 2 channels armed. The channels
+// are re-armed while running, to all channels, to fewer channels, to no channel, which arms SetupChannels, and to all
+// channels again. A new effect chain is published just before each arming, so that the chain swapper holds a pending
+// chain and retired chains when the buffers are re-created. Each arming is run with and without lookahead mode.
+// At last a channel that the driver doesn't have is armed. The engine should stop and refuse to start without
+// buffers, until valid channels are armed again.
+//
+// The effect chain writes the signature of each channel to its output, and the loopback returns it to the input of
+// the same channel. After each arming, the engine should keep switching buffers, process the count of channels armed,
+// and read back the signature of every channel for the seconds. A buffer that the engine drops by an xrun, or
+// discards or outputs as silence in lookahead mode, is not looped back, and the edges of the loopback filter around it
+// don't match. So each of those buffers counted by the engine may cause up to BuffersPerDrop buffers that don't match.
+// Any other buffer should match at every sample. A channel mapped to another device channel or an overrun buffer of
+// the chain doesn't match at any sample.
+
+#include "stdafx.h"
+#include "AsioHandler.h"
+#include "AsioHandlerState.h"
+#include "LoopbackDriver.h"
+
+static const double SampleRate = 48000;
+static const long MaxChannels = 8;
+// Count of channels given to CAsioHandler, which are armed by empty lists.
+static const long SetupChannels = 6;
+static const long BufferSize = 128;
+// Buffers that may not match for each buffer dropped: the buffer itself and the edges of the filter before and after.
+static const long BuffersPerDrop = 3;
+
+// Counters of samples and buffers read back by all chains. Reset before each measurement.
+static std::atomic<LONGLONG> looped[MaxChannels];
+static std::atomic<LONGLONG> mismatched;
+static std::atomic<LONGLONG> mismatchedBuffers;
+static std::atomic<long> processedChannels;
+
+static void resetCounters()
+{
+	for (long channel = 0; channel < MaxChannels; channel++) looped[channel] = 0;
+	mismatched = 0;
+	mismatchedBuffers = 0;
+	processedChannels = 0;
+}
+
+/*
+	Effect that checks the samples looped back and writes the signature of each channel.
+	Signatures are far apart, so that a sample of another channel or of an overrun buffer doesn't match.
+*/
+class CChannelSignatureEffect : public CEffect
+{
+public:
+	virtual LPCTSTR getName() const { return _T("ChannelSignature"); }
+
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		bool isMismatched = false;
+		for (long channel = 0; channel < numChannels; channel++) {
+			const float signature = getSignature(channel);
+			LONGLONG matches = 0;
+			for (long i = 0; i < frames; i++) {
+				if (fabsf(channels[channel][i] - signature) < 0.001f) matches++;
+				channels[channel][i] = signature;
+			}
+			if (channel < MaxChannels) looped[channel] += matches;
+			mismatched += frames - matches;
+			isMismatched |= (matches != frames);
+		}
+		if (isMismatched) mismatchedBuffers++;
+		processedChannels = numChannels;
+	}
+
+	static float getSignature(long channel) { return (float)((channel + 1) * 100); }
+};
+
+static CEffectChain* createEffectChain()
+{
+	CEffectChain* chain = new CEffectChain();
+	chain->addEffect(new CChannelSignatureEffect());
+	return chain;
+}
+
+static LONGLONG getBufferSwitches(const CAsioHandler& handler)
+{
+	return handler.statistics.bufferSwitch[0] + handler.statistics.bufferSwitch[1];
+}
+
+// Count of buffers that the engine has not looped back: dropped by xruns, or discarded or output as silence in lookahead mode.
+static LONGLONG getDroppedBuffers(const CAsioHandler& handler)
+{
+	return handler.statistics.droppedBuffers + handler.statistics.inputOverrun + handler.statistics.outputUnderrun;
+}
+
+static std::vector<long> getChannels(long numChannels)
+{
+	std::vector<long> channels(numChannels);
+	for (long channel = 0; channel < numChannels; channel++) channels[channel] = channel;
+	return channels;
+}
+
+/*
+	Publishes a new chain, arms the channels and checks that the engine processes numChannels for the seconds.
+*/
+static int arm(CAsioHandler& handler, const std::vector<long>& channels, long numChannels, double seconds)
+{
+	HRESULT hr = handler.replaceEffectChain(createEffectChain());
+	if (SUCCEEDED(hr)) hr = handler.armChannels(channels, channels);
+	// Arming is handled by the work queue thread.
+	Sleep(300);
+
+	resetCounters();
+	const LONGLONG switches = getBufferSwitches(handler);
+	const LONGLONG dropped = getDroppedBuffers(handler);
+	Sleep((DWORD)(seconds * 1000));
+	const LONGLONG processed = getBufferSwitches(handler) - switches;
+	// Buffers dropped just after the measurement may have caused mismatches at its end.
+	Sleep(50);
+	const LONGLONG drops = getDroppedBuffers(handler) - dropped;
+
+	LONGLONG minLooped = -1;
+	for (long channel = 0; channel < numChannels; channel++) {
+		if ((minLooped < 0) || (looped[channel] < minLooped)) minLooped = looped[channel];
+	}
+	const bool passed = SUCCEEDED(hr) && (handler.numChannels == numChannels) && (processedChannels == numChannels)
+		&& (seconds * SampleRate / BufferSize / 2 <= processed) && (0 < minLooped) && (mismatchedBuffers <= drops * BuffersPerDrop);
+	printf("%8zu %9ld %9lld %9lld %10lld %8lld %7lld %11zu %10zu  %s\n", channels.size(), (long)processedChannels, (long long)processed,
+		(long long)minLooped, (long long)mismatched, (long long)mismatchedBuffers, (long long)drops,
+		handler.arena.getUsed(), handler.arena.getCapacity(), passed ? "PASS" : "FAIL");
+	if (FAILED(hr)) printf("Failed to arm %ld channels: HRESULT=0x%08x\n", numChannels, hr);
+	return passed ? 0 : 1;
+}
+
+/*
+	Arms a channel that the driver doesn't have, and checks that the engine stops and doesn't start without buffers.
+	Then arms valid channels in standby, starts the engine and checks it.
+*/
+static int recover(CAsioHandler& handler, double seconds)
+{
+	handler.armChannels(getChannels(MaxChannels + 1), getChannels(MaxChannels + 1));
+	Sleep(300);
+	// Start should fail in the work queue thread instead of starting the driver without buffers.
+	handler.start();
+	Sleep(300);
+	const LONGLONG switches = getBufferSwitches(handler);
+	Sleep(100);
+	const bool isStopped = (getBufferSwitches(handler) == switches) && (handler.currentState->type == CAsioHandlerState::Types::Standby);
+	printf("%8ld arming a channel that the driver doesn't have: %s  %s\n", MaxChannels + 1,
+		isStopped ? "Stopped" : "Running", isStopped ? "PASS" : "FAIL");
+
+	handler.armChannels(getChannels(2), getChannels(2));
+	Sleep(300);
+	handler.start();
+	Sleep(200);
+	return (isStopped ? 0 : 1) + arm(handler, getChannels(2), 2, seconds);
+}
+
+static int run(long lookaheadBuffers, double seconds)
+{
+	CComPtr<IASIO> driver;
+	driver.Attach(new CLoopbackDriver(MaxChannels, BufferSize, SampleRate));
+	std::unique_ptr<CAsioHandler> handler(new CAsioHandler(SetupChannels));
+	const std::vector<long> channels = { 0, 1 };
+	handler->armChannels(channels, channels);
+
+	// Setup and start are handled by the work queue thread.
+	HRESULT hr = handler->setup(driver, NULL, lookaheadBuffers, createEffectChain());
+	Sleep(200);
+	if (SUCCEEDED(hr)) hr = handler->start();
+	Sleep(200);
+	if (FAILED(hr) || !getBufferSwitches(*handler)) {
+		printf("Failed to start: HRESULT=0x%08x\n", hr);
+		return 1;
+	}
+
+	printf("Lookahead %ld buffer(s)\n", lookaheadBuffers);
+	printf("Channels Processed  Switches    Looped       Mismatched Dropped  Arena used   Capacity\n");
+	printf("   armed  channels            (minimum)    (smp)    (buf)   (buf)     (bytes)    (bytes)\n");
+	int failures = 0;
+	const long armings[] = { 2, MaxChannels, MaxChannels / 2, 0, MaxChannels };
+	for (long numChannels : armings) {
+		failures += arm(*handler, getChannels(numChannels), numChannels ? numChannels : SetupChannels, seconds);
+	}
+	failures += recover(*handler, seconds);
+
+	handler->stop();
+	Sleep(100);
+	handler->shutdown();
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = (1 < argc) ? atof(argv[1]) : 1;
+	if (seconds <= 0) {
+		printf("Usage: ArmChannels [seconds]\n");
+		return 2;
+	}
+
+	printf("%ld channels of %ld frames at %.0f Hz, %.1f s per arming\n", MaxChannels, BufferSize, SampleRate, seconds);
+	int failures = 0;
+	for (long lookaheadBuffers = 0; lookaheadBuffers <= 1; lookaheadBuffers++) {
+		failures += run(lookaheadBuffers, seconds);
+	}
+	return failures;
+}
@@ -0,0 +1,118 @@
+// ChainSwap.cpp : Checks that chains replaced by CEffectChainSwapper are not deleted while another thread reads them.
+//
+// Usage:
+//   ChainSwap [seconds]
+//
+// The control thread publishes chains for the seconds. Most chains are published twice in a row without
+// process() between them, so that the first one is discarded without being used. Some are taken by process()
+// and retired as the real-time thread does. Meanwhile reader threads take the chain published last through
+// CEffectChainSwapper::Latest, as the work queue thread gets the latency, and read its effect for a while.
+//
+// The effect clears its mark when it is deleted, so a reader that reads a deleted chain sees no mark
+// (or AddressSanitizer reports it if built with -fsanitize=address). At last all chains should have been deleted.
+
+#include "stdafx.h"
+#include "EffectChainSwapper.h"
+
+#include <chrono>
+#include <thread>
+
+static const long NumChannels = 2;
+static const long BufferSize = 64;
+static const double SampleRate = 48000;
+static const long NumReaders = 2;
+// Times a reader reads the mark of the chain taken.
+static const long ReadsPerChain = 1000;
+
+static const long AliveMark = 0x600dc0de;
+static std::atomic<long> liveEffects;
+
+/*
+	Effect that marks itself alive until it is deleted.
+*/
+class CMarkedEffect : public CEffect
+{
+public:
+	CMarkedEffect() : m_mark(AliveMark) { liveEffects++; }
+	virtual ~CMarkedEffect() { m_mark = 0; liveEffects--; }
+
+	virtual LPCTSTR getName() const { return _T("Marked"); }
+	virtual void process(float* const* /*channels*/, long /*numChannels*/, long /*frames*/) {}
+
+	bool isAlive() const { return m_mark.load(std::memory_order_relaxed) == AliveMark; }
+
+protected:
+	std::atomic<long> m_mark;
+};
+
+static CEffectChain* createEffectChain()
+{
+	std::unique_ptr<CEffectChain> chain(new CEffectChain());
+	if (FAILED(HR_EXPECT_OK(chain->addEffect(new CMarkedEffect())))) return NULL;
+	if (FAILED(HR_EXPECT_OK(chain->prepare(NumChannels, BufferSize, SampleRate, ASIOSTFloat32LSB)))) return NULL;
+	return chain.release();
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = (1 < argc) ? atof(argv[1]) : 2;
+	if (seconds <= 0) {
+		printf("Usage: ChainSwap [seconds]\n");
+		return 2;
+	}
+
+	std::unique_ptr<CEffectChainSwapper> swapper(new CEffectChainSwapper());
+	if (FAILED(swapper->initialize(createEffectChain())) || FAILED(swapper->prepare(BufferSize))) {
+		printf("Failed to initialize\n");
+		return 1;
+	}
+
+	std::atomic<bool> isRunning(true);
+	std::atomic<LONGLONG> reads(0), deadReads(0);
+	std::vector<std::thread> readers;
+	for (long i = 0; i < NumReaders; i++) {
+		readers.emplace_back([&]() {
+			while (isRunning) {
+				CEffectChainSwapper::Latest latest(*swapper);
+				const CMarkedEffect* effect = (const CMarkedEffect*)latest->getEffect(0);
+				for (long read = 0; read < ReadsPerChain; read++) {
+					if (!effect->isAlive()) deadReads++;
+				}
+				reads++;
+			}
+		});
+	}
+
+	std::vector<float> buffers(NumChannels * 2 * BufferSize);
+	std::vector<void*> inputs(NumChannels), outputs(NumChannels);
+	for (long channel = 0; channel < NumChannels; channel++) {
+		inputs[channel] = &buffers[channel * BufferSize];
+		outputs[channel] = &buffers[(NumChannels + channel) * BufferSize];
+	}
+
+	LONGLONG published = 0, processed = 0;
+	HRESULT hr = S_OK;
+	const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds((long)(seconds * 1000));
+	while (SUCCEEDED(hr) && (std::chrono::steady_clock::now() < end)) {
+		// The first chain is discarded by the second publish() without being used.
+		hr = swapper->publish(createEffectChain());
+		if (SUCCEEDED(hr)) hr = swapper->publish(createEffectChain());
+		published += 2;
+		// Every 4th time the real-time thread takes the chain and retires the current chain.
+		if (!(published % 8)) {
+			swapper->process(&inputs[0], &outputs[0], BufferSize);
+			processed++;
+		}
+	}
+	isRunning = false;
+	for (std::thread& reader : readers) reader.join();
+	const long swaps = swapper->getSwapCount();
+	swapper.reset();
+
+	const bool passed = SUCCEEDED(hr) && reads && !deadReads && (swaps == processed) && !liveEffects;
+	printf("Published %lld chains, %ld taken by process(), %lld chains read by %ld threads\n",
+		(long long)published, swaps, (long long)reads, NumReaders);
+	printf("Reads of deleted chains: %lld, Chains not deleted: %ld  %s\n", (long long)deadReads, (long)liveEffects, passed ? "PASS" : "FAIL");
+	if (FAILED(hr)) printf("Failed to publish: HRESULT=0x%08x\n", hr);
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+// ClockBridgeDrift.cpp : Checks that the FIFO level of CClockBridge converges between two drifting clocks.
+//
+// Usage:
+//   ClockBridgeDrift [minutes]
+//
+// The producer and the consumer are driven by simulated clocks whose rates are off by some ppm in opposite
+// directions, with random jitter of the callbacks. Time is simulated, so an hour runs in seconds and the result
+// is the same on every run.
+//
+// The fill level of the FIFO is sampled at every read. From SettleSeconds to the end of the run, its mean should be
+// within MaxFillError frames of the target, its deviation from the mean should be small, and the correction of
+// the resampler should be within MaxCorrectionError ppm of the actual ratio of the clocks.
+// No underrun or overflow is allowed after the FIFO has been primed.
+//
+// The mean correction differs from the ratio by the change of the fill level over the time averaged, divided by
+// the time. Runs shorter than MinMinutes don't average long enough for MaxCorrectionError, so they are refused.
+
+#include "stdafx.h"
+#include "ClockBridge.h"
+
+#include <random>
+
+static const double JitterSeconds = 0.002;
+static const double MaxFillError = 4;
+static const double MaxCorrectionError = 2;
+// Time for the loop to settle: several times its time constant of 1 / (LoopDamping * 2 * Pi * LoopFrequency) = 10 s.
+static const double SettleSeconds = 30;
+static const double MinMinutes = 2;
+
+struct Case {
+	double inputRate;
+	double outputRate;
+	long inputFrames;
+	long outputFrames;
+	double inputPpm;		// Error of the producer clock.
+	double outputPpm;		// Error of the consumer clock.
+};
+
+static const Case cases[] = {
+	{ 48000, 48000, 256, 480, 0, 0 },
+	{ 48000, 48000, 256, 480, 150, -150 },
+	{ 48000, 48000, 256, 480, -300, 200 },
+	{ 48000, 48000, 128, 441, 500, -500 },
+	{ 48000, 44100, 256, 441, 100, -100 },
+	{ 44100, 48000, 512, 480, -100, 100 },
+};
+
+static int check(const Case& c, double seconds)
+{
+	CClockBridge bridge;
+	if (FAILED(bridge.initialize(1, c.inputRate, c.outputRate, c.inputFrames, c.outputFrames))) {
+		printf("Failed to initialize\n");
+		return 1;
+	}
+
+	std::vector<float> input(c.inputFrames), output(c.outputFrames);
+	const float* inputs[] = { &input[0] };
+	float* outputs[] = { &output[0] };
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> jitter(0, JitterSeconds);
+
+	// Callbacks are due at multiples of the period of each clock, delayed by jitter.
+	const double inputPeriod = c.inputFrames / (c.inputRate * (1 + c.inputPpm * 1e-6));
+	const double outputPeriod = c.outputFrames / (c.outputRate * (1 + c.outputPpm * 1e-6));
+	LONGLONG writes = 0, reads = 0;
+	double nextWrite = 0, nextRead = outputPeriod;
+	LONGLONG position = 0;
+	long primingUnderruns = -1;
+
+	const double settled = SettleSeconds;
+	double fillSum = 0, fillSquareSum = 0, correctionSum = 0;
+	LONGLONG samples = 0;
+	while (min(nextWrite, nextRead) < seconds) {
+		if (nextWrite <= nextRead) {
+			for (long i = 0; i < c.inputFrames; i++) input[i] = (float)(0.5 * sin(2 * M_PI * 1000 * (position + i) / c.inputRate));
+			position += c.inputFrames;
+			bridge.write(inputs, c.inputFrames);
+			nextWrite = ++writes * inputPeriod + jitter(random);
+		} else {
+			bridge.read(outputs, c.outputFrames);
+			nextRead = ++reads * outputPeriod + jitter(random);
+			// Underruns counted until the first output are of priming.
+			if ((primingUnderruns < 0) && (output[c.outputFrames - 1] != 0)) primingUnderruns = bridge.getUnderruns();
+			if (settled <= nextRead) {
+				fillSum += bridge.getFill();
+				fillSquareSum += bridge.getFill() * bridge.getFill();
+				correctionSum += bridge.getCorrectionPpm();
+				samples++;
+			}
+		}
+	}
+
+	const double fill = fillSum / samples;
+	const double deviation = sqrt(max(0.0, fillSquareSum / samples - fill * fill));
+	const double correction = correctionSum / samples;
+	const double expected = ((1 + c.inputPpm * 1e-6) / (1 + c.outputPpm * 1e-6) - 1) * 1e6;
+	const long underruns = bridge.getUnderruns() - max(0L, primingUnderruns);
+	const bool passed = (fabs(fill - bridge.getTargetFill()) <= MaxFillError) && (deviation <= c.inputFrames)
+		&& (fabs(correction - expected) <= MaxCorrectionError) && !underruns && !bridge.getOverflows();
+	printf("%5.0f %5.0f %5ld %5ld %+5.0f %+5.0f %6ld %8.1f %6.1f %+8.1f %+8.1f %5ld %5ld  %s\n",
+		c.inputRate, c.outputRate, c.inputFrames, c.outputFrames, c.inputPpm, c.outputPpm,
+		bridge.getTargetFill(), fill, deviation, correction, expected, underruns, bridge.getOverflows(), passed ? "PASS" : "FAIL");
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	const double minutes = (1 < argc) ? atof(argv[1]) : 20;
+	if (minutes < MinMinutes) {
+		printf("Usage: ClockBridgeDrift [minutes]\n");
+		printf("       Minutes should be %.0f or more.\n", MinMinutes);
+		return 2;
+	}
+
+	printf("%.1f minutes per case, Jitter up to %.1f ms. Fill and correction are averaged after %.0f s.\n", minutes, JitterSeconds * 1000, SettleSeconds);
+	printf("   In   Out    In   Out    In   Out Target     Fill  Fill  Correct  Expect Under  Over\n");
+	printf(" (Hz)  (Hz) (smp) (smp) (ppm) (ppm)  (smp)    (smp)    SD    (ppm)   (ppm)\n");
+	int failures = 0;
+	for (const Case& c : cases) {
+		failures += check(c, minutes * 60);
+	}
+	return failures;
+}
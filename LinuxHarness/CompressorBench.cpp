@@ -0,0 +1,245 @@
+// CompressorBench.cpp : Measures the SSE kernels of CCompressorEffect against scalar references.
+//
+// Usage:
+//   CompressorBench [buffer size] [seconds]
+//
+// Each kernel of VectorOps.h used by the compressor is run on the same buffer as a scalar loop
+// with the C library, and the time per sample and the maximum difference between them are printed.
+// The whole effect is compared with a scalar reference of the same algorithm: sliding window maximum
+// by std::deque, gain by log10f() and powf(), release by one-pole filter and average over the window.
+//
+// The effect detects level from a sidechain channel and its main channel is 1.0,
+// so that the main channel output is the gain of the effect once the delay line is filled.
+
+#include "stdafx.h"
+#include "CompressorEffect.h"
+#include "VectorOps.h"
+
+#include <deque>
+#include <random>
+
+static const double SampleRate = 48000;
+static const long LookaheadFrames = 48;
+static const float Threshold = -20.0f;
+static const float Ratio = 4.0f;
+static const float Release = 100.0f;
+
+static LONGLONG getTime()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+// Keeps results of the loops measured from being optimized away.
+static volatile float sink;
+
+/*
+	Returns nanoseconds per sample of process() called repeatedly for the seconds.
+*/
+template<class Process>
+static double measure(Process process, long frames, double seconds)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const LONGLONG start = getTime();
+	const LONGLONG end = start + (LONGLONG)(seconds * frequency.QuadPart);
+	LONGLONG runs = 0;
+	LONGLONG now;
+	do {
+		for (int i = 0; i < 100; i++) process();
+		runs += 100;
+		now = getTime();
+	} while (now < end);
+	return (now - start) * 1e9 / frequency.QuadPart / ((double)runs * frames);
+}
+
+static void printRow(const char* name, double sse, double scalar, double difference)
+{
+	printf("%-22s %8.2f %8.2f %7.2fx %10.2e\n", name, sse, scalar, scalar / sse, difference);
+}
+
+/*
+	Scalar reference of CCompressorEffect in Compressor mode with constant parameters.
+	Writes the gain of each sample of the detected channel to gain.
+*/
+class CReferenceCompressor
+{
+public:
+	CReferenceCompressor(long lookahead)
+		: m_window(lookahead + 1), m_position(0), m_released(1.0f), m_average(lookahead + 1, 1.0f), m_averageIndex(0), m_averageSum(lookahead + 1)
+		, m_coefficient((float)exp(-1000.0 / (Release * SampleRate)))
+	{
+	}
+
+	void process(const float* detected, float* gain, long frames)
+	{
+		for (long i = 0; i < frames; i++, m_position++) {
+			const float level = fabsf(detected[i]);
+			while (!m_peaks.empty() && (m_peaks.back().second <= level)) m_peaks.pop_back();
+			m_peaks.push_back(std::make_pair(m_position, level));
+			while (m_peaks.front().first <= m_position - m_window) m_peaks.pop_front();
+
+			const float over = max(0.0f, 20 * log10f(max(m_peaks.front().second, 1e-9f)) - Threshold);
+			const float target = powf(10.0f, (1 / Ratio - 1) * over / 20);
+			m_released = (target < m_released) ? target : target + m_coefficient * (m_released - target);
+
+			m_averageSum += m_released - m_average[m_averageIndex];
+			m_average[m_averageIndex] = m_released;
+			if (++m_averageIndex == m_window) m_averageIndex = 0;
+			gain[i] = (float)(m_averageSum / m_window);
+		}
+	}
+
+private:
+	const long m_window;
+	LONGLONG m_position;
+	std::deque<std::pair<LONGLONG, float>> m_peaks;
+	float m_released;
+	std::vector<float> m_average;
+	long m_averageIndex;
+	double m_averageSum;
+	const float m_coefficient;
+};
+
+static void benchmarkKernels(const std::vector<float>& signal, long frames, double seconds)
+{
+	std::vector<float> sse(frames), scalar(frames);
+
+	// Levels from -120 dB to +20 dB, as the compressor passes to log2Ps().
+	std::vector<float> levels(frames);
+	for (long i = 0; i < frames; i++) levels[i] = powf(10.0f, (-120.0f + 140.0f * i / frames) / 20);
+	double difference = 0;
+	auto log2Sse = [&]() {
+		for (long i = 0; i + 4 <= frames; i += 4) _mm_storeu_ps(&sse[i], log2Ps(_mm_loadu_ps(&levels[i])));
+		sink = sse[0];
+	};
+	auto log2Scalar = [&]() {
+		for (long i = 0; i < frames; i++) scalar[i] = log2f(levels[i]);
+		sink = scalar[0];
+	};
+	log2Sse();
+	log2Scalar();
+	for (long i = 0; i + 4 <= frames; i += 4) {
+		for (long k = 0; k < 4; k++) difference = max(difference, (double)fabsf(sse[i + k] - scalar[i + k]));
+	}
+	printRow("log2Ps / log2f", measure(log2Sse, frames, seconds), measure(log2Scalar, frames, seconds), difference);
+
+	// Exponents of gain reduction from 0 to -40 dB in log2.
+	std::vector<float> exponents(frames);
+	for (long i = 0; i < frames; i++) exponents[i] = -6.64f * i / frames;
+	difference = 0;
+	auto exp2Sse = [&]() {
+		for (long i = 0; i + 4 <= frames; i += 4) _mm_storeu_ps(&sse[i], exp2Ps(_mm_loadu_ps(&exponents[i])));
+		sink = sse[0];
+	};
+	auto exp2Scalar = [&]() {
+		for (long i = 0; i < frames; i++) scalar[i] = exp2f(exponents[i]);
+		sink = scalar[0];
+	};
+	exp2Sse();
+	exp2Scalar();
+	for (long i = 0; i + 4 <= frames; i += 4) {
+		for (long k = 0; k < 4; k++) difference = max(difference, (double)fabsf(sse[i + k] / scalar[i + k] - 1));
+	}
+	printRow("exp2Ps / exp2f (rel)", measure(exp2Sse, frames, seconds), measure(exp2Scalar, frames, seconds), difference);
+
+	auto maxAbsSse = [&]() {
+		vecClear(&sse[0], frames);
+		vecMaxAbsAccumulate(&sse[0], &signal[0], frames);
+		vecMaxAbsAccumulate(&sse[0], &signal[frames], frames);
+		sink = sse[0];
+	};
+	auto maxAbsScalar = [&]() {
+		for (long i = 0; i < frames; i++) scalar[i] = max(fabsf(signal[i]), fabsf(signal[frames + i]));
+		sink = scalar[0];
+	};
+	maxAbsSse();
+	maxAbsScalar();
+	difference = 0;
+	for (long i = 0; i < frames; i++) difference = max(difference, (double)fabsf(sse[i] - scalar[i]));
+	printRow("vecMaxAbsAccumulate", measure(maxAbsSse, frames * 2, seconds), measure(maxAbsScalar, frames * 2, seconds), difference);
+
+	// The true peak filter of the limiter: 8 taps of multiply-add.
+	auto filterSse = [&]() {
+		vecClear(&sse[0], frames);
+		for (long k = 0; k < CCompressorEffect::TruePeakTaps; k++) vecMultiplyAdd(&sse[0], &signal[k], 0.125f, frames);
+		sink = sse[0];
+	};
+	auto filterScalar = [&]() {
+		for (long i = 0; i < frames; i++) {
+			float sum = 0;
+			for (long k = 0; k < CCompressorEffect::TruePeakTaps; k++) sum += signal[i + k] * 0.125f;
+			scalar[i] = sum;
+		}
+		sink = scalar[0];
+	};
+	filterSse();
+	filterScalar();
+	difference = 0;
+	for (long i = 0; i < frames; i++) difference = max(difference, (double)fabsf(sse[i] - scalar[i]));
+	printRow("vecMultiplyAdd x 8", measure(filterSse, frames, seconds), measure(filterScalar, frames, seconds), difference);
+}
+
+static int benchmarkEffect(const std::vector<float>& signal, long frames, double seconds)
+{
+	CCompressorEffect effect(CCompressorEffect::Mode::Compressor, LookaheadFrames / SampleRate, 1);
+	effect.getParameter(CCompressorEffect::Threshold)->setValue(Threshold);
+	effect.getParameter(CCompressorEffect::Ratio)->setValue(Ratio);
+	effect.getParameter(CCompressorEffect::Release)->setValue(Release);
+	if (FAILED(effect.prepare(2, frames, SampleRate))) {
+		printf("Failed to prepare the effect\n");
+		return 1;
+	}
+	CReferenceCompressor reference(LookaheadFrames);
+
+	// The signal is 2 buffers long and played repeatedly.
+	std::vector<float> main(frames), sidechain(frames), gain(frames);
+	float* channels[] = { &main[0], &sidechain[0] };
+	LONGLONG position = 0;
+	double difference = 0;
+	for (long buffer = 0; buffer < 1000; buffer++, position += frames) {
+		std::fill(main.begin(), main.end(), 1.0f);
+		std::copy(&signal[(buffer % 2) * frames], &signal[(buffer % 2 + 1) * frames], sidechain.begin());
+		effect.renderParameters(position, frames);
+		effect.process(channels, 2, frames);
+		reference.process(&sidechain[0], &gain[0], frames);
+		for (long i = 0; (i < frames) && buffer; i++) difference = max(difference, (double)fabsf(main[i] - gain[i]));
+	}
+
+	LONGLONG effectPosition = position;
+	const double effectTime = measure([&]() {
+		effect.renderParameters(effectPosition, frames);
+		effect.process(channels, 2, frames);
+		effectPosition += frames;
+		sink = main[0];
+	}, frames, seconds);
+	const double referenceTime = measure([&]() {
+		reference.process(&sidechain[0], &gain[0], frames);
+		sink = gain[0];
+	}, frames, seconds);
+	printRow("Compressor effect", effectTime, referenceTime, difference);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	const long frames = (1 < argc) ? atol(argv[1]) : 256;
+	const double seconds = (2 < argc) ? atof(argv[2]) : 0.5;
+	if ((frames < 4) || (seconds <= 0)) {
+		printf("Usage: CompressorBench [buffer size] [seconds]\n");
+		return 2;
+	}
+
+	// Noise at -14 dB with bursts at 0 dB, which crosses the threshold.
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+	std::vector<float> signal(frames * 2 + CCompressorEffect::TruePeakTaps);
+	for (size_t i = 0; i < signal.size(); i++) signal[i] = noise(random) * (((i / 64) % 4) ? 0.2f : 1.0f);
+
+	printf("%ld frames at %.0f Hz, Lookahead %ld frames, %.1f s per measurement\n", frames, SampleRate, LookaheadFrames, seconds);
+	printf("Kernel                      SSE   Scalar  Speedup  Max diff\n");
+	printf("                       (ns/smp) (ns/smp)\n");
+	benchmarkKernels(signal, frames, seconds);
+	return benchmarkEffect(signal, frames, seconds);
+}
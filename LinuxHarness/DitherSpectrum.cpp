@@ -0,0 +1,299 @@
+// DitherSpectrum.cpp : Checks the spectrum of dither of CSampleConverter and its conversions to integer types.
+//
+// Usage:
+//   DitherSpectrum [seconds]
+//
+// A sine of SineLsb LSB is converted by fromFloat() with each DitherShape to the integer types of 16 to 24 bits,
+// by buffers of BufferSize frames that is not a multiple of 4 so that the last samples of each buffer are also
+// quantized. The total error is the output minus the input in LSB. With TPDF dither it is the dither and the rounding
+// of 1/4 LSB^2 in total, white and independent of the signal, shaped by the noise transfer function
+// 1 - (h0 z^-1 + h1 z^-2 + h2 z^-3) of the error feedback. The power of each band of its spectrum, averaged over
+// segments of FftSize frames, should be within MaxBandErrorDb of 1/4 |NTF|^2, and it should not be correlated
+// with the sine.
+//
+// Then a sine near full scale and values over full scale are converted to every integer type of little endian with
+// each shape. Outputs should be within the rounding, or the shaped dither, of the input saturated to the type.
+// Int32LSB is not dithered and should be the same with and without a dither state, and its maximum should be
+// 2147483520, the maximum float below 2^31. At last, big endian types should be the bytes of little endian types
+// swapped, with the same dither.
+
+#include "stdafx.h"
+#include "SampleConverter.h"
+#include "Fft.h"
+
+typedef CSampleConverter::DitherShape DitherShape;
+
+static const double SampleRate = 48000;
+static const double SineFrequency = 997;
+// Amplitude of the sine of the spectrum check, so that rounding alone would be correlated with it.
+static const double SineLsb = 100;
+static const long BufferSize = 1003;
+static const long FftSize = 1024;
+static const long Bands = 6;
+static const double MaxBandErrorDb = 0.5;
+static const double MaxCorrelation = 0.01;
+// Maximum float below 2^31, the maximum of Int32LSB.
+static const double MaxInt32 = 2147483520.0;
+
+// Error feedback filter of each DitherShape, the same as SampleConverter.cpp.
+static const double shapingFilters[][3] = {
+	{ 0, 0, 0 },				// None
+	{ 0, 0, 0 },				// Tpdf
+	{ 1.0, 0, 0 },				// FirstOrder
+	{ 1.623, -0.982, 0.109 },	// Weighted
+};
+
+static const DitherShape shapes[] = { DitherShape::None, DitherShape::Tpdf, DitherShape::FirstOrder, DitherShape::Weighted };
+
+struct TypeCase {
+	const char* name;
+	ASIOSampleType type;
+	long bits;
+	long sampleSize;
+	bool isDithered;
+};
+
+static const TypeCase lsbTypes[] = {
+	{ "Int16LSB", ASIOSTInt16LSB, 16, 2, true },
+	{ "Int24LSB", ASIOSTInt24LSB, 24, 3, true },
+	{ "Int32LSB16", ASIOSTInt32LSB16, 16, 4, true },
+	{ "Int32LSB20", ASIOSTInt32LSB20, 20, 4, true },
+	{ "Int32LSB24", ASIOSTInt32LSB24, 24, 4, true },
+	{ "Int32LSB", ASIOSTInt32LSB, 32, 4, false },
+};
+
+// Big endian type and the little endian type of the same samples.
+static const struct { const char* name; ASIOSampleType type; const TypeCase& lsb; } msbTypes[] = {
+	{ "Int16MSB", ASIOSTInt16MSB, lsbTypes[0] },
+	{ "Int24MSB", ASIOSTInt24MSB, lsbTypes[1] },
+	{ "Int32MSB24", ASIOSTInt32MSB24, lsbTypes[4] },
+	{ "Int32MSB", ASIOSTInt32MSB, lsbTypes[5] },
+};
+
+/*
+	Converts the input by buffers of BufferSize frames with the dither.
+*/
+static std::vector<BYTE> convert(const CSampleConverter& converter, long sampleSize, CSampleConverter::Dither& dither, const std::vector<float>& input)
+{
+	const long frames = (long)input.size();
+	std::vector<BYTE> output(frames * sampleSize);
+	for (long i = 0; i < frames; i += BufferSize) {
+		converter.fromFloat(&input[i], &output[i * sampleSize], min(BufferSize, frames - i), dither);
+	}
+	return output;
+}
+
+/*
+	Returns the sample of little endian integer at the index, in LSB.
+*/
+static double readSample(const std::vector<BYTE>& samples, long sampleSize, long index)
+{
+	const BYTE* p = &samples[index * sampleSize];
+	switch (sampleSize) {
+	case 2: return (short)(p[0] | (p[1] << 8));
+	case 3: return (INT32)((p[0] << 8) | (p[1] << 16) | ((UINT32)p[2] << 24)) >> 8;
+	default: return (INT32)(p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32)p[3] << 24));
+	}
+}
+
+static double getScale(const TypeCase& c) { return ldexp(1.0, c.bits - 1); }
+static double getMaxValue(const TypeCase& c) { return (c.bits <= 24) ? (getScale(c) - 1) : MaxInt32; }
+
+/*
+	Returns |NTF|^2 of the shape at the normalized angular frequency.
+*/
+static double getNoiseGain(DitherShape shape, double omega)
+{
+	const double* h = shapingFilters[shape];
+	double re = 1, im = 0;
+	for (int k = 0; k < 3; k++) {
+		re -= h[k] * cos(omega * (k + 1));
+		im += h[k] * sin(omega * (k + 1));
+	}
+	return re * re + im * im;
+}
+
+/*
+	Returns power of the error averaged over Hann windowed segments of FftSize frames, in LSB^2 per bin.
+	Power of white noise of variance v is v in every bin.
+*/
+static std::vector<double> getPowerSpectrum(const std::vector<float>& error)
+{
+	CFft fft;
+	fft.initialize(FftSize);
+	std::vector<float> window(FftSize), segment(FftSize), re(fft.getBinCount()), im(fft.getBinCount());
+	double windowPower = 0;
+	for (long i = 0; i < FftSize; i++) {
+		window[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / FftSize));
+		windowPower += window[i] * window[i];
+	}
+	std::vector<double> power(fft.getBinCount());
+	const long segments = (long)error.size() / FftSize;
+	for (long s = 0; s < segments; s++) {
+		for (long i = 0; i < FftSize; i++) segment[i] = error[s * FftSize + i] * window[i];
+		fft.forwardReal(&segment[0], &re[0], &im[0]);
+		for (long k = 0; k < fft.getBinCount(); k++) power[k] += (re[k] * re[k] + im[k] * im[k]) / (windowPower * segments);
+	}
+	return power;
+}
+
+/*
+	Converts the sine to the type with dither of the shape and checks the spectrum of the error.
+*/
+static int checkSpectrum(const TypeCase& c, DitherShape shape, double seconds)
+{
+	const double scale = getScale(c);
+	std::vector<float> input((size_t)(seconds * SampleRate));
+	for (size_t i = 0; i < input.size(); i++) {
+		input[i] = (float)(SineLsb / scale * sin(2 * M_PI * SineFrequency * i / SampleRate));
+	}
+	CSampleConverter converter;
+	CSampleConverter::Dither dither;
+	converter.initialize(c.type);
+	dither.initialize(shape, 1);
+	const std::vector<BYTE> output = convert(converter, c.sampleSize, dither, input);
+
+	std::vector<float> error(input.size());
+	double errorPower = 0, product = 0, sinePower = 0;
+	for (long i = 0; i < (long)input.size(); i++) {
+		const double x = input[i] * scale;
+		const double e = readSample(output, c.sampleSize, i) - x;
+		error[i] = (float)e;
+		errorPower += e * e;
+		product += e * x;
+		sinePower += x * x;
+	}
+	errorPower /= input.size();
+	const double correlation = product / sqrt(errorPower * input.size() * sinePower);
+
+	// Dither and rounding of 1/4 LSB^2 shaped by NTF.
+	const double* h = shapingFilters[shape];
+	const double expectedPower = 0.25 * (1 + h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+	const std::vector<double> power = getPowerSpectrum(error);
+	const long halfSize = FftSize / 2;
+	bool passed = (fabs(10 * log10(errorPower / expectedPower)) <= MaxBandErrorDb) && (fabs(correlation) <= MaxCorrelation);
+	printf("%-10s %-10s %6.3f %6.3f ", c.name, shape.toString(), errorPower, expectedPower);
+	for (long band = 0; band < Bands; band++) {
+		double measured = 0, expected = 0;
+		const long first = max(1L, band * halfSize / Bands), last = (band + 1) * halfSize / Bands;
+		for (long k = first; k < last; k++) {
+			measured += power[k];
+			expected += 0.25 * getNoiseGain(shape, 2 * M_PI * k / FftSize);
+		}
+		const double errorDb = 10 * log10(measured / expected);
+		if (!(fabs(errorDb) <= MaxBandErrorDb)) passed = false;
+		printf(" %+5.2f", errorDb);
+	}
+	printf(" %+7.4f  %s\n", correlation, passed ? "PASS" : "FAIL");
+	return passed ? 0 : 1;
+}
+
+/*
+	Returns a sine of 0.9 full scale followed by values of full scale and over, in buffers of constant values.
+*/
+static std::vector<float> createLoudInput()
+{
+	std::vector<float> input(BufferSize * 8);
+	for (long i = 0; i < BufferSize * 4; i++) input[i] = (float)(0.9 * sin(2 * M_PI * SineFrequency * i / SampleRate));
+	const float values[] = { 1.0f, -1.0f, 1.5f, -1.5f };
+	for (int n = 0; n < 4; n++) {
+		std::fill(input.begin() + (4 + n) * BufferSize, input.begin() + (5 + n) * BufferSize, values[n]);
+	}
+	return input;
+}
+
+/*
+	Converts the loud input to the type with the shape and checks that outputs are the input saturated to the type,
+	within the rounding if not dithered, or within the shaped errors otherwise. Each error is the dither and the
+	rounding of 1.5 LSB at most, and the rounding of the target in float of 0.5 LSB at full scale of 24 bits.
+*/
+static int checkSaturation(const TypeCase& c, DitherShape shape)
+{
+	const double scale = getScale(c), maxValue = getMaxValue(c);
+	const std::vector<float> input = createLoudInput();
+	CSampleConverter converter;
+	CSampleConverter::Dither dither, noDither;
+	converter.initialize(c.type);
+	dither.initialize(shape, 2);
+	const std::vector<BYTE> output = convert(converter, c.sampleSize, dither, input);
+	const std::vector<BYTE> undithered = convert(converter, c.sampleSize, noDither, input);
+
+	const bool isDithered = c.isDithered && (shape != DitherShape::None);
+	const double* h = shapingFilters[shape];
+	const double maxError = isDithered ? 2 * (1 + fabs(h[0]) + fabs(h[1]) + fabs(h[2])) : 0.5;
+	double error = 0, minOutput = 0, maxOutput = 0;
+	for (long i = 0; i < (long)input.size(); i++) {
+		const double y = readSample(output, c.sampleSize, i);
+		error = max(error, fabs(y - max(-scale, min(maxValue, input[i] * scale))));
+		minOutput = min(minOutput, y);
+		maxOutput = max(maxOutput, y);
+	}
+	// Type that is not dithered should ignore the dither state.
+	const bool isSame = (output == undithered);
+	const bool passed = (error <= maxError) && (minOutput == -scale) && (maxValue - (isDithered ? 1 : 0) <= maxOutput)
+		&& (maxOutput <= maxValue) && (isDithered || isSame);
+	printf("%-10s %-10s %12.0f %12.0f %12.0f %6.2f %6.2f %-4s  %s\n", c.name, shape.toString(), minOutput, maxOutput, maxValue,
+		error, maxError, isSame ? "yes" : "no", passed ? "PASS" : "FAIL");
+	return passed ? 0 : 1;
+}
+
+/*
+	Converts the loud input to the big endian type and to its little endian type with the same dither,
+	and checks that the bytes of each sample are reversed.
+*/
+static int checkByteOrder(const char* name, ASIOSampleType type, const TypeCase& lsb, DitherShape shape)
+{
+	const std::vector<float> input = createLoudInput();
+	CSampleConverter msbConverter, lsbConverter;
+	CSampleConverter::Dither msbDither, lsbDither;
+	msbConverter.initialize(type);
+	lsbConverter.initialize(lsb.type);
+	msbDither.initialize(shape, 3);
+	lsbDither.initialize(shape, 3);
+	const std::vector<BYTE> msbOutput = convert(msbConverter, lsb.sampleSize, msbDither, input);
+	const std::vector<BYTE> lsbOutput = convert(lsbConverter, lsb.sampleSize, lsbDither, input);
+
+	long mismatched = 0;
+	for (long i = 0; i < (long)input.size(); i++) {
+		const BYTE* m = &msbOutput[i * lsb.sampleSize];
+		const BYTE* l = &lsbOutput[i * lsb.sampleSize];
+		if (!std::equal(m, m + lsb.sampleSize, std::reverse_iterator<const BYTE*>(l + lsb.sampleSize))) mismatched++;
+	}
+	const bool passed = !mismatched;
+	printf("%-10s %-10s %-10s %10ld  %s\n", name, lsb.name, shape.toString(), mismatched, passed ? "PASS" : "FAIL");
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = (1 < argc) ? atof(argv[1]) : 4;
+	if (seconds * SampleRate < FftSize) {
+		printf("Usage: DitherSpectrum [seconds]\n");
+		return 2;
+	}
+
+	int failures = 0;
+	printf("Sine of %.0f LSB at %.0f Hz, %.1f seconds by buffers of %ld frames\n", SineLsb, SineFrequency, seconds, BufferSize);
+	printf("Type       Shape       Power Expect  Band power - expected (dB) of %.0f kHz bands  Correlation\n",
+		SampleRate / 2 / Bands / 1000);
+	printf("                      (LSB^2)(LSB^2)\n");
+	for (const TypeCase& c : lsbTypes) {
+		if (!c.isDithered) continue;
+		for (DitherShape shape : shapes) {
+			if (shape != DitherShape::None) failures += checkSpectrum(c, shape, seconds);
+		}
+	}
+
+	printf("\nSine of 0.9 full scale, then +1.0, -1.0, +1.5 and -1.5\n");
+	printf("Type       Shape              Min          Max    Max value  Error  Limit Same as None\n");
+	printf("                                                             (LSB)  (LSB)\n");
+	for (const TypeCase& c : lsbTypes) {
+		for (DitherShape shape : shapes) failures += checkSaturation(c, shape);
+	}
+
+	printf("\nType       LSB type   Shape      Mismatched\n");
+	for (const auto& msb : msbTypes) {
+		for (DitherShape shape : shapes) failures += checkByteOrder(msb.name, msb.type, msb.lsb, shape);
+	}
+	return failures;
+}
@@ -0,0 +1,268 @@
+// EchoCanceller.cpp : Checks CEchoCancellerEffect on simulated echo paths and on recorded vectors.
+//
+// Usage:
+//   EchoCanceller [/record] [vector list]
+//
+// The echo canceller runs in CEffectChain as configured by EffectChain.properties:
+// Input 0 is the microphone, input 1 is the far-end signal played on output 1, which is the reference.
+//
+// Simulated path: The far-end signal is convolved with a room impulse response and the response is
+// replaced in the middle of the run. ERLE (echo return loss enhancement) is printed for each second,
+// and the canceller should reach MinErle before the change and again after it.
+//
+// Recorded vectors: Each line of the vector list (Vectors/EchoCanceller.txt by default) names a WAV file
+// of the microphone on channel 0 and the reference on channel 1, the range in seconds where ERLE is measured
+// and its minimum in dB. The output is compared with <name>.expected.wav recorded by a previous run,
+// so that a change of the algorithm shows up as a difference even if ERLE is still high enough.
+// /record writes the expected files from the current output instead of comparing.
+
+#include "stdafx.h"
+#include "EffectChain.h"
+#include "EchoCancellerEffect.h"
+#include "WaveFile.h"
+
+#include <fstream>
+#include <random>
+#include <sstream>
+
+static const long BufferSize = 128;
+static const double TailTime = 0.2;
+static const long BlockSize = 256;
+
+static const double SimulatedRate = 16000;
+static const double SimulatedSeconds = 16;
+static const double PathChangeTime = 8;
+static const double MinErle = 15;
+static const double ConvergenceTime = 3;
+// Difference between the output and the expected output relative to the expected output.
+static const double MaxDifference = -40;
+
+/*
+	Runs the echo canceller over the whole signal and returns the output aligned to the microphone.
+*/
+static HRESULT cancel(const std::vector<float>& microphone, const std::vector<float>& reference, double sampleRate, std::vector<float>& output)
+{
+	CEffectChain chain;
+	long node = chain.addNode(new CEchoCancellerEffect(TailTime, BlockSize), 2);
+	HR_ASSERT_OK(chain.connect(CEffectGraph::InputNode, 0, node, 0));
+	HR_ASSERT_OK(chain.connect(CEffectGraph::OutputNode, 1, node, 1));
+	HR_ASSERT_OK(chain.connect(node, 0, CEffectGraph::OutputNode, 0));
+	HR_ASSERT_OK(chain.connect(CEffectGraph::InputNode, 1, CEffectGraph::OutputNode, 1));
+	HR_ASSERT_OK(chain.prepare(2, BufferSize, sampleRate, ASIOSTFloat32LSB));
+	const long latency = chain.getLatency();
+
+	// The signal is followed by silence to flush the latency.
+	const size_t frames = microphone.size();
+	std::vector<float> input0(microphone), input1(reference);
+	input0.resize(frames + latency + BufferSize);
+	input1.resize(frames + latency + BufferSize);
+	output.assign(frames, 0);
+	float output0[BufferSize], output1[BufferSize];
+	void* outputs[] = { output0, output1 };
+	for (size_t position = 0; position < frames + latency; position += BufferSize) {
+		const void* inputs[] = { &input0[position], &input1[position] };
+		chain.process(inputs, outputs, BufferSize);
+		for (long i = 0; i < BufferSize; i++) {
+			if ((latency <= (LONGLONG)(position + i)) && (position + i - latency < frames)) output[position + i - latency] = output0[i];
+		}
+	}
+	return S_OK;
+}
+
+static double getEnergy(const std::vector<float>& signal, size_t begin, size_t end)
+{
+	double energy = 0;
+	for (size_t i = begin; (i < end) && (i < signal.size()); i++) energy += (double)signal[i] * signal[i];
+	return energy;
+}
+
+static double getErle(const std::vector<float>& microphone, const std::vector<float>& output, size_t begin, size_t end)
+{
+	return 10 * log10(getEnergy(microphone, begin, end) / max(getEnergy(output, begin, end), 1e-20));
+}
+
+static std::vector<float> makeImpulseResponse(std::mt19937& random, double sampleRate, double delay)
+{
+	std::normal_distribution<float> noise;
+	std::vector<float> response((size_t)(0.15 * sampleRate));
+	const size_t direct = (size_t)(delay * sampleRate);
+	response[direct] = 0.5f;
+	for (size_t k = direct + 1; k < response.size(); k++) {
+		response[k] = 0.1f * noise(random) * expf(-(float)(k - direct) / (float)(0.05 * sampleRate));
+	}
+	return response;
+}
+
+/*
+	Echo of the far-end signal through a room whose response changes at PathChangeTime.
+*/
+static int checkSimulatedPath()
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	const size_t frames = (size_t)(SimulatedSeconds * SimulatedRate);
+	const size_t change = (size_t)(PathChangeTime * SimulatedRate);
+	const std::vector<float> responses[] = { makeImpulseResponse(random, SimulatedRate, 0.008), makeImpulseResponse(random, SimulatedRate, 0.012) };
+
+	std::vector<float> reference(frames), microphone(frames);
+	float colored = 0;
+	for (size_t i = 0; i < frames; i++) {
+		colored = 0.9f * colored + 0.3f * uniform(random);
+		reference[i] = colored;
+	}
+	for (size_t i = 0; i < frames; i++) {
+		const std::vector<float>& response = responses[(i < change) ? 0 : 1];
+		double echo = 0;
+		for (size_t k = 0; (k < response.size()) && (k <= i); k++) echo += response[k] * reference[i - k];
+		microphone[i] = (float)echo + 1e-4f * uniform(random);
+	}
+
+	std::vector<float> output;
+	if (FAILED(cancel(microphone, reference, SimulatedRate, output))) {
+		printf("Simulated path: Failed to run the echo canceller\n");
+		return 1;
+	}
+
+	printf("Simulated path: %.0f s at %.0f Hz, Response changes at %.0f s\n", SimulatedSeconds, SimulatedRate, PathChangeTime);
+	printf("  Time (s)  ERLE (dB)\n");
+	const size_t second = (size_t)SimulatedRate;
+	for (size_t begin = 0; begin < frames; begin += second) {
+		printf("  %8.0f  %9.1f\n", (double)begin / second, getErle(microphone, output, begin, begin + second));
+	}
+
+	int failures = 0;
+	const size_t converged[] = { (size_t)(ConvergenceTime * SimulatedRate), change + (size_t)(ConvergenceTime * SimulatedRate) };
+	const size_t ends[] = { change, frames };
+	for (int i = 0; i < 2; i++) {
+		const double erle = getErle(microphone, output, converged[i], ends[i]);
+		const bool passed = (MinErle <= erle);
+		printf("  %s: ERLE %.1f dB from %.0f s to %.0f s, Minimum %.1f dB\n",
+			passed ? "PASS" : "FAIL", erle, (double)converged[i] / second, (double)ends[i] / second, MinErle);
+		if (!passed) failures++;
+	}
+	return failures;
+}
+
+/*
+	Reads all frames of the file to float buffers of channels.
+*/
+static HRESULT readFile(LPCTSTR path, CWaveFile& file, std::vector<std::vector<float>>& channels)
+{
+	HR_ASSERT_OK(file.open(path));
+	const long numChannels = file.getNumChannels();
+	CSampleConverter converter;
+	HR_ASSERT_OK(converter.initialize(file.getSampleType()));
+
+	std::vector<BYTE> block(numChannels * BufferSize * file.getSampleSize());
+	std::vector<void*> buffers(numChannels);
+	for (long channel = 0; channel < numChannels; channel++) buffers[channel] = &block[channel * BufferSize * file.getSampleSize()];
+	channels.assign(numChannels, std::vector<float>((size_t)file.getFrames()));
+	for (LONGLONG position = 0; position < file.getFrames(); position += BufferSize) {
+		long frames;
+		HR_ASSERT_OK(file.read(&buffers[0], BufferSize, &frames));
+		frames = (long)min((LONGLONG)frames, file.getFrames() - position);
+		for (long channel = 0; channel < numChannels; channel++) converter.toFloat(buffers[channel], &channels[channel][(size_t)position], frames);
+	}
+	return S_OK;
+}
+
+/*
+	Writes the output and the reference in the format of the vector.
+*/
+static HRESULT writeFile(LPCTSTR path, const CWaveFile& format, const std::vector<float>& output, const std::vector<float>& reference)
+{
+	CWaveFile file;
+	HR_ASSERT_OK(file.create(path, format));
+	CSampleConverter converter;
+	HR_ASSERT_OK(converter.initialize(format.getSampleType()));
+
+	std::vector<BYTE> block(2 * BufferSize * format.getSampleSize());
+	const void* buffers[] = { &block[0], &block[BufferSize * format.getSampleSize()] };
+	for (size_t position = 0; position < output.size(); position += BufferSize) {
+		const long frames = (long)min((size_t)BufferSize, output.size() - position);
+		converter.fromFloat(&output[position], (void*)buffers[0], frames);
+		converter.fromFloat(&reference[position], (void*)buffers[1], frames);
+		HR_ASSERT_OK(file.write(buffers, frames));
+	}
+	return file.close();
+}
+
+static int checkVector(const std::string& directory, const std::string& line, bool record)
+{
+	std::istringstream fields(line);
+	std::string name;
+	double begin, end, minErle;
+	if (!(fields >> name >> begin >> end >> minErle)) {
+		printf("Invalid line of the vector list: %s\n", line.c_str());
+		return 1;
+	}
+	const std::string path = directory + name;
+	const std::string expectedPath = path.substr(0, path.rfind('.')) + ".expected.wav";
+
+	CWaveFile file;
+	std::vector<std::vector<float>> channels;
+	std::vector<float> output;
+	if (FAILED(readFile(path.c_str(), file, channels)) || (channels.size() != 2)) {
+		printf("%s: Failed to read 2 channels\n", name.c_str());
+		return 1;
+	}
+	if (FAILED(cancel(channels[0], channels[1], file.getSampleRate(), output))) {
+		printf("%s: Failed to run the echo canceller\n", name.c_str());
+		return 1;
+	}
+
+	const double erle = getErle(channels[0], output, (size_t)(begin * file.getSampleRate()), (size_t)(end * file.getSampleRate()));
+	if (record) {
+		const bool written = SUCCEEDED(writeFile(expectedPath.c_str(), file, output, channels[1]));
+		printf("%s: ERLE %.1f dB from %.1f s to %.1f s, %s %s\n", name.c_str(), erle, begin, end, written ? "Recorded" : "Failed to record", expectedPath.c_str());
+		return written ? 0 : 1;
+	}
+
+	CWaveFile expectedFile;
+	std::vector<std::vector<float>> expected;
+	if (FAILED(readFile(expectedPath.c_str(), expectedFile, expected)) || (expected[0].size() != output.size())) {
+		printf("%s: Failed to read %s\n", name.c_str(), expectedPath.c_str());
+		return 1;
+	}
+	double differenceEnergy = 0;
+	for (size_t i = 0; i < output.size(); i++) differenceEnergy += (double)(output[i] - expected[0][i]) * (output[i] - expected[0][i]);
+	const double difference = 10 * log10(max(differenceEnergy, 1e-20) / getEnergy(expected[0], 0, output.size()));
+
+	const bool passed = (minErle <= erle) && (difference <= MaxDifference);
+	printf("%s: %s: ERLE %.1f dB from %.1f s to %.1f s, Minimum %.1f dB, Difference from expected %.1f dB, Maximum %.1f dB\n",
+		name.c_str(), passed ? "PASS" : "FAIL", erle, begin, end, minErle, difference, MaxDifference);
+	return passed ? 0 : 1;
+}
+
+static int checkVectors(const std::string& listPath, bool record)
+{
+	std::ifstream list(listPath.c_str());
+	if (!list) {
+		printf("Failed to open %s\n", listPath.c_str());
+		return 1;
+	}
+	const size_t separator = listPath.find_last_of('/');
+	const std::string directory = (separator == std::string::npos) ? std::string() : listPath.substr(0, separator + 1);
+
+	int failures = 0;
+	std::string line;
+	while (std::getline(list, line)) {
+		if (line.empty() || (line[0] == '#')) continue;
+		failures += checkVector(directory, line, record);
+	}
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	bool record = false;
+	std::string listPath = "Vectors/EchoCanceller.txt";
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "/record")) record = true;
+		else listPath = argv[i];
+	}
+
+	int failures = record ? 0 : checkSimulatedPath();
+	failures += checkVectors(listPath, record);
+	return failures;
+}
@@ -0,0 +1,250 @@
+// GlitchRate.cpp : Measures glitches of CAsioHandler on CLoopbackDriver with and without lookahead mode.
+//
+// Usage:
+//   GlitchRate [seconds] [buffer size] [stalls per second]
+//
+// The effect chain writes a sample counter to every output channel and burns a part of each buffer period.
+// At random buffers it stalls for 0.25 to 2.25 buffer periods, like a work queue thread that is preempted.
+// The stalls are the same sequence in every mode.
+//
+// The loopback driver records output channel 0 to input channel 0 without delay. At each buffer switch,
+// the input buffer holds the output that was played during the previous period. A played buffer that doesn't
+// continue the previous one sample by sample is a glitch: late, stale, partially written or silent buffers.
+// A buffer inserted into the stream or a gap counts as two glitches, because both of its edges are audible.
+
+#include "stdafx.h"
+#include "AsioHandler.h"
+#include "LoopbackDriver.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+static const double SampleRate = 48000;
+static const long NumChannels = 2;
+// Counter values wrap before float loses integer precision. 0 is silence.
+static const long CounterPeriod = 1 << 20;
+static const double BusyRatio = 0.25;
+static const double MinStall = 0.25;
+static const double MaxStall = 2.25;
+
+static LONGLONG getTime()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+/*
+	Effect that writes a sample counter and simulates processing time with stalls.
+*/
+class CLoadEffect : public CEffect
+{
+public:
+	CLoadEffect(double stallsPerSecond) : m_stallsPerSecond(stallsPerSecond), m_counter(0), m_random(1) {}
+
+	virtual LPCTSTR getName() const { return _T("Load"); }
+
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate) {
+		HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		m_period = maxFrames / sampleRate;
+		m_busyTicks = (LONGLONG)(BusyRatio * m_period * frequency.QuadPart);
+		m_stallProbability = m_stallsPerSecond * m_period;
+		return S_OK;
+	}
+
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		const LONGLONG due = getTime() + m_busyTicks;
+		for (long i = 0; i < frames; i++) {
+			const float value = (float)((m_counter + i) % (CounterPeriod - 1) + 1);
+			for (long channel = 0; channel < numChannels; channel++) channels[channel][i] = value;
+		}
+		m_counter += frames;
+
+		if (std::uniform_real_distribution<double>()(m_random) < m_stallProbability) {
+			const double stall = std::uniform_real_distribution<double>(MinStall, MaxStall)(m_random) * m_period;
+			std::this_thread::sleep_for(std::chrono::duration<double>(stall));
+		}
+		while (getTime() < due) YieldProcessor();
+	}
+
+private:
+	const double m_stallsPerSecond;
+	LONGLONG m_counter;
+	std::mt19937 m_random;
+	double m_period;
+	LONGLONG m_busyTicks;
+	double m_stallProbability;
+};
+
+/*
+	Driver that passes calls to CLoopbackDriver and checks the played samples at each buffer switch.
+
+	The check runs in the driver thread before the engine's callback, so it sees every buffer switch.
+	Only one object can exist at a time, because ASIO callbacks have no context pointer.
+*/
+class CGlitchCountingDriver : public IASIO
+{
+public:
+	CGlitchCountingDriver(long bufferSize)
+		: m_refCount(1), m_callbacks(NULL), m_isSynchronized(false), m_next(0), m_played(0), m_glitches(0)
+	{
+		m_driver.Attach(new CLoopbackDriver(NumChannels, bufferSize, SampleRate));
+		m_monitor[0] = m_monitor[1] = NULL;
+		instance = this;
+	}
+	virtual ~CGlitchCountingDriver() { instance = NULL; }
+
+	LONGLONG getPlayedBuffers() const { return m_played; }
+	LONGLONG getGlitches() const { return m_glitches; }
+
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) { return m_driver->QueryInterface(riid, ppvObject); }
+	virtual ULONG STDMETHODCALLTYPE AddRef() { return ++m_refCount; }
+	virtual ULONG STDMETHODCALLTYPE Release() {
+		ULONG count = --m_refCount;
+		if (!count) delete this;
+		return count;
+	}
+
+	virtual ASIOBool init(void* sysHandle) { return m_driver->init(sysHandle); }
+	virtual void getDriverName(char* name) { strcpy(name, "GlitchRate"); }
+	virtual long getDriverVersion() { return m_driver->getDriverVersion(); }
+	virtual void getErrorMessage(char* string) { m_driver->getErrorMessage(string); }
+	virtual ASIOError start() { return m_driver->start(); }
+	virtual ASIOError stop() { return m_driver->stop(); }
+	virtual ASIOError getChannels(long* numInputChannels, long* numOutputChannels) { return m_driver->getChannels(numInputChannels, numOutputChannels); }
+	virtual ASIOError getLatencies(long* inputLatency, long* outputLatency) { return m_driver->getLatencies(inputLatency, outputLatency); }
+	virtual ASIOError getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity) { return m_driver->getBufferSize(minSize, maxSize, preferredSize, granularity); }
+	virtual ASIOError canSampleRate(ASIOSampleRate sampleRate) { return m_driver->canSampleRate(sampleRate); }
+	virtual ASIOError getSampleRate(ASIOSampleRate* sampleRate) { return m_driver->getSampleRate(sampleRate); }
+	virtual ASIOError setSampleRate(ASIOSampleRate sampleRate) { return m_driver->setSampleRate(sampleRate); }
+	virtual ASIOError getClockSources(ASIOClockSource* clocks, long* numSources) { return m_driver->getClockSources(clocks, numSources); }
+	virtual ASIOError setClockSource(long reference) { return m_driver->setClockSource(reference); }
+	virtual ASIOError getSamplePosition(ASIOSamples* sPos, ASIOTimeStamp* tStamp) { return m_driver->getSamplePosition(sPos, tStamp); }
+	virtual ASIOError getChannelInfo(ASIOChannelInfo* info) { return m_driver->getChannelInfo(info); }
+	virtual ASIOError disposeBuffers() { return m_driver->disposeBuffers(); }
+	virtual ASIOError controlPanel() { return m_driver->controlPanel(); }
+	virtual ASIOError future(long selector, void* opt) { return m_driver->future(selector, opt); }
+	virtual ASIOError outputReady() { return m_driver->outputReady(); }
+
+	virtual ASIOError createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long bufferSize, ASIOCallbacks* callbacks) {
+		m_callbacks = callbacks;
+		m_bufferSize = bufferSize;
+		static ASIOCallbacks monitorCallbacks = { bufferSwitch, sampleRateDidChange, asioMessage, bufferSwitchTimeInfo };
+		ASIOError error = m_driver->createBuffers(bufferInfos, numChannels, bufferSize, &monitorCallbacks);
+		for (long i = 0; i < numChannels; i++) {
+			if (bufferInfos[i].isInput && (bufferInfos[i].channelNum == 0)) {
+				m_monitor[0] = (const float*)bufferInfos[i].buffers[0];
+				m_monitor[1] = (const float*)bufferInfos[i].buffers[1];
+			}
+		}
+		return error;
+	}
+
+private:
+	// Checks the buffer played during the previous period.
+	void check(long doubleBufferIndex) {
+		const float* played = m_monitor[doubleBufferIndex];
+		if (!played) return;
+
+		bool isContinuous = (played[0] != 0);
+		for (long i = 1; isContinuous && (i < m_bufferSize); i++) {
+			isContinuous = (played[i] == next(played[i - 1]));
+		}
+		// Counting starts at the first buffer processed by the effect.
+		if (!m_isSynchronized) {
+			if (!isContinuous) return;
+			m_isSynchronized = true;
+		} else {
+			m_played++;
+			if (!isContinuous || (played[0] != m_next)) m_glitches++;
+		}
+		m_next = isContinuous ? next(played[m_bufferSize - 1]) : 0;
+	}
+
+	static float next(float value) { return (value < CounterPeriod - 1) ? value + 1 : 1; }
+
+	static void bufferSwitch(long doubleBufferIndex, ASIOBool directProcess) {
+		instance->check(doubleBufferIndex);
+		instance->m_callbacks->bufferSwitch(doubleBufferIndex, directProcess);
+	}
+	static ASIOTime* bufferSwitchTimeInfo(ASIOTime* params, long doubleBufferIndex, ASIOBool directProcess) {
+		instance->check(doubleBufferIndex);
+		return instance->m_callbacks->bufferSwitchTimeInfo(params, doubleBufferIndex, directProcess);
+	}
+	static void sampleRateDidChange(ASIOSampleRate sRate) { instance->m_callbacks->sampleRateDidChange(sRate); }
+	static long asioMessage(long selector, long value, void* message, double* opt) { return instance->m_callbacks->asioMessage(selector, value, message, opt); }
+
+	static CGlitchCountingDriver* instance;
+
+	std::atomic<ULONG> m_refCount;
+	CComPtr<IASIO> m_driver;
+	ASIOCallbacks* m_callbacks;
+	long m_bufferSize;
+	const float* m_monitor[2];
+
+	bool m_isSynchronized;
+	float m_next;
+	std::atomic<LONGLONG> m_played;
+	std::atomic<LONGLONG> m_glitches;
+};
+
+/*static*/ CGlitchCountingDriver* CGlitchCountingDriver::instance = NULL;
+
+static int measure(long lookaheadBuffers, double seconds, long bufferSize, double stallsPerSecond)
+{
+	CComPtr<CGlitchCountingDriver> driver;
+	driver.Attach(new CGlitchCountingDriver(bufferSize));
+	std::unique_ptr<CAsioHandler> handler(new CAsioHandler());
+
+	CEffectChain* chain = new CEffectChain();
+	chain->addEffect(new CLoadEffect(stallsPerSecond));
+	// Setup and start are handled by the work queue thread.
+	HRESULT hr = handler->setup(driver, NULL, lookaheadBuffers, chain);
+	Sleep(200);
+	if (SUCCEEDED(hr)) hr = handler->start();
+	Sleep(200);
+	const CAsioHandlerContext::Statistics& statistics = handler->statistics;
+	if (FAILED(hr) || !(statistics.bufferSwitch[0] + statistics.bufferSwitch[1])) {
+		printf("Failed to start: HRESULT=0x%08x\n", hr);
+		return 1;
+	}
+
+	Sleep((DWORD)(seconds * 1000));
+	handler->stop();
+	Sleep(100);
+
+	CAsioHandlerContext::Property property;
+	handler->getProperty(&property);
+	const LONGLONG played = driver->getPlayedBuffers();
+	const LONGLONG glitches = driver->getGlitches();
+	printf("%9ld %7.2f %8lld %8lld %7.3f%% %6ld %8ld %8ld %9ld\n",
+		lookaheadBuffers, property.addedLatency * 1000 / SampleRate, (long long)played, (long long)glitches, played ? 100.0 * glitches / played : 0.0,
+		statistics.xrun, statistics.droppedBuffers, statistics.inputOverrun, statistics.outputUnderrun);
+
+	handler->shutdown();
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = (1 < argc) ? atof(argv[1]) : 10;
+	const long bufferSize = (2 < argc) ? atol(argv[2]) : 128;
+	const double stallsPerSecond = (3 < argc) ? atof(argv[3]) : 5;
+	if ((seconds <= 0) || (bufferSize < CLoopbackDriver::MinBufferSize) || (stallsPerSecond < 0)) {
+		printf("Usage: GlitchRate [seconds] [buffer size] [stalls per second]\n");
+		return 2;
+	}
+
+	printf("%.0f s per mode, %ld frames at %.0f Hz (%.2f ms), %.0f%% busy, %.1f stalls/s of %.2f to %.2f buffers\n",
+		seconds, bufferSize, SampleRate, bufferSize * 1000 / SampleRate, BusyRatio * 100, stallsPerSecond, MinStall, MaxStall);
+	printf("Lookahead Latency   Played Glitches    Rate   Xrun  Dropped  Overrun  Underrun\n");
+	printf("(buffers)    (ms)\n");
+	int failures = 0;
+	for (long lookaheadBuffers = 0; lookaheadBuffers <= CAsioHandlerContext::MaxLookaheadBuffers; lookaheadBuffers++) {
+		failures += measure(lookaheadBuffers, seconds, bufferSize, stallsPerSecond);
+	}
+	return failures;
+}
@@ -0,0 +1,195 @@
+// MultiEngine.cpp : Runs several CAsioHandler objects in one process and checks the slots of CAsioCallbackPool.
+//
+// Usage:
+//   MultiEngine [engines] [seconds] [buffer size]
+//
+// Each engine has its own CLoopbackDriver and an effect chain that writes the signature of the engine to
+// every output channel. The driver loops the output back to the input, so each engine should read only
+// its own signature or silence. Engine i runs at (i + 1) times the buffer size, so each engine should count
+// buffer switches at the rate of its own driver. Another signature or another rate means that the callbacks
+// of the pool routed buffer switches to the wrong engine.
+//
+// Then the pool is filled: CAsioCallbackPool::MaxHandlers engines are set up, one more should fail,
+// and after one of them is shut down, its slot should be acquired by a new engine that runs.
+// At last all engines are shut down and all slots should be acquired again.
+
+#include "stdafx.h"
+#include "AsioHandler.h"
+#include "AsioCallbackPool.h"
+#include "LoopbackDriver.h"
+
+#include <cstdarg>
+
+static const double SampleRate = 48000;
+static const long NumChannels = 2;
+// Signatures of engines differ by 1.
+static const float Tolerance = 0.001f;
+// Count of buffer switches relative to the rate of the driver, that leaves room for a slow machine.
+static const double MinSwitchRatio = 0.8;
+static const double MaxSwitchRatio = 1.2;
+
+/*
+	Effect that checks the samples looped back and writes the signature to all channels.
+*/
+class CSignatureEffect : public CEffect
+{
+public:
+	CSignatureEffect(float signature) : m_signature(signature), m_buffers(0), m_looped(0), m_foreign(0) {}
+
+	virtual LPCTSTR getName() const { return _T("Signature"); }
+
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		for (long channel = 0; channel < numChannels; channel++) {
+			for (long i = 0; i < frames; i++) {
+				const float value = channels[channel][i];
+				// Silence is played before the first output. The loopback filter leaves errors of rounding at its edge.
+				if (fabsf(value - m_signature) < Tolerance) m_looped++;
+				else if (Tolerance <= fabsf(value)) m_foreign++;
+				channels[channel][i] = m_signature;
+			}
+		}
+		m_buffers++;
+	}
+
+	const float m_signature;
+	std::atomic<LONGLONG> m_buffers;
+	std::atomic<LONGLONG> m_looped;
+	std::atomic<LONGLONG> m_foreign;
+};
+
+/*
+	Engine with its own driver and effect. Signature and buffer size of the engine of index i are multiplied by i + 1.
+*/
+struct Engine
+{
+	Engine(long index, long bufferSize) : bufferSize(bufferSize * (index + 1)), effect(new CSignatureEffect((float)(index + 1)))
+	{
+		driver.Attach(new CLoopbackDriver(NumChannels, this->bufferSize, SampleRate));
+		handler.reset(new CAsioHandler());
+	}
+
+	HRESULT setup()
+	{
+		CEffectChain* chain = new CEffectChain();
+		chain->addEffect(effect);
+		return handler->setup(driver, NULL, 0, chain);
+	}
+
+	LONGLONG getBufferSwitches() const { return handler->statistics.bufferSwitch[0] + handler->statistics.bufferSwitch[1]; }
+
+	const long bufferSize;
+	CComPtr<IASIO> driver;
+	std::unique_ptr<CAsioHandler> handler;
+	CSignatureEffect* effect;		// Owned by the effect chain.
+};
+
+static int check(bool passed, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	printf("%s: ", passed ? "PASS" : "FAIL");
+	vprintf(format, args);
+	printf("\n");
+	va_end(args);
+	return passed ? 0 : 1;
+}
+
+/*
+	Runs the engines at the same time and checks that each processes its own buffers.
+*/
+static int runEngines(long numEngines, double seconds, long bufferSize)
+{
+	std::vector<std::unique_ptr<Engine>> engines;
+	int failures = 0;
+	for (long i = 0; i < numEngines; i++) {
+		engines.emplace_back(new Engine(i, bufferSize));
+		failures += check(SUCCEEDED(engines[i]->setup()), "Set up engine %ld", i);
+	}
+	// Setup and start are handled by the work queue thread of each engine.
+	Sleep(200);
+	for (auto& engine : engines) engine->handler->start();
+	Sleep((DWORD)(seconds * 1000));
+	for (auto& engine : engines) engine->handler->stop();
+	Sleep(100);
+
+	printf("Engine Signature Buffer  Expected  Switches  Processed    Looped  Foreign\n");
+	for (long i = 0; i < numEngines; i++) {
+		const Engine& engine = *engines[i];
+		printf("%6ld %9.0f %6ld %9.0f %9lld %10lld %9lld %8lld\n", i, engine.effect->m_signature, engine.bufferSize,
+			seconds * SampleRate / engine.bufferSize, (long long)engine.getBufferSwitches(),
+			(long long)engine.effect->m_buffers, (long long)engine.effect->m_looped, (long long)engine.effect->m_foreign);
+	}
+	for (long i = 0; i < numEngines; i++) {
+		const Engine& engine = *engines[i];
+		const double ratio = engine.getBufferSwitches() / (seconds * SampleRate / engine.bufferSize);
+		failures += check((MinSwitchRatio <= ratio) && (ratio <= MaxSwitchRatio) && engine.effect->m_looped && !engine.effect->m_foreign,
+			"Engine %ld switched at %.2f times the rate of its driver, %lld foreign samples", i, ratio, (long long)engine.effect->m_foreign);
+	}
+	for (auto& engine : engines) engine->handler->shutdown();
+	return failures;
+}
+
+/*
+	Fills all slots of the pool, releases one and acquires it again.
+*/
+static int checkSlots(long bufferSize)
+{
+	const long maxHandlers = CAsioCallbackPool::MaxHandlers;
+	std::vector<std::unique_ptr<Engine>> engines;
+	int failures = 0;
+	long acquired = 0;
+	for (long i = 0; i < maxHandlers; i++) {
+		engines.emplace_back(new Engine(i, bufferSize));
+		if (SUCCEEDED(engines[i]->setup())) acquired++;
+	}
+	failures += check(acquired == maxHandlers, "%ld of %ld engines set up", acquired, maxHandlers);
+
+	std::unique_ptr<Engine> extra(new Engine(maxHandlers, bufferSize));
+	failures += check(FAILED(extra->setup()), "Engine %ld is refused while all slots are in use", maxHandlers);
+	Sleep(200);
+
+	// The engine shut down releases its slot. The extra engine acquires it and should receive its buffer switches.
+	const long released = maxHandlers / 2;
+	engines[released]->handler->shutdown();
+	const bool isSetUp = SUCCEEDED(extra->setup());
+	failures += check(isSetUp, "Engine %ld is set up in the slot released by engine %ld", maxHandlers, released);
+	if (isSetUp) {
+		Sleep(200);
+		extra->handler->start();
+		Sleep(500);
+		extra->handler->stop();
+		Sleep(100);
+		failures += check(extra->getBufferSwitches() && extra->effect->m_looped && !extra->effect->m_foreign && !engines[released]->getBufferSwitches(),
+			"Engine %ld processed %lld buffers in the slot, engine %ld processed %lld buffers after it was shut down",
+			maxHandlers, (long long)extra->effect->m_buffers, released, (long long)engines[released]->getBufferSwitches());
+	}
+
+	// Destroying the engines releases all slots.
+	extra.reset();
+	engines.clear();
+	acquired = 0;
+	for (long i = 0; i < maxHandlers; i++) {
+		engines.emplace_back(new Engine(i, bufferSize));
+		if (SUCCEEDED(engines[i]->setup())) acquired++;
+	}
+	failures += check(acquired == maxHandlers, "%ld of %ld slots acquired again after all engines are destroyed", acquired, maxHandlers);
+	Sleep(200);
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	const long numEngines = (1 < argc) ? atol(argv[1]) : 4;
+	const double seconds = (2 < argc) ? atof(argv[2]) : 2;
+	const long bufferSize = (3 < argc) ? atol(argv[3]) : 256;
+	if ((numEngines < 1) || (CAsioCallbackPool::MaxHandlers < numEngines) || (seconds <= 0) || (bufferSize < CLoopbackDriver::MinBufferSize)) {
+		printf("Usage: MultiEngine [engines] [seconds] [buffer size]\n");
+		printf("  engines: 1 to %ld\n", CAsioCallbackPool::MaxHandlers);
+		return 2;
+	}
+
+	printf("%ld engines for %.1f s, %ld frames at %.0f Hz\n", numEngines, seconds, bufferSize, SampleRate);
+	int failures = runEngines(numEngines, seconds, bufferSize);
+	failures += checkSlots(bufferSize);
+	return failures;
+}
@@ -0,0 +1,217 @@
+// OfflineRender.cpp : Checks that COfflineRenderer compensates the latency and renders the tail of the effect chain.
+//
+// Usage:
+//   OfflineRender
+//
+// An impulse near the end of a WAV file is rendered through chains of an echo effect that reports its tail
+// and a delay effect that reports its latency. The output should start at the same frame as the input and be
+// longer by the tail, so that the echoes after the end of the input are not cut off. Each chain is rendered by
+// buffer sizes that don't divide the length of the file.
+
+#include "stdafx.h"
+#include "OfflineRenderer.h"
+#include "WaveFile.h"
+
+static const double SampleRate = 48000;
+static const long InputFrames = 4800;
+static const long ImpulseFrame = InputFrames - 10;
+static const long EchoDelay = 1000;
+static const long EchoRepeats = 3;
+static const float EchoGain = 0.5f;
+static const long DelayLatency = 300;
+static LPCTSTR InputPath = _T("bin/OfflineRender.in.wav");
+static LPCTSTR OutputPath = _T("bin/OfflineRender.out.wav");
+
+/*
+	Effect that adds repeats of the input at multiples of the delay, each by half of the level of the previous.
+*/
+class CEchoEffect : public CEffect
+{
+public:
+	virtual LPCTSTR getName() const { return _T("Echo"); }
+
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate) {
+		HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+		m_history.assign(numChannels, std::vector<float>(getTailLength()));
+		m_position = 0;
+		return S_OK;
+	}
+
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		const long length = getTailLength();
+		for (long i = 0; i < frames; i++) {
+			for (long channel = 0; channel < numChannels; channel++) {
+				std::vector<float>& history = m_history[channel];
+				const float input = channels[channel][i];
+				float output = input;
+				float gain = 1;
+				for (long repeat = 1; repeat <= EchoRepeats; repeat++) {
+					gain *= EchoGain;
+					output += gain * history[(m_position + length - repeat * EchoDelay) % length];
+				}
+				history[m_position] = input;
+				channels[channel][i] = output;
+			}
+			m_position = (m_position + 1) % length;
+		}
+	}
+
+	virtual long getTailLength() const { return EchoDelay * EchoRepeats; }
+
+protected:
+	std::vector<std::vector<float>> m_history;
+	long m_position;
+};
+
+/*
+	Effect that delays the input by the latency it reports.
+*/
+class CDelayEffect : public CEffect
+{
+public:
+	virtual LPCTSTR getName() const { return _T("Delay"); }
+
+	virtual HRESULT prepare(long numChannels, long maxFrames, double sampleRate) {
+		HR_ASSERT_OK(CEffect::prepare(numChannels, maxFrames, sampleRate));
+		m_history.assign(numChannels, std::vector<float>(DelayLatency));
+		m_position = 0;
+		return S_OK;
+	}
+
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		for (long i = 0; i < frames; i++) {
+			for (long channel = 0; channel < numChannels; channel++) {
+				std::swap(channels[channel][i], m_history[channel][m_position]);
+			}
+			m_position = (m_position + 1) % DelayLatency;
+		}
+	}
+
+	virtual long getLatency() const { return DelayLatency; }
+
+protected:
+	std::vector<std::vector<float>> m_history;
+	long m_position;
+};
+
+struct Case {
+	const char* name;
+	bool hasEcho;
+	bool hasDelay;
+};
+
+static const Case cases[] = {
+	{ "Delay", false, true },
+	{ "Echo", true, false },
+	{ "Echo+Delay", true, true },
+};
+
+// Case rendered by createEffectChain().
+static const Case* currentCase;
+
+static CEffectChain* createEffectChain()
+{
+	std::unique_ptr<CEffectChain> effectChain(new CEffectChain());
+	if (currentCase->hasEcho && FAILED(HR_EXPECT_OK(effectChain->addEffect(new CEchoEffect())))) return NULL;
+	if (currentCase->hasDelay && FAILED(HR_EXPECT_OK(effectChain->addEffect(new CDelayEffect())))) return NULL;
+	return effectChain.release();
+}
+
+/*
+	Writes mono IEEE float WAV file of an impulse at ImpulseFrame.
+*/
+static bool writeInput()
+{
+	std::vector<float> samples(InputFrames);
+	samples[ImpulseFrame] = 1;
+	const UINT32 dataSize = (UINT32)(samples.size() * sizeof(float));
+	const UINT32 riffSize = 4 + (8 + 16) + (8 + dataSize);
+	const WORD format[] = { 3, 1 };		// WAVE_FORMAT_IEEE_FLOAT, Channels
+	const UINT32 rates[] = { (UINT32)SampleRate, (UINT32)SampleRate * sizeof(float) };
+	const WORD sizes[] = { sizeof(float), 32 };	// Block align, Bits
+	const UINT32 formatSize = 16;
+
+	FILE* file = fopen(InputPath, "wb");
+	if (!file) return false;
+	fwrite("RIFF", 1, 4, file);
+	fwrite(&riffSize, 4, 1, file);
+	fwrite("WAVEfmt ", 1, 8, file);
+	fwrite(&formatSize, 4, 1, file);
+	fwrite(format, 2, 2, file);
+	fwrite(rates, 4, 2, file);
+	fwrite(sizes, 2, 2, file);
+	fwrite("data", 1, 4, file);
+	fwrite(&dataSize, 4, 1, file);
+	const bool written = (fwrite(&samples[0], sizeof(float), samples.size(), file) == samples.size());
+	return !fclose(file) && written;
+}
+
+/*
+	Reads samples of the output file. Returns false if failed.
+*/
+static bool readOutput(std::vector<float>& samples)
+{
+	CWaveFile output;
+	if (FAILED(output.open(OutputPath)) || (output.getNumChannels() != 1) || (output.getSampleType() != ASIOSTFloat32LSB)) return false;
+	samples.resize((size_t)output.getFrames());
+	if (samples.empty()) return true;
+	void* buffers[] = { &samples[0] };
+	long frames = 0;
+	return SUCCEEDED(output.read(buffers, (long)samples.size(), &frames)) && (frames == (long)samples.size());
+}
+
+static int render(const Case& c, long bufferSize)
+{
+	currentCase = &c;
+	COfflineRenderer renderer(createEffectChain, bufferSize);
+	COfflineRenderer::Job job = { InputPath, OutputPath };
+	COfflineRenderer::Result result;
+	const HRESULT hr = renderer.render(job, &result);
+
+	// Expected output is the impulse at the same frame as the input, followed by the echoes.
+	const long tail = c.hasEcho ? EchoDelay * EchoRepeats : 0;
+	std::vector<float> expected(InputFrames + tail);
+	expected[ImpulseFrame] = 1;
+	float gain = 1;
+	for (long repeat = 1; c.hasEcho && (repeat <= EchoRepeats); repeat++) {
+		gain *= EchoGain;
+		expected[ImpulseFrame + repeat * EchoDelay] = gain;
+	}
+
+	std::vector<float> samples;
+	const bool isRead = SUCCEEDED(hr) && readOutput(samples);
+	long mismatched = 0;
+	for (size_t i = 0; i < min(samples.size(), expected.size()); i++) {
+		if (expected[i] != samples[i]) mismatched++;
+	}
+	const bool passed = isRead && (samples.size() == expected.size()) && (result.frames == (LONGLONG)expected.size()) && !mismatched;
+	printf("%-10s %6ld %6ld %6ld %8lld %8zu %10ld  %s\n", c.name, bufferSize, InputFrames, tail,
+		(long long)result.frames, samples.size(), mismatched, passed ? "PASS" : "FAIL");
+	if (FAILED(hr)) printf("Failed to render: HRESULT=0x%08x\n", hr);
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char* /*argv*/[])
+{
+	if (1 < argc) {
+		printf("Usage: OfflineRender\n");
+		return 2;
+	}
+	if (!writeInput()) {
+		printf("Failed to write %s\n", InputPath);
+		return 1;
+	}
+
+	printf("Impulse at frame %ld of %ld, Echo of %ld x %ld frames, Delay of %ld frames\n",
+		ImpulseFrame, InputFrames, EchoRepeats, EchoDelay, DelayLatency);
+	printf("Chain      Buffer  Input   Tail Rendered   Output Mismatched\n");
+	printf("            (smp)  (smp)  (smp)    (smp)    (smp)    (smp)\n");
+	int failures = 0;
+	const long bufferSizes[] = { 64, 512 };
+	for (const Case& c : cases) {
+		for (long bufferSize : bufferSizes) {
+			failures += render(c, bufferSize);
+		}
+	}
+	return failures;
+}
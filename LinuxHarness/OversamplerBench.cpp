@@ -0,0 +1,152 @@
+// OversamplerBench.cpp : Measures throughput of COversamplerEffect for each factor and phase of filters.
+//
+// Usage:
+//   OversamplerBench [buffer size] [channels] [seconds]
+//
+// Each factor is run with an effect that does nothing, which is the cost of the half-band filters only,
+// and with a tanh saturator, which is a typical nonlinear effect to be oversampled.
+// Time is per sample per channel at the original rate. "Load" is the time of the saturator
+// relative to the period of a sample at 48 kHz, that is, the part of one core used by one channel.
+//
+// Aliasing is the energy of non-harmonic frequencies below 20 kHz of a saturated 4990 Hz sine relative to
+// its harmonics, so the table also shows what each factor buys. Aliases that fold into the transition band
+// of the last half-band filter, above 20 kHz, are not counted.
+
+#include "stdafx.h"
+#include "OversamplerEffect.h"
+#include "VectorOps.h"
+
+static const double SampleRate = 48000;
+static const double SineFrequency = 4990;
+// Length of the DFT that measures aliasing. SineFrequency is on a bin.
+static const long AnalysisFrames = 4800;
+static const double MaxAudibleFrequency = 20000;
+
+static LONGLONG getTime()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+class CIdentityEffect : public CEffect
+{
+public:
+	virtual LPCTSTR getName() const { return _T("Identity"); }
+	virtual void process(float* const* /*channels*/, long /*numChannels*/, long /*frames*/) {}
+};
+
+class CSaturatorEffect : public CEffect
+{
+public:
+	virtual LPCTSTR getName() const { return _T("Saturator"); }
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		for (long channel = 0; channel < numChannels; channel++) {
+			for (long i = 0; i < frames; i++) channels[channel][i] = tanhf(4 * channels[channel][i]);
+		}
+	}
+};
+
+/*
+	Creates the effect oversampled by the factor, or the effect itself if the factor is 1.
+*/
+static CEffect* createEffect(CEffect* effect, long factor, CHalfBandFilter::Phase phase)
+{
+	return (factor == 1) ? effect : new COversamplerEffect(effect, factor, phase);
+}
+
+/*
+	Returns nanoseconds per sample per channel of the effect processing buffers of sine for the seconds.
+	The same buffer of sine is copied to each channel before each call.
+*/
+static double measureThroughput(CEffect* effect, long frames, long numChannels, double seconds)
+{
+	if (FAILED(effect->prepare(numChannels, frames, SampleRate))) return 0;
+
+	std::vector<std::vector<float>> buffers(numChannels, std::vector<float>(frames));
+	std::vector<float*> channels(numChannels);
+	for (long channel = 0; channel < numChannels; channel++) channels[channel] = &buffers[channel][0];
+	std::vector<float> sine(frames);
+	for (long i = 0; i < frames; i++) sine[i] = 0.5f * sinf(i * 0.1f);
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const LONGLONG start = getTime();
+	const LONGLONG end = start + (LONGLONG)(seconds * frequency.QuadPart);
+	LONGLONG position = 0;
+	LONGLONG now;
+	do {
+		for (long channel = 0; channel < numChannels; channel++) vecCopy(channels[channel], &sine[0], frames);
+		effect->renderParameters(position, frames);
+		effect->process(&channels[0], numChannels, frames);
+		position += frames;
+		now = getTime();
+	} while (now < end);
+	return (now - start) * 1e9 / frequency.QuadPart / ((double)position * numChannels);
+}
+
+/*
+	Returns energy of non-harmonic bins relative to harmonic bins of saturated sine in dB.
+*/
+static double measureAliasing(CEffect* effect, long frames)
+{
+	const long totalFrames = (long)SampleRate;
+	if (FAILED(effect->prepare(1, frames, SampleRate))) return 0;
+
+	std::vector<float> output(totalFrames);
+	for (long position = 0; position + frames <= totalFrames; position += frames) {
+		float* channel = &output[position];
+		for (long i = 0; i < frames; i++) channel[i] = 0.9f * sinf((float)(2 * M_PI * SineFrequency * (position + i) / SampleRate));
+		effect->renderParameters(position, frames);
+		effect->process(&channel, 1, frames);
+	}
+
+	// DFT of the last AnalysisFrames, after the filters have settled.
+	const long binsPerHarmonic = (long)(SineFrequency * AnalysisFrames / SampleRate);
+	const long maxBin = (long)(MaxAudibleFrequency * AnalysisFrames / SampleRate);
+	const float* x = &output[totalFrames - AnalysisFrames - totalFrames % frames];
+	double harmonics = 0, others = 0;
+	for (long k = 1; k < maxBin; k++) {
+		double re = 0, im = 0;
+		for (long i = 0; i < AnalysisFrames; i++) {
+			re += x[i] * cos(2 * M_PI * k * i / AnalysisFrames);
+			im += x[i] * sin(2 * M_PI * k * i / AnalysisFrames);
+		}
+		if (k % binsPerHarmonic == 0) harmonics += re * re + im * im;
+		else others += re * re + im * im;
+	}
+	return 10 * log10(others / harmonics);
+}
+
+int main(int argc, char* argv[])
+{
+	const long frames = (1 < argc) ? atol(argv[1]) : 256;
+	const long numChannels = (2 < argc) ? atol(argv[2]) : 2;
+	const double seconds = (3 < argc) ? atof(argv[3]) : 0.5;
+	if ((frames <= 0) || (numChannels <= 0) || (seconds <= 0)) {
+		printf("Usage: OversamplerBench [buffer size] [channels] [seconds]\n");
+		return 2;
+	}
+
+	printf("%ld frames, %ld channel(s) at %.0f Hz, %.1f s per measurement\n", frames, numChannels, SampleRate, seconds);
+	printf("Phase   Factor Latency  Filters Saturator   Load  Aliasing\n");
+	printf("               (smp)   (ns/smp)  (ns/smp)             (dB)\n");
+	const CHalfBandFilter::Phase phases[] = { CHalfBandFilter::Phase::Linear, CHalfBandFilter::Phase::Minimum };
+	const long factors[] = { 1, 2, 4, 8 };
+	for (CHalfBandFilter::Phase phase : phases) {
+		for (long factor : factors) {
+			// Without oversampling, the phase doesn't matter.
+			if ((factor == 1) && (phase != phases[0])) continue;
+
+			std::unique_ptr<CEffect> filters(createEffect(new CIdentityEffect(), factor, phase));
+			const double filtersTime = measureThroughput(filters.get(), frames, numChannels, seconds);
+			std::unique_ptr<CEffect> saturator(createEffect(new CSaturatorEffect(), factor, phase));
+			const double saturatorTime = measureThroughput(saturator.get(), frames, numChannels, seconds);
+			std::unique_ptr<CEffect> aliasing(createEffect(new CSaturatorEffect(), factor, phase));
+			printf("%-7s %6ld %7ld %8.1f %9.1f %5.2f%% %9.1f\n",
+				(factor == 1) ? "-" : phase.toString(), factor, filters->getLatency(), filtersTime, saturatorTime,
+				saturatorTime * SampleRate / 1e9 * 100, measureAliasing(aliasing.get(), frames));
+		}
+	}
+	return 0;
+}
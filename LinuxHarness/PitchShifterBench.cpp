@@ -0,0 +1,114 @@
+// PitchShifterBench.cpp : Measures CPU time of CPitchShifterEffect per channel.
+//
+// Usage:
+//   PitchShifterBench [seconds] [semitones]
+//
+// The effect is run for each buffer size and count of channels on seconds of a signal of harmonics and noise,
+// as fast as it can. Each buffer is timed.
+// The frame size follows the buffer size (see CPitchShifterEffect), so a buffer smaller than the hop
+// processes a frame only at some buffers. Both the average and the worst time of a buffer are printed:
+// The average is the CPU load and the worst is what the buffer period has to fit.
+//
+// "Load" is the average time per channel relative to the buffer period, that is, the part of one core
+// used by one channel. "Peak" is the worst time of a buffer of all channels relative to the buffer period.
+
+#include "stdafx.h"
+#include "PitchShifterEffect.h"
+
+#include <random>
+
+static const double SampleRate = 48000;
+
+static LONGLONG getTime()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+/*
+	Returns a signal of 8 harmonics of 220 Hz and noise, repeated by each channel with another phase.
+*/
+static std::vector<float> makeSignal(size_t frames)
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> noise(-0.01f, 0.01f);
+	std::vector<float> signal(frames);
+	for (size_t i = 0; i < frames; i++) {
+		double sum = 0;
+		for (int harmonic = 1; harmonic <= 8; harmonic++) sum += sin(2 * M_PI * 220 * harmonic * i / SampleRate) / harmonic;
+		signal[i] = (float)(0.3 * sum) + noise(random);
+	}
+	return signal;
+}
+
+static int measure(long bufferSize, long numChannels, double seconds, float semitones, const std::vector<float>& signal)
+{
+	CPitchShifterEffect effect;
+	effect.getParameter(CPitchShifterEffect::Pitch)->setValue(semitones);
+	if (FAILED(effect.prepare(numChannels, bufferSize, SampleRate))) {
+		printf("Failed to prepare %ld channel(s) of %ld frames\n", numChannels, bufferSize);
+		return 1;
+	}
+
+	std::vector<std::vector<float>> buffers(numChannels, std::vector<float>(bufferSize));
+	std::vector<float*> channels(numChannels);
+	for (long channel = 0; channel < numChannels; channel++) channels[channel] = &buffers[channel][0];
+
+	// Hops of the frames before the measurement fill the buffers of the effect.
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const long measuredBuffers = (long)(seconds * SampleRate / bufferSize);
+	const long warmUp = effect.getFrameSize() / bufferSize + 1;
+	LONGLONG total = 0, worst = 0;
+	size_t offset = 0;
+	for (long buffer = -warmUp; buffer < measuredBuffers; buffer++) {
+		for (long channel = 0; channel < numChannels; channel++) {
+			// Each channel starts at another position of the signal.
+			const size_t start = (offset + channel * 997) % (signal.size() - bufferSize);
+			std::copy(&signal[start], &signal[start + bufferSize], buffers[channel].begin());
+		}
+		offset = (offset + bufferSize) % (signal.size() - bufferSize);
+
+		const LONGLONG start = getTime();
+		effect.renderParameters((LONGLONG)(buffer + warmUp) * bufferSize, bufferSize);
+		effect.process(&channels[0], numChannels, bufferSize);
+		const LONGLONG elapsed = getTime() - start;
+		if (0 <= buffer) {
+			total += elapsed;
+			worst = max(worst, elapsed);
+		}
+	}
+
+	const double period = bufferSize / SampleRate;
+	const double average = (double)total / frequency.QuadPart / measuredBuffers;
+	const double maximum = (double)worst / frequency.QuadPart;
+	printf("%6ld %6ld %8ld %9.1f %9.1f %10.1f %6.2f%% %6.1f%%\n",
+		bufferSize, effect.getFrameSize(), numChannels, average * 1e6, maximum * 1e6,
+		average * 1e9 / (bufferSize * numChannels), average / numChannels / period * 100, maximum / period * 100);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = (1 < argc) ? atof(argv[1]) : 2;
+	const float semitones = (2 < argc) ? (float)atof(argv[2]) : 7.0f;
+	if ((seconds <= 0) || (semitones < -12) || (12 < semitones)) {
+		printf("Usage: PitchShifterBench [seconds] [semitones]\n");
+		return 2;
+	}
+
+	const std::vector<float> signal = makeSignal((size_t)SampleRate);
+	printf("%.1f s of audio per measurement at %.0f Hz, Pitch %+.1f semitones\n", seconds, SampleRate, semitones);
+	printf("Buffer  Frame Channels   Average     Worst  Per channel   Load    Peak\n");
+	printf("(smp)   (smp)               (us)      (us)    (ns/smp)\n");
+	const long bufferSizes[] = { 64, 128, 256, 512, 1024 };
+	const long channelCounts[] = { 1, 2, 4, 8 };
+	int failures = 0;
+	for (long bufferSize : bufferSizes) {
+		for (long numChannels : channelCounts) {
+			failures += measure(bufferSize, numChannels, seconds, semitones, signal);
+		}
+	}
+	return failures;
+}
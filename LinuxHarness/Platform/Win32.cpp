@@ -0,0 +1,875 @@
+// Implementation of the headers of the platform directory.
+
+#include <windows.h>
+#include <atlbase.h>
+#include <mfapi.h>
+#include <mmsystem.h>
+#include <log4cplus/loggingmacros.h>
+#include <win32/stdafx.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <thread>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const GUID IID_IUnknown = { 0x00000000, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+static thread_local DWORD lastError = ERROR_SUCCESS;
+
+DWORD GetLastError() { return lastError; }
+void SetLastError(DWORD error) { lastError = error; }
+
+static DWORD errorFromErrno(int error)
+{
+	switch (error) {
+	case ENOENT: return ERROR_FILE_NOT_FOUND;
+	case EACCES: case EPERM: return ERROR_ACCESS_DENIED;
+	case ENOMEM: case EAGAIN: return ERROR_NOT_ENOUGH_MEMORY;
+	case EINVAL: return ERROR_INVALID_PARAMETER;
+	default: return ERROR_NOT_SUPPORTED;
+	}
+}
+
+/*
+	Kernel objects.
+
+	All waitable objects share one lock and one condition variable.
+	A waiter is woken whenever any object is signaled, and checks the objects it waits for.
+	This is slower than per-object waiting, but WaitForMultipleObjects() with waitAll = FALSE needs no extra machinery.
+*/
+namespace {
+
+std::mutex objectLock;
+std::condition_variable objectSignaled;
+
+class KernelObject {
+public:
+	KernelObject() : m_refCount(1) {}
+	virtual ~KernelObject() {}
+
+	void addRef() { ++m_refCount; }
+	void release() { if (!--m_refCount) delete this; }
+
+	// Called with objectLock held. Returns true and consumes the signal if the object is signaled.
+	virtual bool acquire() { return false; }
+	virtual bool isWaitable() const { return false; }
+
+private:
+	std::atomic<int> m_refCount;
+};
+
+class Event : public KernelObject {
+public:
+	Event(bool manualReset, bool initialState) : m_manualReset(manualReset), m_isSignaled(initialState) {}
+
+	void set() { m_isSignaled = true; }
+	void reset() { m_isSignaled = false; }
+
+	virtual bool acquire() {
+		if (!m_isSignaled) return false;
+		if (!m_manualReset) m_isSignaled = false;
+		return true;
+	}
+	virtual bool isWaitable() const { return true; }
+
+private:
+	const bool m_manualReset;
+	bool m_isSignaled;
+};
+
+class Semaphore : public KernelObject {
+public:
+	Semaphore(LONG initialCount, LONG maximumCount) : m_count(initialCount), m_maximumCount(maximumCount) {}
+
+	bool release(LONG count, LONG* previousCount) {
+		if (count <= 0 || m_count + count > m_maximumCount) return false;
+		if (previousCount) *previousCount = m_count;
+		m_count += count;
+		return true;
+	}
+
+	virtual bool acquire() {
+		if (!m_count) return false;
+		m_count--;
+		return true;
+	}
+	virtual bool isWaitable() const { return true; }
+
+private:
+	LONG m_count;
+	const LONG m_maximumCount;
+};
+
+// Signaled when the thread procedure returns. The running thread holds a reference.
+class Thread : public KernelObject {
+public:
+	Thread() : m_isExited(false), m_thread() {}
+
+	void exit() { m_isExited = true; }
+	void setNativeHandle(pthread_t thread) { m_thread = thread; }
+	pthread_t getNativeHandle() const { return m_thread; }
+
+	virtual bool acquire() { return m_isExited; }
+	virtual bool isWaitable() const { return true; }
+
+private:
+	bool m_isExited;
+	pthread_t m_thread;
+};
+
+class File : public KernelObject {
+public:
+	explicit File(FILE* file) : m_file(file) {}
+	virtual ~File() { fclose(m_file); }
+
+	FILE* get() const { return m_file; }
+
+private:
+	FILE* m_file;
+};
+
+// Shared memory object of "/name". The name is removed when the handle of the process that created it is closed.
+class FileMapping : public KernelObject {
+public:
+	FileMapping(int fd, const std::string& path, bool isCreated, bool isWritable)
+		: m_fd(fd), m_path(path), m_isCreated(isCreated), m_isWritable(isWritable) {}
+	virtual ~FileMapping() {
+		close(m_fd);
+		if (m_isCreated) shm_unlink(m_path.c_str());
+	}
+
+	int get() const { return m_fd; }
+	bool isWritable() const { return m_isWritable; }
+
+private:
+	const int m_fd;
+	const std::string m_path;
+	const bool m_isCreated;
+	const bool m_isWritable;
+};
+
+KernelObject* getObject(HANDLE handle)
+{
+	if (!handle || handle == INVALID_HANDLE_VALUE) return NULL;
+	return (KernelObject*)handle;
+}
+
+template<class T>
+T* getObject(HANDLE handle)
+{
+	T* object = dynamic_cast<T*>(getObject(handle));
+	if (!object) SetLastError(ERROR_INVALID_HANDLE);
+	return object;
+}
+
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+	KernelObject* object = getObject(handle);
+	if (!object) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+	object->release();
+	return TRUE;
+}
+
+HANDLE CreateThread(void* /*attributes*/, SIZE_T /*stackSize*/, LPTHREAD_START_ROUTINE proc, LPVOID parameter, DWORD /*flags*/, DWORD* threadId)
+{
+	Thread* thread = new Thread();
+	thread->addRef();
+	std::thread worker([thread, proc, parameter]() {
+		proc(parameter);
+		{
+			std::lock_guard<std::mutex> lock(objectLock);
+			thread->exit();
+		}
+		objectSignaled.notify_all();
+		thread->release();
+	});
+	thread->setNativeHandle(worker.native_handle());
+	worker.detach();
+	if (threadId) *threadId = (DWORD)(uintptr_t)thread;
+	return thread;
+}
+
+/*
+	THREAD_PRIORITY_HIGHEST and above are mapped to SCHED_FIFO when the process is allowed to use it.
+	Otherwise the priority is left unchanged and the call succeeds, because the engine treats the priority as a hint.
+*/
+BOOL SetThreadPriority(HANDLE handle, int priority)
+{
+	Thread* thread = getObject<Thread>(handle);
+	if (!thread) return FALSE;
+	if (priority >= THREAD_PRIORITY_HIGHEST) {
+		sched_param param;
+		const int maximum = sched_get_priority_max(SCHED_FIFO);
+		param.sched_priority = (priority == THREAD_PRIORITY_TIME_CRITICAL) ? maximum : maximum / 2;
+		pthread_setschedparam(thread->getNativeHandle(), SCHED_FIFO, &param);
+	}
+	return TRUE;
+}
+
+HANDLE CreateEvent(void* /*attributes*/, BOOL manualReset, BOOL initialState, LPCTSTR /*name*/)
+{
+	return new Event(manualReset ? true : false, initialState ? true : false);
+}
+
+BOOL SetEvent(HANDLE handle)
+{
+	Event* event = getObject<Event>(handle);
+	if (!event) return FALSE;
+	{
+		std::lock_guard<std::mutex> lock(objectLock);
+		event->set();
+	}
+	objectSignaled.notify_all();
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE handle)
+{
+	Event* event = getObject<Event>(handle);
+	if (!event) return FALSE;
+	std::lock_guard<std::mutex> lock(objectLock);
+	event->reset();
+	return TRUE;
+}
+
+HANDLE CreateSemaphore(void* /*attributes*/, LONG initialCount, LONG maximumCount, LPCTSTR /*name*/)
+{
+	if (initialCount < 0 || maximumCount <= 0 || initialCount > maximumCount) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+	return new Semaphore(initialCount, maximumCount);
+}
+
+BOOL ReleaseSemaphore(HANDLE handle, LONG releaseCount, LONG* previousCount)
+{
+	Semaphore* semaphore = getObject<Semaphore>(handle);
+	if (!semaphore) return FALSE;
+	{
+		std::lock_guard<std::mutex> lock(objectLock);
+		if (!semaphore->release(releaseCount, previousCount)) {
+			SetLastError(ERROR_INVALID_PARAMETER);
+			return FALSE;
+		}
+	}
+	objectSignaled.notify_all();
+	return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+	return WaitForMultipleObjects(1, &handle, TRUE, milliseconds);
+}
+
+/*
+	With waitAll = TRUE, signals are consumed only when all objects are signaled at the same time.
+*/
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds)
+{
+	std::vector<KernelObject*> objects(count);
+	for (DWORD i = 0; i < count; i++) {
+		objects[i] = getObject(handles[i]);
+		if (!objects[i] || !objects[i]->isWaitable()) {
+			SetLastError(ERROR_INVALID_HANDLE);
+			return WAIT_FAILED;
+		}
+	}
+
+	// Returns WAIT_OBJECT_0 + index if the wait is satisfied, otherwise WAIT_TIMEOUT.
+	auto check = [&]() -> DWORD {
+		if (!waitAll) {
+			for (DWORD i = 0; i < count; i++) {
+				if (objects[i]->acquire()) return WAIT_OBJECT_0 + i;
+			}
+			return WAIT_TIMEOUT;
+		}
+		// Auto-reset objects would lose their signal if only some of them were acquired.
+		// Threads and manual-reset events can be tested without consuming anything.
+		DWORD acquired = 0;
+		for (; acquired < count; acquired++) {
+			if (!objects[acquired]->acquire()) break;
+		}
+		if (acquired == count) return WAIT_OBJECT_0;
+		for (DWORD i = 0; i < acquired; i++) {
+			if (Event* event = dynamic_cast<Event*>(objects[i])) event->set();
+			else if (Semaphore* semaphore = dynamic_cast<Semaphore*>(objects[i])) semaphore->release(1, NULL);
+		}
+		return WAIT_TIMEOUT;
+	};
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	std::unique_lock<std::mutex> lock(objectLock);
+	for (;;) {
+		const DWORD result = check();
+		if (result != WAIT_TIMEOUT) return result;
+		if (milliseconds == INFINITE) {
+			objectSignaled.wait(lock);
+		} else if (objectSignaled.wait_until(lock, deadline) == std::cv_status::timeout) {
+			return check();
+		}
+	}
+}
+
+void Sleep(DWORD milliseconds)
+{
+	if (milliseconds) std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+	else std::this_thread::yield();
+}
+
+// The counter runs at 10 MHz like most Windows systems, so that the engine's 64-bit time arithmetic has the same range.
+static const LONGLONG PerformanceFrequency = 10000000;
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	count->QuadPart = std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, PerformanceFrequency>>>(now).count();
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = PerformanceFrequency;
+	return TRUE;
+}
+
+void GetSystemInfo(SYSTEM_INFO* info)
+{
+	info->dwPageSize = (DWORD)sysconf(_SC_PAGESIZE);
+	info->dwNumberOfProcessors = (DWORD)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+/*
+	Files.
+*/
+HANDLE CreateFile(LPCTSTR path, DWORD access, DWORD /*shareMode*/, void* /*attributes*/, DWORD disposition, DWORD /*flags*/, HANDLE /*templateFile*/)
+{
+	const char* mode;
+	if (disposition == CREATE_ALWAYS) mode = (access & GENERIC_READ) ? "w+b" : "wb";
+	else if (disposition == OPEN_EXISTING) mode = (access & GENERIC_WRITE) ? "r+b" : "rb";
+	else {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return INVALID_HANDLE_VALUE;
+	}
+	FILE* file = fopen(path, mode);
+	if (!file) {
+		SetLastError(errorFromErrno(errno));
+		return INVALID_HANDLE_VALUE;
+	}
+	return new File(file);
+}
+
+BOOL ReadFile(HANDLE handle, void* buffer, DWORD size, DWORD* read, void* /*overlapped*/)
+{
+	File* file = getObject<File>(handle);
+	if (!file) return FALSE;
+	const size_t count = fread(buffer, 1, size, file->get());
+	if (read) *read = (DWORD)count;
+	if (count < size && ferror(file->get())) {
+		SetLastError(errorFromErrno(errno));
+		return FALSE;
+	}
+	// Reaching the end of the file is not an error of synchronous read.
+	return TRUE;
+}
+
+BOOL WriteFile(HANDLE handle, const void* buffer, DWORD size, DWORD* written, void* /*overlapped*/)
+{
+	File* file = getObject<File>(handle);
+	if (!file) return FALSE;
+	const size_t count = fwrite(buffer, 1, size, file->get());
+	if (written) *written = (DWORD)count;
+	if (count < size || fflush(file->get())) {
+		SetLastError(errorFromErrno(errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE handle, LARGE_INTEGER distance, LARGE_INTEGER* position, DWORD method)
+{
+	File* file = getObject<File>(handle);
+	if (!file) return FALSE;
+	const int whence = (method == FILE_BEGIN) ? SEEK_SET : (method == FILE_CURRENT) ? SEEK_CUR : SEEK_END;
+	if (fseeko(file->get(), distance.QuadPart, whence)) {
+		SetLastError(errorFromErrno(errno));
+		return FALSE;
+	}
+	if (position) position->QuadPart = ftello(file->get());
+	return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE handle, LARGE_INTEGER* size)
+{
+	File* file = getObject<File>(handle);
+	if (!file) return FALSE;
+	fflush(file->get());
+	struct stat status;
+	if (fstat(fileno(file->get()), &status)) {
+		SetLastError(errorFromErrno(errno));
+		return FALSE;
+	}
+	size->QuadPart = status.st_size;
+	return TRUE;
+}
+
+DWORD GetFileAttributes(LPCTSTR path)
+{
+	struct stat status;
+	if (stat(path, &status)) {
+		SetLastError(errorFromErrno(errno));
+		return INVALID_FILE_ATTRIBUTES;
+	}
+	// FILE_ATTRIBUTE_DIRECTORY or FILE_ATTRIBUTE_NORMAL.
+	return S_ISDIR(status.st_mode) ? 0x10 : 0x80;
+}
+
+static std::mutex viewLock;
+static std::map<const void*, SIZE_T> views;
+
+HANDLE CreateFileMapping(HANDLE file, void* /*attributes*/, DWORD /*protect*/, DWORD sizeHigh, DWORD sizeLow, LPCTSTR name)
+{
+	// Only named mappings backed by the paging file are emulated.
+	if (file != INVALID_HANDLE_VALUE || !name || !*name) {
+		SetLastError(ERROR_NOT_SUPPORTED);
+		return NULL;
+	}
+	const off_t size = (off_t)(((ULONGLONG)sizeHigh << 32) | sizeLow);
+	if (!size) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+
+	const std::string path = std::string("/") + name;
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (0 <= fd) {
+		if (ftruncate(fd, size)) {
+			SetLastError(errorFromErrno(errno));
+			close(fd);
+			shm_unlink(path.c_str());
+			return NULL;
+		}
+		SetLastError(ERROR_SUCCESS);
+		return new FileMapping(fd, path, true, true);
+	}
+	if (errno != EEXIST || (fd = shm_open(path.c_str(), O_RDWR, 0)) < 0) {
+		SetLastError(errorFromErrno(errno));
+		return NULL;
+	}
+	// The existing object keeps its size, as the existing mapping does.
+	SetLastError(ERROR_ALREADY_EXISTS);
+	return new FileMapping(fd, path, false, true);
+}
+
+HANDLE OpenFileMapping(DWORD access, BOOL /*inherit*/, LPCTSTR name)
+{
+	const bool isWritable = (access != FILE_MAP_READ);
+	const std::string path = std::string("/") + (name ? name : "");
+	const int fd = shm_open(path.c_str(), isWritable ? O_RDWR : O_RDONLY, 0);
+	if (fd < 0) {
+		SetLastError(errorFromErrno(errno));
+		return NULL;
+	}
+	return new FileMapping(fd, path, false, isWritable);
+}
+
+void* MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, SIZE_T size)
+{
+	FileMapping* object = getObject<FileMapping>(mapping);
+	if (!object) return NULL;
+	const bool isWritable = (access != FILE_MAP_READ);
+	if (offsetHigh || offsetLow || (isWritable && !object->isWritable())) {
+		SetLastError(offsetHigh || offsetLow ? ERROR_NOT_SUPPORTED : ERROR_ACCESS_DENIED);
+		return NULL;
+	}
+	struct stat status;
+	if (fstat(object->get(), &status)) {
+		SetLastError(errorFromErrno(errno));
+		return NULL;
+	}
+	// Size 0 maps whole of the object. A view can not be larger than the object.
+	if (!size) size = (SIZE_T)status.st_size;
+	if ((SIZE_T)status.st_size < size) {
+		SetLastError(ERROR_ACCESS_DENIED);
+		return NULL;
+	}
+
+	void* view = mmap(NULL, size, isWritable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, object->get(), 0);
+	if (view == MAP_FAILED) {
+		SetLastError(errorFromErrno(errno));
+		return NULL;
+	}
+	std::lock_guard<std::mutex> lock(viewLock);
+	views[view] = size;
+	return view;
+}
+
+BOOL UnmapViewOfFile(const void* address)
+{
+	std::lock_guard<std::mutex> lock(viewLock);
+	std::map<const void*, SIZE_T>::iterator it = views.find(address);
+	if (it == views.end()) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	munmap((void*)address, it->second);
+	views.erase(it);
+	return TRUE;
+}
+
+/*
+	Virtual memory.
+*/
+static std::mutex regionLock;
+static std::map<void*, SIZE_T> regions;
+static SIZE_T minimumWorkingSet = 200 * 4096;
+static SIZE_T maximumWorkingSet = 1380 * 4096;
+
+void* VirtualAlloc(void* address, SIZE_T size, DWORD type, DWORD /*protect*/)
+{
+	if (address || !(type & MEM_COMMIT) || (type & MEM_LARGE_PAGES)) {
+		SetLastError(ERROR_NOT_SUPPORTED);
+		return NULL;
+	}
+	void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		SetLastError(errorFromErrno(errno));
+		return NULL;
+	}
+	std::lock_guard<std::mutex> lock(regionLock);
+	regions[region] = size;
+	return region;
+}
+
+BOOL VirtualFree(void* address, SIZE_T size, DWORD type)
+{
+	std::lock_guard<std::mutex> lock(regionLock);
+	std::map<void*, SIZE_T>::iterator it = regions.find(address);
+	if (it == regions.end() || size || type != MEM_RELEASE) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	munmap(address, it->second);
+	regions.erase(it);
+	return TRUE;
+}
+
+BOOL VirtualLock(void* address, SIZE_T size)
+{
+	if (mlock(address, size)) {
+		SetLastError(errorFromErrno(errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL VirtualUnlock(void* address, SIZE_T size)
+{
+	if (munlock(address, size)) {
+		SetLastError(errorFromErrno(errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+SIZE_T GetLargePageMinimum() { return 0; }
+
+HANDLE GetCurrentProcess() { return (HANDLE)(intptr_t)-1; }
+
+BOOL GetProcessWorkingSetSize(HANDLE /*process*/, SIZE_T* minimum, SIZE_T* maximum)
+{
+	std::lock_guard<std::mutex> lock(regionLock);
+	*minimum = minimumWorkingSet;
+	*maximum = maximumWorkingSet;
+	return TRUE;
+}
+
+BOOL SetProcessWorkingSetSize(HANDLE /*process*/, SIZE_T minimum, SIZE_T maximum)
+{
+	if (minimum > maximum) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	std::lock_guard<std::mutex> lock(regionLock);
+	minimumWorkingSet = minimum;
+	maximumWorkingSet = maximum;
+	return TRUE;
+}
+
+BOOL OpenProcessToken(HANDLE /*process*/, DWORD /*access*/, HANDLE* /*token*/)
+{
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return FALSE;
+}
+
+BOOL LookupPrivilegeValue(LPCTSTR /*system*/, LPCTSTR /*name*/, LUID* /*luid*/)
+{
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return FALSE;
+}
+
+BOOL AdjustTokenPrivileges(HANDLE /*token*/, BOOL /*disableAll*/, TOKEN_PRIVILEGES* /*state*/, DWORD /*length*/, void* /*previous*/, void* /*returnLength*/)
+{
+	SetLastError(ERROR_NOT_SUPPORTED);
+	return FALSE;
+}
+
+void* _aligned_malloc(size_t size, size_t alignment)
+{
+	void* memory = NULL;
+	if (alignment < sizeof(void*)) alignment = sizeof(void*);
+	return posix_memalign(&memory, alignment, size) ? NULL : memory;
+}
+
+void _aligned_free(void* memory) { free(memory); }
+
+/*
+	Dynamic libraries.
+*/
+HMODULE LoadLibrary(LPCTSTR path)
+{
+	HMODULE module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!module) SetLastError(ERROR_MOD_NOT_FOUND);
+	return module;
+}
+
+FARPROC GetProcAddress(HMODULE module, LPCSTR name)
+{
+	FARPROC proc = dlsym(module, name);
+	if (!proc) SetLastError(ERROR_PROC_NOT_FOUND);
+	return proc;
+}
+
+BOOL FreeLibrary(HMODULE module)
+{
+	return dlclose(module) ? FALSE : TRUE;
+}
+
+/*
+	waveOut. There is no device.
+*/
+MMRESULT waveOutOpen(HWAVEOUT* /*waveOut*/, UINT /*device*/, const WAVEFORMATEX* /*format*/, DWORD_PTR /*callback*/, DWORD_PTR /*instance*/, DWORD /*flags*/) { return MMSYSERR_NODRIVER; }
+MMRESULT waveOutPrepareHeader(HWAVEOUT /*waveOut*/, WAVEHDR* /*header*/, UINT /*size*/) { return MMSYSERR_NODRIVER; }
+MMRESULT waveOutUnprepareHeader(HWAVEOUT /*waveOut*/, WAVEHDR* /*header*/, UINT /*size*/) { return MMSYSERR_NODRIVER; }
+MMRESULT waveOutWrite(HWAVEOUT /*waveOut*/, WAVEHDR* /*header*/, UINT /*size*/) { return MMSYSERR_NODRIVER; }
+MMRESULT waveOutReset(HWAVEOUT /*waveOut*/) { return MMSYSERR_NODRIVER; }
+MMRESULT waveOutClose(HWAVEOUT /*waveOut*/) { return MMSYSERR_NODRIVER; }
+
+/*
+	Registry. Key names are case-insensitive.
+*/
+static std::mutex registryLock;
+static std::map<std::string, std::map<std::string, DWORD>> registry;
+
+static std::string getKeyPath(HKEY parent, LPCTSTR name)
+{
+	std::string path = (parent == HKEY_LOCAL_MACHINE) ? "HKLM\\" : "HKCU\\";
+	path += name;
+	std::transform(path.begin(), path.end(), path.begin(), ::tolower);
+	return path;
+}
+
+LONG CRegKey::Open(HKEY parent, LPCTSTR name, DWORD /*access*/)
+{
+	const std::string path = getKeyPath(parent, name);
+	std::lock_guard<std::mutex> lock(registryLock);
+	if (!registry.count(path)) return ERROR_FILE_NOT_FOUND;
+	m_path = path;
+	return ERROR_SUCCESS;
+}
+
+LONG CRegKey::Create(HKEY parent, LPCTSTR name)
+{
+	m_path = getKeyPath(parent, name);
+	std::lock_guard<std::mutex> lock(registryLock);
+	registry[m_path];
+	return ERROR_SUCCESS;
+}
+
+LONG CRegKey::QueryDWORDValue(LPCTSTR name, DWORD& value)
+{
+	std::lock_guard<std::mutex> lock(registryLock);
+	if (m_path.empty()) return ERROR_INVALID_HANDLE;
+	const std::map<std::string, DWORD>& values = registry[m_path];
+	std::map<std::string, DWORD>::const_iterator it = values.find(name);
+	if (it == values.end()) return ERROR_FILE_NOT_FOUND;
+	value = it->second;
+	return ERROR_SUCCESS;
+}
+
+LONG CRegKey::SetDWORDValue(LPCTSTR name, DWORD value)
+{
+	std::lock_guard<std::mutex> lock(registryLock);
+	if (m_path.empty()) return ERROR_INVALID_HANDLE;
+	registry[m_path][name] = value;
+	return ERROR_SUCCESS;
+}
+
+/*
+	Media Foundation work queues.
+*/
+namespace {
+
+struct WorkQueue {
+	std::mutex lock;
+	std::condition_variable available;
+	std::deque<IMFAsyncCallback*> items;
+	bool isUnlocked = false;
+	std::thread thread;
+};
+
+std::mutex workQueueLock;
+std::map<DWORD, WorkQueue*> workQueues;
+DWORD nextWorkQueueId = 1;
+
+// Runs work items until the queue is unlocked and empty.
+void runWorkQueue(WorkQueue* queue)
+{
+	std::unique_lock<std::mutex> lock(queue->lock);
+	for (;;) {
+		queue->available.wait(lock, [queue]() { return queue->isUnlocked || !queue->items.empty(); });
+		if (queue->items.empty()) return;
+		IMFAsyncCallback* callback = queue->items.front();
+		queue->items.pop_front();
+		lock.unlock();
+		callback->Invoke(NULL);
+		lock.lock();
+	}
+}
+
+}
+
+HRESULT MFStartup(ULONG /*version*/, DWORD /*flags*/) { return S_OK; }
+HRESULT MFShutdown() { return S_OK; }
+
+HRESULT MFAllocateWorkQueue(DWORD* queueId)
+{
+	HR_ASSERT(queueId, E_POINTER);
+	WorkQueue* queue = new WorkQueue();
+	queue->thread = std::thread(runWorkQueue, queue);
+	std::lock_guard<std::mutex> lock(workQueueLock);
+	*queueId = nextWorkQueueId++;
+	workQueues[*queueId] = queue;
+	return S_OK;
+}
+
+HRESULT MFUnlockWorkQueue(DWORD queueId)
+{
+	WorkQueue* queue;
+	{
+		std::lock_guard<std::mutex> lock(workQueueLock);
+		std::map<DWORD, WorkQueue*>::iterator it = workQueues.find(queueId);
+		HR_ASSERT(it != workQueues.end(), E_INVALIDARG);
+		queue = it->second;
+		workQueues.erase(it);
+	}
+	{
+		std::lock_guard<std::mutex> lock(queue->lock);
+		queue->isUnlocked = true;
+	}
+	queue->available.notify_one();
+	queue->thread.join();
+	delete queue;
+	return S_OK;
+}
+
+HRESULT MFPutWorkItem(DWORD queueId, IMFAsyncCallback* callback, IUnknown* /*state*/)
+{
+	HR_ASSERT(callback, E_POINTER);
+	std::lock_guard<std::mutex> lock(workQueueLock);
+	std::map<DWORD, WorkQueue*>::iterator it = workQueues.find(queueId);
+	HR_ASSERT(it != workQueues.end(), E_INVALIDARG);
+	WorkQueue* queue = it->second;
+	{
+		std::lock_guard<std::mutex> queueLock(queue->lock);
+		queue->items.push_back(callback);
+	}
+	queue->available.notify_one();
+	return S_OK;
+}
+
+/*
+	log4cplus.
+*/
+namespace log4cplus {
+
+static std::atomic<LogLevel> threshold(-1);
+static std::mutex outputLock;
+
+static const char* getLevelName(LogLevel level)
+{
+	if (level >= FATAL_LOG_LEVEL) return "FATAL";
+	if (level >= ERROR_LOG_LEVEL) return "ERROR";
+	if (level >= WARN_LOG_LEVEL) return "WARN";
+	if (level >= INFO_LOG_LEVEL) return "INFO";
+	if (level >= DEBUG_LOG_LEVEL) return "DEBUG";
+	return "TRACE";
+}
+
+/*static*/ LogLevel Logger::getThreshold()
+{
+	LogLevel level = threshold;
+	if (level >= 0) return level;
+
+	level = ERROR_LOG_LEVEL;
+	if (const char* name = getenv("LOG4CPLUS_LEVEL")) {
+		static const LogLevel levels[] = { TRACE_LOG_LEVEL, DEBUG_LOG_LEVEL, INFO_LOG_LEVEL, WARN_LOG_LEVEL, ERROR_LOG_LEVEL, FATAL_LOG_LEVEL, OFF_LOG_LEVEL };
+		static const char* names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF" };
+		for (size_t i = 0; i < ARRAYSIZE(levels); i++) {
+			if (!strcasecmp(name, names[i])) level = levels[i];
+		}
+	}
+	threshold = level;
+	return level;
+}
+
+/*static*/ void Logger::setThreshold(LogLevel level)
+{
+	threshold = level;
+}
+
+void Logger::forcedLog(LogLevel level, const std::string& message) const
+{
+	std::lock_guard<std::mutex> lock(outputLock);
+	std::cerr << getLevelName(level) << " " << m_name << " - " << message << std::endl;
+}
+
+}
+
+/*
+	Error checking macros of win32/stdafx.h.
+*/
+namespace win32 {
+
+static log4cplus::Logger logger = log4cplus::Logger::getInstance(_T("win32"));
+
+HRESULT checkResult(HRESULT hr, const char* exp, const char* src, int line)
+{
+	if (FAILED(hr)) {
+		LOG4CPLUS_WARN(logger, src << "(" << line << "): " << exp << " failed. HRESULT=0x" << std::hex << hr);
+	}
+	return hr;
+}
+
+HRESULT checkWin32Result(bool result, const char* exp, const char* src, int line)
+{
+	if (result) return S_OK;
+	DWORD error = GetLastError();
+	if (error == ERROR_SUCCESS) error = ERROR_NOT_SUPPORTED;
+	return checkResult(HRESULT_FROM_WIN32(error), exp, src, line);
+}
+
+}
@@ -0,0 +1,2 @@
+// Not used by the engine sources.
+#pragma once
@@ -0,0 +1,4 @@
+// MFC is not available. Declares the Windows SDK subset.
+#pragma once
+
+#include <windows.h>
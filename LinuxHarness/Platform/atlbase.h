@@ -0,0 +1,110 @@
+// ATL subset used by the engine sources.
+
+#pragma once
+
+#include <windows.h>
+
+template<class T>
+class CComPtr {
+public:
+	CComPtr() : p(NULL) {}
+	CComPtr(T* other) : p(other) { if (p) p->AddRef(); }
+	CComPtr(const CComPtr& other) : p(other.p) { if (p) p->AddRef(); }
+	~CComPtr() { if (p) p->Release(); }
+	CComPtr& operator=(T* other) {
+		if (other) other->AddRef();
+		if (p) p->Release();
+		p = other;
+		return *this;
+	}
+	CComPtr& operator=(const CComPtr& other) { return *this = other.p; }
+	operator T*() const { return p; }
+	T* operator->() const { return p; }
+	T& operator*() const { return *p; }
+	T** operator&() { return &p; }
+	bool operator!() const { return !p; }
+	void Release() { T* old = p; p = NULL; if (old) old->Release(); }
+	void Attach(T* other) { if (p) p->Release(); p = other; }
+	T* Detach() { T* old = p; p = NULL; return old; }
+	HRESULT CopyTo(T** pp) const {
+		if (!pp) return E_POINTER;
+		*pp = p;
+		if (p) p->AddRef();
+		return S_OK;
+	}
+
+	T* p;
+};
+
+class CHandle {
+public:
+	CHandle() : m_h(NULL) {}
+	explicit CHandle(HANDLE h) : m_h(h) {}
+	~CHandle() { Close(); }
+	operator HANDLE() const { return m_h; }
+	void Attach(HANDLE h) { Close(); m_h = h; }
+	HANDLE Detach() { HANDLE h = m_h; m_h = NULL; return h; }
+	void Close() { if (m_h) { CloseHandle(m_h); m_h = NULL; } }
+
+private:
+	CHandle(const CHandle&);
+	void operator=(const CHandle&);
+
+	HANDLE m_h;
+};
+
+class CComAutoCriticalSection {
+public:
+	HRESULT Lock() { m_mutex.lock(); return S_OK; }
+	HRESULT Unlock() { m_mutex.unlock(); return S_OK; }
+
+private:
+	std::recursive_mutex m_mutex;
+};
+
+template<class T>
+class CComCritSecLock {
+public:
+	CComCritSecLock(T& section, bool initialLock = true) : m_section(section), m_isLocked(false) { if (initialLock) Lock(); }
+	~CComCritSecLock() { if (m_isLocked) Unlock(); }
+	HRESULT Lock() { m_section.Lock(); m_isLocked = true; return S_OK; }
+	void Unlock() { m_section.Unlock(); m_isLocked = false; }
+
+private:
+	T& m_section;
+	bool m_isLocked;
+};
+
+/*
+	Conversion classes. Strings are UTF-8 on both sides.
+*/
+class CA2T {
+public:
+	CA2T(LPCSTR text, UINT codePage = CP_UTF8) : m_text(text ? text : "") { (void)codePage; }
+	operator LPCTSTR() const { return m_text.c_str(); }
+
+private:
+	std::string m_text;
+};
+typedef CA2T CT2A;
+
+/*
+	Registry, kept in memory for the life of the process.
+	Only DWORD values are supported.
+*/
+#define HKEY_CURRENT_USER ((HKEY)(intptr_t)0x80000001)
+#define HKEY_LOCAL_MACHINE ((HKEY)(intptr_t)0x80000002)
+#define KEY_READ 0x20019
+#define KEY_WRITE 0x20006
+
+class CRegKey {
+public:
+	LONG Open(HKEY parent, LPCTSTR name, DWORD access = KEY_READ | KEY_WRITE);
+	LONG Create(HKEY parent, LPCTSTR name);
+	LONG QueryDWORDValue(LPCTSTR name, DWORD& value);
+	LONG SetDWORDValue(LPCTSTR name, DWORD value);
+
+private:
+	std::string m_path;
+};
+
@@ -0,0 +1,2 @@
+// GUID is declared by windows.h.
+#pragma once
@@ -0,0 +1,66 @@
+// Properties of log4cplus: key=value lines of a file.
+// Lines starting with # or ! are comments. Line continuation and escapes are not supported.
+
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace log4cplus {
+namespace helpers {
+
+class Properties {
+public:
+	Properties() {}
+
+	// A file that can't be opened results in empty properties.
+	explicit Properties(const std::string& path) {
+		std::ifstream file(path.c_str());
+		std::string line;
+		while (std::getline(file, line)) {
+			const size_t begin = line.find_first_not_of(" \t\r");
+			if (begin == std::string::npos || line[begin] == '#' || line[begin] == '!') continue;
+			const size_t separator = line.find('=', begin);
+			if (separator == std::string::npos) continue;
+			m_properties[trim(line.substr(begin, separator - begin))] = trim(line.substr(separator + 1));
+		}
+	}
+
+	bool exists(const std::string& key) const { return m_properties.count(key) != 0; }
+
+	std::string getProperty(const std::string& key) const {
+		std::map<std::string, std::string>::const_iterator it = m_properties.find(key);
+		return (it != m_properties.end()) ? it->second : std::string();
+	}
+
+	void setProperty(const std::string& key, const std::string& value) { m_properties[key] = value; }
+
+	std::vector<std::string> propertyNames() const {
+		std::vector<std::string> names;
+		for (const auto& property : m_properties) names.push_back(property.first);
+		return names;
+	}
+
+	// Returns properties whose key starts with prefix, with the prefix removed from the key.
+	Properties getPropertySubset(const std::string& prefix) const {
+		Properties subset;
+		for (const auto& property : m_properties) {
+			if (!property.first.compare(0, prefix.size(), prefix)) subset.m_properties[property.first.substr(prefix.size())] = property.second;
+		}
+		return subset;
+	}
+
+private:
+	static std::string trim(const std::string& text) {
+		const size_t begin = text.find_first_not_of(" \t\r");
+		if (begin == std::string::npos) return std::string();
+		return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+	}
+
+	std::map<std::string, std::string> m_properties;
+};
+
+}
+}
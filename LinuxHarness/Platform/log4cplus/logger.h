@@ -0,0 +1,37 @@
+// Logger of log4cplus, writing to stderr.
+// The threshold is taken from the environment variable LOG4CPLUS_LEVEL: TRACE, DEBUG, INFO, WARN, ERROR, FATAL or OFF.
+// The default is ERROR, so the harness output is not mixed with expected warnings such as xruns.
+
+#pragma once
+
+#include <string>
+
+namespace log4cplus {
+
+typedef int LogLevel;
+const LogLevel TRACE_LOG_LEVEL = 0;
+const LogLevel DEBUG_LOG_LEVEL = 10000;
+const LogLevel INFO_LOG_LEVEL = 20000;
+const LogLevel WARN_LOG_LEVEL = 30000;
+const LogLevel ERROR_LOG_LEVEL = 40000;
+const LogLevel FATAL_LOG_LEVEL = 50000;
+const LogLevel OFF_LOG_LEVEL = 60000;
+
+class Logger {
+public:
+	static Logger getInstance(const std::string& name) { return Logger(name); }
+
+	bool isEnabledFor(LogLevel level) const { return level >= getThreshold(); }
+	void forcedLog(LogLevel level, const std::string& message) const;
+
+	// Overrides LOG4CPLUS_LEVEL for all loggers.
+	static void setThreshold(LogLevel level);
+
+private:
+	explicit Logger(const std::string& name) : m_name(name) {}
+	static LogLevel getThreshold();
+
+	std::string m_name;
+};
+
+}
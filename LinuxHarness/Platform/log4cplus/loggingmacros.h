@@ -0,0 +1,23 @@
+// Logging macros of log4cplus.
+
+#pragma once
+
+#include <sstream>
+
+#include "logger.h"
+
+#define LOG4CPLUS_MACRO_BODY(logger, logEvent, level) \
+	do { \
+		if ((logger).isEnabledFor(log4cplus::level)) { \
+			std::ostringstream _log4cplus_buf; \
+			_log4cplus_buf << logEvent; \
+			(logger).forcedLog(log4cplus::level, _log4cplus_buf.str()); \
+		} \
+	} while (0)
+
+#define LOG4CPLUS_TRACE(logger, logEvent) LOG4CPLUS_MACRO_BODY(logger, logEvent, TRACE_LOG_LEVEL)
+#define LOG4CPLUS_DEBUG(logger, logEvent) LOG4CPLUS_MACRO_BODY(logger, logEvent, DEBUG_LOG_LEVEL)
+#define LOG4CPLUS_INFO(logger, logEvent) LOG4CPLUS_MACRO_BODY(logger, logEvent, INFO_LOG_LEVEL)
+#define LOG4CPLUS_WARN(logger, logEvent) LOG4CPLUS_MACRO_BODY(logger, logEvent, WARN_LOG_LEVEL)
+#define LOG4CPLUS_ERROR(logger, logEvent) LOG4CPLUS_MACRO_BODY(logger, logEvent, ERROR_LOG_LEVEL)
+#define LOG4CPLUS_FATAL(logger, logEvent) LOG4CPLUS_MACRO_BODY(logger, logEvent, FATAL_LOG_LEVEL)
@@ -0,0 +1,30 @@
+// Types of IMediaParams used by CEffectParameter.
+#pragma once
+
+typedef float MP_DATA;
+typedef DWORD MP_FLAGS;
+
+typedef enum {
+	MP_CURVE_JUMP = 0x1,
+	MP_CURVE_LINEAR = 0x2,
+	MP_CURVE_SQUARE = 0x4,
+	MP_CURVE_INVSQUARE = 0x8,
+	MP_CURVE_SINE = 0x10
+} MP_CURVE_TYPE;
+
+typedef struct {
+	REFERENCE_TIME rtStart;
+	REFERENCE_TIME rtEnd;
+	MP_DATA valStart;
+	MP_DATA valEnd;
+	MP_CURVE_TYPE iCurve;
+	MP_FLAGS flags;
+} MP_ENVELOPE_SEGMENT;
+
+#define MPF_ENVLP_STANDARD 0x0
+#define MPF_ENVLP_BEGIN_CURRENTVAL 0x1
+#define MPF_ENVLP_BEGIN_NEUTRALVAL 0x2
+#define MPF_PUNCHIN_REFTIME 0
+#define MPF_PUNCHIN_NOW 0x1
+#define MPF_PUNCHIN_STOPPED 0x2
+#define E_NOT_SUFFICIENT_BUFFER HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER)
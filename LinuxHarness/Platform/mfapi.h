@@ -0,0 +1,27 @@
+// Media Foundation work queues.
+
+#pragma once
+
+#include <windows.h>
+
+/*
+	Each queue is served by one thread, so work items of a queue run serially in the order they were put.
+	MFPutWorkItem() doesn't AddRef() the callback: the caller keeps it alive until it unlocks the queue.
+	Invoke() receives NULL as the async result.
+*/
+#define MF_VERSION 0x00020070
+
+struct IMFAsyncResult : public IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE GetState(IUnknown** ppunkState) = 0;
+};
+
+struct IMFAsyncCallback : public IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE GetParameters(DWORD* pdwFlags, DWORD* pdwQueue) = 0;
+	virtual HRESULT STDMETHODCALLTYPE Invoke(IMFAsyncResult* pAsyncResult) = 0;
+};
+
+HRESULT MFStartup(ULONG version, DWORD flags = 0);
+HRESULT MFShutdown();
+HRESULT MFAllocateWorkQueue(DWORD* queue);
+HRESULT MFUnlockWorkQueue(DWORD queue);
+HRESULT MFPutWorkItem(DWORD queue, IMFAsyncCallback* callback, IUnknown* state);
@@ -0,0 +1,6 @@
+// Wave format tags used by the engine sources.
+#pragma once
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
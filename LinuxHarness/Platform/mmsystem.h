@@ -0,0 +1,39 @@
+// waveOut API. There is no wave output device: waveOutOpen() fails with MMSYSERR_NODRIVER.
+#pragma once
+
+typedef struct HWAVEOUT__* HWAVEOUT;
+typedef UINT MMRESULT;
+
+typedef struct {
+	LPSTR lpData;
+	DWORD dwBufferLength;
+	DWORD dwBytesRecorded;
+	DWORD_PTR dwUser;
+	DWORD dwFlags;
+	DWORD dwLoops;
+	void* lpNext;
+	DWORD_PTR reserved;
+} WAVEHDR;
+
+typedef struct {
+	WORD wFormatTag;
+	WORD nChannels;
+	DWORD nSamplesPerSec;
+	DWORD nAvgBytesPerSec;
+	WORD nBlockAlign;
+	WORD wBitsPerSample;
+	WORD cbSize;
+} WAVEFORMATEX;
+
+#define WAVE_MAPPER ((UINT)-1)
+#define MMSYSERR_NOERROR 0
+#define MMSYSERR_NODRIVER 6
+#define WHDR_DONE 0x00000001
+#define CALLBACK_EVENT 0x00050000
+
+MMRESULT waveOutOpen(HWAVEOUT* waveOut, UINT device, const WAVEFORMATEX* format, DWORD_PTR callback, DWORD_PTR instance, DWORD flags);
+MMRESULT waveOutPrepareHeader(HWAVEOUT waveOut, WAVEHDR* header, UINT size);
+MMRESULT waveOutUnprepareHeader(HWAVEOUT waveOut, WAVEHDR* header, UINT size);
+MMRESULT waveOutWrite(HWAVEOUT waveOut, WAVEHDR* header, UINT size);
+MMRESULT waveOutReset(HWAVEOUT waveOut);
+MMRESULT waveOutClose(HWAVEOUT waveOut);
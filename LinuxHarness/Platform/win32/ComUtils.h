@@ -0,0 +1,33 @@
+// Reference counting of the win32 library.
+
+#pragma once
+
+#include <windows.h>
+
+/*
+	The count starts at 0 and the object is deleted when Release() brings it back to 0.
+	Objects that nobody AddRef()s, such as CAsioHandler owned by std::unique_ptr, are never deleted by Release().
+	QueryInterface() is not supported; the engine casts instead.
+*/
+class CUnknownImpl {
+public:
+	CUnknownImpl() : m_refCount(0) {}
+	virtual ~CUnknownImpl() {}
+	ULONG AddRefImpl() { return ++m_refCount; }
+	ULONG ReleaseImpl() {
+		ULONG count = --m_refCount;
+		if (!count) delete this;
+		return count;
+	}
+
+private:
+	std::atomic<ULONG> m_refCount;
+};
+
+#define IUNKNOWN_METHODS \
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** ppvObject) { if (ppvObject) *ppvObject = NULL; return E_NOINTERFACE; } \
+	virtual ULONG STDMETHODCALLTYPE AddRef() { return AddRefImpl(); } \
+	virtual ULONG STDMETHODCALLTYPE Release() { return ReleaseImpl(); }
+#define IUNKNOWN_INTERFACES(...)
+#define QITABENT(c, i) 0
+
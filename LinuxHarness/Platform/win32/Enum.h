@@ -0,0 +1,41 @@
+// ENUM macro of the win32 library.
+// Declares a class that wraps an enum and returns the name of its value by toString().
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace win32 {
+
+// Splits the stringized enumerator list into names.
+inline std::vector<std::string> parseEnumNames(const char* list)
+{
+	std::vector<std::string> names;
+	std::string name;
+	for (const char* p = list; ; p++) {
+		if (!*p || *p == ',') {
+			names.push_back(name);
+			name.clear();
+			if (!*p) break;
+		} else if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+			name += *p;
+		}
+	}
+	return names;
+}
+
+}
+
+#define ENUM(name, ...) \
+	class name { \
+	public: \
+		enum Values { __VA_ARGS__ }; \
+		name(Values value = (Values)0) : value(value) {} \
+		operator Values() const { return value; } \
+		const char* toString() const { \
+			static const std::vector<std::string> names = win32::parseEnumNames(#__VA_ARGS__); \
+			return ((size_t)value < names.size()) ? names[value].c_str() : "?"; \
+		} \
+		Values value; \
+	}
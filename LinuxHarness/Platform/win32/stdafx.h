@@ -0,0 +1,26 @@
+// Error checking macros of the win32 library.
+//   HR_ASSERT(exp, hr)  Returns hr from the calling function if exp is false.
+//   HR_ASSERT_OK(exp)   Returns the HRESULT of exp from the calling function if it failed.
+//   HR_EXPECT(exp, hr)  Evaluates to hr if exp is false, otherwise to S_OK.
+//   HR_EXPECT_OK(exp)   Evaluates to the HRESULT of exp.
+//   WIN32_ASSERT(exp)   Returns HRESULT_FROM_WIN32(GetLastError()) from the calling function if exp is false.
+//   WIN32_EXPECT(exp)   Evaluates to HRESULT_FROM_WIN32(GetLastError()) if exp is false, otherwise to S_OK.
+// Failed HRESULTs are written to the log at WARN level with the expression and the source position.
+
+#pragma once
+
+#include <windows.h>
+
+namespace win32 {
+
+HRESULT checkResult(HRESULT hr, const char* exp, const char* src, int line);
+HRESULT checkWin32Result(bool result, const char* exp, const char* src, int line);
+
+}
+
+#define HR_EXPECT(exp, hr) ((exp) ? S_OK : win32::checkResult(hr, #exp, __FILE__, __LINE__))
+#define HR_EXPECT_OK(exp) win32::checkResult(exp, #exp, __FILE__, __LINE__)
+#define HR_ASSERT(exp, hr) do { if (!(exp)) return win32::checkResult(hr, #exp, __FILE__, __LINE__); } while (0)
+#define HR_ASSERT_OK(exp) do { HRESULT _hr = HR_EXPECT_OK(exp); if (FAILED(_hr)) return _hr; } while (0)
+#define WIN32_EXPECT(exp) win32::checkWin32Result((exp) ? true : false, #exp, __FILE__, __LINE__)
+#define WIN32_ASSERT(exp) do { HRESULT _hr = WIN32_EXPECT(exp); if (FAILED(_hr)) return _hr; } while (0)
@@ -0,0 +1,304 @@
+// Windows SDK subset used by the engine sources of DmoEffector.
+// Implemented by Win32.cpp with the C++ standard library and POSIX.
+// Only what the engine sources call is declared. Behavior follows the Windows documentation.
+
+#pragma once
+
+// Standard headers that the engine sources and the harness programs include after stdafx.h.
+// They are included before min() and max() macros are defined.
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <emmintrin.h>
+
+/*
+	Basic types.
+
+	The harness is built without UNICODE, so TCHAR is char.
+*/
+typedef int32_t HRESULT;
+typedef uint32_t DWORD;
+typedef int BOOL;
+typedef int32_t LONG;
+typedef int32_t INT32;
+typedef uint32_t ULONG;
+typedef unsigned int UINT;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef size_t SIZE_T;
+typedef uintptr_t DWORD_PTR;
+typedef intptr_t LONG_PTR;
+typedef void* LPVOID;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* HWND;
+typedef void* HKEY;
+typedef void* FARPROC;
+typedef char CHAR;
+typedef char TCHAR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef char* LPTSTR;
+typedef const char* LPCTSTR;
+typedef wchar_t WCHAR;
+typedef const wchar_t* LPCWSTR;
+typedef int64_t REFERENCE_TIME;
+typedef union { struct { DWORD LowPart; LONG HighPart; }; LONGLONG QuadPart; } LARGE_INTEGER;
+
+#define _T(x) x
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define CALLBACK
+#define STDMETHODCALLTYPE
+#define __RPC__in_opt
+#define __RPC__out
+#define MAX_PATH 260
+#define MAXLONG 0x7fffffff
+#define MAXDWORD 0xffffffff
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define ZeroMemory(p, n) memset((p), 0, (n))
+#define CopyMemory(d, s, n) memcpy((d), (s), (n))
+#define MoveMemory(d, s, n) memmove((d), (s), (n))
+#define FillMemory(d, n, v) memset((d), (v), (n))
+#define YieldProcessor() __builtin_ia32_pause()
+#define CP_UTF8 65001
+
+/*
+	HRESULT and Win32 error codes.
+*/
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_NOINTERFACE ((HRESULT)0x80004002L)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define E_ABORT ((HRESULT)0x80004004L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFFL)
+#define E_BOUNDS ((HRESULT)0x8000000BL)
+#define E_ILLEGAL_STATE_CHANGE ((HRESULT)0x8000000DL)
+#define E_ILLEGAL_METHOD_CALL ((HRESULT)0x8000000EL)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | 0x80070000))
+
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_MOD_NOT_FOUND 126L
+#define ERROR_PROC_NOT_FOUND 127L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_REVISION_MISMATCH 1306L
+#define ERROR_NOT_SUPPORTED 50L
+
+DWORD GetLastError();
+void SetLastError(DWORD error);
+
+/*
+	Kernel objects.
+
+	A HANDLE points to an object that CloseHandle() deletes.
+	Threads, events and semaphores can be waited for.
+*/
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xFFFFFFFF
+
+#define THREAD_PRIORITY_LOWEST -2
+#define THREAD_PRIORITY_BELOW_NORMAL -1
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_ABOVE_NORMAL 1
+#define THREAD_PRIORITY_HIGHEST 2
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID parameter);
+
+BOOL CloseHandle(HANDLE handle);
+HANDLE CreateThread(void* attributes, SIZE_T stackSize, LPTHREAD_START_ROUTINE proc, LPVOID parameter, DWORD flags, DWORD* threadId);
+BOOL SetThreadPriority(HANDLE thread, int priority);
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, LPCTSTR name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+HANDLE CreateSemaphore(void* attributes, LONG initialCount, LONG maximumCount, LPCTSTR name);
+BOOL ReleaseSemaphore(HANDLE semaphore, LONG releaseCount, LONG* previousCount);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds);
+void Sleep(DWORD milliseconds);
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+
+typedef struct {
+	DWORD dwPageSize;
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+void GetSystemInfo(SYSTEM_INFO* info);
+
+/*
+	Files.
+*/
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 0x1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+
+HANDLE CreateFile(LPCTSTR path, DWORD access, DWORD shareMode, void* attributes, DWORD disposition, DWORD flags, HANDLE templateFile);
+BOOL ReadFile(HANDLE file, void* buffer, DWORD size, DWORD* read, void* overlapped);
+BOOL WriteFile(HANDLE file, const void* buffer, DWORD size, DWORD* written, void* overlapped);
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* position, DWORD method);
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size);
+DWORD GetFileAttributes(LPCTSTR path);
+
+/*
+	Named shared memory is a POSIX shared memory object of "/name", so that other processes such as TapReader can
+	open it by shm_open(). Only mappings backed by the paging file and views from offset 0 are supported.
+	The name is removed when the process that created it closes its handle. Readers that keep the memory mapped
+	see no later session, where on Windows they would keep the mapping alive for the next CreateFileMapping().
+*/
+#define PAGE_READWRITE 0x04
+#define FILE_MAP_READ 0x0004
+#define FILE_MAP_ALL_ACCESS 0xF001F
+
+HANDLE CreateFileMapping(HANDLE file, void* attributes, DWORD protect, DWORD sizeHigh, DWORD sizeLow, LPCTSTR name);
+HANDLE OpenFileMapping(DWORD access, BOOL inherit, LPCTSTR name);
+void* MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, SIZE_T size);
+BOOL UnmapViewOfFile(const void* address);
+
+/*
+	Virtual memory and working set.
+
+	Large pages are not available: GetLargePageMinimum() returns 0.
+	The working set size is recorded but has no effect; VirtualLock() calls mlock().
+*/
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+#define MEM_LARGE_PAGES 0x20000000
+
+void* VirtualAlloc(void* address, SIZE_T size, DWORD type, DWORD protect);
+BOOL VirtualFree(void* address, SIZE_T size, DWORD type);
+BOOL VirtualLock(void* address, SIZE_T size);
+BOOL VirtualUnlock(void* address, SIZE_T size);
+SIZE_T GetLargePageMinimum();
+HANDLE GetCurrentProcess();
+BOOL GetProcessWorkingSetSize(HANDLE process, SIZE_T* minimum, SIZE_T* maximum);
+BOOL SetProcessWorkingSetSize(HANDLE process, SIZE_T minimum, SIZE_T maximum);
+
+struct LUID { DWORD LowPart; LONG HighPart; };
+struct LUID_AND_ATTRIBUTES { LUID Luid; DWORD Attributes; };
+struct TOKEN_PRIVILEGES { DWORD PrivilegeCount; LUID_AND_ATTRIBUTES Privileges[1]; };
+#define TOKEN_ADJUST_PRIVILEGES 0x0020
+#define TOKEN_QUERY 0x0008
+#define SE_PRIVILEGE_ENABLED 0x00000002
+#define SE_LOCK_MEMORY_NAME "SeLockMemoryPrivilege"
+
+BOOL OpenProcessToken(HANDLE process, DWORD access, HANDLE* token);
+BOOL LookupPrivilegeValue(LPCTSTR system, LPCTSTR name, LUID* luid);
+BOOL AdjustTokenPrivileges(HANDLE token, BOOL disableAll, TOKEN_PRIVILEGES* state, DWORD length, void* previous, void* returnLength);
+
+void* _aligned_malloc(size_t size, size_t alignment);
+void _aligned_free(void* memory);
+
+/*
+	Dynamic libraries, through dlopen().
+*/
+HMODULE LoadLibrary(LPCTSTR path);
+FARPROC GetProcAddress(HMODULE module, LPCSTR name);
+BOOL FreeLibrary(HMODULE module);
+
+/*
+	C runtime.
+*/
+#define _tcsicmp strcasecmp
+#define _tcsnicmp strncasecmp
+#define _tcstol strtol
+#define _tcstod strtod
+#define _ttol atol
+
+template<size_t N, class... Args>
+int _stprintf_s(char (&buffer)[N], const char* format, Args... args) { return snprintf(buffer, N, format, args...); }
+template<size_t N, class... Args>
+int sprintf_s(char (&buffer)[N], const char* format, Args... args) { return snprintf(buffer, N, format, args...); }
+inline int strcpy_s(char* buffer, size_t size, const char* source) {
+	if (strlen(source) >= size) { if (size) buffer[0] = '\0'; return ERROR_INSUFFICIENT_BUFFER; }
+	strcpy(buffer, source);
+	return 0;
+}
+template<size_t N>
+int strcpy_s(char (&buffer)[N], const char* source) { return strcpy_s(buffer, N, source); }
+
+/*
+	COM.
+*/
+struct GUID {
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+typedef GUID IID;
+typedef GUID CLSID;
+typedef const GUID& REFGUID;
+typedef const GUID& REFIID;
+typedef const GUID& REFCLSID;
+inline bool operator==(const GUID& a, const GUID& b) { return !memcmp(&a, &b, sizeof(GUID)); }
+inline bool operator!=(const GUID& a, const GUID& b) { return !(a == b); }
+extern const GUID IID_IUnknown;
+
+#define MIDL_INTERFACE(x) struct
+
+struct IUnknown {
+	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) = 0;
+	virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+	virtual ULONG STDMETHODCALLTYPE Release() = 0;
+	virtual ~IUnknown() {}
+};
+
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+
+// MSVC expands __FUNCTION__ to a string literal that can be concatenated with other literals.
+#define __FUNCTION__ ""
@@ -0,0 +1,171 @@
+// TapAttach.cpp : Checks that TapReader attaches to the shared memory tap of a running engine and reads its blocks.
+//
+// Usage:
+//   TapAttach [seconds]
+//
+// CAsioHandler runs on CLoopbackDriver with the shared tap configured for all inputs and outputs. The effect chain
+// writes a constant level to each output, which the loopback returns to the input of the same channel. bin/TapReader
+// runs as another process, attaches to the tap by its name and prints the blocks it read and the peak of each channel
+// every second. Its output is read for the seconds, and then it is terminated.
+//
+// TapReader should attach with every channel of the tap, read blocks at the rate of the engine without overrun, and
+// see the level of every channel.
+
+#include "stdafx.h"
+#include "AsioHandler.h"
+#include "LoopbackDriver.h"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const double SampleRate = 48000;
+static const long NumChannels = 2;
+static const long BufferSize = 256;
+static const float Level = 0.5f;
+// Peak in dBFS expected by TapReader, and the tolerance. The loopback filter may overshoot after a dropped buffer.
+static const double LevelDb = -6.02;
+static const double MaxLevelErrorDb = 1;
+
+/*
+	Effect that writes the level to every channel.
+*/
+class CLevelEffect : public CEffect
+{
+public:
+	virtual LPCTSTR getName() const { return _T("Level"); }
+
+	virtual void process(float* const* channels, long numChannels, long frames) {
+		for (long channel = 0; channel < numChannels; channel++) {
+			std::fill(channels[channel], channels[channel] + frames, Level);
+		}
+	}
+};
+
+static CEffectChain* createEffectChain()
+{
+	CEffectChain* chain = new CEffectChain();
+	chain->addEffect(new CLevelEffect());
+	return chain;
+}
+
+/*
+	Runs TapReader for the seconds and returns its output. Returns false if it could not be run.
+*/
+static bool runTapReader(const std::string& path, const std::string& name, double seconds, std::string& output)
+{
+	int fds[2];
+	if (pipe(fds)) return false;
+	const pid_t pid = fork();
+	if (pid < 0) return false;
+	if (!pid) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(path.c_str(), path.c_str(), name.c_str(), (char*)NULL);
+		_exit(127);
+	}
+	close(fds[1]);
+
+	const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds((long)(seconds * 1000));
+	for (auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now()) {
+		pollfd fd = { fds[0], POLLIN, 0 };
+		const int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count() + 1;
+		if (poll(&fd, 1, timeout) <= 0) continue;
+		char buffer[256];
+		const ssize_t size = read(fds[0], buffer, sizeof(buffer));
+		if (size <= 0) break;
+		output.append(buffer, size);
+	}
+	kill(pid, SIGTERM);
+	int status;
+	waitpid(pid, &status, 0);
+	close(fds[0]);
+	return !WIFEXITED(status) || (WEXITSTATUS(status) != 127);
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = (1 < argc) ? atof(argv[1]) : 4;
+	if (seconds <= 0) {
+		printf("Usage: TapAttach [seconds]\n");
+		return 2;
+	}
+	// TapReader is built next to this program.
+	std::string readerPath(argv[0]);
+	const size_t separator = readerPath.rfind('/');
+	readerPath = ((separator == std::string::npos) ? std::string() : readerPath.substr(0, separator + 1)) + "TapReader";
+	// Name of this process, so that runs at the same time don't share the tap.
+	char name[64];
+	snprintf(name, sizeof(name), "DmoEffectorTapAttach%ld", (long)getpid());
+
+	CComPtr<IASIO> driver;
+	driver.Attach(new CLoopbackDriver(NumChannels, BufferSize, SampleRate));
+	std::unique_ptr<CAsioHandler> handler(new CAsioHandler());
+	const DWORD mask = (1 << NumChannels) - 1;
+	handler->sharedTap.configure(name, mask, mask);
+
+	// Setup and start are handled by the work queue thread.
+	HRESULT hr = handler->setup(driver, NULL, 0, createEffectChain());
+	Sleep(200);
+	if (SUCCEEDED(hr)) hr = handler->start();
+	Sleep(200);
+	if (FAILED(hr) || !handler->sharedTap.isOpen()) {
+		printf("Failed to start with the shared tap '%s': HRESULT=0x%08x\n", name, hr);
+		return 1;
+	}
+
+	std::string output;
+	const bool isRun = runTapReader(readerPath, name, seconds, output);
+	handler->stop();
+	Sleep(100);
+	handler->shutdown();
+	if (!isRun) {
+		printf("Failed to run %s\n", readerPath.c_str());
+		return 1;
+	}
+
+	// Attached: <channels> channels (inputs 0x.., outputs 0x..), <frames> frames, ...
+	// <blocks> blocks, <overruns> overruns, peak dBFS: <peak of each channel>
+	unsigned attachedChannels = 0, attachedFrames = 0;
+	unsigned long long blocks = 0, overruns = 0, reports = 0;
+	double minPeak = 0, maxPeak = -1000;
+	std::istringstream lines(output);
+	std::string line;
+	while (std::getline(lines, line)) {
+		unsigned channels, frames;
+		unsigned long long lineBlocks, lineOverruns;
+		int read;
+		if (sscanf(line.c_str(), "Attached: %u channels (inputs 0x%*x, outputs 0x%*x), %u frames", &channels, &frames) == 2) {
+			attachedChannels = channels;
+			attachedFrames = frames;
+		} else if (sscanf(line.c_str(), "%llu blocks, %llu overruns, peak dBFS:%n", &lineBlocks, &lineOverruns, &read) == 2) {
+			// Counts are totals since attached. Peaks are of the last second.
+			blocks = lineBlocks;
+			overruns = lineOverruns;
+			reports++;
+			double peak;
+			int length;
+			for (const char* p = line.c_str() + read; sscanf(p, "%lf%n", &peak, &length) == 1; p += length) {
+				minPeak = min(minPeak, peak);
+				maxPeak = max(maxPeak, peak);
+			}
+		}
+	}
+
+	// Each report covers a second.
+	const double expectedBlocks = reports * SampleRate / BufferSize;
+	const bool passed = (attachedChannels == NumChannels * 2) && (attachedFrames == BufferSize)
+		&& reports && (expectedBlocks / 2 <= blocks) && !overruns
+		&& (LevelDb - MaxLevelErrorDb <= minPeak) && (maxPeak <= LevelDb + MaxLevelErrorDb);
+	printf("Tap '%s': %u channels of %u frames, %llu reports\n", name, attachedChannels, attachedFrames, reports);
+	printf("Read %llu blocks of %.0f expected, %llu overruns, peak %.1f to %.1f dBFS  %s\n",
+		blocks, expectedBlocks, overruns, minPeak, maxPeak, passed ? "PASS" : "FAIL");
+	if (!passed) printf("Output of TapReader:\n%s", output.c_str());
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+// TraceReplay.cpp : Records a trace of CAsioHandler and replays it by CTraceReplayer, or replays a trace file.
+//
+// Usage:
+//   TraceReplay [seconds]
+//   TraceReplay /replay <trace file> [effect chain properties] [/realtime]
+//
+// Without /replay, CAsioHandler runs on CLoopbackDriver for the seconds with input recorded to TracePath.
+// A parameter change and a replacement of the effect chain are recorded while it runs. Meanwhile another thread sends
+// asioMessage() as a driver may do from its own thread, so that messages are recorded with the records of the user.
+// The trace is replayed as fast as possible and then in real time. Both replays should pass all buffer switches
+// recorded to the engine, and the real time replay should take as long as the recording.
+//
+// /replay replays a trace recorded on Windows or by this program, with the chain of the effect chain properties
+// if given, or with CGainEffect as CMainController does. This is the entry point of CMainController::replayTrace()
+// for Linux, so that a glitch recorded on the device can be reproduced and profiled here.
+
+#include "stdafx.h"
+#include "AsioHandler.h"
+#include "EffectChainConfig.h"
+#include "GainEffect.h"
+#include "LoopbackDriver.h"
+#include "TraceReplayer.h"
+
+#include <thread>
+
+static const double SampleRate = 48000;
+static const long NumChannels = 2;
+static const long BufferSize = 256;
+static LPCTSTR TracePath = _T("bin/TraceReplay.trace");
+// Difference of the time of the real time replay from the duration of the trace.
+static const double MaxTimeError = 0.05;
+// Interval of asioMessage() sent while recording.
+static const DWORD MessageInterval = 5;
+
+// Configuration of the chain used by createEffectChain(). NULL uses CGainEffect.
+static std::unique_ptr<CEffectChainConfig> effectChainConfig;
+
+/*
+	Factory of the chain for the recording and the replays.
+*/
+static CEffectChain* createEffectChain()
+{
+	if (effectChainConfig) return effectChainConfig->createEffectChain();
+
+	std::unique_ptr<CEffectChain> effectChain(new CEffectChain());
+	if (FAILED(HR_EXPECT_OK(effectChain->addEffect(new CGainEffect())))) return NULL;
+	return effectChain.release();
+}
+
+static int check(bool passed, const char* name, const CTraceReplayer::Result& result)
+{
+	printf("%-9s %9ld %7ld %7ld %5ld %7ld %5ld %8.1f %8.1f %8.2f %8.2f  %s\n",
+		name, result.bufferSwitches, result.skippedBufferSwitches, result.droppedRecords, result.xrun, result.droppedBuffers,
+		result.lateBuffers, result.meanProcessing * 1e6, result.maxProcessing * 1e6, result.duration, result.elapsed, passed ? "PASS" : "FAIL");
+	return passed ? 0 : 1;
+}
+
+static void printHeader()
+{
+	printf("Replay     Switches Skipped Dropped  Xrun Dropped  Late  Process  Process Duration  Elapsed\n");
+	printf("                            records       buffers           mean      max\n");
+	printf("                                                            (us)     (us)      (s)      (s)\n");
+}
+
+/*
+	Records the trace of the engine running for the seconds. Returns count of buffer switches of the engine, or -1 if failed.
+*/
+static LONGLONG record(double seconds)
+{
+	CComPtr<IASIO> driver;
+	driver.Attach(new CLoopbackDriver(NumChannels, BufferSize, SampleRate));
+	std::unique_ptr<CAsioHandler> handler(new CAsioHandler());
+	handler->traceRecorder.configure(TracePath, true);
+
+	// Setup and start are handled by the work queue thread.
+	HRESULT hr = handler->setup(driver, NULL, 0, createEffectChain());
+	Sleep(200);
+	if (SUCCEEDED(hr)) hr = handler->start();
+
+	std::atomic<bool> isRunning(true);
+	long messages = 0;
+	std::thread messenger([&]() {
+		for (; isRunning; messages++) {
+			handler->asioMessage(kAsioSelectorSupported, kAsioEngineVersion, NULL, NULL);
+			Sleep(MessageInterval);
+		}
+	});
+	Sleep((DWORD)(seconds * 500));
+
+	// Fades the gain down over a second and replaces the chain, so that the replay runs both.
+	MP_ENVELOPE_SEGMENT segment;
+	ZeroMemory(&segment, sizeof(segment));
+	segment.rtStart = handler->getStreamTime();
+	segment.rtEnd = segment.rtStart + 10000000;
+	segment.valStart = 1.0f;
+	segment.valEnd = 0.5f;
+	segment.iCurve = MP_CURVE_LINEAR;
+	if (SUCCEEDED(hr)) hr = handler->postParameterChange(0, CGainEffect::Gain, segment);
+	if (SUCCEEDED(hr)) hr = handler->replaceEffectChain(createEffectChain());
+	Sleep((DWORD)(seconds * 500));
+	isRunning = false;
+	messenger.join();
+
+	handler->stop();
+	Sleep(100);
+	const LONGLONG bufferSwitches = handler->statistics.bufferSwitch[0] + handler->statistics.bufferSwitch[1];
+	const long droppedRecords = handler->traceRecorder.getDroppedRecords();
+	handler->shutdown();
+	if (FAILED(hr) || !bufferSwitches) {
+		printf("Failed to record: HRESULT=0x%08x\n", hr);
+		return -1;
+	}
+	printf("Recorded %lld buffer switches and %ld messages of %.1f s to %s, %ld record(s) dropped\n",
+		(long long)bufferSwitches, messages, seconds, TracePath, droppedRecords);
+	return droppedRecords ? -1 : bufferSwitches;
+}
+
+static int recordAndReplay(double seconds)
+{
+	const LONGLONG bufferSwitches = record(seconds);
+	if (bufferSwitches < 0) return 1;
+
+	CTraceReplayer replayer(createEffectChain);
+	if (FAILED(replayer.load(TracePath))) {
+		printf("Failed to load %s\n", TracePath);
+		return 1;
+	}
+
+	printHeader();
+	int failures = 0;
+	const bool modes[] = { false, true };
+	for (bool isRealTime : modes) {
+		CTraceReplayer::Result result;
+		const HRESULT hr = replayer.replay(isRealTime, &result);
+		bool passed = SUCCEEDED(hr) && (result.bufferSwitches == bufferSwitches) && !result.skippedBufferSwitches && !result.droppedRecords;
+		// Fast replay waits for each buffer, so it should be faster than the device. Real time replay should keep the time.
+		if (isRealTime) passed = passed && (fabs(result.elapsed - result.duration) <= MaxTimeError * result.duration);
+		else passed = passed && !result.xrun && (result.elapsed < result.duration);
+		failures += check(passed, isRealTime ? "Real time" : "Fast", result);
+	}
+	return failures;
+}
+
+static int replay(LPCTSTR path, LPCTSTR configPath, bool isRealTime)
+{
+	if (configPath) {
+		effectChainConfig.reset(new CEffectChainConfig());
+		if (FAILED(effectChainConfig->load(configPath))) {
+			printf("Failed to load %s\n", configPath);
+			return 1;
+		}
+	}
+
+	CTraceReplayer replayer(createEffectChain);
+	if (FAILED(replayer.load(path))) {
+		printf("Failed to load %s\n", path);
+		return 1;
+	}
+	CTraceReplayer::Result result;
+	const HRESULT hr = replayer.replay(isRealTime, &result);
+	printHeader();
+	// The trace has not been replayed entirely if buffer switches are skipped, as CMainController::replayTrace().
+	return check(SUCCEEDED(hr) && !result.skippedBufferSwitches, isRealTime ? "Real time" : "Fast", result);
+}
+
+int main(int argc, char* argv[])
+{
+	if ((1 < argc) && !strcmp(argv[1], "/replay")) {
+		LPCTSTR path = NULL;
+		LPCTSTR configPath = NULL;
+		bool isRealTime = false;
+		for (int i = 2; i < argc; i++) {
+			if (!strcmp(argv[i], "/realtime")) isRealTime = true;
+			else if (!path) path = argv[i];
+			else configPath = argv[i];
+		}
+		if (!path) {
+			printf("Usage: TraceReplay /replay <trace file> [effect chain properties] [/realtime]\n");
+			return 2;
+		}
+		return replay(path, configPath, isRealTime);
+	}
+
+	const double seconds = (1 < argc) ? atof(argv[1]) : 4;
+	if (seconds <= 0) {
+		printf("Usage: TraceReplay [seconds]\n");
+		printf("       TraceReplay /replay <trace file> [effect chain properties] [/realtime]\n");
+		return 2;
+	}
+	return recordAndReplay(seconds);
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Builds the harness programs into bin/. See ReadMe.txt.
+#
+# Usage: ./build.sh [program...]
+#   Builds all programs if none is given. CXX and CXXFLAGS override the compiler and the flags.
+
+set -e
+cd "$(dirname "$0")"
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--O2}
+FLAGS="-std=c++14 -pthread -IPlatform -I../DmoEffector $CXXFLAGS"
+
+# Engine sources of DmoEffector. UI, COM driver loading and MainController are not built.
+ENGINE="AsioCallbackPool AsioHandler AsioHandlerContext AsioHandlerEvent AsioHandlerState
+	BlockAdapterEffect BlockFifo ClockBridge CompressorEffect DelayLine EchoCancellerEffect
+	Effect EffectChain EffectChainConfig EffectChainSwapper EffectGraph EffectParameter EffectPlugin
+	Fft GainEffect HalfBandFilter LatencyMeter LoopbackDriver OfflineRenderer OversamplerEffect
+	PitchShifterEffect RealTimeArena SampleClock SampleConverter SharedTap SpectrumAnalyzer
+	TraceDriver TraceRecorder TraceReplayer WaveFile WaveFileDriver WaveOutRenderer WorkerPool"
+PROGRAMS="GlitchRate CompressorBench EchoCanceller OversamplerBench PitchShifterBench ClockBridgeDrift MultiEngine TraceReplay ArmChannels OfflineRender ChainSwap TapAttach DitherSpectrum"
+
+mkdir -p bin/obj
+OBJECTS=bin/obj/Win32.o
+$CXX $FLAGS -c Platform/Win32.cpp -o bin/obj/Win32.o &
+for name in $ENGINE; do
+	$CXX $FLAGS -c ../DmoEffector/$name.cpp -o bin/obj/$name.o &
+	OBJECTS="$OBJECTS bin/obj/$name.o"
+done
+wait
+for object in $OBJECTS; do
+	test -f $object || { echo "Failed to compile $object" >&2; exit 1; }
+done
+
+for program in ${@:-$PROGRAMS}; do
+	$CXX $FLAGS $program.cpp $OBJECTS -o bin/$program -ldl
+	echo "bin/$program"
+	# TapAttach runs TapReader, which is built from its own source only as on any POSIX system.
+	if [ $program = TapAttach ]; then
+		$CXX -std=c++14 -pthread -I../DmoEffector $CXXFLAGS ../TapReader/TapReader.cpp -o bin/TapReader -lrt
+		echo "bin/TapReader"
+	fi
+done
@@ -0,0 +1,312 @@
+// TapReader.cpp : Sample reader of the shared memory tap published by DmoEffector.
+//
+// Usage:
+//   TapReader [name]                     Attaches to the tap and shows peak level of each channel every second.
+//   TapReader -throughput [seconds] [blocks per second]
+//                                        Writes and reads a tap of this process. Writer runs as fast as possible
+//                                        if blocks per second is omitted or 0.
+//
+// See ../DmoEffector/SharedTapRing.h for layout of the shared memory.
+
+#include "SharedTapRing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char DefaultName[] = "DmoEffectorTap";
+
+// ASIOSampleType values handled by this sample.
+enum {
+	ASIOSTInt16LSB = 16,
+	ASIOSTInt24LSB = 17,
+	ASIOSTInt32LSB = 18,
+	ASIOSTFloat32LSB = 19,
+};
+
+/*
+	Shared memory mapped to this process.
+
+	Windows: Named file mapping created by DmoEffector.
+	POSIX: Shared memory object of "/name". Win32 shared memory is not visible to POSIX processes,
+	       so this is used by writers on POSIX systems with the same layout, such as -throughput mode.
+*/
+class CSharedMemory
+{
+public:
+	CSharedMemory() : m_memory(NULL), m_size(0)
+#ifdef _WIN32
+		, m_mapping(NULL)
+#endif
+	{}
+	~CSharedMemory() { close(); }
+
+	// Opens existing shared memory. Size is taken from the header.
+	bool open(const char* name)
+	{
+#ifdef _WIN32
+		m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+		if (!m_mapping) return false;
+		// Size of view 0 maps whole of the shared memory.
+		m_memory = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		return m_memory != NULL;
+#else
+		std::string path = std::string("/") + name;
+		int fd = shm_open(path.c_str(), O_RDONLY, 0);
+		if (fd < 0) return false;
+		struct stat st;
+		fstat(fd, &st);
+		m_size = (size_t)st.st_size;
+		m_memory = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (m_memory == MAP_FAILED) m_memory = NULL;
+		return m_memory != NULL;
+#endif
+	}
+
+	// Creates shared memory of the size.
+	bool create(const char* name, size_t size)
+	{
+#ifdef _WIN32
+		m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, name);
+		if (!m_mapping) return false;
+		m_memory = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		return m_memory != NULL;
+#else
+		std::string path = std::string("/") + name;
+		int fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0600);
+		if (fd < 0) return false;
+		if (ftruncate(fd, (off_t)size) < 0) { ::close(fd); return false; }
+		m_size = size;
+		m_memory = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (m_memory == MAP_FAILED) m_memory = NULL;
+		return m_memory != NULL;
+#endif
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (m_memory) UnmapViewOfFile(m_memory);
+		if (m_mapping) CloseHandle(m_mapping);
+		m_mapping = NULL;
+#else
+		if (m_memory) munmap(m_memory, m_size);
+#endif
+		m_memory = NULL;
+	}
+
+	static void remove(const char* name)
+	{
+#ifndef _WIN32
+		shm_unlink((std::string("/") + name).c_str());
+#endif
+	}
+
+	void* get() const { return m_memory; }
+
+protected:
+	void* m_memory;
+	size_t m_size;
+#ifdef _WIN32
+	HANDLE m_mapping;
+#endif
+};
+
+static void sleepMilliseconds(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Returns absolute peak of the buffer in full scale. Returns -1 if the sample type is not handled.
+static float getPeak(const uint8_t* buffer, uint32_t sampleType, uint32_t frames)
+{
+	float peak = 0;
+	for (uint32_t i = 0; i < frames; i++) {
+		float value;
+		switch (sampleType) {
+		case ASIOSTInt16LSB: value = ((const int16_t*)buffer)[i] / 32768.0f; break;
+		case ASIOSTInt24LSB: {
+			const uint8_t* p = &buffer[i * 3];
+			value = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.0f;
+			break;
+		}
+		case ASIOSTInt32LSB: value = ((const int32_t*)buffer)[i] / 2147483648.0f; break;
+		case ASIOSTFloat32LSB: value = ((const float*)buffer)[i]; break;
+		default: return -1;
+		}
+		peak = (peak < fabsf(value)) ? fabsf(value) : peak;
+	}
+	return peak;
+}
+
+/*
+	Reads blocks at own pace.
+
+	Attaches again when the writer formats the shared memory for new session.
+	Blocks overwritten before or while being read are counted as overrun and skipped.
+*/
+static int read(const char* name)
+{
+	CSharedMemory memory;
+	while (!memory.open(name)) {
+		printf("Waiting for '%s' ...\n", name);
+		sleepMilliseconds(1000);
+	}
+	CSharedTapRing ring(memory.get());
+	const SharedTapHeader* header = ring.getHeader();
+
+	for (;;) {
+		uint32_t generation;
+		while (!ring.isFormatted(&generation)) sleepMilliseconds(100);
+		printf("Attached: %u channels (inputs 0x%x, outputs 0x%x), %u frames, type=%u, %.0f Hz, %u blocks\n",
+			header->numChannels, header->inputMask, header->outputMask,
+			header->blockFrames, header->sampleType, header->sampleRate, header->blockCount);
+
+		const uint32_t numChannels = header->numChannels;
+		const size_t bufferBytes = (size_t)header->blockFrames * header->sampleSize;
+		std::vector<float> peaks(numChannels);
+		uint64_t next = ring.getWriteSequence();
+		uint64_t overruns = 0, blocks = 0;
+		auto reported = std::chrono::steady_clock::now();
+
+		while (header->generation.load(std::memory_order_acquire) == generation) {
+			const uint64_t written = ring.getWriteSequence();
+			if (header->blockCount < written - next) {
+				// Fell behind more than the ring. Skip to the oldest block not overwritten.
+				overruns += written - header->blockCount - next;
+				next = written - header->blockCount;
+			}
+			for (; next < written; next++) {
+				uint64_t position;
+				const uint8_t* data = ring.beginRead(next, &position);
+				std::vector<float> blockPeaks(numChannels);
+				for (uint32_t channel = 0; data && (channel < numChannels); channel++) {
+					blockPeaks[channel] = getPeak(&data[channel * bufferBytes], header->sampleType, header->blockFrames);
+				}
+				// Result is used only if the block has not been overwritten while reading.
+				if (data && ring.isValid(next)) {
+					for (uint32_t channel = 0; channel < numChannels; channel++) {
+						peaks[channel] = (peaks[channel] < blockPeaks[channel]) ? blockPeaks[channel] : peaks[channel];
+					}
+					blocks++;
+				} else {
+					overruns++;
+				}
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			if (std::chrono::seconds(1) <= now - reported) {
+				printf("%llu blocks, %llu overruns, peak dBFS:", (unsigned long long)blocks, (unsigned long long)overruns);
+				for (uint32_t channel = 0; channel < numChannels; channel++) {
+					printf(" %.1f", 20 * log10f((peaks[channel] > 1e-10f) ? peaks[channel] : 1e-10f));
+					peaks[channel] = 0;
+				}
+				printf("\n");
+				reported = now;
+			}
+			sleepMilliseconds(20);
+		}
+		printf("Format has been changed by the writer.\n");
+	}
+	return 0;
+}
+
+/*
+	Measures throughput of the ring between a writer thread and a reader thread through shared memory of this process.
+
+	The writer publishes blocks at the rate without waiting for the reader, like the engine.
+	If rate is 0, the writer runs as fast as possible.
+	The reader reads each block in place, checks its content and counts overruns.
+*/
+static int throughput(double seconds, double rate)
+{
+	static const char name[] = "DmoEffectorTapThroughput";
+	const uint32_t channels = 16, frames = 256, sampleSize = 4, blockCount = 128;
+	const size_t size = getSharedTapSize(channels, frames, sampleSize, blockCount);
+
+	CSharedMemory writerMemory, readerMemory;
+	CSharedMemory::remove(name);
+	if (!writerMemory.create(name, size) || !readerMemory.create(name, size)) {
+		printf("Failed to create shared memory.\n");
+		return 1;
+	}
+	CSharedTapRing writer(writerMemory.get());
+	writer.format(0xff, 0xff, channels, frames, ASIOSTInt32LSB, sampleSize, 48000, blockCount);
+	const size_t bufferBytes = frames * sampleSize;
+
+	std::atomic<bool> stop(false);
+	std::thread writerThread([&]() {
+		const auto start = std::chrono::steady_clock::now();
+		for (uint64_t n = 0; !stop.load(std::memory_order_relaxed); n++) {
+			while (rate && (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(n / rate))) {
+				std::this_thread::yield();
+			}
+			// Each sample is the sequence number so that the reader can detect torn blocks.
+			int32_t* data = (int32_t*)writer.beginWrite(n);
+			for (size_t i = 0; i < channels * frames; i++) data[i] = (int32_t)n;
+			writer.endWrite(n, n * frames);
+		}
+	});
+
+	CSharedTapRing reader(readerMemory.get());
+	uint64_t next = 0, blocks = 0, overruns = 0, torn = 0;
+	const auto start = std::chrono::steady_clock::now();
+	while (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(seconds)) {
+		const uint64_t written = reader.getWriteSequence();
+		if (blockCount < written - next) {
+			overruns += written - blockCount - next;
+			next = written - blockCount;
+		}
+		for (; next < written; next++) {
+			uint64_t position;
+			const int32_t* data = (const int32_t*)reader.beginRead(next, &position);
+			if (!data) { overruns++; continue; }
+			bool isSame = true;
+			for (size_t i = 0; i < channels * frames; i += frames) isSame &= (data[i] == data[0]) && (data[i + frames - 1] == data[0]);
+			bool isExpected = ((uint64_t)(uint32_t)data[0] == (uint32_t)next);
+			if (!reader.isValid(next)) { overruns++; continue; }
+			// Valid block should never be torn.
+			if (!isSame || !isExpected) torn++;
+			blocks++;
+		}
+	}
+	stop = true;
+	writerThread.join();
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const uint64_t written = writer.getWriteSequence();
+
+	printf("Written %.0f blocks/s (%.0f MB/s), read %.0f blocks/s (%.0f MB/s), overruns %llu, torn %llu\n",
+		written / elapsed, written * channels * bufferBytes / elapsed / 1e6,
+		blocks / elapsed, blocks * channels * bufferBytes / elapsed / 1e6,
+		(unsigned long long)overruns, (unsigned long long)torn);
+
+	writerMemory.close();
+	readerMemory.close();
+	CSharedMemory::remove(name);
+	return torn ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+	if ((1 < argc) && !strcmp(argv[1], "-throughput")) {
+		return throughput((2 < argc) ? atof(argv[2]) : 3.0, (3 < argc) ? atof(argv[3]) : 0);
+	}
+	return read((1 < argc) ? argv[1] : DefaultName);
+}